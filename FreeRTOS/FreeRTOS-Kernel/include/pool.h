@@ -0,0 +1,318 @@
+/*
+ * FreeRTOS Kernel <DEVELOPMENT BRANCH>
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Memory pools hand out blocks of one fixed size from storage set aside when
+ * the pool is created.  Allocating and freeing a block take a block off, or
+ * put it back on, a list of free blocks threaded through the free blocks
+ * themselves, so both take the same short time however many blocks are in
+ * use, and a pool never fragments.  Blocks may be allocated and freed from
+ * tasks and interrupts, by any number of them, and a task may block until a
+ * block is freed.  The counting semaphore behind the blocking is created with
+ * the pool, so configUSE_COUNTING_SEMAPHORES must be set to 1.
+ *
+ * A block is typically filled by the task or interrupt that allocates it and
+ * freed by the one it is handed to, so only a pointer has to be passed on.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#ifndef INC_FREERTOS_H
+    #error "include FreeRTOS.h must appear in source files before include pool.h"
+#endif
+
+/* *INDENT-OFF* */
+#if defined( __cplusplus )
+    extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * Type by which memory pools are referenced.  For example, a call to
+ * xPoolCreate() returns a PoolHandle_t variable that can then be used as a
+ * parameter to pvPoolAlloc(), vPoolFree(), etc.
+ */
+struct PoolDef_t;
+typedef struct PoolDef_t * PoolHandle_t;
+
+/**
+ * Used to pass information about a memory pool out of vPoolGetStats().
+ */
+typedef struct xPoolStats
+{
+    size_t xBlockSize;               /* The size of each block in bytes, the size the pool was created with rounded up to portBYTE_ALIGNMENT. */
+    UBaseType_t uxBlockCount;        /* The number of blocks in the pool. */
+    UBaseType_t uxBlocksInUse;       /* The number of blocks allocated at the time vPoolGetStats() is called. */
+    UBaseType_t uxMaxBlocksInUse;    /* The most blocks that have been allocated at once since the pool was created. */
+    UBaseType_t uxFailedAllocations; /* The number of calls to pvPoolAlloc() and pvPoolAllocFromISR() that have returned NULL. */
+} PoolStats_t;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * PoolHandle_t xPoolCreate( size_t xBlockSize, UBaseType_t uxBlockCount );
+ * @endcode
+ *
+ * Creates a memory pool of uxBlockCount blocks of xBlockSize bytes each,
+ * using dynamically allocated memory.  The blocks are allocated with the
+ * control structure, in one allocation from the FreeRTOS heap.
+ *
+ * configSUPPORT_DYNAMIC_ALLOCATION must be set to 1 or left undefined in
+ * FreeRTOSConfig.h for xPoolCreate() to be available.
+ *
+ * @param xBlockSize The size of each block in bytes.  It is rounded up to a
+ * multiple of portBYTE_ALIGNMENT, and every block is aligned to it.
+ *
+ * @param uxBlockCount The number of blocks in the pool.
+ *
+ * @return If NULL is returned, then the pool cannot be created because there
+ * is insufficient heap memory available for FreeRTOS to allocate it.  A
+ * non-NULL value being returned indicates that the pool has been created
+ * successfully - the returned value should be stored as the handle to the
+ * created pool.
+ *
+ * Example use:
+ * @code{c}
+ *
+ * void vAFunction( void )
+ * {
+ * PoolHandle_t xPool;
+ *
+ *  // Create a pool of eight 64 byte blocks.
+ *  xPool = xPoolCreate( 64, 8 );
+ *
+ *  if( xPool == NULL )
+ *  {
+ *      // There was not enough heap memory space available to create the
+ *      // pool.
+ *  }
+ *  else
+ *  {
+ *      // The pool was created successfully and can now be used.
+ *  }
+ * }
+ * @endcode
+ * \defgroup xPoolCreate xPoolCreate
+ * \ingroup PoolManagement
+ */
+PoolHandle_t xPoolCreate( size_t xBlockSize,
+                          UBaseType_t uxBlockCount ) PRIVILEGED_FUNCTION;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * void vPoolDelete( PoolHandle_t xPool );
+ * @endcode
+ *
+ * Deletes a memory pool that was previously created using a call to
+ * xPoolCreate().  The blocks are deleted with it, so none may be in use, and
+ * no task may be blocked waiting for one.
+ *
+ * @param xPool The handle of the pool to be deleted.
+ *
+ * \defgroup vPoolDelete vPoolDelete
+ * \ingroup PoolManagement
+ */
+void vPoolDelete( PoolHandle_t xPool ) PRIVILEGED_FUNCTION;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * void * pvPoolAlloc( PoolHandle_t xPool, TickType_t xTicksToWait );
+ * @endcode
+ *
+ * Allocates a block from a memory pool.  If every block is in use the calling
+ * task is held in the Blocked state, for at most xTicksToWait ticks, until a
+ * block is freed.  Tasks waiting for a block are given one in priority order.
+ *
+ * Use pvPoolAllocFromISR() to allocate a block from an interrupt service
+ * routine.
+ *
+ * @param xPool The handle of the pool to allocate from.
+ *
+ * @param xTicksToWait The maximum amount of time the task should remain in the
+ * Blocked state to wait for a block.  The macro pdMS_TO_TICKS() can be used to
+ * convert a time specified in milliseconds into a time specified in ticks.
+ * Setting xTicksToWait to portMAX_DELAY will cause the task to wait
+ * indefinitely (without timing out), provided INCLUDE_vTaskSuspend is set to 1
+ * in FreeRTOSConfig.h.  Setting xTicksToWait to 0 returns at once.
+ *
+ * @return The block, or NULL if no block was freed before the block time
+ * expired.
+ *
+ * Example use:
+ * @code{c}
+ * // A pool of the records handed from vAProducerTask() to a consumer.
+ * PoolHandle_t xRecordPool;
+ *
+ * void vAProducerTask( void * pvParameters )
+ * {
+ * Record_t * pxRecord;
+ *
+ *  for( ;; )
+ *  {
+ *      // Wait up to 100ms for a record to fill.
+ *      pxRecord = pvPoolAlloc( xRecordPool, pdMS_TO_TICKS( 100 ) );
+ *
+ *      if( pxRecord != NULL )
+ *      {
+ *          // Fill the record in place, then pass the pointer on.  The
+ *          // consumer frees the block with vPoolFree() once it is done.
+ *          vFillRecord( pxRecord );
+ *          xQueueSend( xRecordQueue, &pxRecord, portMAX_DELAY );
+ *      }
+ *  }
+ * }
+ * @endcode
+ * \defgroup pvPoolAlloc pvPoolAlloc
+ * \ingroup PoolManagement
+ */
+void * pvPoolAlloc( PoolHandle_t xPool,
+                    TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * void * pvPoolAllocFromISR( PoolHandle_t xPool );
+ * @endcode
+ *
+ * Interrupt safe version of pvPoolAlloc(), which never blocks.  Allocating a
+ * block cannot unblock a task, so there is no pxHigherPriorityTaskWoken
+ * parameter.
+ *
+ * @param xPool The handle of the pool to allocate from.
+ *
+ * @return The block, or NULL if every block is in use.
+ *
+ * \defgroup pvPoolAllocFromISR pvPoolAllocFromISR
+ * \ingroup PoolManagement
+ */
+void * pvPoolAllocFromISR( PoolHandle_t xPool ) PRIVILEGED_FUNCTION;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * void vPoolFree( PoolHandle_t xPool, void * pvBlock );
+ * @endcode
+ *
+ * Returns a block to the memory pool it was allocated from, and unblocks the
+ * highest priority task waiting for a block, if any.  Any task may free a
+ * block, not only the one that allocated it.
+ *
+ * Use vPoolFreeFromISR() to free a block from an interrupt service routine.
+ *
+ * @param xPool The handle of the pool the block was allocated from.
+ *
+ * @param pvBlock The block, as returned by pvPoolAlloc() or
+ * pvPoolAllocFromISR().
+ *
+ * \defgroup vPoolFree vPoolFree
+ * \ingroup PoolManagement
+ */
+void vPoolFree( PoolHandle_t xPool,
+                void * pvBlock ) PRIVILEGED_FUNCTION;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * void vPoolFreeFromISR( PoolHandle_t xPool,
+ *                        void * pvBlock,
+ *                        BaseType_t * const pxHigherPriorityTaskWoken );
+ * @endcode
+ *
+ * Interrupt safe version of vPoolFree().
+ *
+ * @param xPool The handle of the pool the block was allocated from.
+ *
+ * @param pvBlock The block, as returned by pvPoolAlloc() or
+ * pvPoolAllocFromISR().
+ *
+ * @param pxHigherPriorityTaskWoken Set to pdTRUE if freeing the block
+ * unblocked a task with a priority higher than the running task, in which
+ * case a context switch should be requested before the interrupt is exited.
+ *
+ * \defgroup vPoolFreeFromISR vPoolFreeFromISR
+ * \ingroup PoolManagement
+ */
+void vPoolFreeFromISR( PoolHandle_t xPool,
+                       void * pvBlock,
+                       BaseType_t * const pxHigherPriorityTaskWoken ) PRIVILEGED_FUNCTION;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * UBaseType_t uxPoolGetBlocksFree( PoolHandle_t xPool );
+ * @endcode
+ *
+ * Queries a memory pool to see how many of its blocks are free.
+ *
+ * @param xPool The handle of the pool being queried.
+ *
+ * @return The number of blocks that may be allocated without blocking.
+ *
+ * \defgroup uxPoolGetBlocksFree uxPoolGetBlocksFree
+ * \ingroup PoolManagement
+ */
+UBaseType_t uxPoolGetBlocksFree( PoolHandle_t xPool ) PRIVILEGED_FUNCTION;
+
+/**
+ * pool.h
+ *
+ * @code{c}
+ * void vPoolGetStats( PoolHandle_t xPool, PoolStats_t * pxPoolStats );
+ * @endcode
+ *
+ * Fills a PoolStats_t structure with the size of a memory pool, the blocks in
+ * use now and at most since it was created, which is its high water mark, and
+ * the allocations that have failed.
+ *
+ * @param xPool The handle of the pool being queried.
+ *
+ * @param pxPoolStats Set to the statistics of the pool.
+ *
+ * \defgroup vPoolGetStats vPoolGetStats
+ * \ingroup PoolManagement
+ */
+void vPoolGetStats( PoolHandle_t xPool,
+                    PoolStats_t * pxPoolStats ) PRIVILEGED_FUNCTION;
+
+/* *INDENT-OFF* */
+#if defined( __cplusplus )
+    }
+#endif
+/* *INDENT-ON* */
+
+#endif /* !defined( POOL_H ) */
@@ -150,6 +150,17 @@ typedef struct xHeapStats
     size_t xNumberOfSuccessfulFrees;        /* The number of calls to vPortFree() that has successfully freed a block of memory. */
 } HeapStats_t;
 
+/* Used by heap_6.c to pass information about each first level size class out
+ * of uxPortGetHeapClassStats(). */
+typedef struct xHeapClassStats
+{
+    size_t xMinimumBlockSize;              /* The size, in bytes and including the block header, of the smallest block of the class.  The class ends where the next one starts. */
+    size_t xFreeBlocks;                    /* The number of free blocks of the class at the time uxPortGetHeapClassStats() is called. */
+    size_t xAllocatedBlocks;               /* The number of allocated blocks of the class at the time uxPortGetHeapClassStats() is called. */
+    size_t xNumberOfSuccessfulAllocations; /* The number of calls to pvPortMalloc() that have returned a block of the class. */
+    size_t xNumberOfFailedAllocations;     /* The number of calls to pvPortMalloc() for a block of the class that have returned NULL. */
+} HeapClassStats_t;
+
 /*
  * Used to define multiple heap regions for use by heap_5.c.  This function
  * must be called before any calls to pvPortMalloc() - not creating a task,
@@ -169,6 +180,14 @@ void vPortDefineHeapRegions( const HeapRegion_t * const pxHeapRegions ) PRIVILEG
  */
 void vPortGetHeapStats( HeapStats_t * pxHeapStats );
 
+/*
+ * Fills pxClassStats with the statistics of up to uxMaxClasses first level
+ * size classes, smallest first, and returns the number filled.  Only provided
+ * by heap_6.c.
+ */
+UBaseType_t uxPortGetHeapClassStats( HeapClassStats_t * pxClassStats,
+                                     UBaseType_t uxMaxClasses );
+
 /*
  * Map to the memory management routines required for the port.
  */
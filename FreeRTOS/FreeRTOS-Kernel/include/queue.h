@@ -885,6 +885,49 @@ BaseType_t xQueueReceive( QueueHandle_t xQueue,
                           void * const pvBuffer,
                           TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
 
+/**
+ * queue. h
+ * @code{c}
+ * UBaseType_t xQueueReceiveMultiple(
+ *                                    QueueHandle_t xQueue,
+ *                                    void *pvBuffer,
+ *                                    UBaseType_t uxItems,
+ *                                    TickType_t xTicksToWait
+ *                                  );
+ * @endcode
+ *
+ * Receive up to uxItems items from a queue in one call.  The items are copied
+ * into consecutive slots of pvBuffer in the order they were queued, inside a
+ * single critical section, so a batch costs about as much as one
+ * xQueueReceive().  Each item removed can unblock one task waiting to send.
+ *
+ * The call only blocks while the queue is empty.  Once any item is available
+ * it returns with the items that were there, without waiting for uxItems.
+ *
+ * Not for semaphores, mutexes or members of a queue set.  This function must
+ * not be used in an interrupt service routine.
+ *
+ * @param xQueue The handle to the queue from which the items are to be
+ * received.
+ *
+ * @param pvBuffer Pointer to a buffer of at least uxItems items into which the
+ * received items will be copied.
+ *
+ * @param uxItems The most items to receive, at least 1.
+ *
+ * @param xTicksToWait The maximum amount of time the task should block
+ * waiting for an item should the queue be empty at the time of the call.
+ *
+ * @return The number of items received, 0 if the queue stayed empty.
+ *
+ * \defgroup xQueueReceiveMultiple xQueueReceiveMultiple
+ * \ingroup QueueManagement
+ */
+UBaseType_t xQueueReceiveMultiple( QueueHandle_t xQueue,
+                                   void * const pvBuffer,
+                                   const UBaseType_t uxItems,
+                                   TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
+
 /**
  * queue. h
  * @code{c}
@@ -1327,6 +1370,69 @@ BaseType_t xQueueGenericSendFromISR( QueueHandle_t xQueue,
 BaseType_t xQueueGiveFromISR( QueueHandle_t xQueue,
                               BaseType_t * const pxHigherPriorityTaskWoken ) PRIVILEGED_FUNCTION;
 
+/**
+ * queue. h
+ * @code{c}
+ * UBaseType_t xQueueSendMultipleFromISR(
+ *                                        QueueHandle_t xQueue,
+ *                                        const void *pvItemsToQueue,
+ *                                        UBaseType_t uxItems,
+ *                                        BaseType_t *pxHigherPriorityTaskWoken
+ *                                      );
+ * @endcode
+ *
+ * Post up to uxItems items to the back of a queue from an interrupt service
+ * routine.  As many of the items as there is space for are copied, in order,
+ * inside a single critical section, wrapping around the end of the queue's
+ * storage as needed.  Each item posted can unblock one task waiting to
+ * receive, so a single waiting task is woken once for the whole batch.
+ *
+ * Not for semaphores, mutexes or members of a queue set.
+ *
+ * @param xQueue The handle to the queue on which the items are to be posted.
+ *
+ * @param pvItemsToQueue A pointer to uxItems consecutive items.
+ *
+ * @param uxItems The number of items to post, at least 1.
+ *
+ * @param pxHigherPriorityTaskWoken Set to pdTRUE if posting unblocked a task
+ * with a priority higher than the running task, in which case a context
+ * switch should be requested before the interrupt is exited.
+ *
+ * @return The number of items posted, 0 if the queue was full.
+ *
+ * Example usage for buffered IO (where the ISR can obtain more than one value
+ * per call):
+ * @code{c}
+ * void vBufferISR( void )
+ * {
+ * char cIn[ 8 ];
+ * UBaseType_t uxCount = 0;
+ * BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+ *
+ *  // Drain the peripheral's FIFO, then post the bytes in one call.
+ *  while( INPUT_BYTES_WAITING && ( uxCount < sizeof( cIn ) ) )
+ *  {
+ *      cIn[ uxCount++ ] = portINPUT_BYTE( RX_REGISTER_ADDRESS );
+ *  }
+ *
+ *  if( uxCount > 0 )
+ *  {
+ *      xQueueSendMultipleFromISR( xRxQueue, cIn, uxCount, &xHigherPriorityTaskWoken );
+ *  }
+ *
+ *  portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+ * }
+ * @endcode
+ *
+ * \defgroup xQueueSendMultipleFromISR xQueueSendMultipleFromISR
+ * \ingroup QueueManagement
+ */
+UBaseType_t xQueueSendMultipleFromISR( QueueHandle_t xQueue,
+                                       const void * const pvItemsToQueue,
+                                       const UBaseType_t uxItems,
+                                       BaseType_t * const pxHigherPriorityTaskWoken ) PRIVILEGED_FUNCTION;
+
 /**
  * queue. h
  * @code{c}
@@ -71,6 +71,18 @@
 struct StreamBufferDef_t;
 typedef struct StreamBufferDef_t * StreamBufferHandle_t;
 
+/**
+ * Up to two contiguous spans of a stream buffer's storage area, filled in by
+ * xStreamBufferReserve() and xStreamBufferPeek().  The second span is only
+ * used when the bytes wrap around the end of the storage area, and then
+ * starts at its beginning.  An unused span has a NULL pointer and length 0.
+ */
+typedef struct StreamBufferSpans
+{
+    uint8_t * pucData[ 2 ];
+    size_t xLength[ 2 ];
+} StreamBufferSpans_t;
+
 
 /**
  * stream_buffer.h
@@ -419,6 +431,90 @@ size_t xStreamBufferSendFromISR( StreamBufferHandle_t xStreamBuffer,
                                  size_t xDataLengthBytes,
                                  BaseType_t * const pxHigherPriorityTaskWoken ) PRIVILEGED_FUNCTION;
 
+/**
+ * stream_buffer.h
+ *
+ * @code{c}
+ * size_t xStreamBufferReserve( StreamBufferHandle_t xStreamBuffer,
+ *                              StreamBufferSpans_t * const pxSpans );
+ * @endcode
+ *
+ * Lends the writer the free space of a stream buffer, so bytes can be written
+ * in place instead of being copied in by xStreamBufferSend().  pxSpans is set
+ * to the free space, in order, as up to two contiguous spans.  Nothing is
+ * visible to the reader until xStreamBufferCommit() or
+ * xStreamBufferCommitFromISR() publishes the first bytes of the spans.  Only
+ * the writer may call it, from a task or an interrupt, and it never blocks.
+ *
+ * Not for message buffers.
+ *
+ * @param xStreamBuffer The handle of the stream buffer to write to.
+ *
+ * @param pxSpans Set to the free space of the stream buffer.
+ *
+ * @return The number of free bytes, the sum of the span lengths.
+ *
+ * \defgroup xStreamBufferReserve xStreamBufferReserve
+ * \ingroup StreamBufferManagement
+ */
+size_t xStreamBufferReserve( StreamBufferHandle_t xStreamBuffer,
+                             StreamBufferSpans_t * const pxSpans ) PRIVILEGED_FUNCTION;
+
+/**
+ * stream_buffer.h
+ *
+ * @code{c}
+ * size_t xStreamBufferCommit( StreamBufferHandle_t xStreamBuffer,
+ *                             size_t xDataLengthBytes );
+ * @endcode
+ *
+ * Publishes the first xDataLengthBytes bytes of the spans last returned by
+ * xStreamBufferReserve() to the reader, and unblocks a reader waiting for
+ * them once the trigger level is reached, as xStreamBufferSend() would.
+ * Use xStreamBufferCommitFromISR() from an interrupt service routine.
+ *
+ * @param xStreamBuffer The handle of the stream buffer written to.
+ *
+ * @param xDataLengthBytes The number of bytes written in place, at most the
+ * free space returned by xStreamBufferReserve().
+ *
+ * @return xDataLengthBytes.
+ *
+ * \defgroup xStreamBufferCommit xStreamBufferCommit
+ * \ingroup StreamBufferManagement
+ */
+size_t xStreamBufferCommit( StreamBufferHandle_t xStreamBuffer,
+                            size_t xDataLengthBytes ) PRIVILEGED_FUNCTION;
+
+/**
+ * stream_buffer.h
+ *
+ * @code{c}
+ * size_t xStreamBufferCommitFromISR( StreamBufferHandle_t xStreamBuffer,
+ *                                    size_t xDataLengthBytes,
+ *                                    BaseType_t * const pxHigherPriorityTaskWoken );
+ * @endcode
+ *
+ * Interrupt safe version of xStreamBufferCommit().
+ *
+ * @param xStreamBuffer The handle of the stream buffer written to.
+ *
+ * @param xDataLengthBytes The number of bytes written in place, at most the
+ * free space returned by xStreamBufferReserve().
+ *
+ * @param pxHigherPriorityTaskWoken Set to pdTRUE if publishing the bytes
+ * unblocked a task with a priority higher than the running task, in which
+ * case a context switch should be requested before the interrupt is exited.
+ *
+ * @return xDataLengthBytes.
+ *
+ * \defgroup xStreamBufferCommitFromISR xStreamBufferCommitFromISR
+ * \ingroup StreamBufferManagement
+ */
+size_t xStreamBufferCommitFromISR( StreamBufferHandle_t xStreamBuffer,
+                                   size_t xDataLengthBytes,
+                                   BaseType_t * const pxHigherPriorityTaskWoken ) PRIVILEGED_FUNCTION;
+
 /**
  * stream_buffer.h
  *
@@ -508,6 +604,67 @@ size_t xStreamBufferReceive( StreamBufferHandle_t xStreamBuffer,
                              size_t xBufferLengthBytes,
                              TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
 
+/**
+ * stream_buffer.h
+ *
+ * @code{c}
+ * size_t xStreamBufferPeek( StreamBufferHandle_t xStreamBuffer,
+ *                           StreamBufferSpans_t * const pxSpans,
+ *                           TickType_t xTicksToWait );
+ * @endcode
+ *
+ * Lends the reader the bytes held by a stream buffer, so they can be read in
+ * place instead of being copied out by xStreamBufferReceive().  pxSpans is set
+ * to the bytes, oldest first, as up to two contiguous spans.  The bytes stay
+ * in the stream buffer until xStreamBufferConsume() removes them.  Only the
+ * reader may call it, from a task.
+ *
+ * Not for message buffers.
+ *
+ * @param xStreamBuffer The handle of the stream buffer to read from.
+ *
+ * @param pxSpans Set to the bytes held by the stream buffer.
+ *
+ * @param xTicksToWait The maximum amount of time the task should remain in the
+ * Blocked state to wait for data should the stream buffer be empty, as for
+ * xStreamBufferReceive().
+ *
+ * @return The number of bytes held, the sum of the span lengths, 0 if the
+ * stream buffer stayed empty.
+ *
+ * \defgroup xStreamBufferPeek xStreamBufferPeek
+ * \ingroup StreamBufferManagement
+ */
+size_t xStreamBufferPeek( StreamBufferHandle_t xStreamBuffer,
+                          StreamBufferSpans_t * const pxSpans,
+                          TickType_t xTicksToWait ) PRIVILEGED_FUNCTION;
+
+/**
+ * stream_buffer.h
+ *
+ * @code{c}
+ * size_t xStreamBufferConsume( StreamBufferHandle_t xStreamBuffer,
+ *                              size_t xDataLengthBytes );
+ * @endcode
+ *
+ * Removes the first xDataLengthBytes bytes of the spans last returned by
+ * xStreamBufferPeek() from the stream buffer, and unblocks a writer waiting
+ * for space, as xStreamBufferReceive() would.  The rest stay in place for the
+ * next xStreamBufferPeek().
+ *
+ * @param xStreamBuffer The handle of the stream buffer read from.
+ *
+ * @param xDataLengthBytes The number of bytes to remove, at most the number
+ * returned by xStreamBufferPeek().
+ *
+ * @return xDataLengthBytes.
+ *
+ * \defgroup xStreamBufferConsume xStreamBufferConsume
+ * \ingroup StreamBufferManagement
+ */
+size_t xStreamBufferConsume( StreamBufferHandle_t xStreamBuffer,
+                             size_t xDataLengthBytes ) PRIVILEGED_FUNCTION;
+
 /**
  * stream_buffer.h
  *
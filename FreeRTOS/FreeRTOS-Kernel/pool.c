@@ -0,0 +1,367 @@
+/*
+ * FreeRTOS Kernel <DEVELOPMENT BRANCH>
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Standard includes. */
+#include <stdint.h>
+#include <string.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+ * all the API functions to use the MPU wrappers.  That should only be done when
+ * task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "pool.h"
+
+#if ( configSUPPORT_DYNAMIC_ALLOCATION != 1 )
+    #error configSUPPORT_DYNAMIC_ALLOCATION must be set to 1 to build pool.c
+#endif
+
+#if ( configUSE_COUNTING_SEMAPHORES != 1 )
+    #error configUSE_COUNTING_SEMAPHORES must be set to 1 to build pool.c
+#endif
+
+/* Lint e961, e9021 and e750 are suppressed as a MISRA exception justified
+ * because the MPU ports require MPU_WRAPPERS_INCLUDED_FROM_API_FILE to be defined
+ * for the header files above, but not in this file, in order to generate the
+ * correct privileged Vs unprivileged linkage and placement. */
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE /*lint !e961 !e750 !e9021. */
+
+/* Round a size up to a multiple of portBYTE_ALIGNMENT. */
+#define poolALIGN_UP( xSize )    ( ( ( xSize ) + ( size_t ) portBYTE_ALIGNMENT_MASK ) & ~( ( size_t ) portBYTE_ALIGNMENT_MASK ) )
+
+/*-----------------------------------------------------------*/
+
+/* Overlaid on the start of every free block to chain it to the next. */
+typedef struct PoolFreeBlock
+{
+    struct PoolFreeBlock * pxNextFreeBlock;
+} PoolFreeBlock_t;
+
+/* Structure that holds state information on the pool. */
+typedef struct PoolDef_t
+{
+    uint8_t * pucStorage;             /* The first block; the blocks follow each other. */
+    size_t xBlockSize;                /* The size of each block, a multiple of portBYTE_ALIGNMENT. */
+    UBaseType_t uxBlockCount;         /* The number of blocks. */
+    PoolFreeBlock_t * pxFreeList;     /* The free blocks, the one freed last first. */
+    SemaphoreHandle_t xFreeBlocks;    /* Counts the blocks that may be taken off pxFreeList, and holds the tasks waiting for one. */
+    UBaseType_t uxBlocksInUse;        /* The blocks taken off pxFreeList. */
+    UBaseType_t uxMaxBlocksInUse;     /* The most blocks there have been in use at once. */
+    UBaseType_t uxFailedAllocations;  /* The allocations that returned NULL. */
+} Pool_t;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Take the first block off the free list.  Called in a critical section, once
+ * the block has been counted out of xFreeBlocks, so the list is never empty.
+ */
+static void * prvTakeBlock( Pool_t * const pxPool ) PRIVILEGED_FUNCTION;
+
+/*
+ * Put a block back on the free list.  Called in a critical section, before the
+ * block is counted back into xFreeBlocks.
+ */
+static void prvReturnBlock( Pool_t * const pxPool,
+                            void * pvBlock ) PRIVILEGED_FUNCTION;
+
+/*-----------------------------------------------------------*/
+
+PoolHandle_t xPoolCreate( size_t xBlockSize,
+                          UBaseType_t uxBlockCount )
+{
+    Pool_t * pxPool = NULL;
+    uint8_t * pucBlock;
+    size_t xStorageSize;
+    UBaseType_t x;
+
+    configASSERT( xBlockSize > ( size_t ) 0 );
+    configASSERT( uxBlockCount > ( UBaseType_t ) 0 );
+
+    /* A free block holds the link to the next one, and every block starts on
+     * an aligned address. */
+    if( xBlockSize < sizeof( PoolFreeBlock_t ) )
+    {
+        xBlockSize = sizeof( PoolFreeBlock_t );
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    if( xBlockSize <= ( ( size_t ) ~( size_t ) 0 ) - ( size_t ) portBYTE_ALIGNMENT_MASK )
+    {
+        xBlockSize = poolALIGN_UP( xBlockSize );
+
+        /* A pool requires a Pool_t structure and the blocks.  Both are
+         * allocated in a single call to pvPortMalloc(), the blocks following
+         * the structure, which is padded so the first block is aligned.
+         * Check the total does not overflow. */
+        if( ( xBlockSize != ( size_t ) 0 ) &&
+            ( ( size_t ) uxBlockCount <= ( ( ( size_t ) ~( size_t ) 0 ) - poolALIGN_UP( sizeof( Pool_t ) ) ) / xBlockSize ) )
+        {
+            xStorageSize = xBlockSize * ( size_t ) uxBlockCount;
+            pxPool = ( Pool_t * ) pvPortMalloc( poolALIGN_UP( sizeof( Pool_t ) ) + xStorageSize ); /*lint !e9079 malloc() only returns void*. */
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    if( pxPool != NULL )
+    {
+        pxPool->xFreeBlocks = xSemaphoreCreateCounting( uxBlockCount, uxBlockCount );
+
+        if( pxPool->xFreeBlocks != NULL )
+        {
+            pxPool->pucStorage = ( ( uint8_t * ) pxPool ) + poolALIGN_UP( sizeof( Pool_t ) );
+            pxPool->xBlockSize = xBlockSize;
+            pxPool->uxBlockCount = uxBlockCount;
+            pxPool->uxBlocksInUse = 0;
+            pxPool->uxMaxBlocksInUse = 0;
+            pxPool->uxFailedAllocations = 0;
+
+            /* Chain the blocks in address order, so they are handed out from
+             * the first. */
+            pxPool->pxFreeList = NULL;
+            pucBlock = pxPool->pucStorage + xStorageSize;
+
+            for( x = 0; x < uxBlockCount; x++ )
+            {
+                pucBlock -= xBlockSize;
+                ( ( PoolFreeBlock_t * ) pucBlock )->pxNextFreeBlock = pxPool->pxFreeList; /*lint !e9087 !e826 The block is aligned and at least as large as PoolFreeBlock_t. */
+                pxPool->pxFreeList = ( PoolFreeBlock_t * ) pucBlock;                      /*lint !e9087 !e826 The block is aligned and at least as large as PoolFreeBlock_t. */
+            }
+        }
+        else
+        {
+            vPortFree( pxPool );
+            pxPool = NULL;
+        }
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    return pxPool;
+}
+/*-----------------------------------------------------------*/
+
+void vPoolDelete( PoolHandle_t xPool )
+{
+    Pool_t * pxPool = xPool;
+
+    configASSERT( pxPool );
+    configASSERT( pxPool->uxBlocksInUse == ( UBaseType_t ) 0 );
+
+    vSemaphoreDelete( pxPool->xFreeBlocks );
+
+    /* Both the structure and the blocks were allocated using a single call to
+     * pvPortMalloc(), hence only one call to vPortFree() is required. */
+    vPortFree( ( void * ) pxPool );
+}
+/*-----------------------------------------------------------*/
+
+void * pvPoolAlloc( PoolHandle_t xPool,
+                    TickType_t xTicksToWait )
+{
+    Pool_t * const pxPool = xPool;
+    void * pvReturn = NULL;
+
+    configASSERT( pxPool );
+
+    /* The semaphore counts the free blocks and blocks the task until one is
+     * freed.  Once a count is taken a block is certain to be on the list. */
+    if( xSemaphoreTake( pxPool->xFreeBlocks, xTicksToWait ) == pdTRUE )
+    {
+        taskENTER_CRITICAL();
+        {
+            pvReturn = prvTakeBlock( pxPool );
+        }
+        taskEXIT_CRITICAL();
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+        {
+            pxPool->uxFailedAllocations++;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void * pvPoolAllocFromISR( PoolHandle_t xPool )
+{
+    Pool_t * const pxPool = xPool;
+    void * pvReturn = NULL;
+    UBaseType_t uxSavedInterruptStatus;
+
+    configASSERT( pxPool );
+
+    /* Taking a count never unblocks a task, nothing waits to give one. */
+    if( xSemaphoreTakeFromISR( pxPool->xFreeBlocks, NULL ) == pdTRUE )
+    {
+        uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+        {
+            pvReturn = prvTakeBlock( pxPool );
+        }
+        taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+    }
+    else
+    {
+        uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+        {
+            pxPool->uxFailedAllocations++;
+        }
+        taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+    }
+
+    return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPoolFree( PoolHandle_t xPool,
+                void * pvBlock )
+{
+    Pool_t * const pxPool = xPool;
+
+    configASSERT( pxPool );
+
+    taskENTER_CRITICAL();
+    {
+        prvReturnBlock( pxPool, pvBlock );
+    }
+    taskEXIT_CRITICAL();
+
+    /* Counting the block back in gives it to the highest priority task
+     * waiting for one, if there is one. */
+    ( void ) xSemaphoreGive( pxPool->xFreeBlocks );
+}
+/*-----------------------------------------------------------*/
+
+void vPoolFreeFromISR( PoolHandle_t xPool,
+                       void * pvBlock,
+                       BaseType_t * const pxHigherPriorityTaskWoken )
+{
+    Pool_t * const pxPool = xPool;
+    UBaseType_t uxSavedInterruptStatus;
+
+    configASSERT( pxPool );
+
+    uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+    {
+        prvReturnBlock( pxPool, pvBlock );
+    }
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+
+    ( void ) xSemaphoreGiveFromISR( pxPool->xFreeBlocks, pxHigherPriorityTaskWoken );
+}
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxPoolGetBlocksFree( PoolHandle_t xPool )
+{
+    Pool_t * const pxPool = xPool;
+
+    configASSERT( pxPool );
+
+    return uxSemaphoreGetCount( pxPool->xFreeBlocks );
+}
+/*-----------------------------------------------------------*/
+
+void vPoolGetStats( PoolHandle_t xPool,
+                    PoolStats_t * pxPoolStats )
+{
+    Pool_t * const pxPool = xPool;
+
+    configASSERT( pxPool );
+    configASSERT( pxPoolStats );
+
+    taskENTER_CRITICAL();
+    {
+        pxPoolStats->xBlockSize = pxPool->xBlockSize;
+        pxPoolStats->uxBlockCount = pxPool->uxBlockCount;
+        pxPoolStats->uxBlocksInUse = pxPool->uxBlocksInUse;
+        pxPoolStats->uxMaxBlocksInUse = pxPool->uxMaxBlocksInUse;
+        pxPoolStats->uxFailedAllocations = pxPool->uxFailedAllocations;
+    }
+    taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
+static void * prvTakeBlock( Pool_t * const pxPool )
+{
+    PoolFreeBlock_t * pxBlock = pxPool->pxFreeList;
+
+    configASSERT( pxBlock );
+
+    pxPool->pxFreeList = pxBlock->pxNextFreeBlock;
+    pxPool->uxBlocksInUse++;
+
+    if( pxPool->uxBlocksInUse > pxPool->uxMaxBlocksInUse )
+    {
+        pxPool->uxMaxBlocksInUse = pxPool->uxBlocksInUse;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    return ( void * ) pxBlock;
+}
+/*-----------------------------------------------------------*/
+
+static void prvReturnBlock( Pool_t * const pxPool,
+                            void * pvBlock )
+{
+    PoolFreeBlock_t * pxBlock = ( PoolFreeBlock_t * ) pvBlock;
+
+    /* The block must be one of this pool's, and in use. */
+    configASSERT( ( ( uint8_t * ) pvBlock >= pxPool->pucStorage ) &&
+                  ( ( uint8_t * ) pvBlock < pxPool->pucStorage + ( pxPool->xBlockSize * ( size_t ) pxPool->uxBlockCount ) ) );
+    configASSERT( ( ( size_t ) ( ( uint8_t * ) pvBlock - pxPool->pucStorage ) % pxPool->xBlockSize ) == ( size_t ) 0 );
+    configASSERT( pxPool->uxBlocksInUse > ( UBaseType_t ) 0 );
+
+    pxBlock->pxNextFreeBlock = pxPool->pxFreeList;
+    pxPool->pxFreeList = pxBlock;
+    pxPool->uxBlocksInUse--;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,735 @@
+/*
+ * FreeRTOS Kernel <DEVELOPMENT BRANCH>
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * A sample implementation of pvPortMalloc() and vPortFree() that takes the
+ * same, bounded time for every call, whatever the state of the heap, using a
+ * two level segregated fit (TLSF) allocator.
+ *
+ * Free blocks are kept in one list per size class.  The first level splits the
+ * sizes into powers of two, the second level splits each power of two into
+ * heapSL_INDEX_COUNT equal ranges, and a bitmap per level records which lists
+ * are not empty.  An allocation takes the first block of the class of the
+ * wanted size if that block is large enough.  Otherwise it rounds the size up
+ * to the next class boundary, so that every block of the class found fits, and
+ * finds the first non empty class from there with two bit scans instead of a
+ * walk.  A freed block only goes to the head of its list if it is lower in
+ * memory than the block there, which packs allocations towards the start of
+ * the heap.  Every block
+ * records the block before it in memory, so a block being freed is merged with
+ * free neighbours on both sides without a walk either.  Blocks are therefore
+ * always combined as they are freed, as heap_4.c does, but a block is taken
+ * from the smallest class that is sure to fit rather than being the first fit
+ * by address, which keeps the large blocks for large requests.
+ *
+ * The statistics of each first level class can be read with
+ * uxPortGetHeapClassStats().
+ *
+ * See heap_1.c, heap_2.c, heap_3.c, heap_4.c and heap_5.c for alternative
+ * implementations, and the memory management pages of https://www.FreeRTOS.org
+ * for more information.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+ * all the API functions to use the MPU wrappers.  That should only be done when
+ * task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#if ( configSUPPORT_DYNAMIC_ALLOCATION == 0 )
+    #error This file must not be used if configSUPPORT_DYNAMIC_ALLOCATION is 0
+#endif
+
+#if ( portBYTE_ALIGNMENT == 4 )
+    #define heapALIGNMENT_LOG2    ( 2U )
+#elif ( portBYTE_ALIGNMENT == 8 )
+    #define heapALIGNMENT_LOG2    ( 3U )
+#elif ( portBYTE_ALIGNMENT == 16 )
+    #define heapALIGNMENT_LOG2    ( 4U )
+#elif ( portBYTE_ALIGNMENT == 32 )
+    #define heapALIGNMENT_LOG2    ( 5U )
+#else
+    #error heap_6.c does not support this portBYTE_ALIGNMENT
+#endif
+
+/* Each power of two is split into 2 ^ heapSL_INDEX_COUNT_LOG2 classes. */
+#define heapSL_INDEX_COUNT_LOG2    ( 4U )
+#define heapSL_INDEX_COUNT         ( 1U << heapSL_INDEX_COUNT_LOG2 )
+
+/* Blocks smaller than heapSMALL_BLOCK_SIZE share the first class of the first
+ * level, split into classes one alignment unit apart. */
+#define heapFL_INDEX_SHIFT         ( heapSL_INDEX_COUNT_LOG2 + heapALIGNMENT_LOG2 )
+#define heapSMALL_BLOCK_SIZE       ( ( size_t ) 1 << heapFL_INDEX_SHIFT )
+
+/* Blocks of up to 2 ^ heapFL_INDEX_MAX - 1 bytes are mapped, which is a heap of
+ * 1MB by default. */
+#ifdef configHEAP_FL_INDEX_MAX
+    #define heapFL_INDEX_MAX       configHEAP_FL_INDEX_MAX
+#else
+    #define heapFL_INDEX_MAX       ( 20U )
+#endif
+#define heapFL_INDEX_COUNT         ( heapFL_INDEX_MAX - heapFL_INDEX_SHIFT + 1U )
+
+/* The low bits of a block size are always clear, as blocks are aligned, so the
+ * lowest one marks the free blocks. */
+#define heapBLOCK_FREE_BIT         ( ( size_t ) 1 )
+#define heapBLOCK_SIZE( pxBlock )       ( ( pxBlock )->xBlockSize & ~heapBLOCK_FREE_BIT )
+#define heapBLOCK_IS_FREE( pxBlock )    ( ( ( pxBlock )->xBlockSize & heapBLOCK_FREE_BIT ) != 0 )
+
+/* Bit scans of a 32 bit word that is not zero. */
+#define heapFIND_FIRST_SET( ulBits )    ( ( UBaseType_t ) __builtin_ctz( ( unsigned int ) ( ulBits ) ) )
+#define heapFIND_LAST_SET( ulBits )     ( ( UBaseType_t ) ( 31 - __builtin_clz( ( unsigned int ) ( ulBits ) ) ) )
+
+/* Allocate the memory for the heap. */
+#if ( configAPPLICATION_ALLOCATED_HEAP == 1 )
+
+/* The application writer has already defined the array used for the RTOS
+* heap - probably so it can be placed in a special segment or address. */
+    extern uint8_t ucHeap[ configTOTAL_HEAP_SIZE ];
+#else
+    PRIVILEGED_DATA static uint8_t ucHeap[ configTOTAL_HEAP_SIZE ];
+#endif /* configAPPLICATION_ALLOCATED_HEAP */
+
+/* Define the header at the start of every block.  Only the first two members
+ * are kept while a block is allocated; the list links of a free block are
+ * stored in the space the application uses while it is allocated. */
+typedef struct A_BLOCK_HEADER
+{
+    struct A_BLOCK_HEADER * pxPrevPhysBlock; /*<< The block before this one in memory, NULL for the first. */
+    size_t xBlockSize;                       /*<< The size of the block, including this header, with heapBLOCK_FREE_BIT set while it is free. */
+    struct A_BLOCK_HEADER * pxNextFreeBlock; /*<< The next free block of the same class. */
+    struct A_BLOCK_HEADER * pxPrevFreeBlock; /*<< The previous free block of the same class. */
+} BlockHeader_t;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Called automatically to setup the required heap structures the first time
+ * pvPortMalloc() is called.
+ */
+static void prvHeapInit( void ) PRIVILEGED_FUNCTION;
+
+/*
+ * Find the class of a block size.
+ */
+static void prvMappingInsert( size_t xBlockSize,
+                              UBaseType_t * puxFL,
+                              UBaseType_t * puxSL ) PRIVILEGED_FUNCTION;
+
+/*
+ * Find the first non empty class whose blocks are all at least xBlockSize
+ * bytes.  Returns NULL if there is none.
+ */
+static BlockHeader_t * prvFindSuitableBlock( size_t xBlockSize ) PRIVILEGED_FUNCTION;
+
+/*
+ * Add a block to, or take it out of, the list of its class.
+ */
+static void prvInsertFreeBlock( BlockHeader_t * pxBlock ) PRIVILEGED_FUNCTION;
+static void prvRemoveFreeBlock( BlockHeader_t * pxBlock ) PRIVILEGED_FUNCTION;
+
+/*-----------------------------------------------------------*/
+
+/* The size of the part of the header kept in allocated blocks, which must be
+ * correctly byte aligned. */
+static const size_t xHeapStructSize = ( offsetof( BlockHeader_t, pxNextFreeBlock ) + ( ( size_t ) ( portBYTE_ALIGNMENT - 1 ) ) ) & ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+
+/* A free block must hold the whole header. */
+static const size_t xMinimumBlockSize = ( sizeof( BlockHeader_t ) + ( ( size_t ) ( portBYTE_ALIGNMENT - 1 ) ) ) & ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+
+/* The bitmaps of the non empty classes, and the lists of free blocks. */
+PRIVILEGED_DATA static uint32_t ulFLBitmap = 0U;
+PRIVILEGED_DATA static uint32_t ulSLBitmap[ heapFL_INDEX_COUNT ];
+PRIVILEGED_DATA static BlockHeader_t * pxFreeLists[ heapFL_INDEX_COUNT ][ heapSL_INDEX_COUNT ];
+
+/* Marks the end of the heap.  It is never free, so no block is merged with it. */
+PRIVILEGED_DATA static BlockHeader_t * pxEnd = NULL;
+
+/* Keeps track of the number of calls to allocate and free memory as well as the
+ * number of free bytes remaining. */
+PRIVILEGED_DATA static size_t xFreeBytesRemaining = 0U;
+PRIVILEGED_DATA static size_t xMinimumEverFreeBytesRemaining = 0U;
+PRIVILEGED_DATA static size_t xNumberOfSuccessfulAllocations = 0;
+PRIVILEGED_DATA static size_t xNumberOfSuccessfulFrees = 0;
+
+/* The same, and the blocks free now, per first level class. */
+PRIVILEGED_DATA static HeapClassStats_t xClassStats[ heapFL_INDEX_COUNT ];
+
+/*-----------------------------------------------------------*/
+
+void * pvPortMalloc( size_t xWantedSize )
+{
+    BlockHeader_t * pxBlock, * pxNewBlock, * pxNextBlock;
+    UBaseType_t uxFL, uxSL;
+    size_t xBlockSize = 0;
+    void * pvReturn = NULL;
+
+    vTaskSuspendAll();
+    {
+        /* If this is the first call to malloc then the heap will require
+         * initialisation to setup the free lists. */
+        if( pxEnd == NULL )
+        {
+            prvHeapInit();
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        /* The block must hold the header too, and be aligned.  Check for
+         * overflow, and that the size can be mapped to a class. */
+        if( ( xWantedSize > 0 ) &&
+            ( xWantedSize < ( ( size_t ) 1 << heapFL_INDEX_MAX ) ) )
+        {
+            xBlockSize = ( xWantedSize + xHeapStructSize + ( ( size_t ) portBYTE_ALIGNMENT_MASK ) ) & ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+
+            if( xBlockSize < xMinimumBlockSize )
+            {
+                xBlockSize = xMinimumBlockSize;
+            }
+            else
+            {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        if( ( xBlockSize > 0 ) && ( xBlockSize <= xFreeBytesRemaining ) )
+        {
+            pxBlock = prvFindSuitableBlock( xBlockSize );
+        }
+        else
+        {
+            pxBlock = NULL;
+        }
+
+        if( pxBlock != NULL )
+        {
+            prvRemoveFreeBlock( pxBlock );
+
+            /* If the block is larger than required it can be split into two. */
+            if( ( heapBLOCK_SIZE( pxBlock ) - xBlockSize ) >= xMinimumBlockSize )
+            {
+                /* The block after a free block is never free, so the remainder
+                 * cannot be merged with it.  The void cast is used to prevent
+                 * byte alignment warnings from the compiler. */
+                pxNewBlock = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xBlockSize );
+                configASSERT( ( ( ( size_t ) pxNewBlock ) & portBYTE_ALIGNMENT_MASK ) == 0 );
+
+                pxNewBlock->xBlockSize = heapBLOCK_SIZE( pxBlock ) - xBlockSize;
+                pxNewBlock->pxPrevPhysBlock = pxBlock;
+                pxNextBlock = ( void * ) ( ( ( uint8_t * ) pxNewBlock ) + pxNewBlock->xBlockSize );
+                pxNextBlock->pxPrevPhysBlock = pxNewBlock;
+                pxBlock->xBlockSize = xBlockSize;
+
+                prvInsertFreeBlock( pxNewBlock );
+            }
+            else
+            {
+                /* The whole block is handed out. */
+                pxBlock->xBlockSize = heapBLOCK_SIZE( pxBlock );
+            }
+
+            xFreeBytesRemaining -= pxBlock->xBlockSize;
+
+            if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
+            {
+                xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+            }
+            else
+            {
+                mtCOVERAGE_TEST_MARKER();
+            }
+
+            prvMappingInsert( pxBlock->xBlockSize, &uxFL, &uxSL );
+            xClassStats[ uxFL ].xAllocatedBlocks++;
+            xClassStats[ uxFL ].xNumberOfSuccessfulAllocations++;
+            xNumberOfSuccessfulAllocations++;
+
+            /* Return the memory space following the part of the header kept
+             * in allocated blocks. */
+            pvReturn = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xHeapStructSize );
+        }
+        else
+        {
+            /* Sizes that cannot be mapped count as failures of the last class. */
+            if( ( xBlockSize > 0 ) && ( xBlockSize < ( ( size_t ) 1 << heapFL_INDEX_MAX ) ) )
+            {
+                prvMappingInsert( xBlockSize, &uxFL, &uxSL );
+            }
+            else
+            {
+                uxFL = heapFL_INDEX_COUNT - 1U;
+            }
+
+            xClassStats[ uxFL ].xNumberOfFailedAllocations++;
+        }
+
+        traceMALLOC( pvReturn, xWantedSize );
+    }
+    ( void ) xTaskResumeAll();
+
+    #if ( configUSE_MALLOC_FAILED_HOOK == 1 )
+        {
+            if( pvReturn == NULL )
+            {
+                extern void vApplicationMallocFailedHook( void );
+                vApplicationMallocFailedHook();
+            }
+            else
+            {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+    #endif /* if ( configUSE_MALLOC_FAILED_HOOK == 1 ) */
+
+    configASSERT( ( ( ( size_t ) pvReturn ) & ( size_t ) portBYTE_ALIGNMENT_MASK ) == 0 );
+    return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPortFree( void * pv )
+{
+    uint8_t * puc = ( uint8_t * ) pv;
+    BlockHeader_t * pxBlock, * pxNeighbour;
+    UBaseType_t uxFL, uxSL;
+
+    if( pv != NULL )
+    {
+        /* The memory being freed will have the allocated part of a
+         * BlockHeader_t structure immediately before it. */
+        puc -= xHeapStructSize;
+
+        /* This casting is to keep the compiler from issuing warnings. */
+        pxBlock = ( void * ) puc;
+
+        /* Check the block is actually allocated. */
+        configASSERT( !heapBLOCK_IS_FREE( pxBlock ) );
+
+        if( !heapBLOCK_IS_FREE( pxBlock ) )
+        {
+            vTaskSuspendAll();
+            {
+                xFreeBytesRemaining += pxBlock->xBlockSize;
+                traceFREE( pv, pxBlock->xBlockSize );
+
+                prvMappingInsert( pxBlock->xBlockSize, &uxFL, &uxSL );
+                xClassStats[ uxFL ].xAllocatedBlocks--;
+                xNumberOfSuccessfulFrees++;
+
+                /* Merge with the block before it if that one is free. */
+                pxNeighbour = pxBlock->pxPrevPhysBlock;
+
+                if( ( pxNeighbour != NULL ) && heapBLOCK_IS_FREE( pxNeighbour ) )
+                {
+                    prvRemoveFreeBlock( pxNeighbour );
+                    pxNeighbour->xBlockSize = heapBLOCK_SIZE( pxNeighbour ) + pxBlock->xBlockSize;
+                    pxBlock = pxNeighbour;
+                }
+                else
+                {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+
+                /* Merge with the block after it if that one is free.  pxEnd is
+                 * never free. */
+                pxNeighbour = ( void * ) ( ( ( uint8_t * ) pxBlock ) + heapBLOCK_SIZE( pxBlock ) );
+
+                if( heapBLOCK_IS_FREE( pxNeighbour ) )
+                {
+                    prvRemoveFreeBlock( pxNeighbour );
+                    pxBlock->xBlockSize = heapBLOCK_SIZE( pxBlock ) + heapBLOCK_SIZE( pxNeighbour );
+                    pxNeighbour = ( void * ) ( ( ( uint8_t * ) pxBlock ) + pxBlock->xBlockSize );
+                }
+                else
+                {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+
+                pxNeighbour->pxPrevPhysBlock = pxBlock;
+                prvInsertFreeBlock( pxBlock );
+            }
+            ( void ) xTaskResumeAll();
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeHeapSize( void )
+{
+    return xFreeBytesRemaining;
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetMinimumEverFreeHeapSize( void )
+{
+    return xMinimumEverFreeBytesRemaining;
+}
+/*-----------------------------------------------------------*/
+
+void vPortInitialiseBlocks( void )
+{
+    /* This just exists to keep the linker quiet. */
+}
+/*-----------------------------------------------------------*/
+
+static void prvHeapInit( void ) /* PRIVILEGED_FUNCTION */
+{
+    BlockHeader_t * pxFirstFreeBlock;
+    size_t uxAddress;
+    size_t xTotalHeapSize = configTOTAL_HEAP_SIZE;
+    UBaseType_t uxFL;
+
+    /* Ensure the heap starts on a correctly aligned boundary. */
+    uxAddress = ( size_t ) ucHeap;
+
+    if( ( uxAddress & portBYTE_ALIGNMENT_MASK ) != 0 )
+    {
+        uxAddress += ( portBYTE_ALIGNMENT - 1 );
+        uxAddress &= ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+        xTotalHeapSize -= uxAddress - ( size_t ) ucHeap;
+    }
+
+    pxFirstFreeBlock = ( void * ) uxAddress;
+
+    /* pxEnd is used to mark the end of the heap, and is placed in the last
+     * aligned space large enough for the part of the header kept in allocated
+     * blocks. */
+    uxAddress += xTotalHeapSize;
+    uxAddress -= xHeapStructSize;
+    uxAddress &= ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+    pxEnd = ( void * ) uxAddress;
+
+    /* To start with there is a single free block that is sized to take up the
+     * entire heap space, minus the space taken by pxEnd.  It must be mapped to
+     * a class. */
+    pxFirstFreeBlock->xBlockSize = uxAddress - ( size_t ) pxFirstFreeBlock;
+    pxFirstFreeBlock->pxPrevPhysBlock = NULL;
+    configASSERT( pxFirstFreeBlock->xBlockSize < ( ( size_t ) 1 << heapFL_INDEX_MAX ) );
+
+    pxEnd->xBlockSize = 0;
+    pxEnd->pxPrevPhysBlock = pxFirstFreeBlock;
+
+    /* The smallest block of each first level class. */
+    xClassStats[ 0 ].xMinimumBlockSize = xMinimumBlockSize;
+
+    for( uxFL = 1; uxFL < heapFL_INDEX_COUNT; uxFL++ )
+    {
+        xClassStats[ uxFL ].xMinimumBlockSize = heapSMALL_BLOCK_SIZE << ( uxFL - 1U );
+    }
+
+    prvInsertFreeBlock( pxFirstFreeBlock );
+
+    /* Only one block exists - and it covers the entire usable heap space. */
+    xMinimumEverFreeBytesRemaining = heapBLOCK_SIZE( pxFirstFreeBlock );
+    xFreeBytesRemaining = heapBLOCK_SIZE( pxFirstFreeBlock );
+}
+/*-----------------------------------------------------------*/
+
+static void prvMappingInsert( size_t xBlockSize,
+                              UBaseType_t * puxFL,
+                              UBaseType_t * puxSL ) /* PRIVILEGED_FUNCTION */
+{
+    UBaseType_t uxLastSet;
+
+    if( xBlockSize < heapSMALL_BLOCK_SIZE )
+    {
+        /* Small blocks are split into classes one alignment unit apart. */
+        *puxFL = 0;
+        *puxSL = ( UBaseType_t ) ( xBlockSize >> heapALIGNMENT_LOG2 );
+    }
+    else
+    {
+        /* The second level is the bits that follow the highest set bit. */
+        uxLastSet = heapFIND_LAST_SET( xBlockSize );
+        *puxSL = ( UBaseType_t ) ( xBlockSize >> ( uxLastSet - heapSL_INDEX_COUNT_LOG2 ) ) ^ heapSL_INDEX_COUNT;
+        *puxFL = uxLastSet - heapFL_INDEX_SHIFT + 1U;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static BlockHeader_t * prvFindSuitableBlock( size_t xBlockSize ) /* PRIVILEGED_FUNCTION */
+{
+    BlockHeader_t * pxBlock;
+    UBaseType_t uxFL, uxSL;
+    uint32_t ulFLMap, ulSLMap;
+
+    /* The first block of the class the size itself maps to is the closest
+     * fit, if it is large enough. */
+    prvMappingInsert( xBlockSize, &uxFL, &uxSL );
+    pxBlock = pxFreeLists[ uxFL ][ uxSL ];
+
+    if( ( pxBlock != NULL ) && ( heapBLOCK_SIZE( pxBlock ) >= xBlockSize ) )
+    {
+        return pxBlock;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    /* Round the size up to the next class boundary, so that every block of
+     * the class it maps to is large enough. */
+    if( xBlockSize >= heapSMALL_BLOCK_SIZE )
+    {
+        xBlockSize += ( ( size_t ) 1 << ( heapFIND_LAST_SET( xBlockSize ) - heapSL_INDEX_COUNT_LOG2 ) ) - 1U;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    if( xBlockSize >= ( ( size_t ) 1 << heapFL_INDEX_MAX ) )
+    {
+        return NULL;
+    }
+
+    prvMappingInsert( xBlockSize, &uxFL, &uxSL );
+
+    /* Look for a non empty class of the same first level first, then for the
+     * smallest class of the next non empty first level. */
+    ulSLMap = ulSLBitmap[ uxFL ] & ( ~( uint32_t ) 0 << uxSL );
+
+    if( ulSLMap == 0U )
+    {
+        ulFLMap = ulFLBitmap & ( ~( uint32_t ) 0 << ( uxFL + 1U ) );
+
+        if( ulFLMap == 0U )
+        {
+            return NULL;
+        }
+
+        uxFL = heapFIND_FIRST_SET( ulFLMap );
+        ulSLMap = ulSLBitmap[ uxFL ];
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    uxSL = heapFIND_FIRST_SET( ulSLMap );
+
+    return pxFreeLists[ uxFL ][ uxSL ];
+}
+/*-----------------------------------------------------------*/
+
+static void prvInsertFreeBlock( BlockHeader_t * pxBlock ) /* PRIVILEGED_FUNCTION */
+{
+    BlockHeader_t * pxHead;
+    UBaseType_t uxFL, uxSL;
+
+    prvMappingInsert( heapBLOCK_SIZE( pxBlock ), &uxFL, &uxSL );
+
+    pxBlock->xBlockSize |= heapBLOCK_FREE_BIT;
+    pxHead = pxFreeLists[ uxFL ][ uxSL ];
+
+    /* The head of a list is the block handed out next, so it is kept the lower
+     * of the block inserted and the previous head.  That packs the allocated
+     * blocks towards the start of the heap, as first fit does, and leaves
+     * larger free blocks at the end. */
+    if( ( pxHead != NULL ) && ( pxHead < pxBlock ) )
+    {
+        pxBlock->pxPrevFreeBlock = pxHead;
+        pxBlock->pxNextFreeBlock = pxHead->pxNextFreeBlock;
+
+        if( pxBlock->pxNextFreeBlock != NULL )
+        {
+            pxBlock->pxNextFreeBlock->pxPrevFreeBlock = pxBlock;
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        pxHead->pxNextFreeBlock = pxBlock;
+    }
+    else
+    {
+        pxBlock->pxPrevFreeBlock = NULL;
+        pxBlock->pxNextFreeBlock = pxHead;
+
+        if( pxHead != NULL )
+        {
+            pxHead->pxPrevFreeBlock = pxBlock;
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        pxFreeLists[ uxFL ][ uxSL ] = pxBlock;
+    }
+    ulFLBitmap |= ( uint32_t ) 1 << uxFL;
+    ulSLBitmap[ uxFL ] |= ( uint32_t ) 1 << uxSL;
+    xClassStats[ uxFL ].xFreeBlocks++;
+}
+/*-----------------------------------------------------------*/
+
+static void prvRemoveFreeBlock( BlockHeader_t * pxBlock ) /* PRIVILEGED_FUNCTION */
+{
+    UBaseType_t uxFL, uxSL;
+
+    prvMappingInsert( heapBLOCK_SIZE( pxBlock ), &uxFL, &uxSL );
+
+    if( pxBlock->pxNextFreeBlock != NULL )
+    {
+        pxBlock->pxNextFreeBlock->pxPrevFreeBlock = pxBlock->pxPrevFreeBlock;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    if( pxBlock->pxPrevFreeBlock != NULL )
+    {
+        pxBlock->pxPrevFreeBlock->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
+    }
+    else
+    {
+        /* The block was the head of its list; clear the bitmaps once the
+         * list is empty. */
+        pxFreeLists[ uxFL ][ uxSL ] = pxBlock->pxNextFreeBlock;
+
+        if( pxFreeLists[ uxFL ][ uxSL ] == NULL )
+        {
+            ulSLBitmap[ uxFL ] &= ~( ( uint32_t ) 1 << uxSL );
+
+            if( ulSLBitmap[ uxFL ] == 0U )
+            {
+                ulFLBitmap &= ~( ( uint32_t ) 1 << uxFL );
+            }
+            else
+            {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+
+    pxBlock->xBlockSize = heapBLOCK_SIZE( pxBlock );
+    xClassStats[ uxFL ].xFreeBlocks--;
+}
+/*-----------------------------------------------------------*/
+
+void vPortGetHeapStats( HeapStats_t * pxHeapStats )
+{
+    BlockHeader_t * pxBlock;
+    UBaseType_t uxFL, uxSL;
+    size_t xBlocks = 0, xMaxSize = 0, xMinSize = portMAX_DELAY; /* portMAX_DELAY used as a portable way of getting the maximum value. */
+
+    vTaskSuspendAll();
+    {
+        /* Unlike allocating and freeing, this walks every free block. */
+        for( uxFL = 0; uxFL < heapFL_INDEX_COUNT; uxFL++ )
+        {
+            for( uxSL = 0; uxSL < heapSL_INDEX_COUNT; uxSL++ )
+            {
+                for( pxBlock = pxFreeLists[ uxFL ][ uxSL ]; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+                {
+                    xBlocks++;
+
+                    if( heapBLOCK_SIZE( pxBlock ) > xMaxSize )
+                    {
+                        xMaxSize = heapBLOCK_SIZE( pxBlock );
+                    }
+
+                    if( heapBLOCK_SIZE( pxBlock ) < xMinSize )
+                    {
+                        xMinSize = heapBLOCK_SIZE( pxBlock );
+                    }
+                }
+            }
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    pxHeapStats->xSizeOfLargestFreeBlockInBytes = xMaxSize;
+    pxHeapStats->xSizeOfSmallestFreeBlockInBytes = xMinSize;
+    pxHeapStats->xNumberOfFreeBlocks = xBlocks;
+
+    taskENTER_CRITICAL();
+    {
+        pxHeapStats->xAvailableHeapSpaceInBytes = xFreeBytesRemaining;
+        pxHeapStats->xNumberOfSuccessfulAllocations = xNumberOfSuccessfulAllocations;
+        pxHeapStats->xNumberOfSuccessfulFrees = xNumberOfSuccessfulFrees;
+        pxHeapStats->xMinimumEverFreeBytesRemaining = xMinimumEverFreeBytesRemaining;
+    }
+    taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxPortGetHeapClassStats( HeapClassStats_t * pxClassStats,
+                                     UBaseType_t uxMaxClasses )
+{
+    UBaseType_t uxClasses = heapFL_INDEX_COUNT;
+
+    if( uxMaxClasses < uxClasses )
+    {
+        uxClasses = uxMaxClasses;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    vTaskSuspendAll();
+    {
+        /* The minimum sizes are set up with the heap. */
+        if( pxEnd == NULL )
+        {
+            prvHeapInit();
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        memcpy( pxClassStats, xClassStats, uxClasses * sizeof( HeapClassStats_t ) );
+    }
+    ( void ) xTaskResumeAll();
+
+    return uxClasses;
+}
+/*-----------------------------------------------------------*/
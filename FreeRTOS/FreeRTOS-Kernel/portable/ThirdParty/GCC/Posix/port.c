@@ -103,7 +103,9 @@ static portBASE_TYPE xSchedulerEnd = pdFALSE;
 /*-----------------------------------------------------------*/
 
 static void prvSetupSignalsAndSchedulerPolicy( void );
+#if ( configUSE_VIRTUAL_TICK != 1 )
 static void prvSetupTimerInterrupt( void );
+#endif
 static void *prvWaitForStart( void * pvParams );
 static void prvSwitchThread( Thread_t * xThreadToResume,
                              Thread_t *xThreadToSuspend );
@@ -184,9 +186,14 @@ sigset_t xSignals;
 
     hMainThread = pthread_self();
 
+#if ( configUSE_VIRTUAL_TICK == 1 )
+    /* There is no tick timer in virtual time, the idle task steps the tick
+       from portSUPPRESS_TICKS_AND_SLEEP() whenever every task is blocked. */
+#else
     /* Start the timer that generates the tick ISR(SIGALRM).
        Interrupts are disabled here already. */
     prvSetupTimerInterrupt();
+#endif
 
     /* Start the first task. */
     vPortStartFirstTask();
@@ -318,6 +325,7 @@ void vPortClearInterruptMask( portBASE_TYPE xMask )
 }
 /*-----------------------------------------------------------*/
 
+#if ( configUSE_VIRTUAL_TICK != 1 )
 static uint64_t prvGetTimeNs(void)
 {
 struct timespec t;
@@ -365,6 +373,7 @@ int iRet;
 
     prvStartTimeNs = prvGetTimeNs();
 }
+#endif /* configUSE_VIRTUAL_TICK */
 /*-----------------------------------------------------------*/
 
 static void vPortSystemTickHandler( int sig )
@@ -203,6 +203,22 @@ static BaseType_t prvCopyDataToQueue( Queue_t * const pxQueue,
 static void prvCopyDataFromQueue( Queue_t * const pxQueue,
                                   void * const pvBuffer ) PRIVILEGED_FUNCTION;
 
+/*
+ * Copies uxItems items to the back of a queue that has space for them, in at
+ * most two runs either side of the end of the storage area.
+ */
+static void prvCopyMultipleToQueue( Queue_t * const pxQueue,
+                                    const uint8_t * pucItems,
+                                    const UBaseType_t uxItems ) PRIVILEGED_FUNCTION;
+
+/*
+ * Copies uxItems items out of a queue that holds at least that many, in at
+ * most two runs either side of the end of the storage area.
+ */
+static void prvCopyMultipleFromQueue( Queue_t * const pxQueue,
+                                      uint8_t * pucBuffer,
+                                      const UBaseType_t uxItems ) PRIVILEGED_FUNCTION;
+
 #if ( configUSE_QUEUE_SETS == 1 )
 
 /*
@@ -1375,6 +1391,112 @@ BaseType_t xQueueGiveFromISR( QueueHandle_t xQueue,
 }
 /*-----------------------------------------------------------*/
 
+UBaseType_t xQueueSendMultipleFromISR( QueueHandle_t xQueue,
+                                       const void * const pvItemsToQueue,
+                                       const UBaseType_t uxItems,
+                                       BaseType_t * const pxHigherPriorityTaskWoken )
+{
+    UBaseType_t uxSent;
+    UBaseType_t uxSavedInterruptStatus;
+    Queue_t * const pxQueue = xQueue;
+
+    configASSERT( pxQueue );
+    configASSERT( pvItemsToQueue );
+    configASSERT( uxItems > ( UBaseType_t ) 0 );
+
+    /* Semaphores and mutexes have no items to copy. */
+    configASSERT( pxQueue->uxItemSize != ( UBaseType_t ) 0 );
+
+    /* A queue set is posted once per item, which would defeat the purpose. */
+    #if ( configUSE_QUEUE_SETS == 1 )
+        configASSERT( pxQueue->pxQueueSetContainer == NULL );
+    #endif
+
+    portASSERT_IF_INTERRUPT_PRIORITY_INVALID();
+
+    /* Similar to xQueueGenericSendFromISR(), except that as many of the items
+     * as fit are copied in one critical section.  Each item can unblock one
+     * task waiting to receive, so a single waiting task is woken once however
+     * many items are sent. */
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    {
+        UBaseType_t uxWake;
+
+        uxSent = pxQueue->uxLength - pxQueue->uxMessagesWaiting;
+
+        if( uxSent > uxItems )
+        {
+            uxSent = uxItems;
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        if( uxSent > ( UBaseType_t ) 0 )
+        {
+            traceQUEUE_SEND_FROM_ISR( pxQueue );
+
+            prvCopyMultipleToQueue( pxQueue, ( const uint8_t * ) pvItemsToQueue, uxSent );
+            pxQueue->uxMessagesWaiting += uxSent;
+
+            /* The event list is not altered if the queue is locked.  This will
+             * be done when the queue is unlocked later. */
+            if( pxQueue->cTxLock == queueUNLOCKED )
+            {
+                for( uxWake = uxSent; ( uxWake > ( UBaseType_t ) 0 ) && ( listLIST_IS_EMPTY( &( pxQueue->xTasksWaitingToReceive ) ) == pdFALSE ); uxWake-- )
+                {
+                    if( xTaskRemoveFromEventList( &( pxQueue->xTasksWaitingToReceive ) ) != pdFALSE )
+                    {
+                        /* The task waiting has a higher priority so record that a
+                         * context switch is required. */
+                        if( pxHigherPriorityTaskWoken != NULL )
+                        {
+                            *pxHigherPriorityTaskWoken = pdTRUE;
+                        }
+                        else
+                        {
+                            mtCOVERAGE_TEST_MARKER();
+                        }
+                    }
+                    else
+                    {
+                        mtCOVERAGE_TEST_MARKER();
+                    }
+                }
+            }
+            else
+            {
+                /* Count every item, up to the number of tasks, so the task that
+                 * unlocks the queue unblocks as many waiting tasks. */
+                for( uxWake = uxSent; uxWake > ( UBaseType_t ) 0; uxWake-- )
+                {
+                    const int8_t cTxLock = pxQueue->cTxLock;
+
+                    prvIncrementQueueTxLock( pxQueue, cTxLock );
+
+                    if( pxQueue->cTxLock == cTxLock )
+                    {
+                        break;
+                    }
+                    else
+                    {
+                        mtCOVERAGE_TEST_MARKER();
+                    }
+                }
+            }
+        }
+        else
+        {
+            traceQUEUE_SEND_FROM_ISR_FAILED( pxQueue );
+        }
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+
+    return uxSent;
+}
+/*-----------------------------------------------------------*/
+
 BaseType_t xQueueReceive( QueueHandle_t xQueue,
                           void * const pvBuffer,
                           TickType_t xTicksToWait )
@@ -1518,6 +1640,156 @@ BaseType_t xQueueReceive( QueueHandle_t xQueue,
 }
 /*-----------------------------------------------------------*/
 
+UBaseType_t xQueueReceiveMultiple( QueueHandle_t xQueue,
+                                   void * const pvBuffer,
+                                   const UBaseType_t uxItems,
+                                   TickType_t xTicksToWait )
+{
+    BaseType_t xEntryTimeSet = pdFALSE;
+    TimeOut_t xTimeOut;
+    Queue_t * const pxQueue = xQueue;
+
+    configASSERT( ( pxQueue ) );
+    configASSERT( ( pvBuffer ) );
+    configASSERT( uxItems > ( UBaseType_t ) 0 );
+
+    /* Semaphores and mutexes have no items to copy. */
+    configASSERT( pxQueue->uxItemSize != ( UBaseType_t ) 0 );
+
+    /* Cannot block if the scheduler is suspended. */
+    #if ( ( INCLUDE_xTaskGetSchedulerState == 1 ) || ( configUSE_TIMERS == 1 ) )
+        {
+            configASSERT( !( ( xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED ) && ( xTicksToWait != 0 ) ) );
+        }
+    #endif
+
+    /* The same as xQueueReceive(), except that once the queue holds data as
+     * many of the items as were asked for are copied out in one critical
+     * section.  The call only blocks while the queue is empty. */
+    for( ; ; )
+    {
+        taskENTER_CRITICAL();
+        {
+            const UBaseType_t uxMessagesWaiting = pxQueue->uxMessagesWaiting;
+
+            if( uxMessagesWaiting > ( UBaseType_t ) 0 )
+            {
+                const UBaseType_t uxReceived = ( uxMessagesWaiting < uxItems ) ? uxMessagesWaiting : uxItems;
+                BaseType_t xYieldRequired = pdFALSE;
+                UBaseType_t uxWake;
+
+                prvCopyMultipleFromQueue( pxQueue, ( uint8_t * ) pvBuffer, uxReceived );
+                traceQUEUE_RECEIVE( pxQueue );
+                pxQueue->uxMessagesWaiting = uxMessagesWaiting - uxReceived;
+
+                /* There is now space for uxReceived items; unblock up to as
+                 * many tasks waiting to post to the queue, highest priority
+                 * first. */
+                for( uxWake = uxReceived; ( uxWake > ( UBaseType_t ) 0 ) && ( listLIST_IS_EMPTY( &( pxQueue->xTasksWaitingToSend ) ) == pdFALSE ); uxWake-- )
+                {
+                    if( xTaskRemoveFromEventList( &( pxQueue->xTasksWaitingToSend ) ) != pdFALSE )
+                    {
+                        xYieldRequired = pdTRUE;
+                    }
+                    else
+                    {
+                        mtCOVERAGE_TEST_MARKER();
+                    }
+                }
+
+                if( xYieldRequired != pdFALSE )
+                {
+                    queueYIELD_IF_USING_PREEMPTION();
+                }
+                else
+                {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+
+                taskEXIT_CRITICAL();
+                return uxReceived;
+            }
+            else
+            {
+                if( xTicksToWait == ( TickType_t ) 0 )
+                {
+                    /* The queue was empty and no block time is specified (or
+                     * the block time has expired) so leave now. */
+                    taskEXIT_CRITICAL();
+                    traceQUEUE_RECEIVE_FAILED( pxQueue );
+                    return ( UBaseType_t ) 0;
+                }
+                else if( xEntryTimeSet == pdFALSE )
+                {
+                    /* The queue was empty and a block time was specified so
+                     * configure the timeout structure. */
+                    vTaskInternalSetTimeOutState( &xTimeOut );
+                    xEntryTimeSet = pdTRUE;
+                }
+                else
+                {
+                    /* Entry time was already set. */
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        /* Interrupts and other tasks can send to and receive from the queue
+         * now the critical section has been exited. */
+
+        vTaskSuspendAll();
+        prvLockQueue( pxQueue );
+
+        /* Update the timeout state to see if it has expired yet. */
+        if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
+        {
+            /* The timeout has not expired.  If the queue is still empty place
+             * the task on the list of tasks waiting to receive from the queue. */
+            if( prvIsQueueEmpty( pxQueue ) != pdFALSE )
+            {
+                traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue );
+                vTaskPlaceOnEventList( &( pxQueue->xTasksWaitingToReceive ), xTicksToWait );
+                prvUnlockQueue( pxQueue );
+
+                if( xTaskResumeAll() == pdFALSE )
+                {
+                    portYIELD_WITHIN_API();
+                }
+                else
+                {
+                    mtCOVERAGE_TEST_MARKER();
+                }
+            }
+            else
+            {
+                /* The queue contains data again.  Loop back to try and read the
+                 * data. */
+                prvUnlockQueue( pxQueue );
+                ( void ) xTaskResumeAll();
+            }
+        }
+        else
+        {
+            /* Timed out.  If there is no data in the queue exit, otherwise loop
+             * back and attempt to read the data. */
+            prvUnlockQueue( pxQueue );
+            ( void ) xTaskResumeAll();
+
+            if( prvIsQueueEmpty( pxQueue ) != pdFALSE )
+            {
+                traceQUEUE_RECEIVE_FAILED( pxQueue );
+                return ( UBaseType_t ) 0;
+            }
+            else
+            {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
 BaseType_t xQueueSemaphoreTake( QueueHandle_t xQueue,
                                 TickType_t xTicksToWait )
 {
@@ -2285,6 +2557,91 @@ static void prvCopyDataFromQueue( Queue_t * const pxQueue,
 }
 /*-----------------------------------------------------------*/
 
+static void prvCopyMultipleToQueue( Queue_t * const pxQueue,
+                                    const uint8_t * pucItems,
+                                    const UBaseType_t uxItems )
+{
+    /* Items up to the end of the storage area, then the rest from its start. */
+    size_t xFirst = ( size_t ) ( pxQueue->u.xQueue.pcTail - pxQueue->pcWriteTo ); /*lint !e946 !e9016 Pointer arithmetic on char types ok. */
+    const size_t xBytes = ( size_t ) uxItems * ( size_t ) pxQueue->uxItemSize;
+
+    if( xFirst > xBytes )
+    {
+        xFirst = xBytes;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    ( void ) memcpy( ( void * ) pxQueue->pcWriteTo, ( const void * ) pucItems, xFirst ); /*lint !e961 !e418 !e9087 MISRA exception as the casts are only redundant for some ports. */
+    ( void ) memcpy( ( void * ) pxQueue->pcHead, ( const void * ) &( pucItems[ xFirst ] ), xBytes - xFirst ); /*lint !e961 !e418 !e9087 MISRA exception as the casts are only redundant for some ports. */
+
+    if( xFirst < xBytes )
+    {
+        pxQueue->pcWriteTo = pxQueue->pcHead + ( xBytes - xFirst ); /*lint !e9016 Pointer arithmetic on char types ok. */
+    }
+    else
+    {
+        pxQueue->pcWriteTo += xBytes; /*lint !e9016 Pointer arithmetic on char types ok. */
+
+        if( pxQueue->pcWriteTo >= pxQueue->u.xQueue.pcTail ) /*lint !e946 MISRA exception justified as comparison of pointers is the cleanest solution. */
+        {
+            pxQueue->pcWriteTo = pxQueue->pcHead;
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvCopyMultipleFromQueue( Queue_t * const pxQueue,
+                                      uint8_t * pucBuffer,
+                                      const UBaseType_t uxItems )
+{
+    /* pcReadFrom points at the item last read, so reading starts one item on. */
+    int8_t * pcStart = pxQueue->u.xQueue.pcReadFrom + pxQueue->uxItemSize; /*lint !e9016 Pointer arithmetic on char types ok. */
+    const size_t xBytes = ( size_t ) uxItems * ( size_t ) pxQueue->uxItemSize;
+    size_t xFirst;
+
+    if( pcStart >= pxQueue->u.xQueue.pcTail ) /*lint !e946 MISRA exception justified as comparison of pointers is the cleanest solution. */
+    {
+        pcStart = pxQueue->pcHead;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    /* Items up to the end of the storage area, then the rest from its start. */
+    xFirst = ( size_t ) ( pxQueue->u.xQueue.pcTail - pcStart ); /*lint !e946 !e9016 Pointer arithmetic on char types ok. */
+
+    if( xFirst > xBytes )
+    {
+        xFirst = xBytes;
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    ( void ) memcpy( ( void * ) pucBuffer, ( const void * ) pcStart, xFirst ); /*lint !e961 !e418 !e9087 MISRA exception as the casts are only redundant for some ports. */
+    ( void ) memcpy( ( void * ) &( pucBuffer[ xFirst ] ), ( const void * ) pxQueue->pcHead, xBytes - xFirst ); /*lint !e961 !e418 !e9087 MISRA exception as the casts are only redundant for some ports. */
+
+    /* Leave pcReadFrom at the last item read, as prvCopyDataFromQueue() does. */
+    if( xFirst < xBytes )
+    {
+        pxQueue->u.xQueue.pcReadFrom = pxQueue->pcHead + ( xBytes - xFirst ) - pxQueue->uxItemSize; /*lint !e9016 Pointer arithmetic on char types ok. */
+    }
+    else
+    {
+        pxQueue->u.xQueue.pcReadFrom = pcStart + xBytes - pxQueue->uxItemSize; /*lint !e9016 Pointer arithmetic on char types ok. */
+    }
+}
+/*-----------------------------------------------------------*/
+
 static void prvUnlockQueue( Queue_t * const pxQueue )
 {
     /* THIS FUNCTION MUST BE CALLED WITH THE SCHEDULER SUSPENDED. */
@@ -160,6 +160,16 @@ typedef struct StreamBufferDef_t                 /*lint !e9058 Style convention
  */
 static size_t prvBytesInBuffer( const StreamBuffer_t * const pxStreamBuffer ) PRIVILEGED_FUNCTION;
 
+/*
+ * Describe xCount bytes of the buffer's storage area starting at index xStart
+ * as up to two spans, the second starting at the beginning of the storage area
+ * if the bytes wrap around its end.
+ */
+static void prvGetSpans( const StreamBuffer_t * const pxStreamBuffer,
+                         size_t xStart,
+                         size_t xCount,
+                         StreamBufferSpans_t * const pxSpans ) PRIVILEGED_FUNCTION;
+
 /*
  * Add xCount bytes from pucData into the pxStreamBuffer's data storage area.
  * This function does not update the buffer's xHead pointer, so multiple writes
@@ -721,6 +731,119 @@ size_t xStreamBufferSendFromISR( StreamBufferHandle_t xStreamBuffer,
 }
 /*-----------------------------------------------------------*/
 
+size_t xStreamBufferReserve( StreamBufferHandle_t xStreamBuffer,
+                             StreamBufferSpans_t * const pxSpans )
+{
+    StreamBuffer_t * const pxStreamBuffer = xStreamBuffer;
+    size_t xSpace;
+
+    configASSERT( pxStreamBuffer );
+    configASSERT( pxSpans );
+
+    /* Message buffers store a length ahead of every message, which the writer
+     * would have to format itself. */
+    configASSERT( ( pxStreamBuffer->ucFlags & sbFLAGS_IS_MESSAGE_BUFFER ) == ( uint8_t ) 0 );
+
+    /* Only the writer moves xHead, so the free space cannot shrink until the
+     * writer commits. */
+    xSpace = xStreamBufferSpacesAvailable( pxStreamBuffer );
+    prvGetSpans( pxStreamBuffer, pxStreamBuffer->xHead, xSpace, pxSpans );
+
+    return xSpace;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferCommit( StreamBufferHandle_t xStreamBuffer,
+                            size_t xDataLengthBytes )
+{
+    StreamBuffer_t * const pxStreamBuffer = xStreamBuffer;
+    size_t xHead;
+
+    configASSERT( pxStreamBuffer );
+    configASSERT( xDataLengthBytes <= xStreamBufferSpacesAvailable( pxStreamBuffer ) );
+
+    if( xDataLengthBytes > ( size_t ) 0 )
+    {
+        /* The bytes were written in place, publishing them only moves xHead. */
+        xHead = pxStreamBuffer->xHead + xDataLengthBytes;
+
+        if( xHead >= pxStreamBuffer->xLength )
+        {
+            xHead -= pxStreamBuffer->xLength;
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        pxStreamBuffer->xHead = xHead;
+        traceSTREAM_BUFFER_SEND( xStreamBuffer, xDataLengthBytes );
+
+        /* Was a task waiting for the data? */
+        if( prvBytesInBuffer( pxStreamBuffer ) >= pxStreamBuffer->xTriggerLevelBytes )
+        {
+            sbSEND_COMPLETED( pxStreamBuffer );
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    return xDataLengthBytes;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferCommitFromISR( StreamBufferHandle_t xStreamBuffer,
+                                   size_t xDataLengthBytes,
+                                   BaseType_t * const pxHigherPriorityTaskWoken )
+{
+    StreamBuffer_t * const pxStreamBuffer = xStreamBuffer;
+    size_t xHead;
+
+    configASSERT( pxStreamBuffer );
+    configASSERT( xDataLengthBytes <= xStreamBufferSpacesAvailable( pxStreamBuffer ) );
+
+    if( xDataLengthBytes > ( size_t ) 0 )
+    {
+        /* The bytes were written in place, publishing them only moves xHead. */
+        xHead = pxStreamBuffer->xHead + xDataLengthBytes;
+
+        if( xHead >= pxStreamBuffer->xLength )
+        {
+            xHead -= pxStreamBuffer->xLength;
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        pxStreamBuffer->xHead = xHead;
+        traceSTREAM_BUFFER_SEND_FROM_ISR( xStreamBuffer, xDataLengthBytes );
+
+        /* Was a task waiting for the data? */
+        if( prvBytesInBuffer( pxStreamBuffer ) >= pxStreamBuffer->xTriggerLevelBytes )
+        {
+            sbSEND_COMPLETE_FROM_ISR( pxStreamBuffer, pxHigherPriorityTaskWoken );
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    return xDataLengthBytes;
+}
+/*-----------------------------------------------------------*/
+
 static size_t prvWriteMessageToBuffer( StreamBuffer_t * const pxStreamBuffer,
                                        const void * pvTxData,
                                        size_t xDataLengthBytes,
@@ -875,6 +998,123 @@ size_t xStreamBufferReceive( StreamBufferHandle_t xStreamBuffer,
 }
 /*-----------------------------------------------------------*/
 
+size_t xStreamBufferPeek( StreamBufferHandle_t xStreamBuffer,
+                          StreamBufferSpans_t * const pxSpans,
+                          TickType_t xTicksToWait )
+{
+    StreamBuffer_t * const pxStreamBuffer = xStreamBuffer;
+    size_t xBytesAvailable;
+
+    configASSERT( pxStreamBuffer );
+    configASSERT( pxSpans );
+
+    /* Message buffers store a length ahead of every message, which the reader
+     * would have to parse itself. */
+    configASSERT( ( pxStreamBuffer->ucFlags & sbFLAGS_IS_MESSAGE_BUFFER ) == ( uint8_t ) 0 );
+
+    /* Only the writer adds data, so data found here is still there below and
+     * the critical section is only needed when the reader may have to wait. */
+    xBytesAvailable = prvBytesInBuffer( pxStreamBuffer );
+
+    if( ( xBytesAvailable == ( size_t ) 0 ) && ( xTicksToWait != ( TickType_t ) 0 ) )
+    {
+        /* Checking if there is data and clearing the notification state must be
+         * performed atomically. */
+        taskENTER_CRITICAL();
+        {
+            xBytesAvailable = prvBytesInBuffer( pxStreamBuffer );
+
+            if( xBytesAvailable == ( size_t ) 0 )
+            {
+                /* Clear notification state as going to wait for data. */
+                ( void ) xTaskNotifyStateClear( NULL );
+
+                /* Should only be one reader. */
+                configASSERT( pxStreamBuffer->xTaskWaitingToReceive == NULL );
+                pxStreamBuffer->xTaskWaitingToReceive = xTaskGetCurrentTaskHandle();
+            }
+            else
+            {
+                mtCOVERAGE_TEST_MARKER();
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( xBytesAvailable == ( size_t ) 0 )
+        {
+            /* Wait for data to be available. */
+            traceBLOCKING_ON_STREAM_BUFFER_RECEIVE( xStreamBuffer );
+            ( void ) xTaskNotifyWait( ( uint32_t ) 0, ( uint32_t ) 0, NULL, xTicksToWait );
+            pxStreamBuffer->xTaskWaitingToReceive = NULL;
+
+            /* Recheck the data available after blocking. */
+            xBytesAvailable = prvBytesInBuffer( pxStreamBuffer );
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    /* Only the reader moves xTail, so the data stays in place until the reader
+     * consumes it. */
+    prvGetSpans( pxStreamBuffer, pxStreamBuffer->xTail, xBytesAvailable, pxSpans );
+
+    if( xBytesAvailable == ( size_t ) 0 )
+    {
+        traceSTREAM_BUFFER_RECEIVE_FAILED( xStreamBuffer );
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    return xBytesAvailable;
+}
+/*-----------------------------------------------------------*/
+
+size_t xStreamBufferConsume( StreamBufferHandle_t xStreamBuffer,
+                             size_t xDataLengthBytes )
+{
+    StreamBuffer_t * const pxStreamBuffer = xStreamBuffer;
+    size_t xTail;
+
+    configASSERT( pxStreamBuffer );
+    configASSERT( xDataLengthBytes <= prvBytesInBuffer( pxStreamBuffer ) );
+
+    if( xDataLengthBytes > ( size_t ) 0 )
+    {
+        /* Move the tail to effectively remove the bytes read in place. */
+        xTail = pxStreamBuffer->xTail + xDataLengthBytes;
+
+        if( xTail >= pxStreamBuffer->xLength )
+        {
+            xTail -= pxStreamBuffer->xLength;
+        }
+        else
+        {
+            mtCOVERAGE_TEST_MARKER();
+        }
+
+        pxStreamBuffer->xTail = xTail;
+        traceSTREAM_BUFFER_RECEIVE( xStreamBuffer, xDataLengthBytes );
+
+        /* Was a task waiting for space in the buffer? */
+        sbRECEIVE_COMPLETED( pxStreamBuffer );
+    }
+    else
+    {
+        mtCOVERAGE_TEST_MARKER();
+    }
+
+    return xDataLengthBytes;
+}
+/*-----------------------------------------------------------*/
+
 size_t xStreamBufferNextMessageLengthBytes( StreamBufferHandle_t xStreamBuffer )
 {
     StreamBuffer_t * const pxStreamBuffer = xStreamBuffer;
@@ -1235,6 +1475,22 @@ static size_t prvReadBytesFromBuffer( StreamBuffer_t * pxStreamBuffer,
 }
 /*-----------------------------------------------------------*/
 
+static void prvGetSpans( const StreamBuffer_t * const pxStreamBuffer,
+                         size_t xStart,
+                         size_t xCount,
+                         StreamBufferSpans_t * const pxSpans )
+{
+    /* The first span runs up to xCount bytes towards the end of the storage
+     * area, the second holds whatever wrapped around to its start. */
+    const size_t xFirstLength = configMIN( pxStreamBuffer->xLength - xStart, xCount );
+
+    pxSpans->pucData[ 0 ] = ( xFirstLength > ( size_t ) 0 ) ? &( pxStreamBuffer->pucBuffer[ xStart ] ) : NULL;
+    pxSpans->xLength[ 0 ] = xFirstLength;
+    pxSpans->pucData[ 1 ] = ( xCount > xFirstLength ) ? pxStreamBuffer->pucBuffer : NULL;
+    pxSpans->xLength[ 1 ] = xCount - xFirstLength;
+}
+/*-----------------------------------------------------------*/
+
 static size_t prvBytesInBuffer( const StreamBuffer_t * const pxStreamBuffer )
 {
 /* Returns the distance between xTail and xHead. */
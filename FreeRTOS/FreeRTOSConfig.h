@@ -1,31 +1,54 @@
 #ifndef FREERTOS_CONFIG_H
 #define FREERTOS_CONFIG_H
 
-/* Use Pico SDK ISR handlers */
+#if !HOST_SIM && !DUAL_CORE
+/* Use Pico SDK ISR handlers; the RP2040 port used with two cores installs its own */
 #define vPortSVCHandler         isr_svcall
 #define xPortPendSVHandler      isr_pendsv
 #define xPortSysTickHandler     isr_systick
+#endif
 
 #define configUSE_PREEMPTION                    1
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+#if HOST_SIM && SIM_VIRTUAL_TIME
+/* Virtual time: the tick stops while every task is blocked and the idle task
+ * steps it straight to the next wake up or emulated peripheral event */
+#define configUSE_VIRTUAL_TICK                  1
+#define configUSE_TICKLESS_IDLE                 1
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime ) vSimVirtualSleep( xExpectedIdleTime )
+void vSimVirtualSleep( unsigned long xExpectedIdleTime );
+#else
+#define configUSE_VIRTUAL_TICK                  0
 #define configUSE_TICKLESS_IDLE                 0
+#endif
 #define configCPU_CLOCK_HZ                      133000000
 #define configTICK_RATE_HZ                      100
 #define configMAX_PRIORITIES                    5
+#if HOST_SIM
+/* Each task is a pthread on the Posix port and needs a host sized stack */
+#define configMINIMAL_STACK_SIZE                4096
+#else
 #define configMINIMAL_STACK_SIZE                512
+#endif
 #define configMAX_TASK_NAME_LEN                 16
 #define configUSE_16_BIT_TICKS                  0
 #define configIDLE_SHOULD_YIELD                 1
 #define configUSE_TASK_NOTIFICATIONS            1
 #define configTASK_NOTIFICATION_ARRAY_ENTRIES   3
-#define configUSE_MUTEXES                       0
-#define configUSE_RECURSIVE_MUTEXES             0
-#define configUSE_COUNTING_SEMAPHORES           0
+/* lwIP's sys_arch and the CYW43 async context lock need mutexes */
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             1
+#define configUSE_COUNTING_SEMAPHORES           1
 #define configQUEUE_REGISTRY_SIZE               10
 #define configUSE_QUEUE_SETS                    0
 #define configUSE_TIME_SLICING                  0
 #define configUSE_NEWLIB_REENTRANT              0
+#if HOST_SIM
+/* The Posix port still uses portTickType */
+#define configENABLE_BACKWARD_COMPATIBILITY     1
+#else
 #define configENABLE_BACKWARD_COMPATIBILITY     0
+#endif
 #define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
 #define configSTACK_DEPTH_TYPE                  uint16_t
 #define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
@@ -33,18 +56,35 @@
 /* Memory allocation related definitions. */
 #define configSUPPORT_STATIC_ALLOCATION         0
 #define configSUPPORT_DYNAMIC_ALLOCATION        1
-#define configAPPLICATION_ALLOCATED_HEAP        1
+#define configAPPLICATION_ALLOCATED_HEAP        0
+/* Only used by heap_4 and heap_6 (FREERTOS_HEAP); heap_3 uses the C library's heap */
+#if HOST_SIM
+#define configTOTAL_HEAP_SIZE                   ( 1024 * 1024 )
+#else
+#define configTOTAL_HEAP_SIZE                   ( 64 * 1024 )
+#endif
 
 /* Hook function related definitions. */
+#if HOST_SIM
+/* The simulation services its emulated peripherals from the idle hook */
+#define configUSE_IDLE_HOOK                     1
+#else
 #define configUSE_IDLE_HOOK                     0
+#endif
 #define configUSE_TICK_HOOK                     0
 #define configCHECK_FOR_STACK_OVERFLOW          0
 #define configUSE_MALLOC_FAILED_HOOK            0
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
-#define configUSE_TRACE_FACILITY                0
+/* Task run times are counted in microseconds of the 64 bit RP2040 timer, which
+ * never wraps; in the simulation time_us_64() is the simulated clock */
+#define configGENERATE_RUN_TIME_STATS           1
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
+uint64_t time_us_64( void );
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        time_us_64()
+#define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
 /* Co-routine related definitions. */
@@ -70,15 +110,25 @@
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_xTaskGetSchedulerState          1
 #define INCLUDE_xTaskGetCurrentTaskHandle       1
-#define INCLUDE_uxTaskGetStackHighWaterMark     0
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
 #define INCLUDE_xTaskGetIdleTaskHandle          0
 #define INCLUDE_eTaskGetState                   0
 #define INCLUDE_xEventGroupSetBitFromISR        1
+#if DUAL_CORE
+/* The RP2040 port's SDK interop sets event group bits from the cross-core FIFO interrupt */
+#define INCLUDE_xTimerPendFunctionCall          1
+#define configSUPPORT_PICO_SYNC_INTEROP         1
+#define configSUPPORT_PICO_TIME_INTEROP         1
+#else
 #define INCLUDE_xTimerPendFunctionCall          0
+#endif
 #define INCLUDE_xTaskAbortDelay                 0
 #define INCLUDE_xTaskGetHandle                  0
 #define INCLUDE_xTaskResumeFromISR              1
 
-/* A header file that defines trace macro can be included here. */
+/* Kernel events are recorded for tracejson when built with the TRACE option */
+#if TRACE_ENABLED
+#include "trace/trace.h"
+#endif
 
 #endif /* FREERTOS_CONFIG_H */
\ No newline at end of file
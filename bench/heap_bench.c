@@ -0,0 +1,388 @@
+/**
+ * @file heap_bench.c
+ *
+ * @brief Host benchmark of the FreeRTOS heap implementations on the Posix port.
+ *
+ * Built once per heap, as heap_bench_3, heap_bench_4 and heap_bench_6, each
+ * linked with its own portable/MemMang/heap_<n>.c (BENCH_HEAP). Every build
+ * replays the same long random sequence of allocations and frees from a task:
+ * mostly small blocks the size of a meter record, some frames of up to 1 KiB,
+ * a few batches of up to 8 KiB and the odd block of up to 48 KiB, the size of
+ * a task stack. The requested bytes are kept near BENCH_FILL_PERCENT of
+ * configTOTAL_HEAP_SIZE by freeing a random live block whenever they are
+ * above it. One block in BENCH_PINNED_ONE_IN is pinned, so it is only freed
+ * when picked BENCH_PINNED_ONE_IN times, which leaves long lived blocks
+ * scattered through the heap as a running system does.
+ *
+ * It reports the time of every pvPortMalloc() and vPortFree() call, as a mean,
+ * 99th and 99.9th percentile and maximum, the allocations that failed, and,
+ * over the run, the free bytes, the largest free block and the number of free
+ * blocks of heap_4 and heap_6 from vPortGetHeapStats(). heap_3 is the host C
+ * library's malloc here, which neither fails nor reports its free blocks, so
+ * only its times are comparable. heap_6 also prints its size class counters.
+ *
+ * Every block is filled with a pattern that is checked before it is freed,
+ * and heap_4 and heap_6 must have all of their bytes free again at the end.
+ * Once one heap fails an allocation the sequences of the builds differ.
+ *
+ * The maximum includes the host preempting the benchmark thread, so the
+ * percentiles matter more than the maximum.
+ *
+ * Usage: heap_bench_<n> [operations] [seed]
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_OPERATIONS 10000000
+#define BENCH_DEFAULT_SEED 1
+#define BENCH_REPORTS 10
+
+// Most blocks live at once, and the share of the heap their requested bytes are kept near
+#define BENCH_MAX_LIVE 8192
+#define BENCH_FILL_PERCENT 70
+#define BENCH_PINNED_ONE_IN 16
+
+// Call times are counted in 1 ns buckets, and longer ones in the last bucket
+#define BENCH_HISTOGRAM_NS 65536
+
+#define BENCH_HEAP_CLASSES 32
+
+#define BENCH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+typedef struct BENCH_BLOCK_T_
+{
+    uint8_t *data;
+    size_t size;
+    uint8_t pattern;
+    uint8_t pinned;
+} BENCH_BLOCK_T;
+
+typedef struct BENCH_TIMES_T_
+{
+    uint32_t histogram[BENCH_HISTOGRAM_NS];
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} BENCH_TIMES_T;
+
+static size_t xOperations = BENCH_DEFAULT_OPERATIONS;
+static uint64_t ullSeed = BENCH_DEFAULT_SEED;
+
+static BENCH_BLOCK_T xLive[BENCH_MAX_LIVE];
+static size_t xLiveCount;
+static size_t xLiveBytes;
+
+static BENCH_TIMES_T xMallocTimes;
+static BENCH_TIMES_T xFreeTimes;
+static size_t xFailures;
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+// xorshift64*, so every build replays the same sequence for a seed
+static uint32_t prvRandom(void)
+{
+    ullSeed ^= ullSeed >> 12;
+    ullSeed ^= ullSeed << 25;
+    ullSeed ^= ullSeed >> 27;
+    return (uint32_t)((ullSeed * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static size_t prvRandomBetween(size_t xLow, size_t xHigh)
+{
+    return xLow + prvRandom() % (xHigh - xLow + 1);
+}
+
+/**
+ * @brief Pick the size of the next block.
+ *
+ * @return Bytes to request.
+ */
+static size_t prvRandomSize(void)
+{
+    uint32_t ulClass = prvRandom() % 1000;
+
+    if (ulClass < 700)
+    {
+        return prvRandomBetween(16, 96);
+    }
+    if (ulClass < 950)
+    {
+        return prvRandomBetween(97, 1024);
+    }
+    if (ulClass < 998)
+    {
+        return prvRandomBetween(1025, 8 * 1024);
+    }
+    return prvRandomBetween(8 * 1024 + 1, 48 * 1024);
+}
+
+static void prvRecordTime(BENCH_TIMES_T *pxTimes, uint64_t ullNs)
+{
+    pxTimes->histogram[ullNs < BENCH_HISTOGRAM_NS ? ullNs : BENCH_HISTOGRAM_NS - 1]++;
+    pxTimes->calls++;
+    pxTimes->total_ns += ullNs;
+    if (ullNs > pxTimes->max_ns)
+    {
+        pxTimes->max_ns = ullNs;
+    }
+}
+
+/**
+ * @brief Find a percentile of the call times.
+ *
+ * @param pxTimes Call times.
+ * @param dPercent Percentile, 0 to 100.
+ *
+ * @return Time in ns, BENCH_HISTOGRAM_NS - 1 if it is at least that.
+ */
+static uint64_t prvPercentile(const BENCH_TIMES_T *pxTimes, double dPercent)
+{
+    uint64_t ullRank = (uint64_t)((double)pxTimes->calls * dPercent / 100.0);
+    uint64_t ullSeen = 0;
+
+    for (uint64_t i = 0; i < BENCH_HISTOGRAM_NS; i++)
+    {
+        ullSeen += pxTimes->histogram[i];
+        if (ullSeen > ullRank)
+        {
+            return i;
+        }
+    }
+    return BENCH_HISTOGRAM_NS - 1;
+}
+
+/**
+ * @brief Allocate a block of a random size and fill it with its pattern.
+ *
+ * @return None.
+ */
+static void prvAllocate(void)
+{
+    BENCH_BLOCK_T *pxBlock = &xLive[xLiveCount];
+    size_t xSize = prvRandomSize();
+    uint64_t ullStart = prvNowNs();
+    uint8_t *pucData = pvPortMalloc(xSize);
+
+    prvRecordTime(&xMallocTimes, prvNowNs() - ullStart);
+    if (pucData == NULL)
+    {
+        xFailures++;
+        return;
+    }
+
+    pxBlock->data = pucData;
+    pxBlock->size = xSize;
+    pxBlock->pattern = (uint8_t)prvRandom();
+    pxBlock->pinned = prvRandom() % BENCH_PINNED_ONE_IN == 0;
+    memset(pucData, pxBlock->pattern, xSize);
+    xLiveCount++;
+    xLiveBytes += xSize;
+}
+
+/**
+ * @brief Free a random live block, unless it is pinned and not picked this time.
+ *
+ * @return None.
+ */
+static void prvFreeRandom(void)
+{
+    size_t xIndex = prvRandom() % xLiveCount;
+    BENCH_BLOCK_T *pxBlock = &xLive[xIndex];
+    uint64_t ullStart;
+
+    if (pxBlock->pinned && prvRandom() % BENCH_PINNED_ONE_IN != 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < pxBlock->size; i++)
+    {
+        if (pxBlock->data[i] != pxBlock->pattern)
+        {
+            fprintf(stderr, "block of %zu bytes at %p overwritten at byte %zu\n", pxBlock->size,
+                    (void *)pxBlock->data, i);
+            exit(1);
+        }
+    }
+
+    ullStart = prvNowNs();
+    vPortFree(pxBlock->data);
+    prvRecordTime(&xFreeTimes, prvNowNs() - ullStart);
+
+    xLiveBytes -= pxBlock->size;
+    *pxBlock = xLive[--xLiveCount];
+}
+
+/**
+ * @brief Print the state of the heap at a point of the run.
+ *
+ * @param xDone Operations done so far.
+ *
+ * @return None.
+ */
+static void prvReport(size_t xDone)
+{
+#if BENCH_HEAP == 3
+    printf("%12zu %8zu %12zu %12s %12s %8s %10zu\n", xDone, xLiveCount, xLiveBytes, "n/a", "n/a", "n/a", xFailures);
+#else
+    HeapStats_t xStats;
+
+    vPortGetHeapStats(&xStats);
+    printf("%12zu %8zu %12zu %12zu %12zu %8zu %10zu\n", xDone, xLiveCount, xLiveBytes,
+           xStats.xAvailableHeapSpaceInBytes, xStats.xSizeOfLargestFreeBlockInBytes, xStats.xNumberOfFreeBlocks,
+           xFailures);
+#endif
+}
+
+static void prvPrintTimes(const char *pcName, const BENCH_TIMES_T *pxTimes)
+{
+    printf("%-8s %12llu %10.1f %8llu %8llu %10llu\n", pcName, (unsigned long long)pxTimes->calls,
+           pxTimes->calls ? (double)pxTimes->total_ns / (double)pxTimes->calls : 0.0,
+           (unsigned long long)prvPercentile(pxTimes, 99.0), (unsigned long long)prvPercentile(pxTimes, 99.9),
+           (unsigned long long)pxTimes->max_ns);
+}
+
+/**
+ * @brief Run the workload, then end the process.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvBenchTask(void *pvParameters)
+{
+    const size_t xTarget = (size_t)configTOTAL_HEAP_SIZE / 100 * BENCH_FILL_PERCENT;
+#if BENCH_HEAP != 3
+    size_t xFreeAtStart = xPortGetFreeHeapSize();
+#endif
+
+    (void)pvParameters;
+
+    printf("%12s %8s %12s %12s %12s %8s %10s\n", "operations", "blocks", "live bytes", "free bytes", "largest free",
+           "free blks", "failures");
+    for (size_t xDone = 0; xDone < xOperations; xDone++)
+    {
+        if (xLiveCount > 0 && (xLiveBytes > xTarget || xLiveCount == BENCH_MAX_LIVE || prvRandom() % 2 == 0))
+        {
+            prvFreeRandom();
+        }
+        else
+        {
+            prvAllocate();
+        }
+
+        if ((xDone + 1) % (xOperations / BENCH_REPORTS) == 0)
+        {
+            prvReport(xDone + 1);
+        }
+    }
+
+    printf("\n%-8s %12s %10s %8s %8s %10s\n", "call", "calls", "mean ns", "p99 ns", "p99.9 ns", "max ns");
+    prvPrintTimes("malloc", &xMallocTimes);
+    prvPrintTimes("free", &xFreeTimes);
+
+#if BENCH_HEAP == 6
+    {
+        HeapClassStats_t xClasses[BENCH_HEAP_CLASSES];
+        UBaseType_t uxClasses = uxPortGetHeapClassStats(xClasses, BENCH_HEAP_CLASSES);
+
+        printf("\n%12s %10s %10s %12s %10s\n", "class from", "free", "allocated", "allocations", "failures");
+        for (UBaseType_t i = 0; i < uxClasses; i++)
+        {
+            if (xClasses[i].xNumberOfSuccessfulAllocations == 0 && xClasses[i].xNumberOfFailedAllocations == 0 &&
+                xClasses[i].xFreeBlocks == 0)
+            {
+                continue;
+            }
+            printf("%12zu %10zu %10zu %12zu %10zu\n", xClasses[i].xMinimumBlockSize, xClasses[i].xFreeBlocks,
+                   xClasses[i].xAllocatedBlocks, xClasses[i].xNumberOfSuccessfulAllocations,
+                   xClasses[i].xNumberOfFailedAllocations);
+        }
+    }
+#endif
+
+    for (size_t i = 0; i < xLiveCount; i++)
+    {
+        xLive[i].pinned = 0;
+    }
+    while (xLiveCount > 0)
+    {
+        prvFreeRandom();
+    }
+
+#if BENCH_HEAP != 3
+    if (xPortGetFreeHeapSize() != xFreeAtStart)
+    {
+        fprintf(stderr, "%zu bytes free after freeing every block, %zu before the first\n", xPortGetFreeHeapSize(),
+                xFreeAtStart);
+        exit(1);
+    }
+    printf("\nevery block checked and freed, %zu bytes free again\n", xFreeAtStart);
+#else
+    printf("\nevery block checked and freed\n");
+#endif
+
+    exit(0);
+}
+
+// Nothing to service while the benchmark task runs
+void vApplicationIdleHook(void)
+{
+}
+
+// Run time stats are counted in host microseconds
+uint64_t time_us_64(void)
+{
+    return prvNowNs() / 1000;
+}
+
+#if configUSE_VIRTUAL_TICK
+// The benchmark never waits for a time out, so there is no virtual clock to advance
+void vSimVirtualSleep(unsigned long xExpectedIdleTime)
+{
+    (void)xExpectedIdleTime;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        xOperations = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2)
+    {
+        ullSeed = strtoull(argv[2], NULL, 0);
+    }
+    if (xOperations < BENCH_REPORTS)
+    {
+        xOperations = BENCH_REPORTS;
+    }
+    if (ullSeed == 0)
+    {
+        ullSeed = BENCH_DEFAULT_SEED;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("heap_%d, %u byte heap, %zu operations, seed %llu\n", BENCH_HEAP, (unsigned)configTOTAL_HEAP_SIZE,
+           xOperations, (unsigned long long)ullSeed);
+
+    xTaskCreate(prvBenchTask, "Bench", configMINIMAL_STACK_SIZE, NULL, BENCH_TASK_PRIORITY, NULL);
+    vTaskStartScheduler();
+
+    return 1;
+}
@@ -0,0 +1,282 @@
+/**
+ * @file ingest_bench.c
+ *
+ * @brief Loopback benchmark of the controller's ingest server.
+ *
+ * Starts an ingest server on 127.0.0.1 and opens many device connections to
+ * it from a few client threads. Every connection sends a hello frame and then
+ * segments of TCP_BATCH_MAX_RECORDS-sized batches, like the firmware's uplink,
+ * either as fast as the server takes them or paced to an offered load. Each
+ * record carries the microsecond clock at the moment it was encoded in its
+ * time_ms field, so the sink can measure ingest latency from encode to
+ * delivery. Reports sustained records/s and the latency percentiles once every
+ * record has arrived. The server's ACK frames are read and discarded once a
+ * connection is done. Unpaced, latency is mostly queueing in socket buffers;
+ * pace below the unpaced throughput to see the server's own latency.
+ *
+ * Usage: ingest_bench [connections] [records per connection] [shards] [client threads] [records/s, 0 = unpaced]
+ */
+
+#define _GNU_SOURCE
+
+// Standard includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Linux includes
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Project includes
+#include "ingest_server.h"
+#include "latency_histogram.h"
+
+#define BENCH_DEFAULT_CONNECTIONS 1000
+#define BENCH_DEFAULT_RECORDS 2000
+#define BENCH_DEFAULT_CLIENTS 4
+#define BENCH_BATCH_RECORDS 16
+
+typedef struct BENCH_CLIENT_T_
+{
+    pthread_t thread;
+    uint16_t port;
+    unsigned first;
+    unsigned count;
+    size_t records;
+    double rate;
+} BENCH_CLIENT_T;
+
+// One histogram per shard, so the sink never takes a lock
+static LATENCY_HISTOGRAM_T xHistogram[INGEST_MAX_SHARDS];
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+static uint32_t prvNowUs(void)
+{
+    return (uint32_t)(prvNowNs() / 1000);
+}
+
+static void prvOnRecord(void *pvCtx, unsigned uShard, const char *pcDeviceId, const WIRE_RECORD_T *pxRecord)
+{
+    (void)pvCtx;
+    (void)pcDeviceId;
+
+    vLatencyHistogramAdd(&xHistogram[uShard], prvNowUs() - pxRecord->time_ms);
+}
+
+static int prvConnect(uint16_t usPort)
+{
+    struct sockaddr_in xAddr = {.sin_family = AF_INET, .sin_port = htons(usPort), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&xAddr, sizeof(xAddr)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+static int prvSendAll(int fd, const uint8_t *pucData, size_t xLen)
+{
+    while (xLen > 0)
+    {
+        ssize_t xSent = send(fd, pucData, xLen, MSG_NOSIGNAL);
+
+        if (xSent <= 0)
+        {
+            return -1;
+        }
+        pucData += xSent;
+        xLen -= (size_t)xSent;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Drive a share of the connections, one batch per connection in turn.
+ */
+static void *prvClientThread(void *pvArg)
+{
+    BENCH_CLIENT_T *pxClient = pvArg;
+    int *piFd = calloc(pxClient->count, sizeof(int));
+    WIRE_CODEC_T *pxCodec = calloc(pxClient->count, sizeof(WIRE_CODEC_T));
+    uint8_t ucSegment[WIRE_MAX_HELLO_LEN + BENCH_BATCH_RECORDS * WIRE_MAX_RECORD_LEN];
+    uint64_t ullStart;
+
+    for (unsigned i = 0; i < pxClient->count; i++)
+    {
+        char cDeviceId[WIRE_MAX_DEVICE_ID_LEN + 1];
+
+        snprintf(cDeviceId, sizeof(cDeviceId), "BENCH%05u", pxClient->first + i);
+        piFd[i] = prvConnect(pxClient->port);
+        if (piFd[i] < 0)
+        {
+            perror("connect");
+            exit(1);
+        }
+        size_t xLen = xWireEncodeHello(&pxCodec[i], ucSegment, sizeof(ucSegment), cDeviceId);
+        if (prvSendAll(piFd[i], ucSegment, xLen) != 0)
+        {
+            perror("send");
+            exit(1);
+        }
+    }
+
+    ullStart = prvNowNs();
+
+    for (size_t xSent = 0; xSent < pxClient->records; xSent += BENCH_BATCH_RECORDS)
+    {
+        // Hold back until this round is due at the offered rate
+        if (pxClient->rate > 0)
+        {
+            uint64_t ullDue = ullStart + (uint64_t)((double)xSent * pxClient->count / pxClient->rate * 1e9);
+            uint64_t ullNow = prvNowNs();
+
+            if (ullDue > ullNow)
+            {
+                struct timespec xSleep = {.tv_sec = (time_t)((ullDue - ullNow) / 1000000000ULL),
+                                          .tv_nsec = (long)((ullDue - ullNow) % 1000000000ULL)};
+                nanosleep(&xSleep, NULL);
+            }
+        }
+
+        size_t xBatch = pxClient->records - xSent < BENCH_BATCH_RECORDS ? pxClient->records - xSent : BENCH_BATCH_RECORDS;
+
+        for (unsigned i = 0; i < pxClient->count; i++)
+        {
+            size_t xLen = 0;
+
+            for (size_t j = 0; j < xBatch; j++)
+            {
+                WIRE_RECORD_T xRecord = {
+                    .seq = (uint32_t)(xSent + j + 1),
+                    .time_ms = prvNowUs(),
+                    .volume_milli = (int32_t)(1000 + (xSent + j) % 5000),
+                    .mean_flow_milli = 2500,
+                    .min_flow_milli = 2000,
+                    .max_flow_milli = 3000,
+                    .stddev_flow_milli = 150,
+                    .duration_ms = 30000,
+                    .count = 30,
+                };
+                xLen += xWireEncodeRecord(&pxCodec[i], &ucSegment[xLen], sizeof(ucSegment) - xLen, &xRecord);
+            }
+            if (prvSendAll(piFd[i], ucSegment, xLen) != 0)
+            {
+                perror("send");
+                exit(1);
+            }
+        }
+    }
+
+    // Closing with the server's ACKs unread would reset the connection and discard records it has not read yet
+    for (unsigned i = 0; i < pxClient->count; i++)
+    {
+        uint8_t ucDrain[256];
+
+        shutdown(piFd[i], SHUT_WR);
+        while (recv(piFd[i], ucDrain, sizeof(ucDrain), 0) > 0)
+        {
+        }
+        close(piFd[i]);
+    }
+    free(pxCodec);
+    free(piFd);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned uConnections = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_CONNECTIONS;
+    size_t xRecords = argc > 2 ? strtoul(argv[2], NULL, 0) : BENCH_DEFAULT_RECORDS;
+    long lShards = argc > 3 ? strtol(argv[3], NULL, 0) : sysconf(_SC_NPROCESSORS_ONLN) / 2;
+    unsigned uClients = argc > 4 ? (unsigned)strtoul(argv[4], NULL, 0) : BENCH_DEFAULT_CLIENTS;
+    double dRate = argc > 5 ? strtod(argv[5], NULL) : 0;
+    INGEST_SINK_T xSink = {.record = prvOnRecord};
+    INGEST_STATS_T xStats;
+    uint64_t ullTotal = (uint64_t)uConnections * xRecords;
+
+    if (lShards < 1)
+    {
+        lShards = 1;
+    }
+    if (uConnections == 0 || xRecords == 0 || uClients == 0 || uClients > uConnections || lShards > INGEST_MAX_SHARDS)
+    {
+        fprintf(stderr, "usage: %s [connections] [records per connection] [shards] [client threads] [records/s]\n", argv[0]);
+        return 1;
+    }
+
+    INGEST_SERVER_T *pxServer = pxIngestServerStart("127.0.0.1", 0, (unsigned)lShards, &xSink);
+    if (pxServer == NULL)
+    {
+        perror("server");
+        return 1;
+    }
+
+    printf("%u connections x %zu records, %ld shards, %u client threads, ", uConnections, xRecords, lShards, uClients);
+    if (dRate > 0)
+    {
+        printf("%.0f records/s offered\n", dRate);
+    }
+    else
+    {
+        printf("unpaced\n");
+    }
+
+    BENCH_CLIENT_T *pxClients = calloc(uClients, sizeof(BENCH_CLIENT_T));
+    uint64_t ullStart = prvNowNs();
+
+    for (unsigned i = 0; i < uClients; i++)
+    {
+        pxClients[i].port = usIngestServerPort(pxServer);
+        pxClients[i].first = uConnections * i / uClients;
+        pxClients[i].count = uConnections * (i + 1) / uClients - pxClients[i].first;
+        pxClients[i].records = xRecords;
+        pxClients[i].rate = dRate * pxClients[i].count / uConnections;
+        pthread_create(&pxClients[i].thread, NULL, prvClientThread, &pxClients[i]);
+    }
+    for (unsigned i = 0; i < uClients; i++)
+    {
+        pthread_join(pxClients[i].thread, NULL);
+    }
+
+    // Wait for the server to decode everything the clients sent
+    do
+    {
+        vIngestServerStats(pxServer, &xStats);
+    } while (xStats.records < ullTotal && prvNowNs() - ullStart < 120ULL * 1000000000ULL);
+
+    double dSeconds = (double)(prvNowNs() - ullStart) / 1e9;
+
+    vIngestServerStop(pxServer);
+
+    LATENCY_HISTOGRAM_T xMerged = {0};
+    for (long s = 0; s < lShards; s++)
+    {
+        vLatencyHistogramMerge(&xMerged, &xHistogram[s]);
+    }
+
+    printf("%-24s %llu of %llu\n", "records", (unsigned long long)xMerged.count, (unsigned long long)ullTotal);
+    printf("%-24s %.3f s\n", "elapsed", dSeconds);
+    printf("%-24s %.0f records/s\n", "throughput", (double)xMerged.count / dSeconds);
+    vLatencyHistogramPrint(&xMerged, "latency", "us");
+
+    free(pxClients);
+
+    return xMerged.count == ullTotal ? 0 : 1;
+}
@@ -0,0 +1,374 @@
+/**
+ * @file meter_parser_bench.c
+ *
+ * @brief Host micro-benchmark of the meter line parser.
+ *
+ * Compares the fixed point parser against the strtok_r()/atof() path that
+ * vTaskUART used before, both for parsing alone and for parsing plus building
+ * the outbound record. Before timing, every line of the corpus is parsed both
+ * ways and the results are cross-checked, values past the limits are checked
+ * to be rejected, and the volume tracker is checked to account wraps and
+ * restarts but not implausible steps.
+ *
+ * Usage: meter_parser_bench [lines] [rounds]
+ */
+
+// Standard includes
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#else
+#define BENCH_HAVE_TSC 0
+#endif
+
+// Project includes
+#include "meter/meter_parser.h"
+#include "meter/volume_tracker.h"
+
+#define BENCH_LINE_LEN 32
+#define BENCH_DEFAULT_LINES 4096
+#define BENCH_DEFAULT_ROUNDS 200
+#define BENCH_DEVICE_ID "BENCH01"
+
+typedef struct BENCH_LINE_T_
+{
+    char line[BENCH_LINE_LEN];
+    size_t len;
+} BENCH_LINE_T;
+
+typedef struct BENCH_RESULT_T_
+{
+    double ns_per_line;
+    double ticks_per_line;
+} BENCH_RESULT_T;
+
+// Keeps the compiler from discarding the work being measured
+static volatile int32_t lSink;
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+static uint64_t prvNowTicks(void)
+{
+#if BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Legacy path: tokenise a private copy and convert with atof().
+ */
+static int prvLegacyParse(const BENCH_LINE_T *pxLine, char *pcScratch, double *pdVolume, double *pdFlow)
+{
+    char *pcSave = NULL;
+
+    memcpy(pcScratch, pxLine->line, pxLine->len + 1);
+
+    char *pcVolume = strtok_r(pcScratch, ",", &pcSave);
+    char *pcFlow = strtok_r(NULL, ",", &pcSave);
+
+    if (pcVolume == NULL || pcFlow == NULL)
+    {
+        return 0;
+    }
+
+    *pdVolume = atof(pcVolume);
+    *pdFlow = atof(pcFlow);
+
+    return 1;
+}
+
+/**
+ * @brief Legacy path plus the calloc()/snprintf("%.2f") record vTaskUART built.
+ */
+static int prvLegacyRecord(const BENCH_LINE_T *pxLine, char *pcScratch)
+{
+    char *pcSave = NULL;
+
+    memcpy(pcScratch, pxLine->line, pxLine->len + 1);
+
+    char *pcVolume = strtok_r(pcScratch, ",", &pcSave);
+    char *pcFlow = strtok_r(NULL, ",", &pcSave);
+
+    if (pcVolume == NULL || pcFlow == NULL)
+    {
+        return 0;
+    }
+
+    char *pcSend = calloc(BENCH_LINE_LEN, sizeof(char));
+    int iLen = snprintf(pcSend, BENCH_LINE_LEN, "%s,%.2f,%s", pcVolume, atof(pcFlow), BENCH_DEVICE_ID);
+    lSink += pcSend[0];
+    free(pcSend);
+
+    return iLen;
+}
+
+/**
+ * @brief Fixed point path plus the record vTaskUART builds now.
+ */
+static int prvFixedRecord(const BENCH_LINE_T *pxLine, char *pcScratch)
+{
+    METER_SAMPLE_T xSample;
+    char cVolume[METER_FIELD_STR_LEN];
+    char cFlow[METER_FIELD_STR_LEN];
+
+    if (eMeterParseLine(pxLine->line, pxLine->len, &xSample) != METER_PARSE_OK)
+    {
+        return 0;
+    }
+
+    xMeterFormatMilli(cVolume, sizeof(cVolume), xSample.volume_milli);
+    xMeterFormatMilli(cFlow, sizeof(cFlow), xSample.flow_milli);
+
+    return snprintf(pcScratch, BENCH_LINE_LEN, "%s,%s,%s", cVolume, cFlow, BENCH_DEVICE_ID);
+}
+
+/**
+ * @brief Build a corpus shaped like meter output, with a few malformed lines.
+ */
+static void prvBuildCorpus(BENCH_LINE_T *pxLines, size_t xCount)
+{
+    srand(1);
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        double dVolume = (rand() % 10000000) / 100.0;
+        double dFlow = (rand() % 3) == 0 ? 0.0 : (rand() % 10000) / 100.0;
+
+        if (i % 64 == 63)
+        {
+            pxLines[i].len = (size_t)snprintf(pxLines[i].line, BENCH_LINE_LEN, "%.2f", dVolume);
+        }
+        else
+        {
+            pxLines[i].len = (size_t)snprintf(pxLines[i].line, BENCH_LINE_LEN, "%.2f,%.2f", dVolume, dFlow);
+        }
+    }
+}
+
+/**
+ * @brief Cross-check the fixed point results against atof() and "%.2f".
+ */
+static size_t prvVerify(const BENCH_LINE_T *pxLines, size_t xCount)
+{
+    char cScratch[BENCH_LINE_LEN];
+    char cExpected[METER_FIELD_STR_LEN];
+    char cActual[METER_FIELD_STR_LEN];
+    size_t xMismatches = 0;
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        METER_SAMPLE_T xSample;
+        double dVolume;
+        double dFlow;
+        int iLegacy = prvLegacyParse(&pxLines[i], cScratch, &dVolume, &dFlow);
+        int iFixed = eMeterParseLine(pxLines[i].line, pxLines[i].len, &xSample) == METER_PARSE_OK;
+
+        if (iLegacy != iFixed ||
+            (iFixed && (llround(dVolume * METER_SCALE) != xSample.volume_milli ||
+                        llround(dFlow * METER_SCALE) != xSample.flow_milli)))
+        {
+            printf("mismatch: \"%s\"\n", pxLines[i].line);
+            xMismatches++;
+            continue;
+        }
+
+        if (iFixed)
+        {
+            snprintf(cExpected, sizeof(cExpected), "%.2f", dFlow);
+            xMeterFormatMilli(cActual, sizeof(cActual), xSample.flow_milli);
+            if (strcmp(cExpected, cActual) != 0)
+            {
+                printf("format mismatch: %s != %s\n", cActual, cExpected);
+                xMismatches++;
+            }
+        }
+    }
+
+    return xMismatches;
+}
+
+/**
+ * @brief Check that lines with values out of range are rejected, not wrapped.
+ */
+static size_t prvVerifyRejects(void)
+{
+    static const struct
+    {
+        const char *line;
+        METER_PARSE_RESULT_T result;
+    } xCases[] = {
+        {"1000000,1.5", METER_PARSE_OK},
+        {"1000000.001,0", METER_PARSE_OUT_OF_RANGE},
+        {"3000000,1.5", METER_PARSE_OUT_OF_RANGE},
+        {"4294968,0", METER_PARSE_OUT_OF_RANGE},
+        {"9999999,2", METER_PARSE_OUT_OF_RANGE},
+        {"10000000,0", METER_PARSE_OUT_OF_RANGE},
+        {"0,4294968", METER_PARSE_OUT_OF_RANGE},
+        {"0,10000.001", METER_PARSE_OUT_OF_RANGE},
+    };
+    size_t xMismatches = 0;
+
+    for (size_t i = 0; i < sizeof(xCases) / sizeof(xCases[0]); i++)
+    {
+        METER_SAMPLE_T xSample;
+        METER_PARSE_RESULT_T eResult = eMeterParseLine(xCases[i].line, strlen(xCases[i].line), &xSample);
+
+        if (eResult != xCases[i].result)
+        {
+            printf("range mismatch: \"%s\" gave %d, expected %d\n", xCases[i].line, (int)eResult,
+                   (int)xCases[i].result);
+            xMismatches++;
+        }
+    }
+
+    return xMismatches;
+}
+
+/**
+ * @brief Check the volume the tracker accounts for a sequence of readings.
+ */
+static size_t prvVerifyTracker(void)
+{
+    static const struct
+    {
+        int32_t volume;
+        int32_t delta;
+    } xReadings[] = {
+        {1000, 0},                                   // Baseline
+        {1500, 500},                                 // Normal step
+        {1001500, METER_MAX_STEP_MILLI},             // Largest step accepted
+        {900000000, 0},                              // Corrupted reading, resync
+        {1002000, 0},                                // Back from it, too far from 0 for a restart, resync
+        {1002500, 500},                              // Normal step from the new baseline
+        {1002500 + METER_MAX_STEP_MILLI + 1, 0},     // Step just over the limit, resync
+        {METER_VOLUME_WRAP_MILLI - 1000, 0},         // Resync
+        {500, 1500},                                 // Counter wrap
+        {300, 300},                                  // Meter restart
+    };
+    VOLUME_TRACKER_T xTracker;
+    int32_t lTotal = 0;
+    size_t xMismatches = 0;
+
+    vVolumeTrackerReset(&xTracker);
+
+    for (size_t i = 0; i < sizeof(xReadings) / sizeof(xReadings[0]); i++)
+    {
+        int32_t lDelta = lVolumeTrackerUpdate(&xTracker, xReadings[i].volume);
+
+        if (lDelta != xReadings[i].delta)
+        {
+            printf("tracker mismatch: reading %ld gave %ld, expected %ld\n", (long)xReadings[i].volume, (long)lDelta,
+                   (long)xReadings[i].delta);
+            xMismatches++;
+        }
+        lTotal += xReadings[i].delta;
+    }
+
+    if (lVolumeTrackerTake(&xTracker) != lTotal || xTracker.wraps != 1 || xTracker.restarts != 1 ||
+        xTracker.resyncs != 4)
+    {
+        printf("tracker mismatch: %lu wraps, %lu restarts, %lu resyncs\n", (unsigned long)xTracker.wraps,
+               (unsigned long)xTracker.restarts, (unsigned long)xTracker.resyncs);
+        xMismatches++;
+    }
+
+    return xMismatches;
+}
+
+#define BENCH_RUN(pxResult, xCount, xRounds, ...)                                    \
+    do                                                                               \
+    {                                                                                \
+        uint64_t ullStartNs = prvNowNs();                                            \
+        uint64_t ullStartTicks = prvNowTicks();                                      \
+        for (size_t r = 0; r < (xRounds); r++)                                       \
+        {                                                                            \
+            for (size_t i = 0; i < (xCount); i++)                                    \
+            {                                                                        \
+                __VA_ARGS__;                                                          \
+            }                                                                        \
+        }                                                                            \
+        uint64_t ullTicks = prvNowTicks() - ullStartTicks;                           \
+        uint64_t ullNs = prvNowNs() - ullStartNs;                                    \
+        (pxResult)->ns_per_line = (double)ullNs / (double)((xCount) * (xRounds));    \
+        (pxResult)->ticks_per_line = (double)ullTicks / (double)((xCount) * (xRounds)); \
+    } while (0)
+
+static void prvReport(const char *pcName, const BENCH_RESULT_T *pxResult, const BENCH_RESULT_T *pxBaseline)
+{
+    printf("%-24s %8.1f ns/line", pcName, pxResult->ns_per_line);
+    if (BENCH_HAVE_TSC)
+    {
+        printf(" %8.1f TSC ticks/line", pxResult->ticks_per_line);
+    }
+    if (pxBaseline != NULL)
+    {
+        printf("  (%.1fx)", pxBaseline->ns_per_line / pxResult->ns_per_line);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t xCount = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_LINES;
+    size_t xRounds = argc > 2 ? strtoul(argv[2], NULL, 0) : BENCH_DEFAULT_ROUNDS;
+    BENCH_LINE_T *pxLines = calloc(xCount, sizeof(BENCH_LINE_T));
+    char cScratch[BENCH_LINE_LEN];
+    BENCH_RESULT_T xLegacyParse, xFixedParse, xLegacyRecord, xFixedRecord;
+
+    if (pxLines == NULL || xCount == 0 || xRounds == 0)
+    {
+        fprintf(stderr, "usage: %s [lines] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    prvBuildCorpus(pxLines, xCount);
+
+    size_t xMismatches = prvVerify(pxLines, xCount) + prvVerifyRejects() + prvVerifyTracker();
+    if (xMismatches != 0)
+    {
+        printf("%zu mismatches, not timing\n", xMismatches);
+        return 1;
+    }
+
+    printf("%zu lines x %zu rounds\n", xCount, xRounds);
+
+    BENCH_RUN(&xLegacyParse, xCount, xRounds, {
+        double dVolume, dFlow;
+        if (prvLegacyParse(&pxLines[i], cScratch, &dVolume, &dFlow))
+        {
+            lSink += (int32_t)dFlow;
+        }
+    });
+    BENCH_RUN(&xFixedParse, xCount, xRounds, {
+        METER_SAMPLE_T xSample;
+        if (eMeterParseLine(pxLines[i].line, pxLines[i].len, &xSample) == METER_PARSE_OK)
+        {
+            lSink += xSample.flow_milli;
+        }
+    });
+    BENCH_RUN(&xLegacyRecord, xCount, xRounds, lSink += prvLegacyRecord(&pxLines[i], cScratch));
+    BENCH_RUN(&xFixedRecord, xCount, xRounds, lSink += prvFixedRecord(&pxLines[i], cScratch));
+
+    prvReport("parse strtok_r/atof", &xLegacyParse, NULL);
+    prvReport("parse fixed point", &xFixedParse, &xLegacyParse);
+    prvReport("record calloc/%.2f", &xLegacyRecord, NULL);
+    prvReport("record fixed point", &xFixedRecord, &xLegacyRecord);
+
+    free(pxLines);
+
+    return 0;
+}
@@ -0,0 +1,314 @@
+/**
+ * @file outbox_bench.c
+ *
+ * @brief Host benchmark of the flash outbox on the simulated QSPI flash.
+ *
+ * Before timing, the outbox is checked against a reboot with records pending,
+ * a torn slot and a full ring. Then it measures the steady state append rate
+ * with an acknowledgement every batch, replay of a full outbox after an outage,
+ * and the boot scan of a full log. The flash counters give page programs and
+ * erases per record, the erase amplification (bytes erased per byte of record
+ * frame stored) and the spread of erases over the outbox sectors. The device
+ * flash time is estimated from them with the typical W25Q16JV figures.
+ *
+ * Usage: outbox_bench [records] [batch]
+ */
+
+// Standard includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Project includes
+#include "drivers/flash/outbox.h"
+#include "protocol/wire_format.h"
+
+// Simulation includes
+#include "sim_flash.h"
+
+#define BENCH_DEFAULT_RECORDS 200000
+#define BENCH_DEFAULT_BATCH 16
+
+// Typical W25Q16JV page program and sector erase times
+#define BENCH_PAGE_PROGRAM_US 400
+#define BENCH_SECTOR_ERASE_US 45000
+
+// Keeps the compiler from discarding the work being measured
+static volatile int32_t lSink;
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+/**
+ * @brief Build the usage event with the given index, shaped like household water use.
+ */
+static WIRE_RECORD_T prvRecord(uint32_t ulIndex)
+{
+    uint32_t ulHash = ulIndex * 2654435761u;
+    int32_t lMean = 500 + (int32_t)(ulHash % 20000);
+    int32_t lSpread = (int32_t)((ulHash >> 8) % 2000);
+
+    return (WIRE_RECORD_T){
+        .time_ms = ulIndex * 60000u,
+        .volume_milli = (int32_t)((ulHash >> 4) % 200000),
+        .mean_flow_milli = lMean,
+        .min_flow_milli = lMean - lSpread,
+        .max_flow_milli = lMean + (int32_t)((ulHash >> 12) % 2000),
+        .stddev_flow_milli = lSpread / 3,
+        .duration_ms = 1000 + (ulHash >> 16) % 300000,
+        .count = 1 + (ulHash >> 20) % 300,
+    };
+}
+
+/**
+ * @brief Erase the outbox region, as on a new device.
+ */
+static void prvErase(void)
+{
+    flash_range_erase(OUTBOX_OFFSET, OUTBOX_SECTORS * FLASH_SECTOR_SIZE);
+}
+
+/**
+ * @brief Read every pending record and check that they are the next ones expected, in sequence.
+ *
+ * @return Number of records read, or SIZE_MAX on a mismatch.
+ */
+static size_t prvReplay(OUTBOX_T *pxOutbox, uint32_t ulFirst, size_t xBatch)
+{
+    WIRE_RECORD_T xRecords[BENCH_DEFAULT_BATCH * 4];
+    uint32_t ulSeq = pxOutbox->acked_seq;
+    size_t xTotal = 0;
+    size_t xRead;
+
+    if (xBatch > sizeof(xRecords) / sizeof(xRecords[0]))
+    {
+        xBatch = sizeof(xRecords) / sizeof(xRecords[0]);
+    }
+
+    while ((xRead = xOutboxRead(pxOutbox, xRecords, xBatch)) > 0)
+    {
+        for (size_t i = 0; i < xRead; i++)
+        {
+            WIRE_RECORD_T xExpected = prvRecord(ulFirst + (uint32_t)(xTotal + i));
+
+            // The outbox numbered the records as they were appended
+            xExpected.seq = xRecords[i].seq;
+            if (xRecords[i].seq <= ulSeq || memcmp(&xRecords[i], &xExpected, sizeof(xExpected)) != 0)
+            {
+                printf("record %zu mismatch\n", xTotal + i);
+                return SIZE_MAX;
+            }
+            ulSeq = xRecords[i].seq;
+        }
+        xTotal += xRead;
+        xOutboxAck(pxOutbox, ulSeq);
+    }
+
+    return xTotal;
+}
+
+/**
+ * @brief Check recovery across a reboot, a torn slot and a full ring.
+ */
+static size_t prvVerify(void)
+{
+    OUTBOX_T xOutbox;
+    WIRE_RECORD_T xRecord;
+    WIRE_RECORD_T xSecond = {0};
+    size_t xFailures = 0;
+    uint32_t ulHalf = OUTBOX_CAPACITY / 2;
+
+    // Records pending before a reboot are all replayed after it, and acknowledged ones are not
+    prvErase();
+    vOutboxInit(&xOutbox);
+    for (uint32_t i = 0; i < ulHalf; i++)
+    {
+        xRecord = prvRecord(i);
+        xOutboxAppend(&xOutbox, &xRecord);
+    }
+    vOutboxInit(&xOutbox);
+    if (ulOutboxPending(&xOutbox) != ulHalf || prvReplay(&xOutbox, 0, BENCH_DEFAULT_BATCH) != ulHalf)
+    {
+        printf("reboot: %lu of %lu records pending\n", (unsigned long)ulOutboxPending(&xOutbox),
+               (unsigned long)ulHalf);
+        xFailures++;
+    }
+    vOutboxInit(&xOutbox);
+    if (ulOutboxPending(&xOutbox) != 0 || xOutboxRead(&xOutbox, &xRecord, 1) != 0)
+    {
+        printf("reboot: acknowledged records replayed again\n");
+        xFailures++;
+    }
+
+    // A slot torn by a reset is skipped, the records around it survive
+    prvErase();
+    vOutboxInit(&xOutbox);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        xRecord = prvRecord(i);
+        xOutboxAppend(&xOutbox, &xRecord);
+    }
+    {
+        uint32_t ulOffset = OUTBOX_OFFSET + 2 * OUTBOX_SLOT_LEN;
+        uint8_t ucPage[FLASH_PAGE_SIZE];
+
+        // Clear a bit of the frame type as an interrupted program would
+        memset(ucPage, 0xFF, sizeof(ucPage));
+        ucPage[ulOffset % FLASH_PAGE_SIZE + 8] = (uint8_t)~WIRE_FRAME_RECORD;
+        flash_range_program(ulOffset - ulOffset % FLASH_PAGE_SIZE, ucPage, sizeof(ucPage));
+    }
+    vOutboxInit(&xOutbox);
+    if (xOutbox.stats.torn != 1 || xOutboxRead(&xOutbox, &xRecord, 1) != 1 || xRecord.seq != 1 ||
+        xOutboxRead(&xOutbox, &xSecond, 1) != 1 || xSecond.seq != 3)
+    {
+        printf("torn slot: %lu torn, sequence %lu after %lu\n", (unsigned long)xOutbox.stats.torn,
+               (unsigned long)xSecond.seq, (unsigned long)xRecord.seq);
+        xFailures++;
+    }
+
+    // A full ring gives up its oldest records, the newest are replayed in order
+    prvErase();
+    vOutboxInit(&xOutbox);
+    for (uint32_t i = 0; i < OUTBOX_CAPACITY + ulHalf; i++)
+    {
+        xRecord = prvRecord(i);
+        xOutboxAppend(&xOutbox, &xRecord);
+    }
+    uint32_t ulPending = ulOutboxPending(&xOutbox);
+    uint32_t ulLost = xOutbox.stats.lost;
+    if (ulPending + ulLost != OUTBOX_CAPACITY + ulHalf || ulPending < OUTBOX_CAPACITY - (OUTBOX_SLOTS_PER_SECTOR - 1))
+    {
+        printf("full ring: %lu pending, %lu lost\n", (unsigned long)ulPending, (unsigned long)ulLost);
+        xFailures++;
+    }
+    vOutboxInit(&xOutbox);
+    if (ulOutboxPending(&xOutbox) != ulPending || prvReplay(&xOutbox, ulLost, BENCH_DEFAULT_BATCH) != ulPending)
+    {
+        printf("full ring: replay after reboot does not match\n");
+        xFailures++;
+    }
+
+    return xFailures;
+}
+
+static void prvPrintFlash(const char *pcName, const SIM_FLASH_STATS_T *pxBefore, uint32_t ulRecords,
+                          uint64_t ullFrameBytes)
+{
+    SIM_FLASH_STATS_T xAfter;
+    uint64_t ullPrograms;
+    uint64_t ullErases;
+
+    vSimFlashStats(&xAfter);
+    ullPrograms = xAfter.page_programs - pxBefore->page_programs;
+    ullErases = xAfter.sector_erases - pxBefore->sector_erases;
+
+    printf("%-24s %8.3f programs/record %8.4f erases/record", pcName, (double)ullPrograms / ulRecords,
+           (double)ullErases / ulRecords);
+    if (ullFrameBytes > 0)
+    {
+        printf("  erase amplification %.1f", (double)(ullErases * FLASH_SECTOR_SIZE) / (double)ullFrameBytes);
+    }
+    printf("\n%-24s %8.1f ms flash time per 1000 records on the device\n", "",
+           (double)(ullPrograms * BENCH_PAGE_PROGRAM_US + ullErases * BENCH_SECTOR_ERASE_US) / ulRecords);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t ulCount = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_RECORDS;
+    size_t xBatch = argc > 2 ? strtoul(argv[2], NULL, 0) : BENCH_DEFAULT_BATCH;
+    OUTBOX_T xOutbox;
+    SIM_FLASH_STATS_T xBefore;
+    uint64_t ullFrameBytes = 0;
+    uint64_t ullStart;
+    uint32_t ulFirstSector = OUTBOX_OFFSET / FLASH_SECTOR_SIZE;
+
+    if (ulCount == 0 || xBatch == 0)
+    {
+        fprintf(stderr, "usage: %s [records] [batch]\n", argv[0]);
+        return 1;
+    }
+
+    size_t xFailures = prvVerify();
+    if (xFailures != 0)
+    {
+        printf("%zu failures, not timing\n", xFailures);
+        return 1;
+    }
+
+    printf("%u sectors, %u records capacity, %lu records, ack every %zu\n", OUTBOX_SECTORS, OUTBOX_CAPACITY,
+           (unsigned long)ulCount, xBatch);
+
+    // Steady state: records are acknowledged soon after they are stored, the ring wraps many times
+    prvErase();
+    vOutboxInit(&xOutbox);
+    vSimFlashStats(&xBefore);
+    uint32_t ulEraseBase[OUTBOX_SECTORS];
+    for (uint32_t s = 0; s < OUTBOX_SECTORS; s++)
+    {
+        ulEraseBase[s] = ulSimFlashSectorErases(ulFirstSector + s);
+    }
+    ullStart = prvNowNs();
+    for (uint32_t i = 0; i < ulCount; i++)
+    {
+        WIRE_RECORD_T xRecord = prvRecord(i);
+        WIRE_CODEC_T xCodec = {.session = true};
+        uint8_t ucFrame[WIRE_MAX_RECORD_LEN];
+
+        ullFrameBytes += xWireEncodeRecord(&xCodec, ucFrame, sizeof(ucFrame), &xRecord);
+        xOutboxAppend(&xOutbox, &xRecord);
+        if ((i + 1) % xBatch == 0)
+        {
+            xOutboxAck(&xOutbox, xOutbox.next_seq - 1);
+        }
+    }
+    double dAppend = (double)(prvNowNs() - ullStart) / ulCount;
+    uint32_t ulMinErases = UINT32_MAX;
+    uint32_t ulMaxErases = 0;
+    for (uint32_t s = 0; s < OUTBOX_SECTORS; s++)
+    {
+        uint32_t ulErases = ulSimFlashSectorErases(ulFirstSector + s) - ulEraseBase[s];
+
+        ulMinErases = ulErases < ulMinErases ? ulErases : ulMinErases;
+        ulMaxErases = ulErases > ulMaxErases ? ulErases : ulMaxErases;
+    }
+    printf("%-24s %8.1f ns/record  %.1f bytes/record frame\n", "append", dAppend, (double)ullFrameBytes / ulCount);
+    prvPrintFlash("", &xBefore, ulCount, ullFrameBytes);
+    printf("%-24s %8lu min %8lu max erases per sector\n", "wear", (unsigned long)ulMinErases,
+           (unsigned long)ulMaxErases);
+
+    // Outage: the outbox fills up, then is replayed and acknowledged batch by batch
+    prvErase();
+    vOutboxInit(&xOutbox);
+    for (uint32_t i = 0; i < OUTBOX_CAPACITY; i++)
+    {
+        WIRE_RECORD_T xRecord = prvRecord(i);
+        xOutboxAppend(&xOutbox, &xRecord);
+    }
+
+    ullStart = prvNowNs();
+    vOutboxInit(&xOutbox);
+    double dScan = (double)(prvNowNs() - ullStart) / 1000.0;
+
+    vSimFlashStats(&xBefore);
+    ullStart = prvNowNs();
+    size_t xReplayed = prvReplay(&xOutbox, 0, xBatch);
+    double dReplay = (double)(prvNowNs() - ullStart) / (double)xReplayed;
+    if (xReplayed != OUTBOX_CAPACITY)
+    {
+        printf("replayed %zu of %u records\n", xReplayed, OUTBOX_CAPACITY);
+        return 1;
+    }
+    lSink += (int32_t)xReplayed;
+
+    printf("%-24s %8.1f us for a full outbox\n", "boot scan", dScan);
+    printf("%-24s %8.1f ns/record  %.0f records/s\n", "replay", dReplay, 1e9 / dReplay);
+    prvPrintFlash("", &xBefore, (uint32_t)xReplayed, 0);
+
+    return 0;
+}
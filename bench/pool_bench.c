@@ -0,0 +1,600 @@
+/**
+ * @file pool_bench.c
+ *
+ * @brief Host checks and benchmark of the kernel's fixed block memory pools on the FreeRTOS Posix port.
+ *
+ * Before timing, a pool is exhausted and refilled from tasks and a simulated
+ * interrupt, checking that every block is distinct and aligned and that the
+ * in use, high water and failure counts follow. An allocation on an empty pool
+ * must time out after its block time, and a task blocked on one must be handed
+ * the block freed by an interrupt. Then a simulated interrupt hands filled
+ * blocks by pointer to a consumer task that checks and frees them.
+ *
+ * Two costs are measured:
+ *  - alloc/free: allocating a block and freeing it again, with pvPoolAlloc()
+ *    and vPoolFree(), their FromISR versions, and pvPortMalloc() and
+ *    vPortFree() of the kernel's heap, FREERTOS_HEAP;
+ *  - pass: moving a record from one side to the other within a task, by value
+ *    through a stream buffer as the firmware moves WIRE_RECORD_T, or as a pool
+ *    block whose pointer goes through a queue, for records of 32 and 256 bytes.
+ *
+ * On the Posix port a critical section is a signal mask system call, so the
+ * ratios matter more than the figures.
+ *
+ * Usage: pool_bench [rounds]
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <pool.h>
+#include <queue.h>
+#include <stream_buffer.h>
+#include <task.h>
+
+// Standard includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_ROUNDS 1000000
+
+// Blocks of the checks; the size is rounded up to portBYTE_ALIGNMENT
+#define BENCH_CHECK_BLOCKS 8
+#define BENCH_CHECK_BLOCK_SIZE 20
+#define BENCH_CHECK_TIMEOUT_TICKS 5
+#define BENCH_CHECK_HANDOFFS 200000
+
+// Records that may be waiting on either path of the pass benchmark
+#define BENCH_RECORDS 32
+
+#define BENCH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define BENCH_CONSUMER_PRIORITY (tskIDLE_PRIORITY + 2)
+
+static const size_t xRecordSizes[] = {32, 256};
+
+static size_t xRounds = BENCH_DEFAULT_ROUNDS;
+
+// Pool and queue of the blocked waiter and the handoff consumer
+static PoolHandle_t xCheckPool;
+static QueueHandle_t xCheckQueue;
+
+// Block the waiter was handed, and blocks the consumer has checked
+static void *volatile pvWaiterBlock;
+static volatile size_t xChecked;
+static volatile BaseType_t xCheckFailed;
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+/**
+ * @brief Allocate a block as an interrupt would.
+ *
+ * @param xPool Pool to allocate from.
+ *
+ * @return The block, or NULL.
+ */
+static void *prvAllocFromISR(PoolHandle_t xPool)
+{
+    void *pvBlock;
+
+    // The Posix port's FromISR masks are empty, the critical section keeps the tick out as an ISR would
+    taskENTER_CRITICAL();
+    pvBlock = pvPoolAllocFromISR(xPool);
+    taskEXIT_CRITICAL();
+
+    return pvBlock;
+}
+
+/**
+ * @brief Free a block as an interrupt would, and switch to a task it woke.
+ *
+ * @param xPool Pool the block came from.
+ * @param pvBlock Block to free.
+ *
+ * @return None.
+ */
+static void prvFreeFromISR(PoolHandle_t xPool, void *pvBlock)
+{
+    BaseType_t xWoken = pdFALSE;
+
+    taskENTER_CRITICAL();
+    vPoolFreeFromISR(xPool, pvBlock, &xWoken);
+    taskEXIT_CRITICAL();
+    portYIELD_FROM_ISR(xWoken);
+}
+
+/**
+ * @brief Check a pool's counters.
+ *
+ * @param xPool Pool to check.
+ * @param uxInUse Blocks that should be in use.
+ * @param uxMaxInUse Expected high water mark.
+ * @param uxFailed Allocations that should have failed.
+ *
+ * @return 0 if they match, -1 otherwise.
+ */
+static int prvCheckStats(PoolHandle_t xPool, UBaseType_t uxInUse, UBaseType_t uxMaxInUse, UBaseType_t uxFailed)
+{
+    PoolStats_t xStats;
+
+    vPoolGetStats(xPool, &xStats);
+    if (xStats.uxBlocksInUse != uxInUse || xStats.uxMaxBlocksInUse != uxMaxInUse ||
+        xStats.uxFailedAllocations != uxFailed || uxPoolGetBlocksFree(xPool) != xStats.uxBlockCount - uxInUse)
+    {
+        fprintf(stderr, "stats: %u in use, %u at most, %u failed, %u free; expected %u, %u, %u\n",
+                (unsigned)xStats.uxBlocksInUse, (unsigned)xStats.uxMaxBlocksInUse,
+                (unsigned)xStats.uxFailedAllocations, (unsigned)uxPoolGetBlocksFree(xPool), (unsigned)uxInUse,
+                (unsigned)uxMaxInUse, (unsigned)uxFailed);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Exhaust and refill a pool, checking the blocks and the counters.
+ *
+ * @return 0 if everything matched, -1 otherwise.
+ */
+static int prvCheckBlocks(void)
+{
+    PoolHandle_t xPool = xPoolCreate(BENCH_CHECK_BLOCK_SIZE, BENCH_CHECK_BLOCKS);
+    uint8_t *pucBlocks[BENCH_CHECK_BLOCKS];
+    PoolStats_t xStats;
+    int iResult = -1;
+
+    vPoolGetStats(xPool, &xStats);
+    if (xStats.xBlockSize < BENCH_CHECK_BLOCK_SIZE || xStats.xBlockSize % portBYTE_ALIGNMENT != 0 ||
+        xStats.uxBlockCount != BENCH_CHECK_BLOCKS)
+    {
+        fprintf(stderr, "blocks: pool of %zu byte blocks\n", xStats.xBlockSize);
+        goto done;
+    }
+
+    // Half from a task, half from an interrupt, each filled with its index
+    for (UBaseType_t i = 0; i < BENCH_CHECK_BLOCKS; i++)
+    {
+        pucBlocks[i] = i % 2 ? prvAllocFromISR(xPool) : pvPoolAlloc(xPool, 0);
+        if (pucBlocks[i] == NULL || (uintptr_t)pucBlocks[i] % portBYTE_ALIGNMENT != 0)
+        {
+            fprintf(stderr, "blocks: block %u is %p\n", (unsigned)i, (void *)pucBlocks[i]);
+            goto done;
+        }
+        memset(pucBlocks[i], (int)i, xStats.xBlockSize);
+    }
+    for (UBaseType_t i = 0; i < BENCH_CHECK_BLOCKS; i++)
+    {
+        for (size_t j = 0; j < xStats.xBlockSize; j++)
+        {
+            if (pucBlocks[i][j] != i)
+            {
+                fprintf(stderr, "blocks: block %u overlaps another\n", (unsigned)i);
+                goto done;
+            }
+        }
+    }
+
+    if (pvPoolAlloc(xPool, 0) != NULL || prvAllocFromISR(xPool) != NULL ||
+        prvCheckStats(xPool, BENCH_CHECK_BLOCKS, BENCH_CHECK_BLOCKS, 2) != 0)
+    {
+        fprintf(stderr, "blocks: allocated from an empty pool\n");
+        goto done;
+    }
+
+    // The block freed last is handed out first
+    vPoolFree(xPool, pucBlocks[3]);
+    prvFreeFromISR(xPool, pucBlocks[5]);
+    if (prvCheckStats(xPool, BENCH_CHECK_BLOCKS - 2, BENCH_CHECK_BLOCKS, 2) != 0 || pvPoolAlloc(xPool, 0) != pucBlocks[5])
+    {
+        fprintf(stderr, "blocks: freed block not handed out again\n");
+        goto done;
+    }
+    vPoolFree(xPool, pucBlocks[5]);
+
+    for (UBaseType_t i = 0; i < BENCH_CHECK_BLOCKS; i++)
+    {
+        if (i != 3 && i != 5)
+        {
+            vPoolFree(xPool, pucBlocks[i]);
+        }
+    }
+    if (prvCheckStats(xPool, 0, BENCH_CHECK_BLOCKS, 2) == 0)
+    {
+        iResult = 0;
+    }
+
+done:
+    vPoolDelete(xPool);
+    return iResult;
+}
+
+/**
+ * @brief Check that an allocation from an empty pool waits its block time.
+ *
+ * @return 0 if it returned NULL after the block time, -1 otherwise.
+ */
+static int prvCheckTimeout(void)
+{
+    PoolHandle_t xPool = xPoolCreate(BENCH_CHECK_BLOCK_SIZE, 1);
+    void *pvBlock = pvPoolAlloc(xPool, 0);
+    TickType_t xStart = xTaskGetTickCount();
+    void *pvLate = pvPoolAlloc(xPool, BENCH_CHECK_TIMEOUT_TICKS);
+    TickType_t xWaited = xTaskGetTickCount() - xStart;
+    int iResult = 0;
+
+    if (pvBlock == NULL || pvLate != NULL || xWaited < BENCH_CHECK_TIMEOUT_TICKS ||
+        prvCheckStats(xPool, 1, 1, 1) != 0)
+    {
+        fprintf(stderr, "timeout: got %p after %lu ticks\n", pvLate, (unsigned long)xWaited);
+        iResult = -1;
+    }
+
+    vPoolFree(xPool, pvBlock);
+    vPoolDelete(xPool);
+    return iResult;
+}
+
+/**
+ * @brief Waiter of the wake check, blocked on the empty pool until a block is freed.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvWaiterTask(void *pvParameters)
+{
+    (void)pvParameters;
+
+    pvWaiterBlock = pvPoolAlloc(xCheckPool, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Check that a task blocked on an empty pool is handed the block an interrupt frees.
+ *
+ * @return 0 if the waiter got the block at once, -1 otherwise.
+ */
+static int prvCheckWake(void)
+{
+    void *pvBlock;
+    int iResult = 0;
+
+    xCheckPool = xPoolCreate(BENCH_CHECK_BLOCK_SIZE, 1);
+    pvBlock = pvPoolAlloc(xCheckPool, 0);
+    pvWaiterBlock = NULL;
+
+    // The waiter has the higher priority, so it has blocked on the pool once this returns
+    xTaskCreate(prvWaiterTask, "Waiter", configMINIMAL_STACK_SIZE, NULL, BENCH_CONSUMER_PRIORITY, NULL);
+    if (pvWaiterBlock != NULL)
+    {
+        fprintf(stderr, "wake: waiter did not block\n");
+        iResult = -1;
+    }
+
+    // And it has taken the block once the interrupt returns
+    prvFreeFromISR(xCheckPool, pvBlock);
+    if (pvWaiterBlock != pvBlock || prvCheckStats(xCheckPool, 1, 1, 0) != 0)
+    {
+        fprintf(stderr, "wake: waiter got %p, not %p\n", pvWaiterBlock, pvBlock);
+        iResult = -1;
+    }
+
+    if (pvWaiterBlock != NULL)
+    {
+        vPoolFree(xCheckPool, pvWaiterBlock);
+    }
+    // Let the idle task clean up the waiter before the pool goes
+    vTaskDelay(2);
+    vPoolDelete(xCheckPool);
+    return iResult;
+}
+
+/**
+ * @brief Consumer of the handoff check, checking and freeing every block it is passed.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvConsumerTask(void *pvParameters)
+{
+    uint32_t *pulBlock;
+    size_t xExpected = 0;
+
+    (void)pvParameters;
+
+    for (;;)
+    {
+        if (xQueueReceive(xCheckQueue, &pulBlock, portMAX_DELAY) == pdPASS)
+        {
+            if (pulBlock[0] != (uint32_t)xExpected || pulBlock[1] != ~(uint32_t)xExpected)
+            {
+                xCheckFailed = pdTRUE;
+            }
+            xExpected++;
+            vPoolFree(xCheckPool, pulBlock);
+            xChecked = xExpected;
+        }
+    }
+}
+
+/**
+ * @brief Hand filled blocks from a simulated interrupt to a consumer task that checks and frees them.
+ *
+ * @return 0 if every block arrived intact and went back to the pool, -1 otherwise.
+ */
+static int prvCheckHandoff(void)
+{
+    size_t xSent = 0;
+    size_t xFull = 0;
+    size_t xBursts = 0;
+    PoolStats_t xStats;
+
+    xCheckPool = xPoolCreate(2 * sizeof(uint32_t), BENCH_CHECK_BLOCKS);
+    xCheckQueue = xQueueCreate(BENCH_CHECK_BLOCKS, sizeof(uint32_t *));
+    xChecked = 0;
+    xCheckFailed = pdFALSE;
+    xTaskCreate(prvConsumerTask, "Consumer", configMINIMAL_STACK_SIZE, NULL, BENCH_CONSUMER_PRIORITY, NULL);
+
+    while (xSent < BENCH_CHECK_HANDOFFS)
+    {
+        BaseType_t xWoken = pdFALSE;
+        uint32_t *pulBlock;
+        UBaseType_t uxBurst = (UBaseType_t)(xBursts++ % (BENCH_CHECK_BLOCKS + 2)) + 1;
+
+        // Bursts of up to two more blocks than the pool holds, so some find it empty
+        taskENTER_CRITICAL();
+        for (UBaseType_t i = 0; i < uxBurst; i++)
+        {
+            pulBlock = pvPoolAllocFromISR(xCheckPool);
+            if (pulBlock == NULL)
+            {
+                xFull++;
+                break;
+            }
+            pulBlock[0] = (uint32_t)xSent;
+            pulBlock[1] = ~(uint32_t)xSent;
+            (void)xQueueSendFromISR(xCheckQueue, &pulBlock, &xWoken);
+            xSent++;
+        }
+        taskEXIT_CRITICAL();
+        portYIELD_FROM_ISR(xWoken);
+    }
+
+    vPoolGetStats(xCheckPool, &xStats);
+    if (xCheckFailed || xChecked != xSent || xStats.uxBlocksInUse != 0 || xStats.uxMaxBlocksInUse != BENCH_CHECK_BLOCKS ||
+        xStats.uxFailedAllocations != xFull || xFull == 0)
+    {
+        fprintf(stderr, "handoff: %zu of %zu blocks checked, %u in use, %u at most, %u of %zu failures counted\n",
+                (size_t)xChecked, xSent, (unsigned)xStats.uxBlocksInUse, (unsigned)xStats.uxMaxBlocksInUse,
+                (unsigned)xStats.uxFailedAllocations, xFull);
+        return -1;
+    }
+
+    printf("%zu blocks handed from an interrupt to a task, %zu allocations found the pool empty\n", xSent, xFull);
+    return 0;
+}
+
+/**
+ * @brief Time allocating and freeing one block in a task.
+ *
+ * @param xSize Bytes per block.
+ * @param iPath 0 for pvPoolAlloc(), 1 for pvPoolAllocFromISR(), 2 for pvPortMalloc().
+ *
+ * @return Nanoseconds per allocation and free.
+ */
+static double prvAllocFree(size_t xSize, int iPath)
+{
+    PoolHandle_t xPool = xPoolCreate(xSize, BENCH_RECORDS);
+    uint64_t ullStart;
+    uint64_t ullElapsed;
+    size_t xFailed = 0;
+
+    ullStart = prvNowNs();
+    for (size_t xRound = 0; xRound < xRounds; xRound++)
+    {
+        void *pvBlock;
+
+        if (iPath == 0)
+        {
+            pvBlock = pvPoolAlloc(xPool, 0);
+            xFailed += pvBlock == NULL;
+            vPoolFree(xPool, pvBlock);
+        }
+        else if (iPath == 1)
+        {
+            BaseType_t xWoken = pdFALSE;
+
+            taskENTER_CRITICAL();
+            pvBlock = pvPoolAllocFromISR(xPool);
+            xFailed += pvBlock == NULL;
+            vPoolFreeFromISR(xPool, pvBlock, &xWoken);
+            taskEXIT_CRITICAL();
+        }
+        else
+        {
+            pvBlock = pvPortMalloc(xSize);
+            xFailed += pvBlock == NULL;
+            vPortFree(pvBlock);
+        }
+    }
+    ullElapsed = prvNowNs() - ullStart;
+
+    vPoolDelete(xPool);
+    if (xFailed != 0)
+    {
+        fprintf(stderr, "alloc/free: %zu allocations failed\n", xFailed);
+        exit(1);
+    }
+
+    return (double)ullElapsed / (double)xRounds;
+}
+
+/**
+ * @brief Time passing records from one side to the other in a task.
+ *
+ * @param xSize Bytes per record.
+ * @param xByPointer Whether the record is a pool block passed by pointer, or copied through a stream buffer.
+ *
+ * @return Nanoseconds per record.
+ */
+static double prvPass(size_t xSize, BaseType_t xByPointer)
+{
+    PoolHandle_t xPool = xPoolCreate(xSize, BENCH_RECORDS);
+    QueueHandle_t xQueue = xQueueCreate(BENCH_RECORDS, sizeof(uint8_t *));
+    StreamBufferHandle_t xStream = xStreamBufferCreate(BENCH_RECORDS * xSize, 1);
+    uint8_t *pucRecord = malloc(xSize);
+    uint8_t *pucIn = malloc(xSize);
+    uint32_t ulSum = 0;
+    uint32_t ulExpected = 0;
+    uint64_t ullStart;
+    uint64_t ullElapsed;
+
+    ullStart = prvNowNs();
+    for (size_t xRound = 0; xRound < xRounds; xRound++)
+    {
+        if (xByPointer)
+        {
+            // Filled in place, then only the pointer moves; the reader frees the block
+            uint8_t *pucBlock = pvPoolAlloc(xPool, 0);
+            uint8_t *pucReceived = NULL;
+
+            pucBlock[0] = (uint8_t)xRound;
+            pucBlock[xSize - 1] = (uint8_t)xRound;
+            (void)xQueueSend(xQueue, &pucBlock, 0);
+            (void)xQueueReceive(xQueue, &pucReceived, 0);
+            ulSum += pucReceived[0] + pucReceived[xSize - 1];
+            vPoolFree(xPool, pucReceived);
+        }
+        else
+        {
+            // Filled on the writer's stack, then copied in and out, as vTaskUART hands records to vTaskTCP
+            pucRecord[0] = (uint8_t)xRound;
+            pucRecord[xSize - 1] = (uint8_t)xRound;
+            (void)xStreamBufferSend(xStream, pucRecord, xSize, 0);
+            (void)xStreamBufferReceive(xStream, pucIn, xSize, 0);
+            ulSum += pucIn[0] + pucIn[xSize - 1];
+        }
+    }
+    ullElapsed = prvNowNs() - ullStart;
+
+    free(pucRecord);
+    free(pucIn);
+    vStreamBufferDelete(xStream);
+    vQueueDelete(xQueue);
+    vPoolDelete(xPool);
+
+    for (size_t xRound = 0; xRound < xRounds; xRound++)
+    {
+        ulExpected += 2 * (uint8_t)xRound;
+    }
+    if (ulSum != ulExpected)
+    {
+        fprintf(stderr, "pass: records lost\n");
+        exit(1);
+    }
+
+    return (double)ullElapsed / (double)xRounds;
+}
+
+/**
+ * @brief Run the checks and benchmarks, then end the process.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvBenchTask(void *pvParameters)
+{
+    char cHeap[16];
+
+    (void)pvParameters;
+
+    if (prvCheckBlocks() != 0 || prvCheckTimeout() != 0 || prvCheckWake() != 0 || prvCheckHandoff() != 0)
+    {
+        fprintf(stderr, "pool checks failed\n");
+        exit(1);
+    }
+    printf("pool checks passed\n\n");
+
+    snprintf(cHeap, sizeof(cHeap), "heap_%d ns", FREERTOS_HEAP);
+    printf("%-12s %6s %10s %10s %12s\n", "alloc/free", "bytes", "pool ns", "ISR ns", cHeap);
+    for (size_t i = 0; i < sizeof(xRecordSizes) / sizeof(xRecordSizes[0]); i++)
+    {
+        double dPool = prvAllocFree(xRecordSizes[i], 0);
+        double dISR = prvAllocFree(xRecordSizes[i], 1);
+        double dHeap = prvAllocFree(xRecordSizes[i], 2);
+
+        printf("%-12s %6zu %10.1f %10.1f %12.1f\n", "", xRecordSizes[i], dPool, dISR, dHeap);
+    }
+
+    printf("\n%-12s %6s %10s %10s %8s\n", "pass", "bytes", "copy ns", "pointer ns", "speedup");
+    for (size_t i = 0; i < sizeof(xRecordSizes) / sizeof(xRecordSizes[0]); i++)
+    {
+        double dCopy = prvPass(xRecordSizes[i], pdFALSE);
+        double dPointer = prvPass(xRecordSizes[i], pdTRUE);
+
+        printf("%-12s %6zu %10.1f %10.1f %7.2fx\n", "", xRecordSizes[i], dCopy, dPointer, dCopy / dPointer);
+    }
+
+    exit(0);
+}
+
+#if configUSE_VIRTUAL_TICK
+// The timeout check waits for ticks, so the idle task moves the virtual clock on, one tick at a time
+void vApplicationIdleHook(void)
+{
+    BaseType_t xSwitch;
+
+    taskENTER_CRITICAL();
+    xSwitch = xTaskIncrementTick();
+    taskEXIT_CRITICAL();
+
+    if (xSwitch != pdFALSE)
+    {
+        taskYIELD();
+    }
+}
+
+// Or straight to the next wake up when that is further away
+void vSimVirtualSleep(unsigned long xExpectedIdleTime)
+{
+    vTaskStepTick(xExpectedIdleTime);
+}
+#else
+// Nothing to service while the benchmark tasks are blocked
+void vApplicationIdleHook(void)
+{
+}
+#endif
+
+// Run time stats are counted in host microseconds
+uint64_t time_us_64(void)
+{
+    return prvNowNs() / 1000;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        xRounds = strtoul(argv[1], NULL, 0);
+    }
+    if (xRounds == 0)
+    {
+        xRounds = 1;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("%zu rounds per run, pools of %u records\n", xRounds, (unsigned)BENCH_RECORDS);
+
+    xTaskCreate(prvBenchTask, "Bench", configMINIMAL_STACK_SIZE, NULL, BENCH_TASK_PRIORITY, NULL);
+    vTaskStartScheduler();
+
+    return 1;
+}
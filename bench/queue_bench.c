@@ -0,0 +1,409 @@
+/**
+ * @file queue_bench.c
+ *
+ * @brief Host benchmark of the bulk queue transfers on the FreeRTOS Posix port.
+ *
+ * Compares xQueueSendMultipleFromISR() and xQueueReceiveMultiple() with the
+ * single item xQueueSendFromISR() and xQueueReceive() path that moved UART
+ * bytes one at a time, for batches of 1, 8 and 64 one-byte items. Before
+ * timing, both bulk calls are checked against the single item ones on queues
+ * of one and four byte items, with batches that wrap around the end of the
+ * storage, fill the queue and find it empty.
+ *
+ * Two costs are measured per item:
+ *  - copy: one task sends a batch and receives it back, so only the copies and
+ *    critical sections are timed;
+ *  - handoff: an "interrupt" in a low priority task sends each batch to a
+ *    higher priority consumer task blocked on the queue, and yields once, as
+ *    an ISR would; the consumer drains the queue and blocks again. The
+ *    "interrupt" masks the tick with a critical section, which costs the same
+ *    for both paths.
+ *
+ * Usage: queue_bench [items]
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <task.h>
+
+// Standard includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_ITEMS 2000000
+#define BENCH_QUEUE_LEN 256
+#define BENCH_MAX_BATCH 64
+
+// Queue length of the checks, so batches wrap around the storage often
+#define BENCH_CHECK_QUEUE_LEN 13
+#define BENCH_CHECK_ROUNDS 100000
+
+#define BENCH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define BENCH_CONSUMER_PRIORITY (tskIDLE_PRIORITY + 2)
+
+static const UBaseType_t uxBatches[] = {1, 8, 64};
+
+static size_t xItems = BENCH_DEFAULT_ITEMS;
+
+static QueueHandle_t xHandoffQueue;
+
+// Whether the consumer drains the queue with xQueueReceiveMultiple()
+static volatile BaseType_t xConsumerBulk;
+
+// Items the consumer has received and the sum of their values, checked after every run
+static volatile size_t xConsumed;
+static volatile uint32_t ulConsumedSum;
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+/**
+ * @brief Check the bulk calls against a model of the queue, mixed with single item calls.
+ *
+ * @param uxItemSize Bytes per item, 1 or 4.
+ *
+ * @return 0 if every transfer matched, -1 otherwise.
+ */
+static int prvCheck(UBaseType_t uxItemSize)
+{
+    QueueHandle_t xQueue = xQueueCreate(BENCH_CHECK_QUEUE_LEN, uxItemSize);
+    uint8_t ucBuffer[(BENCH_CHECK_QUEUE_LEN + 2) * 4];
+    uint32_t ulNextSent = 0;
+    uint32_t ulNextReceived = 0;
+    uint32_t ulHash = 1;
+
+    if (xQueue == NULL)
+    {
+        return -1;
+    }
+
+    for (uint32_t ulRound = 0; ulRound < BENCH_CHECK_ROUNDS; ulRound++)
+    {
+        const UBaseType_t uxWaiting = uxQueueMessagesWaiting(xQueue);
+        UBaseType_t uxCount;
+        UBaseType_t uxExpected;
+        UBaseType_t uxDone;
+
+        ulHash = ulHash * 1103515245u + 12345u;
+        uxCount = 1 + (ulHash >> 16) % (BENCH_CHECK_QUEUE_LEN + 2);
+
+        if (ulHash & 0x40000000u)
+        {
+            BaseType_t xWoken = pdFALSE;
+
+            uxExpected = BENCH_CHECK_QUEUE_LEN - uxWaiting < uxCount ? BENCH_CHECK_QUEUE_LEN - uxWaiting : uxCount;
+            for (UBaseType_t i = 0; i < uxCount; i++)
+            {
+                uint32_t ulValue = ulNextSent + (uint32_t)i;
+                memcpy(&ucBuffer[i * uxItemSize], &ulValue, uxItemSize);
+            }
+
+            if (ulHash & 0x20000000u)
+            {
+                uxDone = xQueueSendMultipleFromISR(xQueue, ucBuffer, uxCount, &xWoken);
+            }
+            else
+            {
+                for (uxDone = 0; uxDone < uxCount; uxDone++)
+                {
+                    if (xQueueSendFromISR(xQueue, &ucBuffer[uxDone * uxItemSize], &xWoken) != pdPASS)
+                    {
+                        break;
+                    }
+                }
+            }
+            if (uxDone != uxExpected)
+            {
+                fprintf(stderr, "round %u: sent %u of %u, expected %u\n", (unsigned)ulRound, (unsigned)uxDone,
+                        (unsigned)uxCount, (unsigned)uxExpected);
+                return -1;
+            }
+            ulNextSent += (uint32_t)uxDone;
+        }
+        else
+        {
+            uxExpected = uxWaiting < uxCount ? uxWaiting : uxCount;
+
+            if (ulHash & 0x20000000u)
+            {
+                uxDone = xQueueReceiveMultiple(xQueue, ucBuffer, uxCount, 0);
+            }
+            else
+            {
+                for (uxDone = 0; uxDone < uxCount; uxDone++)
+                {
+                    if (xQueueReceive(xQueue, &ucBuffer[uxDone * uxItemSize], 0) != pdPASS)
+                    {
+                        break;
+                    }
+                }
+            }
+            if (uxDone != uxExpected)
+            {
+                fprintf(stderr, "round %u: received %u of %u, expected %u\n", (unsigned)ulRound, (unsigned)uxDone,
+                        (unsigned)uxCount, (unsigned)uxExpected);
+                return -1;
+            }
+            for (UBaseType_t i = 0; i < uxDone; i++)
+            {
+                uint32_t ulValue = 0;
+                uint32_t ulWant = ulNextReceived + (uint32_t)i;
+
+                memcpy(&ulValue, &ucBuffer[i * uxItemSize], uxItemSize);
+                if (uxItemSize < sizeof(ulWant))
+                {
+                    ulWant &= (1u << (8 * uxItemSize)) - 1;
+                }
+                if (ulValue != ulWant)
+                {
+                    fprintf(stderr, "round %u: item %u is %u, expected %u\n", (unsigned)ulRound, (unsigned)i,
+                            (unsigned)ulValue, (unsigned)ulWant);
+                    return -1;
+                }
+            }
+            ulNextReceived += (uint32_t)uxDone;
+        }
+    }
+
+    vQueueDelete(xQueue);
+
+    return 0;
+}
+
+/**
+ * @brief Time sending batches to a queue and receiving them back in the same task.
+ *
+ * @param uxBatch Items per batch.
+ * @param xBulk Whether to use the bulk calls.
+ *
+ * @return Nanoseconds per item.
+ */
+static double prvCopy(UBaseType_t uxBatch, BaseType_t xBulk)
+{
+    QueueHandle_t xQueue = xQueueCreate(BENCH_QUEUE_LEN, sizeof(uint8_t));
+    uint8_t ucOut[BENCH_MAX_BATCH];
+    uint8_t ucIn[BENCH_MAX_BATCH];
+    uint32_t ulSum = 0;
+    uint64_t ullStart;
+    uint64_t ullElapsed;
+    size_t xRounds = xItems / uxBatch;
+
+    for (UBaseType_t i = 0; i < uxBatch; i++)
+    {
+        ucOut[i] = (uint8_t)(i * 7);
+    }
+
+    ullStart = prvNowNs();
+    for (size_t xRound = 0; xRound < xRounds; xRound++)
+    {
+        BaseType_t xWoken = pdFALSE;
+
+        if (xBulk)
+        {
+            (void)xQueueSendMultipleFromISR(xQueue, ucOut, uxBatch, &xWoken);
+            (void)xQueueReceiveMultiple(xQueue, ucIn, uxBatch, 0);
+        }
+        else
+        {
+            for (UBaseType_t i = 0; i < uxBatch; i++)
+            {
+                (void)xQueueSendFromISR(xQueue, &ucOut[i], &xWoken);
+            }
+            for (UBaseType_t i = 0; i < uxBatch; i++)
+            {
+                (void)xQueueReceive(xQueue, &ucIn[i], 0);
+            }
+        }
+        ulSum += ucIn[uxBatch - 1];
+    }
+    ullElapsed = prvNowNs() - ullStart;
+
+    vQueueDelete(xQueue);
+    if (ulSum != (uint32_t)xRounds * (uint8_t)((uxBatch - 1) * 7))
+    {
+        fprintf(stderr, "copy: items lost\n");
+        exit(1);
+    }
+
+    return (double)ullElapsed / (double)(xRounds * uxBatch);
+}
+
+/**
+ * @brief Consumer of the handoff runs, draining the queue whenever it is woken.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvConsumerTask(void *pvParameters)
+{
+    uint8_t ucIn[BENCH_MAX_BATCH];
+
+    (void)pvParameters;
+
+    for (;;)
+    {
+        if (xConsumerBulk)
+        {
+            UBaseType_t uxReceived = xQueueReceiveMultiple(xHandoffQueue, ucIn, BENCH_MAX_BATCH, portMAX_DELAY);
+
+            for (UBaseType_t i = 0; i < uxReceived; i++)
+            {
+                ulConsumedSum += ucIn[i];
+            }
+            xConsumed += uxReceived;
+        }
+        else if (xQueueReceive(xHandoffQueue, &ucIn[0], portMAX_DELAY) == pdPASS)
+        {
+            ulConsumedSum += ucIn[0];
+            xConsumed++;
+        }
+    }
+}
+
+/**
+ * @brief Time batches handed from a simulated interrupt to the blocked consumer task.
+ *
+ * @param uxBatch Items per batch.
+ * @param xBulk Whether to use the bulk calls.
+ *
+ * @return Nanoseconds per item.
+ */
+static double prvHandoff(UBaseType_t uxBatch, BaseType_t xBulk)
+{
+    uint8_t ucOut[BENCH_MAX_BATCH];
+    uint64_t ullStart;
+    uint64_t ullElapsed;
+    uint32_t ulSum = 0;
+    size_t xRounds = xItems / uxBatch / 4;
+
+    for (UBaseType_t i = 0; i < uxBatch; i++)
+    {
+        ucOut[i] = (uint8_t)(i * 7);
+        ulSum += ucOut[i];
+    }
+
+    xConsumerBulk = xBulk;
+    xConsumed = 0;
+    ulConsumedSum = 0;
+
+    ullStart = prvNowNs();
+    for (size_t xRound = 0; xRound < xRounds; xRound++)
+    {
+        BaseType_t xWoken = pdFALSE;
+
+        // The Posix port's FromISR masks are empty, the critical section keeps the tick out as an ISR would
+        taskENTER_CRITICAL();
+        if (xBulk)
+        {
+            (void)xQueueSendMultipleFromISR(xHandoffQueue, ucOut, uxBatch, &xWoken);
+        }
+        else
+        {
+            for (UBaseType_t i = 0; i < uxBatch; i++)
+            {
+                (void)xQueueSendFromISR(xHandoffQueue, &ucOut[i], &xWoken);
+            }
+        }
+        taskEXIT_CRITICAL();
+        portYIELD_FROM_ISR(xWoken);
+    }
+    ullElapsed = prvNowNs() - ullStart;
+
+    // The consumer has the higher priority, so it has drained the queue before the yield returns
+    if (xConsumed != xRounds * uxBatch || ulConsumedSum != (uint32_t)(xRounds * ulSum))
+    {
+        fprintf(stderr, "handoff: %zu of %zu items consumed\n", (size_t)xConsumed, xRounds * uxBatch);
+        exit(1);
+    }
+
+    return (double)ullElapsed / (double)(xRounds * uxBatch);
+}
+
+/**
+ * @brief Run the checks and benchmarks, then end the process.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvBenchTask(void *pvParameters)
+{
+    (void)pvParameters;
+
+    if (prvCheck(1) != 0 || prvCheck(4) != 0)
+    {
+        fprintf(stderr, "bulk transfers do not match the single item path\n");
+        exit(1);
+    }
+    printf("bulk transfers match the single item path over %u rounds\n\n", (unsigned)BENCH_CHECK_ROUNDS);
+
+    xHandoffQueue = xQueueCreate(BENCH_QUEUE_LEN, sizeof(uint8_t));
+    xTaskCreate(prvConsumerTask, "Consumer", configMINIMAL_STACK_SIZE, NULL, BENCH_CONSUMER_PRIORITY, NULL);
+
+    printf("%-8s %6s %14s %14s %8s\n", "path", "batch", "single ns/item", "bulk ns/item", "speedup");
+    for (size_t i = 0; i < sizeof(uxBatches) / sizeof(uxBatches[0]); i++)
+    {
+        double dSingle = prvCopy(uxBatches[i], pdFALSE);
+        double dBulk = prvCopy(uxBatches[i], pdTRUE);
+
+        printf("%-8s %6u %14.1f %14.1f %7.2fx\n", "copy", (unsigned)uxBatches[i], dSingle, dBulk, dSingle / dBulk);
+    }
+    for (size_t i = 0; i < sizeof(uxBatches) / sizeof(uxBatches[0]); i++)
+    {
+        double dSingle = prvHandoff(uxBatches[i], pdFALSE);
+        double dBulk = prvHandoff(uxBatches[i], pdTRUE);
+
+        printf("%-8s %6u %14.1f %14.1f %7.2fx\n", "handoff", (unsigned)uxBatches[i], dSingle, dBulk, dSingle / dBulk);
+    }
+
+    exit(0);
+}
+
+// Nothing to service while the benchmark tasks are blocked
+void vApplicationIdleHook(void)
+{
+}
+
+// Run time stats are counted in host microseconds
+uint64_t time_us_64(void)
+{
+    return prvNowNs() / 1000;
+}
+
+#if configUSE_VIRTUAL_TICK
+// The benchmark never waits for a time out, so there is no virtual clock to advance
+void vSimVirtualSleep(unsigned long xExpectedIdleTime)
+{
+    (void)xExpectedIdleTime;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        xItems = strtoul(argv[1], NULL, 0);
+    }
+    if (xItems < 4 * BENCH_MAX_BATCH)
+    {
+        xItems = 4 * BENCH_MAX_BATCH;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("%zu items per copy run, %zu per handoff run, queue of %u bytes\n", xItems, xItems / 4,
+           (unsigned)BENCH_QUEUE_LEN);
+
+    xTaskCreate(prvBenchTask, "Bench", configMINIMAL_STACK_SIZE, NULL, BENCH_TASK_PRIORITY, NULL);
+    vTaskStartScheduler();
+
+    return 1;
+}
@@ -0,0 +1,933 @@
+/**
+ * @file ring_bench.c
+ *
+ * @brief Host stress test and benchmark of the SPSC ring on the FreeRTOS Posix port.
+ *
+ * Two stress checks run first, each moving a numbered byte sequence through a
+ * small ring in random sized pieces, half copied and half in place, with the
+ * consumer checking every byte:
+ *  - threads: a producer and a consumer thread outside of FreeRTOS, so the
+ *    two sides run in parallel on two host cores with no lock at all;
+ *  - doorbell: a simulated interrupt in a low priority task writes and rings
+ *    the doorbell now and then, and always once the ring is full; a higher
+ *    priority consumer task waits with xSPSCRingWait() and drains the ring.
+ *
+ * The kernel's stream buffer spans are checked next:
+ *  - spans: xStreamBufferReserve() and xStreamBufferPeek() lend one span and
+ *    then two once the bytes wrap, and a peek on an empty buffer times out;
+ *  - trigger: a consumer task blocked in xStreamBufferPeek() stays blocked by
+ *    xStreamBufferCommit() until the trigger level is reached, and is woken by
+ *    xStreamBufferCommitFromISR();
+ *  - stream: the numbered sequence goes from a simulated interrupt committing
+ *    in place to that consumer consuming random parts of what it peeks.
+ *
+ * Then the cost per byte of handing chunks from an interrupt to a task is
+ * compared for the ring, xStreamBufferSendFromISR() and xQueueSendFromISR()
+ * with one byte items, the paths ISR_UART_RX has used, for chunks of 1 and 8
+ * bytes and of a full RP2040 RX FIFO:
+ *  - copy: one task writes a chunk and reads it back, so only the transfer
+ *    itself is timed;
+ *  - handoff: an "interrupt" in a low priority task writes each chunk, wakes
+ *    the higher priority consumer task of its path and yields once, as an ISR
+ *    would; the consumer drains its path and blocks again. The "interrupt"
+ *    masks the tick with a critical section, which costs the same for every
+ *    path.
+ *
+ * Usage: ring_bench [bytes]
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <stream_buffer.h>
+#include <task.h>
+
+// Standard includes
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Project includes
+#include "ring/spsc_ring.h"
+
+#define BENCH_DEFAULT_BYTES 2000000
+#define BENCH_BUFFER_LEN 256
+#define BENCH_MAX_CHUNK 32
+
+// Ring of the stress checks, small so the indices wrap and the ring fills often
+#define BENCH_STRESS_RING_LEN 64
+#define BENCH_STRESS_THREAD_BYTES 50000000
+#define BENCH_STRESS_DOORBELL_BYTES 2000000
+
+// Stream buffer of the span checks, small so the spans wrap often, and a trigger level above one byte
+#define BENCH_SPAN_BUFFER_LEN 16
+#define BENCH_SPAN_TRIGGER 4
+#define BENCH_SPAN_STRESS_BYTES 1000000
+
+#define BENCH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define BENCH_CONSUMER_PRIORITY (tskIDLE_PRIORITY + 2)
+
+// Task notification index of the doorbells
+#define BENCH_NOTIFY_INDEX 0
+
+typedef enum BENCH_PATH_E_
+{
+    BENCH_PATH_QUEUE,
+    BENCH_PATH_STREAM,
+    BENCH_PATH_RING,
+    BENCH_PATHS
+} BENCH_PATH_E;
+
+static const char *const pcPathNames[BENCH_PATHS] = {"queue", "stream", "ring"};
+
+static const size_t xChunks[] = {1, 8, BENCH_MAX_CHUNK};
+
+static size_t xBytes = BENCH_DEFAULT_BYTES;
+
+static QueueHandle_t xQueue;
+static StreamBufferHandle_t xStreamBuffer;
+static SPSC_RING_T xRing;
+static uint8_t ucRingStorage[BENCH_BUFFER_LEN];
+
+// Bytes each consumer has received and their sum, checked after every run
+static volatile size_t xConsumed[BENCH_PATHS];
+static volatile uint32_t ulConsumedSum[BENCH_PATHS];
+
+// State of the doorbell stress check, shared by the bench task and its consumer
+static SPSC_RING_T xStressRing;
+static uint8_t ucStressStorage[BENCH_STRESS_RING_LEN];
+static volatile size_t xStressConsumed;
+static volatile BaseType_t xStressFailed;
+
+// State of the stream buffer span checks, shared by the bench task and its consumer
+static StreamBufferHandle_t xSpanBuffer;
+static volatile size_t xSpanConsumed;
+static volatile size_t xSpanWrapped;
+static volatile BaseType_t xSpanFailed;
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+// Byte number n of the stress sequence; 251 is prime, so it never lines up with the ring
+static uint8_t prvStressByte(uint32_t ulNumber)
+{
+    return (uint8_t)(ulNumber % 251);
+}
+
+/**
+ * @brief Write the next piece of the stress sequence into a ring.
+ *
+ * @param pxRing Ring.
+ * @param ulNext Number of the next byte of the sequence.
+ * @param ulHash Random value choosing the size and the way of writing.
+ *
+ * @return Number of bytes written.
+ */
+static uint32_t prvStressWrite(SPSC_RING_T *pxRing, uint32_t ulNext, uint32_t ulHash)
+{
+    size_t xCount = 1 + (ulHash >> 16) % (pxRing->size + 8);
+
+    if (ulHash & 0x40000000u)
+    {
+        uint8_t *pucSpan;
+        size_t xSpan = xSPSCRingReserve(pxRing, &pucSpan);
+
+        if (xCount > xSpan)
+        {
+            xCount = xSpan;
+        }
+        for (size_t i = 0; i < xCount; i++)
+        {
+            pucSpan[i] = prvStressByte(ulNext + (uint32_t)i);
+        }
+        vSPSCRingCommit(pxRing, xCount);
+
+        return (uint32_t)xCount;
+    }
+    else
+    {
+        uint8_t ucPiece[BENCH_BUFFER_LEN + 8];
+
+        for (size_t i = 0; i < xCount; i++)
+        {
+            ucPiece[i] = prvStressByte(ulNext + (uint32_t)i);
+        }
+
+        return (uint32_t)xSPSCRingWrite(pxRing, ucPiece, xCount);
+    }
+}
+
+/**
+ * @brief Read the next piece of the stress sequence out of a ring and check it.
+ *
+ * @param pxRing Ring.
+ * @param ulNext Number of the next byte of the sequence.
+ * @param ulHash Random value choosing the size and the way of reading.
+ * @param pulRead Set to the number of bytes read.
+ *
+ * @return 0 if every byte read was the one expected, -1 otherwise.
+ */
+static int prvStressRead(SPSC_RING_T *pxRing, uint32_t ulNext, uint32_t ulHash, uint32_t *pulRead)
+{
+    size_t xCount = 1 + (ulHash >> 16) % (pxRing->size + 8);
+    const uint8_t *pucData;
+    uint8_t ucPiece[BENCH_BUFFER_LEN + 8];
+
+    if (ulHash & 0x40000000u)
+    {
+        size_t xSpan = xSPSCRingPeek(pxRing, &pucData);
+
+        if (xCount > xSpan)
+        {
+            xCount = xSpan;
+        }
+    }
+    else
+    {
+        xCount = xSPSCRingRead(pxRing, ucPiece, xCount);
+        pucData = ucPiece;
+    }
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        if (pucData[i] != prvStressByte(ulNext + (uint32_t)i))
+        {
+            fprintf(stderr, "byte %u is %u, expected %u\n", (unsigned)(ulNext + i), (unsigned)pucData[i],
+                    (unsigned)prvStressByte(ulNext + (uint32_t)i));
+            return -1;
+        }
+    }
+
+    if (pucData != ucPiece)
+    {
+        vSPSCRingConsume(pxRing, xCount);
+    }
+    *pulRead = (uint32_t)xCount;
+
+    return 0;
+}
+
+static void *prvStressProducerThread(void *pvRing)
+{
+    uint32_t ulNext = 0;
+    uint32_t ulHash = 1;
+
+    while (ulNext < BENCH_STRESS_THREAD_BYTES)
+    {
+        ulHash = ulHash * 1103515245u + 12345u;
+        ulNext += prvStressWrite(pvRing, ulNext, ulHash);
+        if (ulSPSCRingAvailable(pvRing) == BENCH_STRESS_RING_LEN)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check the ring between two threads running in parallel, outside of FreeRTOS.
+ *
+ * @return 0 if the consumer received the whole sequence, -1 otherwise.
+ */
+static int prvStressThreads(void)
+{
+    static SPSC_RING_T xThreadRing;
+    static uint8_t ucThreadStorage[BENCH_STRESS_RING_LEN];
+    pthread_t xProducer;
+    uint32_t ulNext = 0;
+    uint32_t ulHash = 7;
+
+    vSPSCRingInit(&xThreadRing, ucThreadStorage, sizeof(ucThreadStorage));
+    if (pthread_create(&xProducer, NULL, prvStressProducerThread, &xThreadRing) != 0)
+    {
+        return -1;
+    }
+
+    while (ulNext < BENCH_STRESS_THREAD_BYTES)
+    {
+        uint32_t ulRead;
+
+        ulHash = ulHash * 1103515245u + 12345u;
+        // The process ends on a failure, taking the producer with it
+        if (prvStressRead(&xThreadRing, ulNext, ulHash, &ulRead) != 0)
+        {
+            return -1;
+        }
+        ulNext += ulRead;
+        if (ulRead == 0)
+        {
+            sched_yield();
+        }
+    }
+
+    pthread_join(xProducer, NULL);
+
+    return ulSPSCRingAvailable(&xThreadRing) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Consumer of the doorbell stress check, draining the ring whenever it is rung.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvStressConsumerTask(void *pvParameters)
+{
+    uint32_t ulHash = 7;
+
+    (void)pvParameters;
+
+    vSPSCRingSetDoorbell(&xStressRing, xTaskGetCurrentTaskHandle(), BENCH_NOTIFY_INDEX);
+
+    for (;;)
+    {
+        // Also take the path that returns at once
+        if (xSPSCRingWait(&xStressRing, 0) == pdFALSE)
+        {
+            (void)xSPSCRingWait(&xStressRing, portMAX_DELAY);
+        }
+
+        while (ulSPSCRingAvailable(&xStressRing) > 0)
+        {
+            uint32_t ulRead;
+
+            ulHash = ulHash * 1103515245u + 12345u;
+            if (prvStressRead(&xStressRing, (uint32_t)xStressConsumed, ulHash, &ulRead) != 0)
+            {
+                xStressFailed = pdTRUE;
+                vSPSCRingFlush(&xStressRing);
+                break;
+            }
+            xStressConsumed += ulRead;
+        }
+    }
+}
+
+/**
+ * @brief Check the ring and its doorbell between a simulated interrupt and a task.
+ *
+ * @return 0 if the consumer received the whole sequence, -1 otherwise.
+ */
+static int prvStressDoorbell(void)
+{
+    uint32_t ulNext = 0;
+    uint32_t ulHash = 1;
+
+    vSPSCRingInit(&xStressRing, ucStressStorage, sizeof(ucStressStorage));
+    xTaskCreate(prvStressConsumerTask, "Stress", configMINIMAL_STACK_SIZE, NULL, BENCH_CONSUMER_PRIORITY, NULL);
+
+    while (ulNext < BENCH_STRESS_DOORBELL_BYTES && !xStressFailed)
+    {
+        BaseType_t xWoken = pdFALSE;
+
+        ulHash = ulHash * 1103515245u + 12345u;
+
+        // The Posix port's FromISR masks are empty, the critical section keeps the tick out as an ISR would
+        taskENTER_CRITICAL();
+        ulNext += prvStressWrite(&xStressRing, ulNext, ulHash);
+        if ((ulHash & 0x08000000u) || ulSPSCRingAvailable(&xStressRing) == BENCH_STRESS_RING_LEN ||
+            ulNext >= BENCH_STRESS_DOORBELL_BYTES)
+        {
+            vSPSCRingNotifyFromISR(&xStressRing, &xWoken);
+        }
+        taskEXIT_CRITICAL();
+        portYIELD_FROM_ISR(xWoken);
+    }
+
+    // The consumer has the higher priority, so it has drained the ring before the last yield returns
+    if (xStressFailed || xStressConsumed != BENCH_STRESS_DOORBELL_BYTES)
+    {
+        fprintf(stderr, "doorbell: %zu of %u bytes consumed\n", (size_t)xStressConsumed,
+                (unsigned)BENCH_STRESS_DOORBELL_BYTES);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write part of the stress sequence into spans lent by xStreamBufferReserve().
+ *
+ * @param pxSpans Spans.
+ * @param xCount Bytes to write, at most the sum of the span lengths.
+ * @param ulNext Number of the first byte.
+ *
+ * @return None.
+ */
+static void prvSpanFill(const StreamBufferSpans_t *pxSpans, size_t xCount, uint32_t ulNext)
+{
+    for (size_t i = 0; i < xCount; i++)
+    {
+        size_t xFirst = pxSpans->xLength[0];
+        uint8_t *pucByte = i < xFirst ? &pxSpans->pucData[0][i] : &pxSpans->pucData[1][i - xFirst];
+
+        *pucByte = prvStressByte(ulNext + (uint32_t)i);
+    }
+}
+
+/**
+ * @brief Check part of the stress sequence in spans lent by xStreamBufferPeek().
+ *
+ * @param pxSpans Spans.
+ * @param xCount Bytes to check, at most the sum of the span lengths.
+ * @param ulNext Number of the first byte.
+ *
+ * @return 0 if every byte was the one expected, -1 otherwise.
+ */
+static int prvSpanCheck(const StreamBufferSpans_t *pxSpans, size_t xCount, uint32_t ulNext)
+{
+    for (size_t i = 0; i < xCount; i++)
+    {
+        size_t xFirst = pxSpans->xLength[0];
+        uint8_t ucByte = i < xFirst ? pxSpans->pucData[0][i] : pxSpans->pucData[1][i - xFirst];
+
+        if (ucByte != prvStressByte(ulNext + (uint32_t)i))
+        {
+            fprintf(stderr, "span byte %u is %u, expected %u\n", (unsigned)(ulNext + i), (unsigned)ucByte,
+                    (unsigned)prvStressByte(ulNext + (uint32_t)i));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check the spans lent on a stream buffer, in one task.
+ *
+ * @return 0 if the spans, their bytes and the peek time out were as expected, -1 otherwise.
+ */
+static int prvCheckSpans(void)
+{
+    StreamBufferHandle_t xBuffer = xStreamBufferCreate(BENCH_SPAN_BUFFER_LEN, 1);
+    StreamBufferSpans_t xSpans;
+    TickType_t xStart;
+    int iResult = -1;
+
+    // Empty: all the free space is one span, and a peek finds nothing
+    if (xStreamBufferReserve(xBuffer, &xSpans) != BENCH_SPAN_BUFFER_LEN ||
+        xSpans.xLength[0] != BENCH_SPAN_BUFFER_LEN || xSpans.pucData[1] != NULL || xSpans.xLength[1] != 0)
+    {
+        fprintf(stderr, "spans: empty buffer lent %zu + %zu bytes\n", xSpans.xLength[0], xSpans.xLength[1]);
+        goto out;
+    }
+    prvSpanFill(&xSpans, 10, 0);
+    (void)xStreamBufferCommit(xBuffer, 10);
+
+    if (xStreamBufferPeek(xBuffer, &xSpans, 0) != 10 || xSpans.xLength[1] != 0 || prvSpanCheck(&xSpans, 10, 0) != 0)
+    {
+        fprintf(stderr, "spans: peeked %zu + %zu bytes, expected 10\n", xSpans.xLength[0], xSpans.xLength[1]);
+        goto out;
+    }
+    (void)xStreamBufferConsume(xBuffer, 6);
+
+    // The free space now wraps around the end of the storage
+    if (xStreamBufferReserve(xBuffer, &xSpans) != BENCH_SPAN_BUFFER_LEN - 4 || xSpans.xLength[1] == 0 ||
+        xSpans.pucData[1] == NULL)
+    {
+        fprintf(stderr, "spans: reserve lent %zu + %zu bytes, expected two spans\n", xSpans.xLength[0],
+                xSpans.xLength[1]);
+        goto out;
+    }
+    prvSpanFill(&xSpans, BENCH_SPAN_BUFFER_LEN - 4, 10);
+    (void)xStreamBufferCommit(xBuffer, BENCH_SPAN_BUFFER_LEN - 4);
+
+    // And so do the bytes held, which must come back in order from both spans
+    if (xStreamBufferPeek(xBuffer, &xSpans, 0) != BENCH_SPAN_BUFFER_LEN || xSpans.xLength[1] == 0 ||
+        prvSpanCheck(&xSpans, BENCH_SPAN_BUFFER_LEN, 6) != 0)
+    {
+        fprintf(stderr, "spans: peek lent %zu + %zu bytes, expected two spans\n", xSpans.xLength[0],
+                xSpans.xLength[1]);
+        goto out;
+    }
+    (void)xStreamBufferConsume(xBuffer, BENCH_SPAN_BUFFER_LEN);
+
+    // Nothing comes, so the peek waits its full time and lends no span
+    xStart = xTaskGetTickCount();
+    if (xStreamBufferPeek(xBuffer, &xSpans, 2) != 0 || xTaskGetTickCount() - xStart < 2 ||
+        xSpans.pucData[0] != NULL || xSpans.pucData[1] != NULL)
+    {
+        fprintf(stderr, "spans: peek on an empty buffer returned after %lu ticks\n",
+                (unsigned long)(xTaskGetTickCount() - xStart));
+        goto out;
+    }
+
+    iResult = 0;
+
+out:
+    vStreamBufferDelete(xBuffer);
+
+    return iResult;
+}
+
+/**
+ * @brief Consumer of the span checks, peeking with a block and consuming random parts.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvSpanConsumerTask(void *pvParameters)
+{
+    uint32_t ulHash = 11;
+
+    (void)pvParameters;
+
+    for (;;)
+    {
+        StreamBufferSpans_t xSpans;
+        size_t xHeld = xStreamBufferPeek(xSpanBuffer, &xSpans, portMAX_DELAY);
+        size_t xCount;
+
+        if (xHeld == 0)
+        {
+            continue;
+        }
+        if (xSpans.xLength[1] != 0)
+        {
+            xSpanWrapped++;
+        }
+
+        ulHash = ulHash * 1103515245u + 12345u;
+        xCount = 1 + (ulHash >> 16) % xHeld;
+        if (prvSpanCheck(&xSpans, xCount, (uint32_t)xSpanConsumed) != 0)
+        {
+            xSpanFailed = pdTRUE;
+            vTaskSuspend(NULL);
+        }
+
+        (void)xStreamBufferConsume(xSpanBuffer, xCount);
+        xSpanConsumed += xCount;
+    }
+}
+
+/**
+ * @brief Check the trigger level, the wake up from an interrupt and the spans under stress.
+ *
+ * @return 0 if the consumer was woken as expected and received the whole sequence, -1 otherwise.
+ */
+static int prvStressSpans(void)
+{
+    StreamBufferSpans_t xSpans;
+    BaseType_t xWoken = pdFALSE;
+    uint32_t ulNext = 0;
+    uint32_t ulHash = 3;
+
+    xSpanBuffer = xStreamBufferCreate(BENCH_SPAN_BUFFER_LEN, BENCH_SPAN_TRIGGER);
+    xTaskCreate(prvSpanConsumerTask, "Spans", configMINIMAL_STACK_SIZE, NULL, BENCH_CONSUMER_PRIORITY, NULL);
+
+    // The consumer is blocked in its peek; below the trigger level a commit leaves it there
+    (void)xStreamBufferReserve(xSpanBuffer, &xSpans);
+    prvSpanFill(&xSpans, BENCH_SPAN_TRIGGER - 1, ulNext);
+    (void)xStreamBufferCommit(xSpanBuffer, BENCH_SPAN_TRIGGER - 1);
+    ulNext += BENCH_SPAN_TRIGGER - 1;
+    if (xSpanConsumed != 0)
+    {
+        fprintf(stderr, "trigger: consumer woken by %zu of %u bytes\n", (size_t)xSpanConsumed,
+                (unsigned)BENCH_SPAN_TRIGGER);
+        return -1;
+    }
+
+    // Reaching it wakes the consumer, which has the higher priority and drains the buffer at once
+    (void)xStreamBufferReserve(xSpanBuffer, &xSpans);
+    prvSpanFill(&xSpans, 1, ulNext);
+    (void)xStreamBufferCommit(xSpanBuffer, 1);
+    ulNext += 1;
+    if (xSpanConsumed != ulNext)
+    {
+        fprintf(stderr, "trigger: consumer took %zu of %u bytes\n", (size_t)xSpanConsumed, (unsigned)ulNext);
+        return -1;
+    }
+
+    // From an interrupt, the wake up is reported to be switched to on the way out
+    taskENTER_CRITICAL();
+    (void)xStreamBufferReserve(xSpanBuffer, &xSpans);
+    prvSpanFill(&xSpans, BENCH_SPAN_TRIGGER, ulNext);
+    (void)xStreamBufferCommitFromISR(xSpanBuffer, BENCH_SPAN_TRIGGER, &xWoken);
+    taskEXIT_CRITICAL();
+    ulNext += BENCH_SPAN_TRIGGER;
+    if (xWoken != pdTRUE)
+    {
+        fprintf(stderr, "trigger: commit from an interrupt woke no task\n");
+        return -1;
+    }
+    portYIELD_FROM_ISR(xWoken);
+    if (xSpanConsumed != ulNext)
+    {
+        fprintf(stderr, "trigger: consumer took %zu of %u bytes after the interrupt\n", (size_t)xSpanConsumed,
+                (unsigned)ulNext);
+        return -1;
+    }
+
+    // Random sized commits from the "interrupt", as much as fits each time
+    while (ulNext < BENCH_SPAN_STRESS_BYTES && !xSpanFailed)
+    {
+        size_t xFree;
+        size_t xCount;
+
+        xWoken = pdFALSE;
+        ulHash = ulHash * 1103515245u + 12345u;
+
+        // The Posix port's FromISR masks are empty, the critical section keeps the tick out as an ISR would
+        taskENTER_CRITICAL();
+        xFree = xStreamBufferReserve(xSpanBuffer, &xSpans);
+        xCount = 1 + (ulHash >> 16) % BENCH_SPAN_BUFFER_LEN;
+        if (xCount > xFree)
+        {
+            xCount = xFree;
+        }
+        if (xCount > BENCH_SPAN_STRESS_BYTES - ulNext)
+        {
+            xCount = BENCH_SPAN_STRESS_BYTES - ulNext;
+        }
+        if (xCount > xSpans.xLength[0])
+        {
+            xSpanWrapped++;
+        }
+        prvSpanFill(&xSpans, xCount, ulNext);
+        (void)xStreamBufferCommitFromISR(xSpanBuffer, xCount, &xWoken);
+        taskEXIT_CRITICAL();
+        ulNext += (uint32_t)xCount;
+        portYIELD_FROM_ISR(xWoken);
+    }
+
+    // Less than the trigger level may be left once the consumer has blocked on an empty buffer again
+    if (xSpanFailed || xSpanConsumed + xStreamBufferBytesAvailable(xSpanBuffer) != BENCH_SPAN_STRESS_BYTES ||
+        xStreamBufferBytesAvailable(xSpanBuffer) >= BENCH_SPAN_TRIGGER || xSpanWrapped == 0)
+    {
+        fprintf(stderr, "stream: %zu of %u bytes consumed, %zu held, %zu wrapped spans\n", (size_t)xSpanConsumed,
+                (unsigned)BENCH_SPAN_STRESS_BYTES, xStreamBufferBytesAvailable(xSpanBuffer), (size_t)xSpanWrapped);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write a chunk as an interrupt handler would.
+ *
+ * @param xPath Path to write to.
+ * @param pucData Chunk.
+ * @param xLength Bytes of the chunk.
+ * @param pxWoken Set to pdTRUE if the consumer of the path was woken.
+ *
+ * @return None.
+ */
+static void prvSendFromISR(BENCH_PATH_E xPath, const uint8_t *pucData, size_t xLength, BaseType_t *pxWoken)
+{
+    switch (xPath)
+    {
+    case BENCH_PATH_QUEUE:
+        for (size_t i = 0; i < xLength; i++)
+        {
+            (void)xQueueSendFromISR(xQueue, &pucData[i], pxWoken);
+        }
+        break;
+    case BENCH_PATH_STREAM:
+        (void)xStreamBufferSendFromISR(xStreamBuffer, pucData, xLength, pxWoken);
+        break;
+    default:
+        (void)xSPSCRingWrite(&xRing, pucData, xLength);
+        vSPSCRingNotifyFromISR(&xRing, pxWoken);
+        break;
+    }
+}
+
+/**
+ * @brief Time writing chunks and reading them back in the same task.
+ *
+ * @param xPath Path to time.
+ * @param xChunk Bytes per chunk.
+ *
+ * @return Nanoseconds per byte.
+ */
+static double prvCopy(BENCH_PATH_E xPath, size_t xChunk)
+{
+    // Not the handoff's, whose consumers would take the bytes
+    QueueHandle_t xCopyQueue = xQueueCreate(BENCH_BUFFER_LEN, sizeof(uint8_t));
+    StreamBufferHandle_t xCopyStreamBuffer = xStreamBufferCreate(BENCH_BUFFER_LEN, 1);
+    static SPSC_RING_T xCopyRing;
+    static uint8_t ucCopyStorage[BENCH_BUFFER_LEN];
+    uint8_t ucOut[BENCH_MAX_CHUNK];
+    uint8_t ucIn[BENCH_MAX_CHUNK];
+    uint32_t ulSum = 0;
+    uint64_t ullStart;
+    uint64_t ullElapsed;
+    size_t xRounds = xBytes / xChunk;
+
+    vSPSCRingInit(&xCopyRing, ucCopyStorage, sizeof(ucCopyStorage));
+    for (size_t i = 0; i < xChunk; i++)
+    {
+        ucOut[i] = (uint8_t)(i * 7);
+    }
+
+    ullStart = prvNowNs();
+    for (size_t xRound = 0; xRound < xRounds; xRound++)
+    {
+        BaseType_t xWoken = pdFALSE;
+
+        switch (xPath)
+        {
+        case BENCH_PATH_QUEUE:
+            for (size_t i = 0; i < xChunk; i++)
+            {
+                (void)xQueueSendFromISR(xCopyQueue, &ucOut[i], &xWoken);
+            }
+            for (size_t i = 0; i < xChunk; i++)
+            {
+                (void)xQueueReceive(xCopyQueue, &ucIn[i], 0);
+            }
+            break;
+        case BENCH_PATH_STREAM:
+            (void)xStreamBufferSendFromISR(xCopyStreamBuffer, ucOut, xChunk, &xWoken);
+            (void)xStreamBufferReceive(xCopyStreamBuffer, ucIn, xChunk, 0);
+            break;
+        default:
+            (void)xSPSCRingWrite(&xCopyRing, ucOut, xChunk);
+            (void)xSPSCRingRead(&xCopyRing, ucIn, xChunk);
+            break;
+        }
+        ulSum += ucIn[xChunk - 1];
+    }
+    ullElapsed = prvNowNs() - ullStart;
+
+    vQueueDelete(xCopyQueue);
+    vStreamBufferDelete(xCopyStreamBuffer);
+    if (ulSum != (uint32_t)xRounds * (uint8_t)((xChunk - 1) * 7))
+    {
+        fprintf(stderr, "copy: %s lost bytes\n", pcPathNames[xPath]);
+        exit(1);
+    }
+
+    return (double)ullElapsed / (double)(xRounds * xChunk);
+}
+
+/**
+ * @brief Consumer of the handoff runs, draining its path whenever it is woken.
+ *
+ * @param pvParameters The path, a BENCH_PATH_E.
+ *
+ * @return None.
+ */
+static void prvConsumerTask(void *pvParameters)
+{
+    BENCH_PATH_E xPath = (BENCH_PATH_E)(uintptr_t)pvParameters;
+    uint8_t ucIn[BENCH_BUFFER_LEN];
+    size_t xReceived;
+
+    if (xPath == BENCH_PATH_RING)
+    {
+        vSPSCRingSetDoorbell(&xRing, xTaskGetCurrentTaskHandle(), BENCH_NOTIFY_INDEX);
+    }
+
+    for (;;)
+    {
+        switch (xPath)
+        {
+        case BENCH_PATH_QUEUE:
+            xReceived = xQueueReceive(xQueue, ucIn, portMAX_DELAY) == pdPASS ? 1 : 0;
+            break;
+        case BENCH_PATH_STREAM:
+            xReceived = xStreamBufferReceive(xStreamBuffer, ucIn, sizeof(ucIn), portMAX_DELAY);
+            break;
+        default:
+            (void)xSPSCRingWait(&xRing, portMAX_DELAY);
+            xReceived = xSPSCRingRead(&xRing, ucIn, sizeof(ucIn));
+            break;
+        }
+
+        for (size_t i = 0; i < xReceived; i++)
+        {
+            ulConsumedSum[xPath] += ucIn[i];
+        }
+        xConsumed[xPath] += xReceived;
+    }
+}
+
+/**
+ * @brief Time chunks handed from a simulated interrupt to the blocked consumer task of a path.
+ *
+ * @param xPath Path to time.
+ * @param xChunk Bytes per chunk.
+ *
+ * @return Nanoseconds per byte.
+ */
+static double prvHandoff(BENCH_PATH_E xPath, size_t xChunk)
+{
+    uint8_t ucOut[BENCH_MAX_CHUNK];
+    uint64_t ullStart;
+    uint64_t ullElapsed;
+    uint32_t ulSum = 0;
+    size_t xRounds = xBytes / xChunk / 4;
+
+    for (size_t i = 0; i < xChunk; i++)
+    {
+        ucOut[i] = (uint8_t)(i * 7);
+        ulSum += ucOut[i];
+    }
+
+    xConsumed[xPath] = 0;
+    ulConsumedSum[xPath] = 0;
+
+    ullStart = prvNowNs();
+    for (size_t xRound = 0; xRound < xRounds; xRound++)
+    {
+        BaseType_t xWoken = pdFALSE;
+
+        taskENTER_CRITICAL();
+        prvSendFromISR(xPath, ucOut, xChunk, &xWoken);
+        taskEXIT_CRITICAL();
+        portYIELD_FROM_ISR(xWoken);
+    }
+    ullElapsed = prvNowNs() - ullStart;
+
+    // The consumer has the higher priority, so it has drained its path before the yield returns
+    if (xConsumed[xPath] != xRounds * xChunk || ulConsumedSum[xPath] != (uint32_t)(xRounds * ulSum))
+    {
+        fprintf(stderr, "handoff: %s consumed %zu of %zu bytes\n", pcPathNames[xPath], (size_t)xConsumed[xPath],
+                xRounds * xChunk);
+        exit(1);
+    }
+
+    return (double)ullElapsed / (double)(xRounds * xChunk);
+}
+
+/**
+ * @brief Run the doorbell check and the benchmarks, then end the process.
+ *
+ * @param pvParameters Unused.
+ *
+ * @return None.
+ */
+static void prvBenchTask(void *pvParameters)
+{
+    (void)pvParameters;
+
+    if (prvStressDoorbell() != 0)
+    {
+        fprintf(stderr, "the doorbell lost or corrupted bytes\n");
+        exit(1);
+    }
+    printf("doorbell: %u bytes from a simulated interrupt intact\n", (unsigned)BENCH_STRESS_DOORBELL_BYTES);
+
+    if (prvCheckSpans() != 0 || prvStressSpans() != 0)
+    {
+        fprintf(stderr, "the stream buffer spans lost or corrupted bytes\n");
+        exit(1);
+    }
+    printf("spans: %u bytes from a simulated interrupt intact, %zu wrapped spans\n\n",
+           (unsigned)BENCH_SPAN_STRESS_BYTES, (size_t)xSpanWrapped);
+
+    xQueue = xQueueCreate(BENCH_BUFFER_LEN, sizeof(uint8_t));
+    xStreamBuffer = xStreamBufferCreate(BENCH_BUFFER_LEN, 1);
+    vSPSCRingInit(&xRing, ucRingStorage, sizeof(ucRingStorage));
+
+    for (uintptr_t i = 0; i < BENCH_PATHS; i++)
+    {
+        xTaskCreate(prvConsumerTask, pcPathNames[i], configMINIMAL_STACK_SIZE, (void *)i, BENCH_CONSUMER_PRIORITY,
+                    NULL);
+    }
+
+    printf("%-8s %6s %12s %12s %12s %9s %9s\n", "path", "chunk", "queue ns/B", "stream ns/B", "ring ns/B",
+           "vs queue", "vs stream");
+    for (size_t i = 0; i < sizeof(xChunks) / sizeof(xChunks[0]); i++)
+    {
+        double dTimes[BENCH_PATHS];
+
+        for (int j = 0; j < BENCH_PATHS; j++)
+        {
+            dTimes[j] = prvCopy((BENCH_PATH_E)j, xChunks[i]);
+        }
+        printf("%-8s %6zu %12.1f %12.1f %12.1f %8.2fx %8.2fx\n", "copy", xChunks[i], dTimes[BENCH_PATH_QUEUE],
+               dTimes[BENCH_PATH_STREAM], dTimes[BENCH_PATH_RING], dTimes[BENCH_PATH_QUEUE] / dTimes[BENCH_PATH_RING],
+               dTimes[BENCH_PATH_STREAM] / dTimes[BENCH_PATH_RING]);
+    }
+    for (size_t i = 0; i < sizeof(xChunks) / sizeof(xChunks[0]); i++)
+    {
+        double dTimes[BENCH_PATHS];
+
+        for (int j = 0; j < BENCH_PATHS; j++)
+        {
+            dTimes[j] = prvHandoff((BENCH_PATH_E)j, xChunks[i]);
+        }
+        printf("%-8s %6zu %12.1f %12.1f %12.1f %8.2fx %8.2fx\n", "handoff", xChunks[i], dTimes[BENCH_PATH_QUEUE],
+               dTimes[BENCH_PATH_STREAM], dTimes[BENCH_PATH_RING], dTimes[BENCH_PATH_QUEUE] / dTimes[BENCH_PATH_RING],
+               dTimes[BENCH_PATH_STREAM] / dTimes[BENCH_PATH_RING]);
+    }
+
+    exit(0);
+}
+
+#if configUSE_VIRTUAL_TICK
+// The span check waits for a peek to time out, so the idle task moves the virtual clock on, one tick at a time
+void vApplicationIdleHook(void)
+{
+    BaseType_t xSwitch;
+
+    taskENTER_CRITICAL();
+    xSwitch = xTaskIncrementTick();
+    taskEXIT_CRITICAL();
+
+    if (xSwitch != pdFALSE)
+    {
+        taskYIELD();
+    }
+}
+
+// Or straight to the next wake up when that is further away
+void vSimVirtualSleep(unsigned long xExpectedIdleTime)
+{
+    vTaskStepTick(xExpectedIdleTime);
+}
+#else
+// Nothing to service while the benchmark tasks are blocked
+void vApplicationIdleHook(void)
+{
+}
+#endif
+
+// Run time stats are counted in host microseconds
+uint64_t time_us_64(void)
+{
+    return prvNowNs() / 1000;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        xBytes = strtoul(argv[1], NULL, 0);
+    }
+    if (xBytes < 4 * BENCH_MAX_CHUNK)
+    {
+        xBytes = 4 * BENCH_MAX_CHUNK;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Before the scheduler starts, so the threads are plain host threads
+    if (prvStressThreads() != 0)
+    {
+        fprintf(stderr, "the ring lost or corrupted bytes between threads\n");
+        return 1;
+    }
+    printf("threads: %u bytes between two host threads intact\n", (unsigned)BENCH_STRESS_THREAD_BYTES);
+
+    printf("%zu bytes per copy run, %zu per handoff run, buffers of %u bytes\n", xBytes, xBytes / 4,
+           (unsigned)BENCH_BUFFER_LEN);
+
+    xTaskCreate(prvBenchTask, "Bench", configMINIMAL_STACK_SIZE, NULL, BENCH_TASK_PRIORITY, NULL);
+    vTaskStartScheduler();
+
+    return 1;
+}
@@ -0,0 +1,264 @@
+/**
+ * @file wire_format_bench.c
+ *
+ * @brief Host micro-benchmark of the binary uplink wire format.
+ *
+ * Compares the binary framing against the ASCII record vTaskUART sent before,
+ * for bytes per record and for the cost of building and parsing records on
+ * the controller side. Before timing, every record of the corpus is encoded,
+ * decoded and compared, and corrupted frames must be rejected by the CRC.
+ *
+ * Usage: wire_format_bench [records] [rounds]
+ */
+
+// Standard includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Project includes
+#include "meter/meter_parser.h"
+#include "protocol/wire_format.h"
+
+#define BENCH_DEFAULT_RECORDS 4096
+#define BENCH_DEFAULT_ROUNDS 200
+#define BENCH_DEVICE_ID "BENCH01"
+#define BENCH_ASCII_LEN 96
+
+// Keeps the compiler from discarding the work being measured
+static volatile int32_t lSink;
+
+static uint64_t prvNowNs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000000ULL + (uint64_t)xNow.tv_nsec;
+}
+
+/**
+ * @brief Build usage events shaped like household water use.
+ */
+static void prvBuildCorpus(WIRE_RECORD_T *pxRecords, size_t xCount)
+{
+    uint32_t ulTime = 0;
+
+    srand(1);
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        int32_t lMean = 500 + rand() % 20000;
+        int32_t lSpread = rand() % 2000;
+
+        ulTime += 1000 + (uint32_t)(rand() % 600000);
+        pxRecords[i] = (WIRE_RECORD_T){
+            .seq = (uint32_t)i + 1,
+            .time_ms = ulTime,
+            .volume_milli = rand() % 200000,
+            .mean_flow_milli = lMean,
+            .min_flow_milli = lMean - lSpread,
+            .max_flow_milli = lMean + rand() % 2000,
+            .stddev_flow_milli = lSpread / 3,
+            .duration_ms = 1000 + (uint32_t)(rand() % 300000),
+            .count = 1 + (uint32_t)(rand() % 300),
+        };
+    }
+}
+
+/**
+ * @brief The "volume,mean,min,max,stddev,duration_ms,count,DEVICE_ID\n" record sent before.
+ */
+static size_t prvAsciiRecord(char *pcBuffer, const WIRE_RECORD_T *pxRecord)
+{
+    char cVolume[METER_FIELD_STR_LEN], cMean[METER_FIELD_STR_LEN], cMin[METER_FIELD_STR_LEN];
+    char cMax[METER_FIELD_STR_LEN], cStdDev[METER_FIELD_STR_LEN];
+
+    xMeterFormatMilli(cVolume, sizeof(cVolume), pxRecord->volume_milli);
+    xMeterFormatMilli(cMean, sizeof(cMean), pxRecord->mean_flow_milli);
+    xMeterFormatMilli(cMin, sizeof(cMin), pxRecord->min_flow_milli);
+    xMeterFormatMilli(cMax, sizeof(cMax), pxRecord->max_flow_milli);
+    xMeterFormatMilli(cStdDev, sizeof(cStdDev), pxRecord->stddev_flow_milli);
+
+    return (size_t)snprintf(pcBuffer, BENCH_ASCII_LEN, "%s,%s,%s,%s,%s,%lu,%lu,%s\n",
+                            cVolume, cMean, cMin, cMax, cStdDev,
+                            (unsigned long)pxRecord->duration_ms, (unsigned long)pxRecord->count, BENCH_DEVICE_ID);
+}
+
+/**
+ * @brief Controller side parse of an ASCII record, the way a strtok/strtod ingest would.
+ */
+static int32_t prvAsciiParse(char *pcLine)
+{
+    char *pcSave = NULL;
+    int32_t lSum = 0;
+
+    for (char *pcField = strtok_r(pcLine, ",\n", &pcSave); pcField != NULL; pcField = strtok_r(NULL, ",\n", &pcSave))
+    {
+        lSum += (int32_t)(strtod(pcField, NULL) * METER_SCALE);
+    }
+
+    return lSum;
+}
+
+/**
+ * @brief Round trip every record and check that damaged frames are caught.
+ */
+static size_t prvVerify(const WIRE_RECORD_T *pxRecords, size_t xCount, uint8_t *pucStream, size_t *pxStreamLen)
+{
+    WIRE_CODEC_T xEncoder;
+    WIRE_CODEC_T xDecoder = {0};
+    WIRE_FRAME_T xFrame;
+    size_t xLen = xWireEncodeHello(&xEncoder, pucStream, WIRE_MAX_HELLO_LEN, BENCH_DEVICE_ID);
+    size_t xOffset = 0;
+    size_t xConsumed;
+    size_t xMismatches = 0;
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        xLen += xWireEncodeRecord(&xEncoder, &pucStream[xLen], WIRE_MAX_RECORD_LEN, &pxRecords[i]);
+    }
+    *pxStreamLen = xLen;
+
+    if (eWireDecodeFrame(&xDecoder, pucStream, xLen, &xConsumed, &xFrame) != WIRE_OK ||
+        xFrame.type != WIRE_FRAME_HELLO || strcmp(xFrame.device_id, BENCH_DEVICE_ID) != 0)
+    {
+        printf("hello frame not decoded\n");
+        return 1;
+    }
+    xOffset = xConsumed;
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        WIRE_RESULT_T eResult = eWireDecodeFrame(&xDecoder, &pucStream[xOffset], xLen - xOffset, &xConsumed, &xFrame);
+
+        if (eResult != WIRE_OK || memcmp(&xFrame.record, &pxRecords[i], sizeof(WIRE_RECORD_T)) != 0)
+        {
+            printf("record %zu mismatch (%d)\n", i, eResult);
+            xMismatches++;
+        }
+        xOffset += xConsumed;
+    }
+
+    // Every single bit flip in a frame must be rejected
+    for (size_t xBit = 0; xBit < 8 * WIRE_MAX_RECORD_LEN; xBit++)
+    {
+        uint8_t ucFrame[WIRE_MAX_RECORD_LEN];
+        WIRE_CODEC_T xCodec = {.session = true};
+        size_t xFrameLen = xWireEncodeRecord(&xCodec, ucFrame, sizeof(ucFrame), &pxRecords[0]);
+
+        if (xBit >= 8 * xFrameLen)
+        {
+            break;
+        }
+        ucFrame[xBit / 8] ^= (uint8_t)(1u << (xBit % 8));
+        xCodec = (WIRE_CODEC_T){.session = true};
+        if (eWireDecodeFrame(&xCodec, ucFrame, xFrameLen, &xConsumed, &xFrame) == WIRE_OK)
+        {
+            printf("bit flip %zu not detected\n", xBit);
+            xMismatches++;
+        }
+    }
+
+    return xMismatches;
+}
+
+int main(int argc, char **argv)
+{
+    size_t xCount = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_RECORDS;
+    size_t xRounds = argc > 2 ? strtoul(argv[2], NULL, 0) : BENCH_DEFAULT_ROUNDS;
+    WIRE_RECORD_T *pxRecords = calloc(xCount, sizeof(WIRE_RECORD_T));
+    uint8_t *pucStream = calloc(WIRE_MAX_HELLO_LEN + xCount * WIRE_MAX_RECORD_LEN, 1);
+    char *pcAscii = calloc(xCount, BENCH_ASCII_LEN);
+    size_t xStreamLen = 0;
+    size_t xAsciiLen = 0;
+
+    if (pxRecords == NULL || pucStream == NULL || pcAscii == NULL || xCount == 0 || xRounds == 0)
+    {
+        fprintf(stderr, "usage: %s [records] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    prvBuildCorpus(pxRecords, xCount);
+
+    size_t xMismatches = prvVerify(pxRecords, xCount, pucStream, &xStreamLen);
+    if (xMismatches != 0)
+    {
+        printf("%zu mismatches, not timing\n", xMismatches);
+        return 1;
+    }
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        xAsciiLen += prvAsciiRecord(&pcAscii[i * BENCH_ASCII_LEN], &pxRecords[i]);
+    }
+
+    printf("%zu records x %zu rounds\n", xCount, xRounds);
+    printf("%-24s %8.1f bytes/record\n", "ascii", (double)xAsciiLen / (double)xCount);
+    printf("%-24s %8.1f bytes/record  (%.1fx smaller)\n", "binary", (double)xStreamLen / (double)xCount,
+           (double)xAsciiLen / (double)xStreamLen);
+
+    uint64_t ullStart = prvNowNs();
+    for (size_t r = 0; r < xRounds; r++)
+    {
+        for (size_t i = 0; i < xCount; i++)
+        {
+            lSink += (int32_t)prvAsciiRecord(&pcAscii[i * BENCH_ASCII_LEN], &pxRecords[i]);
+        }
+    }
+    double dAsciiEncode = (double)(prvNowNs() - ullStart) / (double)(xCount * xRounds);
+
+    ullStart = prvNowNs();
+    for (size_t r = 0; r < xRounds; r++)
+    {
+        WIRE_CODEC_T xCodec;
+        size_t xLen = xWireEncodeHello(&xCodec, pucStream, WIRE_MAX_HELLO_LEN, BENCH_DEVICE_ID);
+        for (size_t i = 0; i < xCount; i++)
+        {
+            xLen += xWireEncodeRecord(&xCodec, &pucStream[xLen], WIRE_MAX_RECORD_LEN, &pxRecords[i]);
+        }
+        lSink += (int32_t)xLen;
+    }
+    double dBinaryEncode = (double)(prvNowNs() - ullStart) / (double)(xCount * xRounds);
+
+    // strtok_r writes into the line, so parse a fresh copy every time
+    ullStart = prvNowNs();
+    for (size_t r = 0; r < xRounds; r++)
+    {
+        for (size_t i = 0; i < xCount; i++)
+        {
+            char cLine[BENCH_ASCII_LEN];
+            memcpy(cLine, &pcAscii[i * BENCH_ASCII_LEN], BENCH_ASCII_LEN);
+            lSink += prvAsciiParse(cLine);
+        }
+    }
+    double dAsciiDecode = (double)(prvNowNs() - ullStart) / (double)(xCount * xRounds);
+
+    ullStart = prvNowNs();
+    for (size_t r = 0; r < xRounds; r++)
+    {
+        WIRE_CODEC_T xCodec = {0};
+        WIRE_FRAME_T xFrame;
+        size_t xConsumed;
+        size_t xOffset = 0;
+
+        while (xOffset < xStreamLen &&
+               eWireDecodeFrame(&xCodec, &pucStream[xOffset], xStreamLen - xOffset, &xConsumed, &xFrame) == WIRE_OK)
+        {
+            lSink += xFrame.record.mean_flow_milli;
+            xOffset += xConsumed;
+        }
+    }
+    double dBinaryDecode = (double)(prvNowNs() - ullStart) / (double)(xCount * xRounds);
+
+    printf("%-24s %8.1f ns/record\n", "encode ascii", dAsciiEncode);
+    printf("%-24s %8.1f ns/record  (%.1fx)\n", "encode binary", dBinaryEncode, dAsciiEncode / dBinaryEncode);
+    printf("%-24s %8.1f ns/record\n", "decode ascii", dAsciiDecode);
+    printf("%-24s %8.1f ns/record  (%.1fx)\n", "decode binary", dBinaryDecode, dAsciiDecode / dBinaryDecode);
+
+    free(pcAscii);
+    free(pucStream);
+    free(pxRecords);
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file controller_main.c
+ *
+ * @brief Controller daemon that ingests device records on TCP_PORT.
+ *
+ * Every decoded record is written to stdout as one CSV line:
+ *
+ *     device_id,seq,time_ms,volume,mean,min,max,stddev,duration_ms,count
+ *
+ * with flow and volume in milli-units. Records a device replays after a lost
+ * acknowledgement are dropped, so every seq of a device appears once. Telemetry from the devices, their heap,
+ * queue depths and the CPU share and free stack of every task, is printed to stderr as it arrives. Counters are
+ * printed to stderr every CONTROLLER_STATS_S seconds. SIGINT or SIGTERM stops the daemon.
+ *
+ * Commands for the devices are read from stdin, one per line:
+ *
+ *     <device_id|*> <command> [value]
+ *
+ * where command is one of clear, flush_ms, batch_records, heartbeat_ms,
+ * flow_start, flow_stop and telemetry_ms, and * sends it to every device. Settings are sent
+ * again to a device whenever it starts a session.
+ *
+ * Usage: controller [-a address] [-p port] [-t shards] [-q]
+ */
+
+// Standard includes
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Project includes
+#include "ingest_server.h"
+
+// Port the devices connect to, TCP_PORT in the firmware
+#define CONTROLLER_PORT 65400
+
+// Interval of the counter report
+#define CONTROLLER_STATS_S 10
+
+// Longest command line read from stdin
+#define CONTROLLER_LINE_LEN 128
+
+// Longest telemetry report, a line for the device and one for each task
+#define CONTROLLER_TELEMETRY_LEN (128 * (1 + WIRE_MAX_TELEMETRY_TASKS))
+
+static volatile sig_atomic_t xStop;
+
+static void prvOnSignal(int iSignal)
+{
+    (void)iSignal;
+    xStop = 1;
+}
+
+static void prvPrintSession(void *pvCtx, unsigned uShard, const char *pcDeviceId)
+{
+    (void)pvCtx;
+    fprintf(stderr, "<controller> shard %u: session from %s\n", uShard, pcDeviceId);
+}
+
+static void prvPrintRecord(void *pvCtx, unsigned uShard, const char *pcDeviceId, const WIRE_RECORD_T *pxRecord)
+{
+    (void)pvCtx;
+    (void)uShard;
+
+    // One fprintf per record; stdio locks the stream, so lines from different shards never interleave
+    fprintf(stdout, "%s,%lu,%lu,%ld,%ld,%ld,%ld,%ld,%lu,%lu\n", pcDeviceId, (unsigned long)pxRecord->seq,
+            (unsigned long)pxRecord->time_ms, (long)pxRecord->volume_milli, (long)pxRecord->mean_flow_milli,
+            (long)pxRecord->min_flow_milli, (long)pxRecord->max_flow_milli, (long)pxRecord->stddev_flow_milli,
+            (unsigned long)pxRecord->duration_ms, (unsigned long)pxRecord->count);
+}
+
+static void prvPrintTelemetry(void *pvCtx, unsigned uShard, const char *pcDeviceId, const WIRE_TELEMETRY_T *pxTelemetry)
+{
+    char cReport[CONTROLLER_TELEMETRY_LEN];
+    int iLen;
+
+    (void)pvCtx;
+    (void)uShard;
+
+    iLen = snprintf(cReport, sizeof(cReport),
+                    "<controller> telemetry from %s at %lu ms over %lu ms: heap %lu free, %lu lowest; %lu uart bytes, "
+                    "%lu records queued, %lu in the batch, %lu in the outbox\n",
+                    pcDeviceId, (unsigned long)pxTelemetry->time_ms, (unsigned long)pxTelemetry->interval_ms,
+                    (unsigned long)pxTelemetry->heap_free, (unsigned long)pxTelemetry->heap_min,
+                    (unsigned long)pxTelemetry->uart_bytes, (unsigned long)pxTelemetry->queued_records,
+                    (unsigned long)pxTelemetry->batch_records, (unsigned long)pxTelemetry->outbox_records);
+    for (uint32_t i = 0; i < pxTelemetry->task_count && iLen > 0 && (size_t)iLen < sizeof(cReport); i++)
+    {
+        const WIRE_TASK_STATS_T *pxTask = &pxTelemetry->tasks[i];
+
+        iLen += snprintf(&cReport[iLen], sizeof(cReport) - (size_t)iLen,
+                         "<controller>   %-16s %3lu.%lu%% cpu, %5lu stack bytes free\n", pxTask->name,
+                         (unsigned long)(pxTask->cpu_permille / 10), (unsigned long)(pxTask->cpu_permille % 10),
+                         (unsigned long)pxTask->stack_free);
+    }
+
+    // One fprintf per report, so reports from different shards never interleave
+    fprintf(stderr, "%s", cReport);
+}
+
+/**
+ * @brief Send the command on one line of stdin.
+ *
+ * @param pxServer Running server.
+ * @param pcLine Line of the form "<device_id|*> <command> [value]".
+ *
+ * @return None.
+ */
+static void prvCommandLine(INGEST_SERVER_T *pxServer, char *pcLine)
+{
+    char *pcSave;
+    const char *pcDevice = strtok_r(pcLine, " \t\r\n", &pcSave);
+    const char *pcName = strtok_r(NULL, " \t\r\n", &pcSave);
+    const char *pcValue = strtok_r(NULL, " \t\r\n", &pcSave);
+    WIRE_COMMAND_T xCommand = {0};
+    char *pcEnd = NULL;
+
+    if (pcDevice == NULL)
+    {
+        return;
+    }
+
+    xCommand.id = pcName != NULL ? ucWireCommandId(pcName) : 0;
+    if (pcValue != NULL)
+    {
+        xCommand.value = (uint32_t)strtoul(pcValue, &pcEnd, 0);
+    }
+    if (xCommand.id == 0 || (pcValue != NULL && *pcEnd != '\0'))
+    {
+        fprintf(stderr, "<controller> usage: <device_id|*> <command> [value]\n");
+        return;
+    }
+
+    if (!xIngestServerCommand(pxServer, strcmp(pcDevice, "*") == 0 ? NULL : pcDevice, &xCommand))
+    {
+        fprintf(stderr, "<controller> command %s not sent\n", pcName);
+        return;
+    }
+    fprintf(stderr, "<controller> %s %s %lu\n", pcDevice, pcName, (unsigned long)xCommand.value);
+}
+
+/**
+ * @brief Return the monotonic clock in milliseconds.
+ *
+ * @return Milliseconds on CLOCK_MONOTONIC.
+ */
+static uint64_t prvNowMs(void)
+{
+    struct timespec xNow;
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (uint64_t)xNow.tv_sec * 1000 + (uint64_t)xNow.tv_nsec / 1000000;
+}
+
+int main(int argc, char **argv)
+{
+    const char *pcAddress = NULL;
+    unsigned long ulPort = CONTROLLER_PORT;
+    long lShards = sysconf(_SC_NPROCESSORS_ONLN);
+    INGEST_SINK_T xSink = {.session = prvPrintSession, .record = prvPrintRecord, .telemetry = prvPrintTelemetry};
+    INGEST_SERVER_T *pxServer;
+    int iOpt;
+
+    while ((iOpt = getopt(argc, argv, "a:p:t:q")) != -1)
+    {
+        switch (iOpt)
+        {
+        case 'a':
+            pcAddress = optarg;
+            break;
+        case 'p':
+            ulPort = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            lShards = strtol(optarg, NULL, 0);
+            break;
+        case 'q':
+            // Count records without printing them
+            xSink.session = NULL;
+            xSink.record = NULL;
+            xSink.telemetry = NULL;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-a address] [-p port] [-t shards] [-q]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (lShards < 1)
+    {
+        lShards = 1;
+    }
+    if (lShards > INGEST_MAX_SHARDS)
+    {
+        lShards = INGEST_MAX_SHARDS;
+    }
+
+    signal(SIGINT, prvOnSignal);
+    signal(SIGTERM, prvOnSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    pxServer = pxIngestServerStart(pcAddress, (uint16_t)ulPort, (unsigned)lShards, &xSink);
+    if (pxServer == NULL)
+    {
+        perror("<controller> failed to start");
+        return 1;
+    }
+    fprintf(stderr, "<controller> listening on port %u with %ld shards\n", usIngestServerPort(pxServer), lShards);
+
+    // Commands arrive on stdin until it is closed
+    struct pollfd xStdin = {.fd = STDIN_FILENO, .events = POLLIN};
+    static char cLine[CONTROLLER_LINE_LEN];
+    size_t xLineLen = 0;
+    uint64_t ullReportMs = prvNowMs() + CONTROLLER_STATS_S * 1000;
+
+    while (!xStop)
+    {
+        INGEST_STATS_T xStats;
+        uint64_t ullNowMs = prvNowMs();
+
+        if (ullNowMs < ullReportMs)
+        {
+            // A signal interrupts the wait
+            if (poll(&xStdin, 1, (int)(ullReportMs - ullNowMs)) > 0)
+            {
+                ssize_t xRead = read(STDIN_FILENO, &cLine[xLineLen], sizeof(cLine) - 1 - xLineLen);
+                char *pcNewline;
+
+                if (xRead <= 0 && !(xRead < 0 && errno == EINTR))
+                {
+                    xStdin.fd = -1;
+                    continue;
+                }
+                xLineLen += xRead > 0 ? (size_t)xRead : 0;
+                cLine[xLineLen] = '\0';
+
+                while ((pcNewline = strchr(cLine, '\n')) != NULL)
+                {
+                    *pcNewline = '\0';
+                    prvCommandLine(pxServer, cLine);
+                    xLineLen -= (size_t)(pcNewline + 1 - cLine);
+                    memmove(cLine, pcNewline + 1, xLineLen + 1);
+                }
+
+                // An overlong line is dropped
+                if (xLineLen == sizeof(cLine) - 1)
+                {
+                    xLineLen = 0;
+                }
+            }
+            continue;
+        }
+        ullReportMs = ullNowMs + CONTROLLER_STATS_S * 1000;
+
+        vIngestServerStats(pxServer, &xStats);
+        fprintf(stderr, "<controller> %llu open, %llu sessions, %llu records, %llu duplicates, %llu telemetry, %llu acks, %llu commands, %llu bytes, %llu crc errors, %llu protocol errors\n",
+                (unsigned long long)(xStats.accepted - xStats.closed), (unsigned long long)xStats.sessions,
+                (unsigned long long)xStats.records, (unsigned long long)xStats.duplicates,
+                (unsigned long long)xStats.telemetry,                (unsigned long long)xStats.acks, (unsigned long long)xStats.commands, (unsigned long long)xStats.rx_bytes,
+                (unsigned long long)xStats.crc_errors, (unsigned long long)xStats.protocol_errors);
+        fflush(stdout);
+    }
+
+    vIngestServerStop(pxServer);
+
+    return 0;
+}
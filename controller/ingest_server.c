@@ -0,0 +1,961 @@
+/**
+ * @file ingest_server.c
+ *
+ * @brief Source file for the controller's record ingest server.
+ */
+
+#define _GNU_SOURCE
+
+// Standard includes
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Linux includes
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Project includes
+#include "ingest_server.h"
+
+// Events handled per epoll_wait call
+#define INGEST_MAX_EVENTS 256
+
+// Latest value of every setting and when it was sent, 0 if it never was
+typedef struct INGEST_SETTINGS_T_
+{
+    uint32_t value[WIRE_CMD_COUNT];
+    uint64_t stamp[WIRE_CMD_COUNT];
+} INGEST_SETTINGS_T;
+
+// Highest sequence number taken from a device; entries live as long as the server
+typedef struct INGEST_DEVICE_T_
+{
+    struct INGEST_DEVICE_T_ *next;
+    uint32_t last_seq;
+    char device_id[WIRE_MAX_DEVICE_ID_LEN + 1];
+    // Guarded by the device lock
+    INGEST_SETTINGS_T settings;
+} INGEST_DEVICE_T;
+
+// A command on its way to a shard, for every device if device_id is empty
+typedef struct INGEST_COMMAND_T_
+{
+    char device_id[WIRE_MAX_DEVICE_ID_LEN + 1];
+    WIRE_COMMAND_T command;
+} INGEST_COMMAND_T;
+
+typedef struct INGEST_CONN_T_
+{
+    struct INGEST_CONN_T_ *prev;
+    struct INGEST_CONN_T_ *next;
+    int fd;
+    WIRE_CODEC_T codec;
+    char device_id[WIRE_MAX_DEVICE_ID_LEN + 1];
+    INGEST_DEVICE_T *device;
+    uint32_t acked_seq;
+    // Whole frames waiting to be sent, and whether EPOLLOUT is armed for them
+    bool tx_armed;
+    size_t tx_off;
+    size_t tx_len;
+    uint8_t tx[INGEST_TX_BUFFER_LEN];
+    size_t len;
+    uint8_t buffer[INGEST_RX_BUFFER_LEN];
+} INGEST_CONN_T;
+
+// Aligned so the counters of neighbouring shards never share a cache line
+typedef struct INGEST_SHARD_T_
+{
+    struct INGEST_SERVER_T_ *server;
+    unsigned index;
+    int listen_fd;
+    int epoll_fd;
+    int stop_fd;
+    int command_fd;
+    pthread_t thread;
+    INGEST_CONN_T *conns;
+    pthread_mutex_t command_lock;
+    unsigned command_count;
+    INGEST_COMMAND_T commands[INGEST_COMMAND_QUEUE];
+    INGEST_STATS_T stats;
+} __attribute__((aligned(64))) INGEST_SHARD_T;
+
+struct INGEST_SERVER_T_
+{
+    INGEST_SINK_T sink;
+    uint16_t port;
+    unsigned shards;
+    INGEST_SHARD_T shard[INGEST_MAX_SHARDS];
+
+    // Only taken when a session starts or a command is sent; records update their device with atomics
+    pthread_mutex_t device_lock;
+    INGEST_DEVICE_T *devices[INGEST_DEVICE_BUCKETS];
+
+    // Settings sent to every device, and the stamp of the last command; guarded by the device lock
+    INGEST_SETTINGS_T settings;
+    uint64_t command_stamp;
+};
+
+// Marks the listening socket, the stop event and the command event in epoll_event.data
+static int iListenTag;
+static int iStopTag;
+static int iCommandTag;
+
+static inline void prvCount(uint64_t *pullCounter, uint64_t ullValue)
+{
+    __atomic_store_n(pullCounter, __atomic_load_n(pullCounter, __ATOMIC_RELAXED) + ullValue, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Open a listening socket that shares its port with the other shards.
+ *
+ * @param pcAddress IPv4 address to listen on, NULL for any.
+ * @param usPort Port to listen on, 0 to let the kernel choose one.
+ *
+ * @return The socket, or -1 on error.
+ */
+static int prvListen(const char *pcAddress, uint16_t usPort)
+{
+    struct sockaddr_in xAddr = {.sin_family = AF_INET, .sin_port = htons(usPort), .sin_addr.s_addr = htonl(INADDR_ANY)};
+    int iOne = 1;
+    int fd;
+
+    if (pcAddress != NULL && inet_pton(AF_INET, pcAddress, &xAddr.sin_addr) != 1)
+    {
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &iOne, sizeof(iOne)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &iOne, sizeof(iOne)) != 0 ||
+        bind(fd, (struct sockaddr *)&xAddr, sizeof(xAddr)) != 0 ||
+        listen(fd, INGEST_BACKLOG) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Find the entry of a device in the table, adding it on its first session.
+ *
+ * @param pxServer Server that owns the table.
+ * @param pcDeviceId Device identifier.
+ *
+ * @return The entry, or NULL if it could not be allocated.
+ */
+static INGEST_DEVICE_T *prvDevice(INGEST_SERVER_T *pxServer, const char *pcDeviceId)
+{
+    // FNV-1a
+    uint32_t ulHash = 2166136261u;
+    INGEST_DEVICE_T *pxDevice;
+
+    for (const char *pc = pcDeviceId; *pc != '\0'; pc++)
+    {
+        ulHash = (ulHash ^ (uint8_t)*pc) * 16777619u;
+    }
+
+    pthread_mutex_lock(&pxServer->device_lock);
+
+    INGEST_DEVICE_T **ppxBucket = &pxServer->devices[ulHash & (INGEST_DEVICE_BUCKETS - 1)];
+
+    for (pxDevice = *ppxBucket; pxDevice != NULL; pxDevice = pxDevice->next)
+    {
+        if (strcmp(pxDevice->device_id, pcDeviceId) == 0)
+        {
+            break;
+        }
+    }
+
+    if (pxDevice == NULL && (pxDevice = calloc(1, sizeof(INGEST_DEVICE_T))) != NULL)
+    {
+        strncpy(pxDevice->device_id, pcDeviceId, WIRE_MAX_DEVICE_ID_LEN);
+        pxDevice->next = *ppxBucket;
+        *ppxBucket = pxDevice;
+    }
+
+    pthread_mutex_unlock(&pxServer->device_lock);
+
+    return pxDevice;
+}
+
+/**
+ * @brief Take a record's sequence number for its device.
+ *
+ * Connections of the same device may overlap on different shards, so the
+ * number only moves up through compare-and-swap.
+ *
+ * @param pxDevice Device that sent the record.
+ * @param ulSeq Sequence number of the record.
+ *
+ * @return false if the device sent the record before.
+ */
+static bool prvTakeSeq(INGEST_DEVICE_T *pxDevice, uint32_t ulSeq)
+{
+    uint32_t ulLast = __atomic_load_n(&pxDevice->last_seq, __ATOMIC_RELAXED);
+
+    do
+    {
+        if (ulSeq <= ulLast)
+        {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&pxDevice->last_seq, &ulLast, ulSeq, true, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    return true;
+}
+
+/**
+ * @brief Write out as much of a connection's queued frames as the socket takes.
+ *
+ * Never blocks the shard: whatever is left waits for EPOLLOUT, which is only
+ * armed while bytes are queued. A broken connection is left to the read side.
+ *
+ * @param pxShard Shard that owns the connection.
+ * @param pxConn Connection to send on.
+ *
+ * @return None.
+ */
+static void prvSend(INGEST_SHARD_T *pxShard, INGEST_CONN_T *pxConn)
+{
+    while (pxConn->tx_off < pxConn->tx_len)
+    {
+        ssize_t xSent = send(pxConn->fd, &pxConn->tx[pxConn->tx_off], pxConn->tx_len - pxConn->tx_off,
+                             MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (xSent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (xSent <= 0)
+        {
+            break;
+        }
+        pxConn->tx_off += (size_t)xSent;
+    }
+
+    if (pxConn->tx_off == pxConn->tx_len)
+    {
+        pxConn->tx_off = 0;
+        pxConn->tx_len = 0;
+    }
+
+    bool xArm = pxConn->tx_len > 0;
+
+    if (xArm != pxConn->tx_armed)
+    {
+        struct epoll_event xEvent = {.events = EPOLLIN | EPOLLRDHUP | (xArm ? EPOLLOUT : 0), .data.ptr = pxConn};
+
+        epoll_ctl(pxShard->epoll_fd, EPOLL_CTL_MOD, pxConn->fd, &xEvent);
+        pxConn->tx_armed = xArm;
+    }
+}
+
+/**
+ * @brief Make room for a frame behind the queued ones.
+ *
+ * Frames are only ever queued whole, a frame cut short would break the stream.
+ *
+ * @param pxConn Connection to queue on.
+ * @param xLen Longest encoding of the frame.
+ *
+ * @return Where to encode the frame, or NULL if it does not fit.
+ */
+static uint8_t *prvTxReserve(INGEST_CONN_T *pxConn, size_t xLen)
+{
+    if (pxConn->tx_off > 0)
+    {
+        memmove(pxConn->tx, &pxConn->tx[pxConn->tx_off], pxConn->tx_len - pxConn->tx_off);
+        pxConn->tx_len -= pxConn->tx_off;
+        pxConn->tx_off = 0;
+    }
+
+    return sizeof(pxConn->tx) - pxConn->tx_len >= xLen ? &pxConn->tx[pxConn->tx_len] : NULL;
+}
+
+/**
+ * @brief Acknowledge the device's records up to the last one taken.
+ *
+ * An ACK that does not fit behind the frames already queued is skipped, as the
+ * next one covers it.
+ *
+ * @param pxShard Shard that owns the connection.
+ * @param pxConn Connection with an open session.
+ *
+ * @return None.
+ */
+static void prvAck(INGEST_SHARD_T *pxShard, INGEST_CONN_T *pxConn)
+{
+    uint32_t ulSeq = __atomic_load_n(&pxConn->device->last_seq, __ATOMIC_RELAXED);
+    uint8_t *pucFrame;
+
+    if (ulSeq != pxConn->acked_seq && (pucFrame = prvTxReserve(pxConn, WIRE_MAX_ACK_LEN)) != NULL)
+    {
+        pxConn->tx_len += xWireEncodeAck(pucFrame, WIRE_MAX_ACK_LEN, ulSeq);
+        pxConn->acked_seq = ulSeq;
+        prvCount(&pxShard->stats.acks, 1);
+    }
+
+    prvSend(pxShard, pxConn);
+}
+
+/**
+ * @brief Queue a command frame on a connection.
+ *
+ * @param pxShard Shard that owns the connection.
+ * @param pxConn Connection with an open session.
+ * @param pxCommand Command to queue.
+ *
+ * @return None.
+ */
+static void prvQueueCommand(INGEST_SHARD_T *pxShard, INGEST_CONN_T *pxConn, const WIRE_COMMAND_T *pxCommand)
+{
+    uint8_t *pucFrame = prvTxReserve(pxConn, WIRE_MAX_COMMAND_LEN);
+
+    if (pucFrame == NULL)
+    {
+        fprintf(stderr, "<ingest> %s: send queue full, command %s dropped\n", pxConn->device_id,
+                pcWireCommandName(pxCommand->id));
+        return;
+    }
+
+    pxConn->tx_len += xWireEncodeCommand(pucFrame, WIRE_MAX_COMMAND_LEN, pxCommand);
+    prvCount(&pxShard->stats.commands, 1);
+}
+
+/**
+ * @brief Queue the controller's settings on a connection whose session just started.
+ *
+ * For every setting the newer of the device's own and the one sent to every device is used.
+ *
+ * @param pxShard Shard that owns the connection.
+ * @param pxConn Connection with an open session.
+ *
+ * @return None.
+ */
+static void prvQueueSettings(INGEST_SHARD_T *pxShard, INGEST_CONN_T *pxConn)
+{
+    INGEST_SERVER_T *pxServer = pxShard->server;
+    WIRE_COMMAND_T xCommands[WIRE_CMD_COUNT];
+    unsigned uCount = 0;
+
+    pthread_mutex_lock(&pxServer->device_lock);
+    for (uint8_t ucId = 0; ucId < WIRE_CMD_COUNT; ucId++)
+    {
+        const INGEST_SETTINGS_T *pxNewer = pxConn->device->settings.stamp[ucId] > pxServer->settings.stamp[ucId]
+                                               ? &pxConn->device->settings
+                                               : &pxServer->settings;
+
+        if (pxNewer->stamp[ucId] != 0)
+        {
+            xCommands[uCount++] = (WIRE_COMMAND_T){.id = ucId, .value = pxNewer->value[ucId]};
+        }
+    }
+    pthread_mutex_unlock(&pxServer->device_lock);
+
+    for (unsigned i = 0; i < uCount; i++)
+    {
+        prvQueueCommand(pxShard, pxConn, &xCommands[i]);
+    }
+}
+
+/**
+ * @brief Queue the commands sent to the shard on the sessions they are for.
+ *
+ * @param pxShard Shard woken by its command event.
+ *
+ * @return None.
+ */
+static void prvShardCommands(INGEST_SHARD_T *pxShard)
+{
+    INGEST_COMMAND_T xCommands[INGEST_COMMAND_QUEUE];
+    unsigned uCount;
+    uint64_t ullValue;
+
+    (void)read(pxShard->command_fd, &ullValue, sizeof(ullValue));
+
+    pthread_mutex_lock(&pxShard->command_lock);
+    uCount = pxShard->command_count;
+    memcpy(xCommands, pxShard->commands, uCount * sizeof(xCommands[0]));
+    pxShard->command_count = 0;
+    pthread_mutex_unlock(&pxShard->command_lock);
+
+    for (INGEST_CONN_T *pxConn = pxShard->conns; pxConn != NULL; pxConn = pxConn->next)
+    {
+        if (pxConn->device == NULL)
+        {
+            continue;
+        }
+        for (unsigned i = 0; i < uCount; i++)
+        {
+            if (xCommands[i].device_id[0] == '\0' || strcmp(xCommands[i].device_id, pxConn->device_id) == 0)
+            {
+                prvQueueCommand(pxShard, pxConn, &xCommands[i].command);
+            }
+        }
+        prvSend(pxShard, pxConn);
+    }
+}
+
+static void prvClose(INGEST_SHARD_T *pxShard, INGEST_CONN_T *pxConn)
+{
+    if (pxConn->prev != NULL)
+    {
+        pxConn->prev->next = pxConn->next;
+    }
+    else
+    {
+        pxShard->conns = pxConn->next;
+    }
+    if (pxConn->next != NULL)
+    {
+        pxConn->next->prev = pxConn->prev;
+    }
+
+    epoll_ctl(pxShard->epoll_fd, EPOLL_CTL_DEL, pxConn->fd, NULL);
+    close(pxConn->fd);
+    free(pxConn);
+    prvCount(&pxShard->stats.closed, 1);
+}
+
+/**
+ * @brief Accept every pending connection on the shard's listening socket.
+ *
+ * @param pxShard Shard that owns the socket.
+ *
+ * @return None.
+ */
+static void prvAccept(INGEST_SHARD_T *pxShard)
+{
+    for (;;)
+    {
+        int fd = accept4(pxShard->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            // EAGAIN once drained; other errors (e.g. EMFILE) are retried on the next wakeup
+            return;
+        }
+
+        INGEST_CONN_T *pxConn = calloc(1, sizeof(INGEST_CONN_T));
+        struct epoll_event xEvent = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = pxConn};
+
+        if (pxConn == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        pxConn->fd = fd;
+
+        if (epoll_ctl(pxShard->epoll_fd, EPOLL_CTL_ADD, fd, &xEvent) != 0)
+        {
+            close(fd);
+            free(pxConn);
+            continue;
+        }
+
+        // Kept on a list so vIngestServerStop() can close idle connections
+        pxConn->next = pxShard->conns;
+        if (pxShard->conns != NULL)
+        {
+            pxShard->conns->prev = pxConn;
+        }
+        pxShard->conns = pxConn;
+        prvCount(&pxShard->stats.accepted, 1);
+    }
+}
+
+/**
+ * @brief Decode and deliver every complete frame buffered on a connection.
+ *
+ * @param pxShard Shard that owns the connection.
+ * @param pxConn Connection to decode.
+ *
+ * @return false if the stream cannot be resynchronised and the connection must be closed.
+ */
+static bool prvDecode(INGEST_SHARD_T *pxShard, INGEST_CONN_T *pxConn)
+{
+    const INGEST_SINK_T *pxSink = &pxShard->server->sink;
+    size_t xOffset = 0;
+    uint64_t ullRecords = 0;
+    uint64_t ullDuplicates = 0;
+    bool xOk = true;
+
+    while (xOffset < pxConn->len)
+    {
+        WIRE_FRAME_T xFrame;
+        size_t xConsumed;
+        WIRE_RESULT_T eResult = eWireDecodeFrame(&pxConn->codec, &pxConn->buffer[xOffset], pxConn->len - xOffset,
+                                                 &xConsumed, &xFrame);
+
+        if (eResult == WIRE_INCOMPLETE)
+        {
+            break;
+        }
+
+        if (eResult == WIRE_OK && xFrame.type == WIRE_FRAME_RECORD)
+        {
+            // Without a table entry the record is delivered rather than lost
+            if (pxConn->device != NULL && !prvTakeSeq(pxConn->device, xFrame.record.seq))
+            {
+                ullDuplicates++;
+            }
+            else
+            {
+                ullRecords++;
+                if (pxSink->record != NULL)
+                {
+                    pxSink->record(pxSink->ctx, pxShard->index, pxConn->device_id, &xFrame.record);
+                }
+            }
+        }
+        else if (eResult == WIRE_OK && xFrame.type == WIRE_FRAME_TELEMETRY)
+        {
+            WIRE_TELEMETRY_T xTelemetry;
+
+            // A bad payload in a well delimited frame is skipped, the records around it still count
+            if (eWireDecodeTelemetry(&xFrame, &xTelemetry) != WIRE_OK)
+            {
+                prvCount(&pxShard->stats.protocol_errors, 1);
+            }
+            else
+            {
+                prvCount(&pxShard->stats.telemetry, 1);
+                if (pxSink->telemetry != NULL)
+                {
+                    pxSink->telemetry(pxSink->ctx, pxShard->index, pxConn->device_id, &xTelemetry);
+                }
+            }
+        }
+        else if (eResult == WIRE_OK && xFrame.type == WIRE_FRAME_HELLO)
+        {
+            memcpy(pxConn->device_id, xFrame.device_id, sizeof(pxConn->device_id));
+            pxConn->device = prvDevice(pxShard->server, pxConn->device_id);
+            pxConn->acked_seq = 0;
+            prvCount(&pxShard->stats.sessions, 1);
+            if (pxSink->session != NULL)
+            {
+                pxSink->session(pxSink->ctx, pxShard->index, pxConn->device_id);
+            }
+            if (pxConn->device != NULL)
+            {
+                prvQueueSettings(pxShard, pxConn);
+            }
+        }
+        else if (eResult == WIRE_BAD_CRC)
+        {
+            prvCount(&pxShard->stats.crc_errors, 1);
+        }
+        else
+        {
+            // Including an ACK or a command, which only the controller sends
+            prvCount(&pxShard->stats.protocol_errors, 1);
+        }
+
+        // A frame that cannot be delimited, or a session that cannot be decoded, ends the connection
+        if (xConsumed == 0 || eResult == WIRE_BAD_VERSION || eResult == WIRE_MALFORMED)
+        {
+            xOk = false;
+            break;
+        }
+        xOffset += xConsumed;
+    }
+
+    prvCount(&pxShard->stats.records, ullRecords);
+    prvCount(&pxShard->stats.duplicates, ullDuplicates);
+
+    memmove(pxConn->buffer, &pxConn->buffer[xOffset], pxConn->len - xOffset);
+    pxConn->len -= xOffset;
+
+    return xOk;
+}
+
+/**
+ * @brief Read everything available on a connection and decode it.
+ *
+ * @param pxShard Shard that owns the connection.
+ * @param pxConn Readable connection.
+ *
+ * @return false if the connection was closed.
+ */
+static bool prvRead(INGEST_SHARD_T *pxShard, INGEST_CONN_T *pxConn)
+{
+    for (;;)
+    {
+        ssize_t xRead = recv(pxConn->fd, &pxConn->buffer[pxConn->len], sizeof(pxConn->buffer) - pxConn->len, 0);
+
+        if (xRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        if (xRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (xRead <= 0)
+        {
+            prvClose(pxShard, pxConn);
+            return false;
+        }
+
+        prvCount(&pxShard->stats.rx_bytes, (uint64_t)xRead);
+        pxConn->len += (size_t)xRead;
+
+        if (!prvDecode(pxShard, pxConn))
+        {
+            prvClose(pxShard, pxConn);
+            return false;
+        }
+
+        // Also right after a hello, so the device learns where the controller is
+        if (pxConn->device != NULL)
+        {
+            prvAck(pxShard, pxConn);
+        }
+    }
+}
+
+static void *prvShardThread(void *pvArg)
+{
+    INGEST_SHARD_T *pxShard = pvArg;
+    struct epoll_event xEvents[INGEST_MAX_EVENTS];
+
+    for (;;)
+    {
+        int iCount = epoll_wait(pxShard->epoll_fd, xEvents, INGEST_MAX_EVENTS, -1);
+
+        for (int i = 0; i < iCount; i++)
+        {
+            if (xEvents[i].data.ptr == &iStopTag)
+            {
+                return NULL;
+            }
+            if (xEvents[i].data.ptr == &iListenTag)
+            {
+                prvAccept(pxShard);
+                continue;
+            }
+            if (xEvents[i].data.ptr == &iCommandTag)
+            {
+                prvShardCommands(pxShard);
+                continue;
+            }
+
+            INGEST_CONN_T *pxConn = xEvents[i].data.ptr;
+
+            if (xEvents[i].events & EPOLLOUT)
+            {
+                prvSend(pxShard, pxConn);
+                if ((xEvents[i].events & ~(uint32_t)EPOLLOUT) == 0)
+                {
+                    continue;
+                }
+            }
+
+            // Read first, a peer that sent its last records and closed still gets them delivered
+            if (prvRead(pxShard, pxConn) && (xEvents[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            {
+                prvClose(pxShard, pxConn);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Create the sockets and epoll instance of a shard.
+ *
+ * @param pxShard Shard to set up, with server and index filled in.
+ * @param pcAddress IPv4 address to listen on, NULL for any.
+ * @param usPort Port to listen on.
+ *
+ * @return true on success.
+ */
+static bool prvShardOpen(INGEST_SHARD_T *pxShard, const char *pcAddress, uint16_t usPort)
+{
+    struct epoll_event xListen = {.events = EPOLLIN, .data.ptr = &iListenTag};
+    struct epoll_event xStop = {.events = EPOLLIN, .data.ptr = &iStopTag};
+    struct epoll_event xCommand = {.events = EPOLLIN, .data.ptr = &iCommandTag};
+
+    pthread_mutex_init(&pxShard->command_lock, NULL);
+    pxShard->listen_fd = prvListen(pcAddress, usPort);
+    pxShard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    pxShard->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pxShard->command_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    return pxShard->listen_fd >= 0 && pxShard->epoll_fd >= 0 && pxShard->stop_fd >= 0 && pxShard->command_fd >= 0 &&
+           epoll_ctl(pxShard->epoll_fd, EPOLL_CTL_ADD, pxShard->listen_fd, &xListen) == 0 &&
+           epoll_ctl(pxShard->epoll_fd, EPOLL_CTL_ADD, pxShard->stop_fd, &xStop) == 0 &&
+           epoll_ctl(pxShard->epoll_fd, EPOLL_CTL_ADD, pxShard->command_fd, &xCommand) == 0;
+}
+
+static void prvShardClose(INGEST_SHARD_T *pxShard)
+{
+    if (pxShard->listen_fd >= 0)
+    {
+        close(pxShard->listen_fd);
+    }
+    if (pxShard->epoll_fd >= 0)
+    {
+        close(pxShard->epoll_fd);
+    }
+    if (pxShard->stop_fd >= 0)
+    {
+        close(pxShard->stop_fd);
+    }
+    if (pxShard->command_fd >= 0)
+    {
+        close(pxShard->command_fd);
+    }
+    pthread_mutex_destroy(&pxShard->command_lock);
+}
+
+/**
+ * @brief Start an ingest server.
+ *
+ * @param pcAddress IPv4 address to listen on, NULL for any.
+ * @param usPort Port to listen on, 0 to let the kernel choose one.
+ * @param uShards Number of shard threads, at most INGEST_MAX_SHARDS.
+ * @param pxSink Sink that receives sessions and records; copied.
+ *
+ * @return The running server, or NULL if it could not be started.
+ */
+INGEST_SERVER_T *pxIngestServerStart(const char *pcAddress, uint16_t usPort, unsigned uShards, const INGEST_SINK_T *pxSink)
+{
+    INGEST_SERVER_T *pxServer;
+    unsigned uOpened = 0;
+    unsigned uStarted = 0;
+
+    if (uShards == 0 || uShards > INGEST_MAX_SHARDS)
+    {
+        return NULL;
+    }
+
+    if (posix_memalign((void **)&pxServer, 64, sizeof(*pxServer)) != 0)
+    {
+        return NULL;
+    }
+    memset(pxServer, 0, sizeof(*pxServer));
+    pthread_mutex_init(&pxServer->device_lock, NULL);
+    pxServer->sink = *pxSink;
+    pxServer->shards = uShards;
+    pxServer->port = usPort;
+
+    for (; uOpened < uShards; uOpened++)
+    {
+        INGEST_SHARD_T *pxShard = &pxServer->shard[uOpened];
+
+        pxShard->server = pxServer;
+        pxShard->index = uOpened;
+        if (!prvShardOpen(pxShard, pcAddress, pxServer->port))
+        {
+            prvShardClose(pxShard);
+            goto fail;
+        }
+
+        // The first shard picks the port when asked for any, the others join it
+        if (pxServer->port == 0)
+        {
+            struct sockaddr_in xAddr;
+            socklen_t xLen = sizeof(xAddr);
+
+            getsockname(pxShard->listen_fd, (struct sockaddr *)&xAddr, &xLen);
+            pxServer->port = ntohs(xAddr.sin_port);
+        }
+    }
+
+    for (; uStarted < uShards; uStarted++)
+    {
+        if (pthread_create(&pxServer->shard[uStarted].thread, NULL, prvShardThread, &pxServer->shard[uStarted]) != 0)
+        {
+            goto fail;
+        }
+    }
+
+    return pxServer;
+
+fail:
+    for (unsigned i = 0; i < uStarted; i++)
+    {
+        uint64_t ullOne = 1;
+        (void)write(pxServer->shard[i].stop_fd, &ullOne, sizeof(ullOne));
+        pthread_join(pxServer->shard[i].thread, NULL);
+    }
+    for (unsigned i = 0; i < uOpened; i++)
+    {
+        prvShardClose(&pxServer->shard[i]);
+    }
+    pthread_mutex_destroy(&pxServer->device_lock);
+    free(pxServer);
+
+    return NULL;
+}
+
+/**
+ * @brief Return the port the server listens on.
+ *
+ * @param pxServer Running server.
+ *
+ * @return The port.
+ */
+uint16_t usIngestServerPort(const INGEST_SERVER_T *pxServer)
+{
+    return pxServer->port;
+}
+
+/**
+ * @brief Send a command to a device, or to every device.
+ *
+ * Safe to call from any thread. Every shard is woken to write the command to
+ * the matching sessions it has open; a device without one gets a setting when
+ * it next connects.
+ *
+ * @param pxServer Running server.
+ * @param pcDeviceId Device to send the command to, NULL for every device.
+ * @param pxCommand Command to send.
+ *
+ * @return false if the command is unknown or a shard's queue is full.
+ */
+bool xIngestServerCommand(INGEST_SERVER_T *pxServer, const char *pcDeviceId, const WIRE_COMMAND_T *pxCommand)
+{
+    INGEST_COMMAND_T xQueued = {.command = *pxCommand};
+    bool xOk = true;
+
+    if (pcWireCommandName(pxCommand->id) == NULL)
+    {
+        return false;
+    }
+
+    if (pcDeviceId != NULL)
+    {
+        strncpy(xQueued.device_id, pcDeviceId, WIRE_MAX_DEVICE_ID_LEN);
+    }
+
+    // A clear is an action rather than a setting, it is not sent again on the next session
+    if (pxCommand->id != WIRE_CMD_CLEAR)
+    {
+        INGEST_DEVICE_T *pxDevice = pcDeviceId != NULL ? prvDevice(pxServer, xQueued.device_id) : NULL;
+
+        if (pcDeviceId != NULL && pxDevice == NULL)
+        {
+            return false;
+        }
+
+        pthread_mutex_lock(&pxServer->device_lock);
+        INGEST_SETTINGS_T *pxSettings = pxDevice != NULL ? &pxDevice->settings : &pxServer->settings;
+
+        pxSettings->value[pxCommand->id] = pxCommand->value;
+        pxSettings->stamp[pxCommand->id] = ++pxServer->command_stamp;
+        pthread_mutex_unlock(&pxServer->device_lock);
+    }
+
+    for (unsigned i = 0; i < pxServer->shards; i++)
+    {
+        INGEST_SHARD_T *pxShard = &pxServer->shard[i];
+        uint64_t ullOne = 1;
+
+        pthread_mutex_lock(&pxShard->command_lock);
+        if (pxShard->command_count < INGEST_COMMAND_QUEUE)
+        {
+            pxShard->commands[pxShard->command_count++] = xQueued;
+        }
+        else
+        {
+            xOk = false;
+        }
+        pthread_mutex_unlock(&pxShard->command_lock);
+
+        (void)write(pxShard->command_fd, &ullOne, sizeof(ullOne));
+    }
+
+    return xOk;
+}
+
+/**
+ * @brief Sum the counters of all shards.
+ *
+ * The counters are read without stopping the shards, so they may be slightly behind.
+ *
+ * @param pxServer Running server.
+ * @param pxStats Destination for the totals.
+ *
+ * @return None.
+ */
+void vIngestServerStats(const INGEST_SERVER_T *pxServer, INGEST_STATS_T *pxStats)
+{
+    *pxStats = (INGEST_STATS_T){0};
+
+    for (unsigned i = 0; i < pxServer->shards; i++)
+    {
+        const INGEST_STATS_T *pxShard = &pxServer->shard[i].stats;
+
+        pxStats->accepted += __atomic_load_n(&pxShard->accepted, __ATOMIC_RELAXED);
+        pxStats->closed += __atomic_load_n(&pxShard->closed, __ATOMIC_RELAXED);
+        pxStats->sessions += __atomic_load_n(&pxShard->sessions, __ATOMIC_RELAXED);
+        pxStats->records += __atomic_load_n(&pxShard->records, __ATOMIC_RELAXED);
+        pxStats->duplicates += __atomic_load_n(&pxShard->duplicates, __ATOMIC_RELAXED);
+        pxStats->telemetry += __atomic_load_n(&pxShard->telemetry, __ATOMIC_RELAXED);
+        pxStats->acks += __atomic_load_n(&pxShard->acks, __ATOMIC_RELAXED);
+        pxStats->commands += __atomic_load_n(&pxShard->commands, __ATOMIC_RELAXED);
+        pxStats->rx_bytes += __atomic_load_n(&pxShard->rx_bytes, __ATOMIC_RELAXED);
+        pxStats->crc_errors += __atomic_load_n(&pxShard->crc_errors, __ATOMIC_RELAXED);
+        pxStats->protocol_errors += __atomic_load_n(&pxShard->protocol_errors, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Stop the shards, close every connection and free the server.
+ *
+ * @param pxServer Server to stop.
+ *
+ * @return None.
+ */
+void vIngestServerStop(INGEST_SERVER_T *pxServer)
+{
+    for (unsigned i = 0; i < pxServer->shards; i++)
+    {
+        uint64_t ullOne = 1;
+        (void)write(pxServer->shard[i].stop_fd, &ullOne, sizeof(ullOne));
+    }
+
+    for (unsigned i = 0; i < pxServer->shards; i++)
+    {
+        INGEST_SHARD_T *pxShard = &pxServer->shard[i];
+
+        pthread_join(pxShard->thread, NULL);
+
+        while (pxShard->conns != NULL)
+        {
+            prvClose(pxShard, pxShard->conns);
+        }
+        prvShardClose(pxShard);
+    }
+
+    for (unsigned i = 0; i < INGEST_DEVICE_BUCKETS; i++)
+    {
+        while (pxServer->devices[i] != NULL)
+        {
+            INGEST_DEVICE_T *pxDevice = pxServer->devices[i];
+
+            pxServer->devices[i] = pxDevice->next;
+            free(pxDevice);
+        }
+    }
+    pthread_mutex_destroy(&pxServer->device_lock);
+
+    free(pxServer);
+}
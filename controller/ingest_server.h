@@ -0,0 +1,146 @@
+/**
+ * @file ingest_server.h
+ *
+ * @brief Header file for the controller's record ingest server.
+ *
+ * Devices connect to TCP_PORT and send the binary wire format from
+ * src/protocol/wire_format.h. The server runs one shard thread per core, each
+ * with its own SO_REUSEPORT listening socket and epoll instance, so the kernel
+ * spreads connections across shards and a connection is only ever touched by
+ * the thread that accepted it. Decoded records are handed to a sink, whose
+ * callbacks run on the shard threads concurrently.
+ *
+ * The server remembers the highest sequence number taken from every device,
+ * in a table shared by the shards since a reconnect may land on another one.
+ * A record that is not above it was replayed by the device after an ACK was
+ * lost and is dropped, so the sink sees every record once. The table is only
+ * kept in memory: after a controller restart the records a device replays are
+ * delivered again. The sequence number is acknowledged back after every read
+ * and when a session starts, so a device resumes where the controller is.
+ *
+ * Commands are sent down to a device, or to every device, with
+ * xIngestServerCommand(). They are queued for the shards, which write them to
+ * the connections they own. The latest value of every setting is remembered,
+ * for each device and for every device, and the newer of the two is sent again
+ * whenever a session starts, so a device that was offline or restarted comes
+ * back with the controller's settings. A clear is only sent to the sessions
+ * that are open.
+ */
+
+#ifndef INGEST_SERVER_H_
+#define INGEST_SERVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Most shard threads a server runs
+#define INGEST_MAX_SHARDS 64
+
+// Bytes buffered per connection; holds many frames of WIRE_MAX_RECORD_LEN
+#define INGEST_RX_BUFFER_LEN 4096
+
+// Listen backlog of every shard
+#define INGEST_BACKLOG 1024
+
+// Buckets of the device table, a power of two
+#define INGEST_DEVICE_BUCKETS 4096
+
+// Bytes queued for sending per connection; holds an ACK and a command for every setting
+#define INGEST_TX_BUFFER_LEN 256
+
+// Commands waiting for a shard to send them
+#define INGEST_COMMAND_QUEUE 64
+
+// Type definitions
+typedef struct INGEST_SINK_T_
+{
+    void *ctx;
+
+    // A device started a session; called again if it reconnects
+    void (*session)(void *ctx, unsigned shard, const char *device_id);
+
+    // A record arrived from a device with an open session, never one it sent before
+    void (*record)(void *ctx, unsigned shard, const char *device_id, const WIRE_RECORD_T *record);
+
+    // A device reported its health; telemetry is neither acknowledged nor deduplicated
+    void (*telemetry)(void *ctx, unsigned shard, const char *device_id, const WIRE_TELEMETRY_T *telemetry);
+} INGEST_SINK_T;
+
+typedef struct INGEST_STATS_T_
+{
+    uint64_t accepted;
+    uint64_t closed;
+    uint64_t sessions;
+    uint64_t records;
+    uint64_t duplicates;
+    uint64_t telemetry;
+    uint64_t acks;
+    uint64_t commands;
+    uint64_t rx_bytes;
+    uint64_t crc_errors;
+    uint64_t protocol_errors;
+} INGEST_STATS_T;
+
+typedef struct INGEST_SERVER_T_ INGEST_SERVER_T;
+
+/**
+ * @brief Start an ingest server.
+ *
+ * @param pcAddress IPv4 address to listen on, NULL for any.
+ * @param usPort Port to listen on, 0 to let the kernel choose one.
+ * @param uShards Number of shard threads, at most INGEST_MAX_SHARDS.
+ * @param pxSink Sink that receives sessions, records and telemetry; copied.
+ *
+ * @return The running server, or NULL if it could not be started.
+ */
+INGEST_SERVER_T *pxIngestServerStart(const char *pcAddress, uint16_t usPort, unsigned uShards, const INGEST_SINK_T *pxSink);
+
+/**
+ * @brief Return the port the server listens on.
+ *
+ * @param pxServer Running server.
+ *
+ * @return The port.
+ */
+uint16_t usIngestServerPort(const INGEST_SERVER_T *pxServer);
+
+/**
+ * @brief Send a command to a device, or to every device.
+ *
+ * Safe to call from any thread. Every shard is woken to write the command to
+ * the matching sessions it has open; a device without one gets a setting when
+ * it next connects.
+ *
+ * @param pxServer Running server.
+ * @param pcDeviceId Device to send the command to, NULL for every device.
+ * @param pxCommand Command to send.
+ *
+ * @return false if the command is unknown or a shard's queue is full.
+ */
+bool xIngestServerCommand(INGEST_SERVER_T *pxServer, const char *pcDeviceId, const WIRE_COMMAND_T *pxCommand);
+
+/**
+ * @brief Sum the counters of all shards.
+ *
+ * The counters are read without stopping the shards, so they may be slightly behind.
+ *
+ * @param pxServer Running server.
+ * @param pxStats Destination for the totals.
+ *
+ * @return None.
+ */
+void vIngestServerStats(const INGEST_SERVER_T *pxServer, INGEST_STATS_T *pxStats);
+
+/**
+ * @brief Stop the shards, close every connection and free the server.
+ *
+ * @param pxServer Server to stop.
+ *
+ * @return None.
+ */
+void vIngestServerStop(INGEST_SERVER_T *pxServer);
+
+#endif /* INGEST_SERVER_H_ */
@@ -0,0 +1,134 @@
+/**
+ * @file latency_histogram.c
+ *
+ * @brief Source file for the log-linear latency histogram of the host tools.
+ */
+
+// Standard includes
+#include <stdio.h>
+
+// Project includes
+#include "latency_histogram.h"
+
+static unsigned prvBucket(uint32_t ulValue)
+{
+    unsigned uExp;
+
+    if (ulValue < LATENCY_SUB_BUCKETS)
+    {
+        return ulValue;
+    }
+    uExp = 31u - (unsigned)__builtin_clz(ulValue);
+
+    return ((uExp - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + ((ulValue >> (uExp - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+static uint32_t prvBucketValue(unsigned uBucket)
+{
+    unsigned uExp = uBucket >> LATENCY_SUB_BITS;
+
+    if (uExp == 0)
+    {
+        return uBucket;
+    }
+
+    // Upper edge of the bucket
+    return ((LATENCY_SUB_BUCKETS | (uBucket & (LATENCY_SUB_BUCKETS - 1))) + 1) << (uExp - 1);
+}
+
+/**
+ * @brief Count a value.
+ *
+ * @param pxHistogram Histogram to update.
+ * @param ulValue Value, in any unit.
+ *
+ * @return None.
+ */
+void vLatencyHistogramAdd(LATENCY_HISTOGRAM_T *pxHistogram, uint32_t ulValue)
+{
+    pxHistogram->bucket[prvBucket(ulValue)]++;
+    pxHistogram->count++;
+    if (ulValue > pxHistogram->max)
+    {
+        pxHistogram->max = ulValue;
+    }
+}
+
+/**
+ * @brief Add the counts of one histogram to another.
+ *
+ * @param pxInto Histogram to update.
+ * @param pxFrom Histogram to add.
+ *
+ * @return None.
+ */
+void vLatencyHistogramMerge(LATENCY_HISTOGRAM_T *pxInto, const LATENCY_HISTOGRAM_T *pxFrom)
+{
+    for (unsigned b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        pxInto->bucket[b] += pxFrom->bucket[b];
+    }
+    pxInto->count += pxFrom->count;
+    if (pxFrom->max > pxInto->max)
+    {
+        pxInto->max = pxFrom->max;
+    }
+}
+
+/**
+ * @brief Return the value below which a fraction of the counted values lie.
+ *
+ * @param pxHistogram Histogram to read.
+ * @param dQuantile Fraction between 0 and 1; 1 returns the largest value counted.
+ *
+ * @return The upper edge of the bucket holding the quantile, 0 if nothing was counted.
+ */
+uint32_t ulLatencyHistogramQuantile(const LATENCY_HISTOGRAM_T *pxHistogram, double dQuantile)
+{
+    uint64_t ullRank = (uint64_t)(dQuantile * (double)pxHistogram->count);
+    uint64_t ullSeen = 0;
+
+    if (pxHistogram->count == 0)
+    {
+        return 0;
+    }
+    if (ullRank >= pxHistogram->count)
+    {
+        return pxHistogram->max;
+    }
+
+    for (unsigned b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        ullSeen += pxHistogram->bucket[b];
+        if (ullSeen > ullRank)
+        {
+            uint32_t ulEdge = prvBucketValue(b);
+            return ulEdge < pxHistogram->max ? ulEdge : pxHistogram->max;
+        }
+    }
+
+    return pxHistogram->max;
+}
+
+/**
+ * @brief Print the p50, p90, p99 and p99.9 quantiles and the maximum, one per line.
+ *
+ * @param pxHistogram Histogram to print.
+ * @param pcName Name printed in front of every quantile.
+ * @param pcUnit Unit of the counted values.
+ *
+ * @return None.
+ */
+void vLatencyHistogramPrint(const LATENCY_HISTOGRAM_T *pxHistogram, const char *pcName, const char *pcUnit)
+{
+    static const double dQuantile[] = {0.5, 0.9, 0.99, 0.999};
+    char cLabel[64];
+
+    for (size_t q = 0; q < sizeof(dQuantile) / sizeof(dQuantile[0]); q++)
+    {
+        snprintf(cLabel, sizeof(cLabel), "%s p%g", pcName, dQuantile[q] * 100);
+        printf("%-24s <= %lu %s\n", cLabel, (unsigned long)ulLatencyHistogramQuantile(pxHistogram, dQuantile[q]), pcUnit);
+    }
+    snprintf(cLabel, sizeof(cLabel), "%s max", pcName);
+    printf("%-24s %lu %s\n", cLabel, (unsigned long)pxHistogram->max, pcUnit);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file latency_histogram.h
+ *
+ * @brief Header file for the log-linear latency histogram of the host tools.
+ *
+ * Values are counted in LATENCY_SUB_BUCKETS buckets per power of two, so any
+ * quantile is reported to within 1/16 of its value over the whole 32 bit
+ * range. A histogram is not locked; give every thread its own and merge them
+ * once the threads are done.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+
+// Buckets per power of two, as a number of bits
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1u << LATENCY_SUB_BITS)
+
+#define LATENCY_BUCKETS (32 << LATENCY_SUB_BITS)
+
+// Type definitions
+// Aligned so histograms owned by different threads never share a cache line
+typedef struct LATENCY_HISTOGRAM_T_
+{
+    uint64_t count;
+    uint32_t max;
+    uint64_t bucket[LATENCY_BUCKETS];
+} __attribute__((aligned(64))) LATENCY_HISTOGRAM_T;
+
+/**
+ * @brief Count a value.
+ *
+ * @param pxHistogram Histogram to update.
+ * @param ulValue Value, in any unit.
+ *
+ * @return None.
+ */
+void vLatencyHistogramAdd(LATENCY_HISTOGRAM_T *pxHistogram, uint32_t ulValue);
+
+/**
+ * @brief Add the counts of one histogram to another.
+ *
+ * @param pxInto Histogram to update.
+ * @param pxFrom Histogram to add.
+ *
+ * @return None.
+ */
+void vLatencyHistogramMerge(LATENCY_HISTOGRAM_T *pxInto, const LATENCY_HISTOGRAM_T *pxFrom);
+
+/**
+ * @brief Return the value below which a fraction of the counted values lie.
+ *
+ * @param pxHistogram Histogram to read.
+ * @param dQuantile Fraction between 0 and 1; 1 returns the largest value counted.
+ *
+ * @return The upper edge of the bucket holding the quantile, 0 if nothing was counted.
+ */
+uint32_t ulLatencyHistogramQuantile(const LATENCY_HISTOGRAM_T *pxHistogram, double dQuantile);
+
+/**
+ * @brief Print the p50, p90, p99 and p99.9 quantiles and the maximum, one per line.
+ *
+ * @param pxHistogram Histogram to print.
+ * @param pcName Name printed in front of every quantile.
+ * @param pcUnit Unit of the counted values.
+ *
+ * @return None.
+ */
+void vLatencyHistogramPrint(const LATENCY_HISTOGRAM_T *pxHistogram, const char *pcName, const char *pcUnit);
+
+#endif /* LATENCY_HISTOGRAM_H_ */
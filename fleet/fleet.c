@@ -0,0 +1,905 @@
+/**
+ * @file fleet.c
+ *
+ * @brief Source file for the fleet load generator.
+ */
+
+#define _GNU_SOURCE
+
+// Standard includes
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Linux includes
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Meter includes
+#include "meter/flow_stats.h"
+#include "meter/meter_parser.h"
+#include "meter/volume_tracker.h"
+
+// Project includes
+#include "fleet.h"
+
+// Largest segment a device writes, TCP_BATCH_MAX_BYTES in the firmware
+#define FLEET_SEGMENT_MAX_BYTES (WIRE_MAX_HELLO_LEN + FLEET_BATCH_MAX_RECORDS * WIRE_MAX_RECORD_LEN)
+
+// Flow varies by up to this fraction either side of the event's mean from one meter line to the next
+#define FLEET_FLOW_JITTER 0.1
+
+// Events handled per epoll_wait call
+#define FLEET_MAX_EVENTS 256
+
+// Longest a worker sleeps, so stop requests, storms and outages are noticed
+#define FLEET_MAX_WAIT_MS 100
+
+// The states of vTaskTCP
+typedef enum
+{
+    FLEET_STATE_CONNECTING = 0,
+    FLEET_STATE_ESTABLISHED,
+    FLEET_STATE_DRAINING,
+    FLEET_STATE_BACKOFF,
+} FLEET_STATE_T;
+
+typedef struct FLEET_DEVICE_T_
+{
+    unsigned id;
+    unsigned heap_index;
+    int fd;
+    FLEET_STATE_T state;
+
+    // Next time the device needs its timer serviced, the key of the worker's heap
+    uint64_t due_ms;
+
+    // Fleet time the device booted; its uptime is the record clock
+    uint64_t boot_ms;
+
+    uint64_t state_us;
+    uint32_t retry_ms;
+    uint32_t backoff_ms;
+
+    // Fleet time the next usage event ends, and how long it lasts
+    uint64_t event_ms;
+    uint32_t event_duration_ms;
+
+    uint64_t rng;
+    int32_t meter_volume_milli;
+    VOLUME_TRACKER_T volume;
+
+    // Records waiting for a batch, the TCP stream buffer of the firmware, numbered from 1 like the outbox does
+    uint32_t last_seq;
+    WIRE_RECORD_T queue[FLEET_QUEUE_RECORDS];
+    uint32_t queue_head;
+    uint32_t queue_count;
+
+    // Segment being written
+    WIRE_CODEC_T codec;
+    uint32_t out_len;
+    uint32_t out_sent;
+    uint32_t out_records;
+    uint8_t out[FLEET_SEGMENT_MAX_BYTES];
+} FLEET_DEVICE_T;
+
+// Aligned so the counters of neighbouring workers never share a cache line
+typedef struct FLEET_WORKER_T_
+{
+    struct FLEET_T_ *fleet;
+    pthread_t thread;
+    int epoll_fd;
+    FLEET_DEVICE_T *devices;
+    unsigned count;
+    FLEET_DEVICE_T **heap;
+    bool network_down;
+    uint64_t next_storm_ms;
+    FLEET_STATS_T stats;
+    LATENCY_HISTOGRAM_T connect_us;
+} __attribute__((aligned(64))) FLEET_WORKER_T;
+
+struct FLEET_T_
+{
+    FLEET_CONFIG_T config;
+    struct sockaddr_in addr;
+    uint64_t start_us;
+    bool stop;
+    unsigned started;
+    FLEET_DEVICE_T *devices;
+    FLEET_WORKER_T worker[FLEET_MAX_WORKERS];
+};
+
+static inline void prvCount(uint64_t *pullCounter, uint64_t ullValue)
+{
+    __atomic_store_n(pullCounter, __atomic_load_n(pullCounter, __ATOMIC_RELAXED) + ullValue, __ATOMIC_RELAXED);
+}
+
+static uint64_t prvMonotonicUs(void)
+{
+    struct timespec xNow;
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+    return (uint64_t)xNow.tv_sec * 1000000ULL + (uint64_t)xNow.tv_nsec / 1000;
+}
+
+/**
+ * @brief xorshift64*, one generator per device so workers never share state.
+ *
+ * @return A uniform random number in [0, 1).
+ */
+static double prvRandom(uint64_t *pullState)
+{
+    uint64_t x = *pullState;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *pullState = x;
+
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+}
+
+static double prvSample(const FLEET_DIST_T *pxDist, uint64_t *pullState)
+{
+    switch (pxDist->kind)
+    {
+    case FLEET_DIST_UNIFORM:
+        return pxDist->a + (pxDist->b - pxDist->a) * prvRandom(pullState);
+    case FLEET_DIST_EXP:
+        return -pxDist->a * log(1.0 - prvRandom(pullState));
+    default:
+        return pxDist->a;
+    }
+}
+
+/**
+ * @brief Parse a distribution given as const:A, uniform:A:B or exp:MEAN.
+ *
+ * @param pcSpec Text to parse.
+ * @param pxDist Destination for the distribution.
+ *
+ * @return true if the text was a valid distribution.
+ */
+bool xFleetParseDist(const char *pcSpec, FLEET_DIST_T *pxDist)
+{
+    if (sscanf(pcSpec, "uniform:%lf:%lf", &pxDist->a, &pxDist->b) == 2)
+    {
+        pxDist->kind = FLEET_DIST_UNIFORM;
+        return pxDist->a >= 0 && pxDist->b >= pxDist->a;
+    }
+    if (sscanf(pcSpec, "exp:%lf", &pxDist->a) == 1)
+    {
+        pxDist->kind = FLEET_DIST_EXP;
+        pxDist->b = 0;
+        return pxDist->a > 0;
+    }
+    if (sscanf(pcSpec, "const:%lf", &pxDist->a) == 1)
+    {
+        pxDist->kind = FLEET_DIST_CONST;
+        pxDist->b = 0;
+        return pxDist->a >= 0;
+    }
+
+    return false;
+}
+
+static void prvHeapSwap(FLEET_DEVICE_T **pxHeap, unsigned a, unsigned b)
+{
+    FLEET_DEVICE_T *pxTmp = pxHeap[a];
+
+    pxHeap[a] = pxHeap[b];
+    pxHeap[b] = pxTmp;
+    pxHeap[a]->heap_index = a;
+    pxHeap[b]->heap_index = b;
+}
+
+/**
+ * @brief Restore the heap order after a device's due time changed.
+ */
+static void prvHeapFix(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice)
+{
+    FLEET_DEVICE_T **pxHeap = pxWorker->heap;
+    unsigned i = pxDevice->heap_index;
+
+    while (i > 0 && pxHeap[(i - 1) / 2]->due_ms > pxHeap[i]->due_ms)
+    {
+        prvHeapSwap(pxHeap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    for (;;)
+    {
+        unsigned uLeft = 2 * i + 1;
+        unsigned uSmallest = i;
+
+        if (uLeft < pxWorker->count && pxHeap[uLeft]->due_ms < pxHeap[uSmallest]->due_ms)
+        {
+            uSmallest = uLeft;
+        }
+        if (uLeft + 1 < pxWorker->count && pxHeap[uLeft + 1]->due_ms < pxHeap[uSmallest]->due_ms)
+        {
+            uSmallest = uLeft + 1;
+        }
+        if (uSmallest == i)
+        {
+            return;
+        }
+        prvHeapSwap(pxHeap, i, uSmallest);
+        i = uSmallest;
+    }
+}
+
+/**
+ * @brief Work out when the device next needs its timer serviced.
+ */
+static void prvDeviceSchedule(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice)
+{
+    uint64_t ullDue = pxDevice->event_ms;
+    uint64_t ullTimer = UINT64_MAX;
+
+    switch (pxDevice->state)
+    {
+    case FLEET_STATE_BACKOFF:
+        ullTimer = pxDevice->state_us / 1000 + pxDevice->retry_ms;
+        break;
+    case FLEET_STATE_CONNECTING:
+        ullTimer = pxDevice->state_us / 1000 + FLEET_CONNECT_TIMEOUT_MS;
+        break;
+    case FLEET_STATE_ESTABLISHED:
+        if (pxDevice->queue_count > 0)
+        {
+            ullTimer = pxDevice->boot_ms + pxDevice->queue[pxDevice->queue_head].time_ms + FLEET_BATCH_FLUSH_MS;
+        }
+        break;
+    default:
+        break;
+    }
+
+    pxDevice->due_ms = ullTimer < ullDue ? ullTimer : ullDue;
+    prvHeapFix(pxWorker, pxDevice);
+}
+
+static void prvDeviceWatch(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint32_t ulEvents)
+{
+    struct epoll_event xEvent = {.events = ulEvents, .data.ptr = pxDevice};
+
+    epoll_ctl(pxWorker->epoll_fd, EPOLL_CTL_MOD, pxDevice->fd, &xEvent);
+}
+
+/**
+ * @brief Schedule the next usage event after the one that just ended.
+ */
+static void prvDeviceNextEvent(const FLEET_CONFIG_T *pxConfig, FLEET_DEVICE_T *pxDevice)
+{
+    double dGap = prvSample(&pxConfig->interval_s, &pxDevice->rng) * 1000.0;
+    double dDuration = prvSample(&pxConfig->duration_s, &pxDevice->rng) * 1000.0;
+
+    pxDevice->event_duration_ms = dDuration < FLEET_SAMPLE_MS ? FLEET_SAMPLE_MS : (uint32_t)dDuration;
+    pxDevice->event_ms += (uint64_t)dGap + pxDevice->event_duration_ms;
+}
+
+/**
+ * @brief Play the meter lines of a usage event through the firmware's statistics and queue its record.
+ */
+static void prvDeviceEvent(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice)
+{
+    const FLEET_CONFIG_T *pxConfig = &pxWorker->fleet->config;
+    uint32_t ulEnd = (uint32_t)(pxDevice->event_ms - pxDevice->boot_ms);
+    uint32_t ulStart = ulEnd - pxDevice->event_duration_ms;
+    int32_t lMean = (int32_t)(prvSample(&pxConfig->flow, &pxDevice->rng) * METER_SCALE);
+    FLOW_STATS_T xStats;
+    FLOW_SUMMARY_T xSummary;
+
+    vFlowStatsReset(&xStats);
+
+    for (uint32_t t = ulStart; t < ulEnd; t += FLEET_SAMPLE_MS)
+    {
+        int32_t lFlow = lMean + (int32_t)((prvRandom(&pxDevice->rng) * 2.0 - 1.0) * FLEET_FLOW_JITTER * lMean);
+        uint32_t ulHold = ulEnd - t < FLEET_SAMPLE_MS ? ulEnd - t : FLEET_SAMPLE_MS;
+
+        if (lFlow < 1)
+        {
+            lFlow = 1;
+        }
+
+        // Each line reports the total so far and the current flow, which the total follows until the next line
+        lVolumeTrackerUpdate(&pxDevice->volume, pxDevice->meter_volume_milli);
+        vFlowStatsAdd(&xStats, t, lFlow);
+        pxDevice->meter_volume_milli = (int32_t)((pxDevice->meter_volume_milli + (int64_t)lFlow * ulHold / 60000) %
+                                                 METER_VOLUME_WRAP_MILLI);
+    }
+
+    // The line with zero flow ends the event, as in vTaskUART
+    lVolumeTrackerUpdate(&pxDevice->volume, pxDevice->meter_volume_milli);
+    vFlowStatsFinish(&xStats, ulEnd);
+    vFlowStatsSummary(&xStats, &xSummary);
+
+    prvCount(&pxWorker->stats.events, 1);
+
+    if (pxDevice->queue_count == FLEET_QUEUE_RECORDS)
+    {
+        prvCount(&pxWorker->stats.records_dropped, 1);
+        lVolumeTrackerTake(&pxDevice->volume);
+    }
+    else
+    {
+        pxDevice->queue[(pxDevice->queue_head + pxDevice->queue_count) % FLEET_QUEUE_RECORDS] = (WIRE_RECORD_T){
+            .seq = ++pxDevice->last_seq,
+            .time_ms = ulEnd,
+            .volume_milli = lVolumeTrackerTake(&pxDevice->volume),
+            .mean_flow_milli = xSummary.mean_flow_milli,
+            .min_flow_milli = xSummary.min_flow_milli,
+            .max_flow_milli = xSummary.max_flow_milli,
+            .stddev_flow_milli = xSummary.stddev_flow_milli,
+            .duration_ms = xSummary.duration_ms,
+            .count = xSummary.count,
+        };
+        pxDevice->queue_count++;
+    }
+
+    prvDeviceNextEvent(pxConfig, pxDevice);
+}
+
+/**
+ * @brief Drop the connection and wait before reconnecting, as vTCPClientBackoff() does.
+ */
+static void prvDeviceBackoff(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    if (pxDevice->fd >= 0)
+    {
+        // Reset rather than close, so storms do not leave thousands of ports in TIME_WAIT
+        struct linger xLinger = {.l_onoff = 1, .l_linger = 0};
+
+        setsockopt(pxDevice->fd, SOL_SOCKET, SO_LINGER, &xLinger, sizeof(xLinger));
+        close(pxDevice->fd);
+        pxDevice->fd = -1;
+    }
+
+    // Records of a segment that was not written completely are gone, like unacknowledged ones on the device
+    if (pxDevice->out_len > 0)
+    {
+        prvCount(&pxWorker->stats.records_lost, pxDevice->out_records);
+        pxDevice->out_len = 0;
+    }
+
+    pxDevice->state = FLEET_STATE_BACKOFF;
+    pxDevice->state_us = ullNowUs;
+    pxDevice->retry_ms = pxDevice->backoff_ms;
+    pxDevice->backoff_ms = pxDevice->backoff_ms >= FLEET_BACKOFF_MAX_MS / 2 ? FLEET_BACKOFF_MAX_MS : pxDevice->backoff_ms * 2;
+}
+
+static void prvDeviceClosed(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    if (pxDevice->state == FLEET_STATE_CONNECTING)
+    {
+        prvCount(&pxWorker->stats.connect_failures, 1);
+    }
+    else
+    {
+        prvCount(&pxWorker->stats.disconnects, 1);
+    }
+    prvDeviceBackoff(pxWorker, pxDevice, ullNowUs);
+}
+
+static void prvDeviceOpen(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    const struct sockaddr_in *pxAddr = &pxWorker->fleet->addr;
+    struct epoll_event xEvent = {.events = EPOLLOUT, .data.ptr = pxDevice};
+
+    prvCount(&pxWorker->stats.connect_attempts, 1);
+    pxDevice->state = FLEET_STATE_CONNECTING;
+
+    // A storm opens thousands of connections in one pass, so time each from its own connect()
+    pxDevice->state_us = prvMonotonicUs() - pxWorker->fleet->start_us;
+
+    if (pxWorker->network_down)
+    {
+        prvDeviceClosed(pxWorker, pxDevice, ullNowUs);
+        return;
+    }
+
+    pxDevice->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (pxDevice->fd < 0 ||
+        (connect(pxDevice->fd, (const struct sockaddr *)pxAddr, sizeof(*pxAddr)) != 0 && errno != EINPROGRESS) ||
+        epoll_ctl(pxWorker->epoll_fd, EPOLL_CTL_ADD, pxDevice->fd, &xEvent) != 0)
+    {
+        prvDeviceClosed(pxWorker, pxDevice, ullNowUs);
+    }
+}
+
+/**
+ * @brief Write the rest of the current segment.
+ */
+static void prvDeviceSend(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    while (pxDevice->out_sent < pxDevice->out_len)
+    {
+        ssize_t xSent = send(pxDevice->fd, &pxDevice->out[pxDevice->out_sent], pxDevice->out_len - pxDevice->out_sent,
+                             MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (xSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (pxDevice->state != FLEET_STATE_DRAINING)
+            {
+                pxDevice->state = FLEET_STATE_DRAINING;
+                prvDeviceWatch(pxWorker, pxDevice, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+            }
+            return;
+        }
+        if (xSent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (xSent < 0)
+        {
+            prvDeviceClosed(pxWorker, pxDevice, ullNowUs);
+            return;
+        }
+        pxDevice->out_sent += (uint32_t)xSent;
+    }
+
+    prvCount(&pxWorker->stats.records_sent, pxDevice->out_records);
+    prvCount(&pxWorker->stats.segments, 1);
+    prvCount(&pxWorker->stats.tx_bytes, pxDevice->out_len);
+    pxDevice->out_len = 0;
+
+    if (pxDevice->state == FLEET_STATE_DRAINING)
+    {
+        pxDevice->state = FLEET_STATE_ESTABLISHED;
+        prvDeviceWatch(pxWorker, pxDevice, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+/**
+ * @brief Send batches while one is full or its oldest record has waited FLEET_BATCH_FLUSH_MS.
+ */
+static void prvDeviceFlush(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    while (pxDevice->state == FLEET_STATE_ESTABLISHED && pxDevice->queue_count > 0)
+    {
+        uint32_t ulCount = pxDevice->queue_count < FLEET_BATCH_MAX_RECORDS ? pxDevice->queue_count : FLEET_BATCH_MAX_RECORDS;
+        size_t xLen = 0;
+
+        if (ulCount < FLEET_BATCH_MAX_RECORDS &&
+            ullNowUs / 1000 < pxDevice->boot_ms + pxDevice->queue[pxDevice->queue_head].time_ms + FLEET_BATCH_FLUSH_MS)
+        {
+            return;
+        }
+
+        // The first segment of a connection opens the session
+        if (!pxDevice->codec.session)
+        {
+            char cDeviceId[WIRE_MAX_DEVICE_ID_LEN + 1];
+
+            snprintf(cDeviceId, sizeof(cDeviceId), FLEET_DEVICE_PREFIX "%05u", pxDevice->id);
+            xLen = xWireEncodeHello(&pxDevice->codec, pxDevice->out, sizeof(pxDevice->out), cDeviceId);
+        }
+        for (uint32_t i = 0; i < ulCount; i++)
+        {
+            xLen += xWireEncodeRecord(&pxDevice->codec, &pxDevice->out[xLen], sizeof(pxDevice->out) - xLen,
+                                      &pxDevice->queue[(pxDevice->queue_head + i) % FLEET_QUEUE_RECORDS]);
+        }
+        pxDevice->queue_head = (pxDevice->queue_head + ulCount) % FLEET_QUEUE_RECORDS;
+        pxDevice->queue_count -= ulCount;
+
+        pxDevice->out_len = (uint32_t)xLen;
+        pxDevice->out_sent = 0;
+        pxDevice->out_records = ulCount;
+        prvDeviceSend(pxWorker, pxDevice, ullNowUs);
+    }
+}
+
+/**
+ * @brief Finish a connection attempt once the socket reports writable.
+ */
+static void prvDeviceConnected(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    int iError = 0;
+    socklen_t xLen = sizeof(iError);
+
+    if (getsockopt(pxDevice->fd, SOL_SOCKET, SO_ERROR, &iError, &xLen) != 0 || iError != 0)
+    {
+        prvDeviceClosed(pxWorker, pxDevice, ullNowUs);
+        return;
+    }
+
+    prvCount(&pxWorker->stats.connects, 1);
+    vLatencyHistogramAdd(&pxWorker->connect_us, (uint32_t)(ullNowUs - pxDevice->state_us));
+
+    pxDevice->state = FLEET_STATE_ESTABLISHED;
+    pxDevice->state_us = ullNowUs;
+    pxDevice->backoff_ms = FLEET_BACKOFF_MIN_MS;
+    pxDevice->codec.session = false;
+    prvDeviceWatch(pxWorker, pxDevice, EPOLLIN | EPOLLRDHUP);
+}
+
+/**
+ * @brief Read and discard whatever the controller sends, its ACK frames included; notice when it closes.
+ */
+static void prvDeviceRead(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    uint8_t ucBuffer[256];
+
+    for (;;)
+    {
+        ssize_t xRead = recv(pxDevice->fd, ucBuffer, sizeof(ucBuffer), MSG_DONTWAIT);
+
+        if (xRead > 0)
+        {
+            continue;
+        }
+        if (xRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        if (xRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        prvDeviceClosed(pxWorker, pxDevice, ullNowUs);
+        return;
+    }
+}
+
+static void prvDeviceIo(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint32_t ulEvents, uint64_t ullNowUs)
+{
+    if (pxDevice->state == FLEET_STATE_CONNECTING)
+    {
+        prvDeviceConnected(pxWorker, pxDevice, ullNowUs);
+    }
+    else if (pxDevice->state == FLEET_STATE_DRAINING && (ulEvents & EPOLLOUT))
+    {
+        prvDeviceSend(pxWorker, pxDevice, ullNowUs);
+    }
+
+    if ((pxDevice->state == FLEET_STATE_ESTABLISHED || pxDevice->state == FLEET_STATE_DRAINING) &&
+        (ulEvents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+    {
+        prvDeviceRead(pxWorker, pxDevice, ullNowUs);
+    }
+
+    // A connection that just opened or drained may replay a backlog at once
+    prvDeviceFlush(pxWorker, pxDevice, ullNowUs);
+    prvDeviceSchedule(pxWorker, pxDevice);
+}
+
+static void prvDeviceTick(FLEET_WORKER_T *pxWorker, FLEET_DEVICE_T *pxDevice, uint64_t ullNowUs)
+{
+    uint64_t ullNowMs = ullNowUs / 1000;
+
+    while (pxDevice->event_ms <= ullNowMs)
+    {
+        prvDeviceEvent(pxWorker, pxDevice);
+    }
+
+    switch (pxDevice->state)
+    {
+    case FLEET_STATE_BACKOFF:
+        if (ullNowMs >= pxDevice->state_us / 1000 + pxDevice->retry_ms)
+        {
+            prvDeviceOpen(pxWorker, pxDevice, ullNowUs);
+        }
+        break;
+    case FLEET_STATE_CONNECTING:
+        if (ullNowMs >= pxDevice->state_us / 1000 + FLEET_CONNECT_TIMEOUT_MS)
+        {
+            prvDeviceClosed(pxWorker, pxDevice, ullNowUs);
+        }
+        break;
+    case FLEET_STATE_ESTABLISHED:
+        prvDeviceFlush(pxWorker, pxDevice, ullNowUs);
+        break;
+    default:
+        break;
+    }
+
+    prvDeviceSchedule(pxWorker, pxDevice);
+}
+
+/**
+ * @brief Drop every connection of the worker at once.
+ */
+static void prvWorkerDropAll(FLEET_WORKER_T *pxWorker, uint64_t ullNowUs)
+{
+    for (unsigned i = 0; i < pxWorker->count; i++)
+    {
+        FLEET_DEVICE_T *pxDevice = &pxWorker->devices[i];
+
+        if (pxDevice->state != FLEET_STATE_BACKOFF)
+        {
+            prvDeviceClosed(pxWorker, pxDevice, ullNowUs);
+            prvDeviceSchedule(pxWorker, pxDevice);
+        }
+    }
+}
+
+/**
+ * @brief Apply reconnect storms and outages that are due.
+ */
+static void prvWorkerNetwork(FLEET_WORKER_T *pxWorker, uint64_t ullNowUs)
+{
+    const FLEET_CONFIG_T *pxConfig = &pxWorker->fleet->config;
+    uint64_t ullNowMs = ullNowUs / 1000;
+
+    if (pxConfig->storm_period_ms > 0 && ullNowMs >= pxWorker->next_storm_ms)
+    {
+        prvWorkerDropAll(pxWorker, ullNowUs);
+        pxWorker->next_storm_ms += pxConfig->storm_period_ms;
+    }
+
+    if (pxConfig->outage_period_ms > 0)
+    {
+        bool xDown = ullNowMs >= pxConfig->outage_period_ms && ullNowMs % pxConfig->outage_period_ms < pxConfig->outage_ms;
+
+        if (xDown && !pxWorker->network_down)
+        {
+            prvWorkerDropAll(pxWorker, ullNowUs);
+        }
+        pxWorker->network_down = xDown;
+    }
+}
+
+static void *prvWorkerThread(void *pvArg)
+{
+    FLEET_WORKER_T *pxWorker = pvArg;
+    FLEET_T *pxFleet = pxWorker->fleet;
+    struct epoll_event xEvents[FLEET_MAX_EVENTS];
+
+    while (!__atomic_load_n(&pxFleet->stop, __ATOMIC_RELAXED))
+    {
+        uint64_t ullNowUs = prvMonotonicUs() - pxFleet->start_us;
+        int iWaitMs;
+        int iCount;
+
+        prvWorkerNetwork(pxWorker, ullNowUs);
+
+        while (pxWorker->heap[0]->due_ms <= ullNowUs / 1000)
+        {
+            prvDeviceTick(pxWorker, pxWorker->heap[0], ullNowUs);
+        }
+
+        iWaitMs = pxWorker->heap[0]->due_ms - ullNowUs / 1000 < FLEET_MAX_WAIT_MS
+                      ? (int)(pxWorker->heap[0]->due_ms - ullNowUs / 1000)
+                      : FLEET_MAX_WAIT_MS;
+        iCount = epoll_wait(pxWorker->epoll_fd, xEvents, FLEET_MAX_EVENTS, iWaitMs);
+
+        ullNowUs = prvMonotonicUs() - pxFleet->start_us;
+        for (int i = 0; i < iCount; i++)
+        {
+            prvDeviceIo(pxWorker, xEvents[i].data.ptr, xEvents[i].events, ullNowUs);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Create the devices of a fleet without starting them.
+ *
+ * @param pxConfig Fleet configuration; copied, address must outlive the fleet.
+ *
+ * @return The fleet, or NULL if it could not be allocated.
+ */
+FLEET_T *pxFleetCreate(const FLEET_CONFIG_T *pxConfig)
+{
+    FLEET_T *pxFleet;
+
+    if (pxConfig->devices == 0 || pxConfig->workers == 0 || pxConfig->workers > FLEET_MAX_WORKERS ||
+        pxConfig->workers > pxConfig->devices)
+    {
+        return NULL;
+    }
+
+    if (posix_memalign((void **)&pxFleet, 64, sizeof(*pxFleet)) != 0)
+    {
+        return NULL;
+    }
+    memset(pxFleet, 0, sizeof(*pxFleet));
+    pxFleet->config = *pxConfig;
+    pxFleet->addr = (struct sockaddr_in){.sin_family = AF_INET, .sin_port = htons(pxConfig->port),
+                                         .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    for (unsigned w = 0; w < FLEET_MAX_WORKERS; w++)
+    {
+        pxFleet->worker[w].epoll_fd = -1;
+    }
+
+    if ((pxConfig->address != NULL && inet_pton(AF_INET, pxConfig->address, &pxFleet->addr.sin_addr) != 1) ||
+        (pxFleet->devices = calloc(pxConfig->devices, sizeof(FLEET_DEVICE_T))) == NULL)
+    {
+        free(pxFleet);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < pxConfig->devices; i++)
+    {
+        FLEET_DEVICE_T *pxDevice = &pxFleet->devices[i];
+
+        pxDevice->id = i;
+        pxDevice->fd = -1;
+        pxDevice->rng = (pxConfig->seed + 1) * 0x9E3779B97F4A7C15ULL ^ (i + 1) * 0xBF58476D1CE4E5B9ULL;
+        pxDevice->boot_ms = (uint64_t)pxConfig->ramp_ms * i / pxConfig->devices;
+        pxDevice->meter_volume_milli = (int32_t)(prvRandom(&pxDevice->rng) * METER_VOLUME_WRAP_MILLI);
+        vVolumeTrackerReset(&pxDevice->volume);
+
+        // Boot straight into a connection attempt, with the first usage event some time later
+        pxDevice->state = FLEET_STATE_BACKOFF;
+        pxDevice->state_us = pxDevice->boot_ms * 1000;
+        pxDevice->retry_ms = 0;
+        pxDevice->backoff_ms = FLEET_BACKOFF_MIN_MS;
+        pxDevice->event_ms = pxDevice->boot_ms;
+        prvDeviceNextEvent(pxConfig, pxDevice);
+    }
+
+    for (unsigned w = 0; w < pxConfig->workers; w++)
+    {
+        FLEET_WORKER_T *pxWorker = &pxFleet->worker[w];
+        unsigned uFirst = pxConfig->devices * w / pxConfig->workers;
+
+        pxWorker->fleet = pxFleet;
+        pxWorker->devices = &pxFleet->devices[uFirst];
+        pxWorker->count = pxConfig->devices * (w + 1) / pxConfig->workers - uFirst;
+        pxWorker->next_storm_ms = pxConfig->storm_period_ms;
+        pxWorker->heap = calloc(pxWorker->count, sizeof(FLEET_DEVICE_T *));
+        pxWorker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (pxWorker->heap == NULL || pxWorker->epoll_fd < 0)
+        {
+            vFleetStop(pxFleet, NULL);
+            return NULL;
+        }
+
+        // Every due time starts at 0, a valid heap that each schedule keeps valid
+        for (unsigned i = 0; i < pxWorker->count; i++)
+        {
+            pxWorker->heap[i] = &pxWorker->devices[i];
+            pxWorker->devices[i].heap_index = i;
+        }
+        for (unsigned i = 0; i < pxWorker->count; i++)
+        {
+            prvDeviceSchedule(pxWorker, &pxWorker->devices[i]);
+        }
+    }
+
+    return pxFleet;
+}
+
+/**
+ * @brief Start the worker threads; the devices boot over the configured ramp.
+ *
+ * @param pxFleet Fleet to start.
+ *
+ * @return true if every worker started.
+ */
+bool xFleetStart(FLEET_T *pxFleet)
+{
+    pxFleet->start_us = prvMonotonicUs();
+
+    for (; pxFleet->started < pxFleet->config.workers; pxFleet->started++)
+    {
+        FLEET_WORKER_T *pxWorker = &pxFleet->worker[pxFleet->started];
+
+        if (pthread_create(&pxWorker->thread, NULL, prvWorkerThread, pxWorker) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Sum the counters of all workers.
+ *
+ * The counters are read without stopping the workers, so they may be slightly behind.
+ *
+ * @param pxFleet Running fleet.
+ * @param pxStats Destination for the totals.
+ *
+ * @return None.
+ */
+void vFleetStats(const FLEET_T *pxFleet, FLEET_STATS_T *pxStats)
+{
+    *pxStats = (FLEET_STATS_T){0};
+
+    for (unsigned i = 0; i < pxFleet->config.workers; i++)
+    {
+        const FLEET_STATS_T *pxWorker = &pxFleet->worker[i].stats;
+
+        pxStats->connect_attempts += __atomic_load_n(&pxWorker->connect_attempts, __ATOMIC_RELAXED);
+        pxStats->connects += __atomic_load_n(&pxWorker->connects, __ATOMIC_RELAXED);
+        pxStats->connect_failures += __atomic_load_n(&pxWorker->connect_failures, __ATOMIC_RELAXED);
+        pxStats->disconnects += __atomic_load_n(&pxWorker->disconnects, __ATOMIC_RELAXED);
+        pxStats->events += __atomic_load_n(&pxWorker->events, __ATOMIC_RELAXED);
+        pxStats->records_sent += __atomic_load_n(&pxWorker->records_sent, __ATOMIC_RELAXED);
+        pxStats->records_dropped += __atomic_load_n(&pxWorker->records_dropped, __ATOMIC_RELAXED);
+        pxStats->records_lost += __atomic_load_n(&pxWorker->records_lost, __ATOMIC_RELAXED);
+        pxStats->segments += __atomic_load_n(&pxWorker->segments, __ATOMIC_RELAXED);
+        pxStats->tx_bytes += __atomic_load_n(&pxWorker->tx_bytes, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Return how long ago a record's usage event ended.
+ *
+ * Safe to call from any thread, e.g. from an ingest sink.
+ *
+ * @param pxFleet Running fleet.
+ * @param pcDeviceId ID of the device that sent the record.
+ * @param pxRecord The record.
+ * @param pulAgeUs Destination for the age in microseconds.
+ *
+ * @return false if the device is not part of the fleet.
+ */
+bool xFleetRecordAge(const FLEET_T *pxFleet, const char *pcDeviceId, const WIRE_RECORD_T *pxRecord, uint32_t *pulAgeUs)
+{
+    size_t xPrefix = strlen(FLEET_DEVICE_PREFIX);
+    char *pcEnd;
+    unsigned long ulId;
+    int64_t llAge;
+
+    if (strncmp(pcDeviceId, FLEET_DEVICE_PREFIX, xPrefix) != 0)
+    {
+        return false;
+    }
+    ulId = strtoul(&pcDeviceId[xPrefix], &pcEnd, 10);
+    if (*pcEnd != '\0' || ulId >= pxFleet->config.devices)
+    {
+        return false;
+    }
+
+    // Boot times never change once the fleet is created, so no locking is needed
+    llAge = (int64_t)(prvMonotonicUs() - pxFleet->start_us) -
+            (int64_t)(pxFleet->devices[ulId].boot_ms + pxRecord->time_ms) * 1000;
+    *pulAgeUs = llAge < 0 ? 0 : llAge > UINT32_MAX ? UINT32_MAX : (uint32_t)llAge;
+
+    return true;
+}
+
+/**
+ * @brief Stop the workers, close every connection and free the fleet.
+ *
+ * @param pxFleet Fleet to stop.
+ * @param pxConnectUs Histogram the connection setup times are added to, or NULL.
+ *
+ * @return None.
+ */
+void vFleetStop(FLEET_T *pxFleet, LATENCY_HISTOGRAM_T *pxConnectUs)
+{
+    __atomic_store_n(&pxFleet->stop, true, __ATOMIC_RELAXED);
+
+    for (unsigned w = 0; w < pxFleet->started; w++)
+    {
+        pthread_join(pxFleet->worker[w].thread, NULL);
+    }
+
+    for (unsigned w = 0; w < FLEET_MAX_WORKERS; w++)
+    {
+        FLEET_WORKER_T *pxWorker = &pxFleet->worker[w];
+
+        if (pxConnectUs != NULL)
+        {
+            vLatencyHistogramMerge(pxConnectUs, &pxWorker->connect_us);
+        }
+        if (pxWorker->epoll_fd >= 0)
+        {
+            close(pxWorker->epoll_fd);
+        }
+        free(pxWorker->heap);
+    }
+
+    for (unsigned i = 0; i < pxFleet->config.devices; i++)
+    {
+        if (pxFleet->devices[i].fd >= 0)
+        {
+            close(pxFleet->devices[i].fd);
+        }
+    }
+
+    free(pxFleet->devices);
+    free(pxFleet);
+}
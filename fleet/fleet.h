@@ -0,0 +1,169 @@
+/**
+ * @file fleet.h
+ *
+ * @brief Header file for the fleet load generator.
+ *
+ * Simulates many devices against a controller from one Linux process. Every
+ * device is a small state machine that mirrors the firmware's uplink: usage
+ * events are summarised with the firmware's own flow statistics and volume
+ * tracker into WIRE_RECORD_T records, queued like the TCP stream buffer,
+ * batched and encoded in the wire format, and sent over a connection that is
+ * reopened with the same doubling backoff as vTaskTCP. Devices are spread
+ * over worker threads, each running an epoll loop and a timer heap, so tens
+ * of thousands of devices cost a few threads and no per-device stacks.
+ *
+ * On top of steady load the fleet can reset every connection at once (a
+ * reconnect storm) or take the network away for a while and bring it back
+ * (an outage, after which every device replays its queued records at once).
+ */
+
+#ifndef FLEET_H_
+#define FLEET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Project includes
+#include "latency_histogram.h"
+
+// Uplink behaviour of the firmware; the headers that define it need FreeRTOS and lwIP
+#define FLEET_BATCH_MAX_RECORDS 16                           // TCP_BATCH_MAX_RECORDS
+#define FLEET_BATCH_FLUSH_MS 2000                            // TCP_BATCH_FLUSH_MS
+#define FLEET_QUEUE_RECORDS (2 * FLEET_BATCH_MAX_RECORDS)    // TCP_TX_BUFFER_LEN in records
+#define FLEET_CONNECT_TIMEOUT_MS 10000                       // TCP_CONNECT_TIMEOUT_MS
+#define FLEET_BACKOFF_MIN_MS 1000                            // TCP_BACKOFF_MIN_MS
+#define FLEET_BACKOFF_MAX_MS 60000                           // TCP_BACKOFF_MAX_MS
+
+// Interval between meter lines while water flows
+#define FLEET_SAMPLE_MS 1000
+
+// Most worker threads a fleet runs
+#define FLEET_MAX_WORKERS 64
+
+// Device IDs are this prefix and the device number
+#define FLEET_DEVICE_PREFIX "FLEET"
+
+// Type definitions
+typedef enum
+{
+    FLEET_DIST_CONST = 0,
+    FLEET_DIST_UNIFORM,
+    FLEET_DIST_EXP,
+} FLEET_DIST_KIND_T;
+
+// A random quantity: const:A, uniform:A:B or exp:MEAN
+typedef struct FLEET_DIST_T_
+{
+    FLEET_DIST_KIND_T kind;
+    double a;
+    double b;
+} FLEET_DIST_T;
+
+typedef struct FLEET_CONFIG_T_
+{
+    const char *address;
+    uint16_t port;
+    unsigned devices;
+    unsigned workers;
+    uint32_t seed;
+
+    // Devices boot spread evenly over this time
+    uint32_t ramp_ms;
+
+    // Time between usage events and their length in seconds, and their flow in meter units per minute
+    FLEET_DIST_T interval_s;
+    FLEET_DIST_T duration_s;
+    FLEET_DIST_T flow;
+
+    // Reset every connection with this period; 0 for never
+    uint32_t storm_period_ms;
+
+    // Take the network down for outage_ms every outage_period_ms; 0 for never
+    uint32_t outage_period_ms;
+    uint32_t outage_ms;
+} FLEET_CONFIG_T;
+
+typedef struct FLEET_STATS_T_
+{
+    uint64_t connect_attempts;
+    uint64_t connects;
+    uint64_t connect_failures;
+    uint64_t disconnects;
+    uint64_t events;
+    uint64_t records_sent;
+    uint64_t records_dropped;
+    uint64_t records_lost;
+    uint64_t segments;
+    uint64_t tx_bytes;
+} FLEET_STATS_T;
+
+typedef struct FLEET_T_ FLEET_T;
+
+/**
+ * @brief Parse a distribution given as const:A, uniform:A:B or exp:MEAN.
+ *
+ * @param pcSpec Text to parse.
+ * @param pxDist Destination for the distribution.
+ *
+ * @return true if the text was a valid distribution.
+ */
+bool xFleetParseDist(const char *pcSpec, FLEET_DIST_T *pxDist);
+
+/**
+ * @brief Create the devices of a fleet without starting them.
+ *
+ * @param pxConfig Fleet configuration; copied, address must outlive the fleet.
+ *
+ * @return The fleet, or NULL if it could not be allocated.
+ */
+FLEET_T *pxFleetCreate(const FLEET_CONFIG_T *pxConfig);
+
+/**
+ * @brief Start the worker threads; the devices boot over the configured ramp.
+ *
+ * @param pxFleet Fleet to start.
+ *
+ * @return true if every worker started.
+ */
+bool xFleetStart(FLEET_T *pxFleet);
+
+/**
+ * @brief Sum the counters of all workers.
+ *
+ * The counters are read without stopping the workers, so they may be slightly behind.
+ *
+ * @param pxFleet Running fleet.
+ * @param pxStats Destination for the totals.
+ *
+ * @return None.
+ */
+void vFleetStats(const FLEET_T *pxFleet, FLEET_STATS_T *pxStats);
+
+/**
+ * @brief Return how long ago a record's usage event ended.
+ *
+ * Safe to call from any thread, e.g. from an ingest sink.
+ *
+ * @param pxFleet Running fleet.
+ * @param pcDeviceId ID of the device that sent the record.
+ * @param pxRecord The record.
+ * @param pulAgeUs Destination for the age in microseconds.
+ *
+ * @return false if the device is not part of the fleet.
+ */
+bool xFleetRecordAge(const FLEET_T *pxFleet, const char *pcDeviceId, const WIRE_RECORD_T *pxRecord, uint32_t *pulAgeUs);
+
+/**
+ * @brief Stop the workers, close every connection and free the fleet.
+ *
+ * @param pxFleet Fleet to stop.
+ * @param pxConnectUs Histogram the connection setup times are added to, or NULL.
+ *
+ * @return None.
+ */
+void vFleetStop(FLEET_T *pxFleet, LATENCY_HISTOGRAM_T *pxConnectUs);
+
+#endif /* FLEET_H_ */
@@ -0,0 +1,305 @@
+/**
+ * @file fleet_main.c
+ *
+ * @brief Load generator that runs a fleet of simulated devices against a controller.
+ *
+ * Without -a the fleet runs against an ingest server started in the same
+ * process on loopback, which also measures how old every record is when it
+ * is decoded, from the end of its usage event. That age includes the time
+ * the record waited in the device's queue and batch, so it is what the
+ * controller sees. With -a the fleet drives an external controller and only
+ * the device side is measured.
+ *
+ * Once a second a line with the connection and record rates is printed; the
+ * totals and the connection setup and record age percentiles follow at the end.
+ *
+ * Usage: fleet [-n devices] [-w workers] [-a address] [-p port] [-S shards] [-t seconds]
+ *              [-r ramp seconds] [-i interval] [-d duration] [-f flow]
+ *              [-s storm period] [-o outage period:outage length] [-x seed]
+ */
+
+// Standard includes
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Linux includes
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Project includes
+#include "fleet.h"
+#include "ingest_server.h"
+#include "latency_histogram.h"
+
+#define FLEET_DEFAULT_DEVICES 1000
+#define FLEET_DEFAULT_SECONDS 60
+#define FLEET_DEFAULT_RAMP_S 10
+#define FLEET_DEFAULT_INTERVAL "exp:60"
+#define FLEET_DEFAULT_DURATION "uniform:5:60"
+#define FLEET_DEFAULT_FLOW "uniform:2:12"
+
+// Port of the controller, TCP_PORT in the firmware
+#define FLEET_DEFAULT_PORT 65400
+
+// Longest time the in-process server is given to decode what the devices sent last
+#define FLEET_DRAIN_MS 2000
+
+static volatile sig_atomic_t xStop;
+
+// Fleet the in-process sink measures record ages against, set before the fleet starts
+static FLEET_T *pxSinkFleet;
+
+// One histogram per shard, so the sink never takes a lock
+static LATENCY_HISTOGRAM_T xAgeMs[INGEST_MAX_SHARDS];
+
+static void prvOnSignal(int iSignal)
+{
+    (void)iSignal;
+    xStop = 1;
+}
+
+static void prvOnRecord(void *pvCtx, unsigned uShard, const char *pcDeviceId, const WIRE_RECORD_T *pxRecord)
+{
+    FLEET_T *pxFleet = __atomic_load_n(&pxSinkFleet, __ATOMIC_ACQUIRE);
+    uint32_t ulAgeUs;
+
+    (void)pvCtx;
+
+    if (pxFleet != NULL && xFleetRecordAge(pxFleet, pcDeviceId, pxRecord, &ulAgeUs))
+    {
+        vLatencyHistogramAdd(&xAgeMs[uShard], ulAgeUs / 1000);
+    }
+}
+
+static void prvSleepMs(unsigned uMs)
+{
+    struct timespec xSleep = {.tv_sec = uMs / 1000, .tv_nsec = (long)(uMs % 1000) * 1000000L};
+    nanosleep(&xSleep, NULL);
+}
+
+static int prvUsage(const char *pcName)
+{
+    fprintf(stderr,
+            "usage: %s [-n devices] [-w workers] [-a address] [-p port] [-S shards] [-t seconds]\n"
+            "          [-r ramp seconds] [-i interval] [-d duration] [-f flow]\n"
+            "          [-s storm period] [-o outage period:outage length] [-x seed]\n"
+            "interval and duration in seconds, flow in meter units per minute,\n"
+            "each given as const:A, uniform:A:B or exp:MEAN\n",
+            pcName);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    FLEET_CONFIG_T xConfig = {
+        .port = FLEET_DEFAULT_PORT,
+        .devices = FLEET_DEFAULT_DEVICES,
+        .workers = 1,
+        .ramp_ms = FLEET_DEFAULT_RAMP_S * 1000,
+    };
+    unsigned long ulSeconds = FLEET_DEFAULT_SECONDS;
+    long lShards = 1;
+    INGEST_SERVER_T *pxServer = NULL;
+    FLEET_T *pxFleet;
+    FLEET_STATS_T xLast = {0};
+    FLEET_STATS_T xStats;
+    INGEST_STATS_T xIngest = {0};
+    uint64_t ullLastIngest = 0;
+    LATENCY_HISTOGRAM_T xConnectUs = {0};
+    LATENCY_HISTOGRAM_T xAge = {0};
+    struct rlimit xFiles;
+    double dOutagePeriod = 0;
+    double dOutage = 0;
+    int iOpt;
+
+    xFleetParseDist(FLEET_DEFAULT_INTERVAL, &xConfig.interval_s);
+    xFleetParseDist(FLEET_DEFAULT_DURATION, &xConfig.duration_s);
+    xFleetParseDist(FLEET_DEFAULT_FLOW, &xConfig.flow);
+
+    while ((iOpt = getopt(argc, argv, "n:w:a:p:S:t:r:i:d:f:s:o:x:")) != -1)
+    {
+        switch (iOpt)
+        {
+        case 'n':
+            xConfig.devices = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            xConfig.workers = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            xConfig.address = optarg;
+            break;
+        case 'p':
+            xConfig.port = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            lShards = strtol(optarg, NULL, 0);
+            break;
+        case 't':
+            ulSeconds = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            xConfig.ramp_ms = (uint32_t)(strtod(optarg, NULL) * 1000);
+            break;
+        case 'i':
+            if (!xFleetParseDist(optarg, &xConfig.interval_s))
+            {
+                return prvUsage(argv[0]);
+            }
+            break;
+        case 'd':
+            if (!xFleetParseDist(optarg, &xConfig.duration_s))
+            {
+                return prvUsage(argv[0]);
+            }
+            break;
+        case 'f':
+            if (!xFleetParseDist(optarg, &xConfig.flow))
+            {
+                return prvUsage(argv[0]);
+            }
+            break;
+        case 's':
+            xConfig.storm_period_ms = (uint32_t)(strtod(optarg, NULL) * 1000);
+            break;
+        case 'o':
+            if (sscanf(optarg, "%lf:%lf", &dOutagePeriod, &dOutage) != 2 || dOutage >= dOutagePeriod)
+            {
+                return prvUsage(argv[0]);
+            }
+            xConfig.outage_period_ms = (uint32_t)(dOutagePeriod * 1000);
+            xConfig.outage_ms = (uint32_t)(dOutage * 1000);
+            break;
+        case 'x':
+            xConfig.seed = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            return prvUsage(argv[0]);
+        }
+    }
+
+    if (lShards < 1 || lShards > INGEST_MAX_SHARDS)
+    {
+        return prvUsage(argv[0]);
+    }
+
+    // Every device holds a socket, and so does the in-process server for each of them
+    if (getrlimit(RLIMIT_NOFILE, &xFiles) == 0 && xFiles.rlim_cur < xFiles.rlim_max)
+    {
+        xFiles.rlim_cur = xFiles.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &xFiles);
+    }
+
+    signal(SIGINT, prvOnSignal);
+    signal(SIGTERM, prvOnSignal);
+
+    if (xConfig.address == NULL)
+    {
+        INGEST_SINK_T xSink = {.record = prvOnRecord};
+
+        pxServer = pxIngestServerStart("127.0.0.1", 0, (unsigned)lShards, &xSink);
+        if (pxServer == NULL)
+        {
+            perror("<fleet> failed to start the ingest server");
+            return 1;
+        }
+        xConfig.port = usIngestServerPort(pxServer);
+    }
+
+    pxFleet = pxFleetCreate(&xConfig);
+    if (pxFleet == NULL)
+    {
+        fprintf(stderr, "<fleet> failed to create %u devices on %u workers\n", xConfig.devices, xConfig.workers);
+        return prvUsage(argv[0]);
+    }
+    __atomic_store_n(&pxSinkFleet, pxFleet, __ATOMIC_RELEASE);
+
+    printf("%u devices on %u workers against %s:%u%s\n", xConfig.devices, xConfig.workers,
+           xConfig.address != NULL ? xConfig.address : "127.0.0.1", xConfig.port,
+           pxServer != NULL ? " (in-process server)" : "");
+    printf("%5s %7s %8s %8s %8s %10s %10s %8s %8s\n", "t", "open", "conn/s", "fail/s", "disc/s",
+           "events/s", "sent/s", "ingest/s", "lost");
+
+    if (!xFleetStart(pxFleet))
+    {
+        perror("<fleet> failed to start the workers");
+        return 1;
+    }
+
+    for (unsigned long t = 1; t <= ulSeconds && !xStop; t++)
+    {
+        prvSleepMs(1000);
+
+        vFleetStats(pxFleet, &xStats);
+        if (pxServer != NULL)
+        {
+            vIngestServerStats(pxServer, &xIngest);
+        }
+
+        printf("%5lu %7llu %8llu %8llu %8llu %10llu %10llu %8llu %8llu\n", t,
+               (unsigned long long)(xStats.connects - xStats.disconnects),
+               (unsigned long long)(xStats.connects - xLast.connects),
+               (unsigned long long)(xStats.connect_failures - xLast.connect_failures),
+               (unsigned long long)(xStats.disconnects - xLast.disconnects),
+               (unsigned long long)(xStats.events - xLast.events),
+               (unsigned long long)(xStats.records_sent - xLast.records_sent),
+               (unsigned long long)(xIngest.records - ullLastIngest),
+               (unsigned long long)xStats.records_lost);
+        fflush(stdout);
+
+        xLast = xStats;
+        ullLastIngest = xIngest.records;
+    }
+
+    vFleetStats(pxFleet, &xStats);
+    vFleetStop(pxFleet, &xConnectUs);
+
+    if (pxServer != NULL)
+    {
+        // Let the server decode what the devices wrote before they were stopped
+        for (unsigned uWaited = 0; uWaited < FLEET_DRAIN_MS; uWaited += 10)
+        {
+            vIngestServerStats(pxServer, &xIngest);
+            if (xIngest.records >= xStats.records_sent)
+            {
+                break;
+            }
+            prvSleepMs(10);
+        }
+        __atomic_store_n(&pxSinkFleet, NULL, __ATOMIC_RELEASE);
+        vIngestServerStats(pxServer, &xIngest);
+        vIngestServerStop(pxServer);
+
+        for (long s = 0; s < lShards; s++)
+        {
+            vLatencyHistogramMerge(&xAge, &xAgeMs[s]);
+        }
+    }
+
+    printf("%-24s %llu of %llu, %llu failed\n", "connects", (unsigned long long)xStats.connects,
+           (unsigned long long)xStats.connect_attempts, (unsigned long long)xStats.connect_failures);
+    printf("%-24s %llu\n", "disconnects", (unsigned long long)xStats.disconnects);
+    printf("%-24s %llu\n", "usage events", (unsigned long long)xStats.events);
+    printf("%-24s %llu in %llu segments, %.1f records/segment\n", "records sent",
+           (unsigned long long)xStats.records_sent, (unsigned long long)xStats.segments,
+           xStats.segments > 0 ? (double)xStats.records_sent / (double)xStats.segments : 0.0);
+    printf("%-24s %llu queue full, %llu with the connection\n", "records dropped",
+           (unsigned long long)xStats.records_dropped, (unsigned long long)xStats.records_lost);
+    printf("%-24s %llu bytes\n", "payload", (unsigned long long)xStats.tx_bytes);
+    if (pxServer != NULL)
+    {
+        printf("%-24s %llu records, %llu sessions, %llu crc errors, %llu protocol errors\n", "ingested",
+               (unsigned long long)xIngest.records, (unsigned long long)xIngest.sessions,
+               (unsigned long long)xIngest.crc_errors, (unsigned long long)xIngest.protocol_errors);
+    }
+    vLatencyHistogramPrint(&xConnectUs, "connect", "us");
+    if (pxServer != NULL)
+    {
+        vLatencyHistogramPrint(&xAge, "record age", "ms");
+    }
+
+    return 0;
+}
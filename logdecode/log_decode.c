@@ -0,0 +1,355 @@
+/**
+ * @file log_decode.c
+ *
+ * @brief Host decoder for the firmware's binary log output.
+ *
+ * A firmware built with LOG_BINARY writes each log record as a COBS encoded
+ * frame between NUL bytes, holding the offset of its format string in the
+ * log_fmt section, a time stamp in microseconds and the raw arguments. The
+ * decoder reads the format strings from the ELF file of the same build and
+ * prints every record as
+ *
+ *     [seconds.micros] L text
+ *
+ * where L is the level letter (D, I, W or E). Bytes outside of frames, such as
+ * the printf output of main() before the scheduler starts, are copied through.
+ *
+ * Usage: logdecode <elf> [capture]
+ *
+ * The capture is read from stdin if it is not given, so the USB serial port can
+ * be piped in directly.
+ */
+
+// Standard includes
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Project includes
+#include "log/log.h"
+#include "log/log_format.h"
+
+// Longest frame accepted, anything longer is not a record
+#define LOG_DECODE_FRAME_LEN 512
+
+// Longest line rendered
+#define LOG_DECODE_LINE_LEN 1024
+
+typedef struct LOG_SECTION_T_
+{
+    char *data;
+    size_t len;
+} LOG_SECTION_T;
+
+/**
+ * @brief Read a whole file into memory.
+ *
+ * @param pcPath Path of the file.
+ * @param pxLen Set to the length of the file.
+ *
+ * @return The contents, to be freed by the caller, or NULL on error.
+ */
+static uint8_t *prvReadFile(const char *pcPath, size_t *pxLen)
+{
+    FILE *pxFile = fopen(pcPath, "rb");
+    uint8_t *pucData = NULL;
+    long lLen;
+
+    if (pxFile == NULL)
+    {
+        return NULL;
+    }
+    if (fseek(pxFile, 0, SEEK_END) == 0 && (lLen = ftell(pxFile)) > 0 && fseek(pxFile, 0, SEEK_SET) == 0)
+    {
+        pucData = malloc((size_t)lLen);
+        if (pucData != NULL && fread(pucData, 1, (size_t)lLen, pxFile) != (size_t)lLen)
+        {
+            free(pucData);
+            pucData = NULL;
+        }
+        *pxLen = (size_t)lLen;
+    }
+    fclose(pxFile);
+
+    return pucData;
+}
+
+/**
+ * @brief Find the log_fmt section of a little-endian ELF file.
+ *
+ * Both ELF32 (the RP2040 firmware) and ELF64 (the host simulation) are read.
+ *
+ * @param pucElf Contents of the ELF file.
+ * @param xLen Length of the ELF file.
+ * @param pxSection Set to a copy of the section, NUL terminated.
+ *
+ * @return 0 on success, -1 if the file is not an ELF file or has no log_fmt section.
+ */
+static int prvFindSection(const uint8_t *pucElf, size_t xLen, LOG_SECTION_T *pxSection)
+{
+    uint64_t ullShOff;
+    size_t xShEntSize;
+    unsigned uShNum;
+    unsigned uShStrNdx;
+    int iClass;
+
+    if (xLen < EI_NIDENT || memcmp(pucElf, ELFMAG, SELFMAG) != 0 || pucElf[EI_DATA] != ELFDATA2LSB)
+    {
+        return -1;
+    }
+
+    iClass = pucElf[EI_CLASS];
+    if (iClass == ELFCLASS32 && xLen >= sizeof(Elf32_Ehdr))
+    {
+        const Elf32_Ehdr *pxHeader = (const Elf32_Ehdr *)pucElf;
+
+        ullShOff = pxHeader->e_shoff;
+        xShEntSize = pxHeader->e_shentsize;
+        uShNum = pxHeader->e_shnum;
+        uShStrNdx = pxHeader->e_shstrndx;
+    }
+    else if (iClass == ELFCLASS64 && xLen >= sizeof(Elf64_Ehdr))
+    {
+        const Elf64_Ehdr *pxHeader = (const Elf64_Ehdr *)pucElf;
+
+        ullShOff = pxHeader->e_shoff;
+        xShEntSize = pxHeader->e_shentsize;
+        uShNum = pxHeader->e_shnum;
+        uShStrNdx = pxHeader->e_shstrndx;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (uShStrNdx >= uShNum || ullShOff + (uint64_t)uShNum * xShEntSize > xLen ||
+        xShEntSize < (iClass == ELFCLASS32 ? sizeof(Elf32_Shdr) : sizeof(Elf64_Shdr)))
+    {
+        return -1;
+    }
+
+    // Name offset, file offset and size of a section header of either class
+    uint64_t ullNames[3];
+    uint64_t ullSection[3];
+
+    for (unsigned i = 0; i <= uShNum; i++)
+    {
+        unsigned uIndex = i == 0 ? uShStrNdx : i - 1;
+        const uint8_t *pucHeader = pucElf + ullShOff + (uint64_t)uIndex * xShEntSize;
+        uint64_t *pullOut = i == 0 ? ullNames : ullSection;
+
+        if (iClass == ELFCLASS32)
+        {
+            const Elf32_Shdr *pxShdr = (const Elf32_Shdr *)pucHeader;
+
+            pullOut[0] = pxShdr->sh_name;
+            pullOut[1] = pxShdr->sh_offset;
+            pullOut[2] = pxShdr->sh_type == SHT_NOBITS ? 0 : pxShdr->sh_size;
+        }
+        else
+        {
+            const Elf64_Shdr *pxShdr = (const Elf64_Shdr *)pucHeader;
+
+            pullOut[0] = pxShdr->sh_name;
+            pullOut[1] = pxShdr->sh_offset;
+            pullOut[2] = pxShdr->sh_type == SHT_NOBITS ? 0 : pxShdr->sh_size;
+        }
+        if (pullOut[1] + pullOut[2] > xLen)
+        {
+            return -1;
+        }
+
+        if (i > 0 && ullNames[2] > ullSection[0] &&
+            strncmp((const char *)pucElf + ullNames[1] + ullSection[0], "log_fmt", ullNames[2] - ullSection[0]) == 0)
+        {
+            pxSection->len = ullSection[2];
+            pxSection->data = malloc(pxSection->len + 1);
+            if (pxSection->data == NULL)
+            {
+                return -1;
+            }
+            memcpy(pxSection->data, pucElf + ullSection[1], pxSection->len);
+            pxSection->data[pxSection->len] = '\0';
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Undo the COBS encoding of a frame in place.
+ *
+ * @param pucFrame Frame without its delimiting NUL bytes.
+ * @param xLen Length of the frame.
+ *
+ * @return Length of the decoded record, or 0 if the frame is malformed.
+ */
+static size_t prvCobsDecode(uint8_t *pucFrame, size_t xLen)
+{
+    size_t xIn = 0;
+    size_t xOut = 0;
+
+    while (xIn < xLen)
+    {
+        uint8_t ucCode = pucFrame[xIn++];
+
+        if (ucCode == 0 || xIn + ucCode - 1 > xLen)
+        {
+            return 0;
+        }
+        for (unsigned i = 1; i < ucCode; i++)
+        {
+            pucFrame[xOut++] = pucFrame[xIn++];
+        }
+        if (ucCode != 0xFF && xIn < xLen)
+        {
+            pucFrame[xOut++] = 0;
+        }
+    }
+
+    return xOut;
+}
+
+/**
+ * @brief Print one record.
+ *
+ * @param pxFormats The log_fmt section.
+ * @param pucRecord Decoded record: format offset, time stamp and arguments.
+ * @param xLen Length of the record.
+ * @param pullTimeUs Time of the previous record, extended past the 32 bit wrap.
+ *
+ * @return None.
+ */
+static void prvPrintRecord(const LOG_SECTION_T *pxFormats, const uint8_t *pucRecord, size_t xLen,
+                           uint64_t *pullTimeUs)
+{
+    static char cLine[LOG_DECODE_LINE_LEN];
+    uint16_t usId;
+    uint32_t ulTime;
+
+    if (xLen < LOG_HEADER_LEN - 1)
+    {
+        fprintf(stderr, "<logdecode> short frame of %zu bytes\n", xLen);
+        return;
+    }
+
+    usId = (uint16_t)(pucRecord[0] | pucRecord[1] << 8);
+    ulTime = (uint32_t)pucRecord[2] | (uint32_t)pucRecord[3] << 8 | (uint32_t)pucRecord[4] << 16 |
+             (uint32_t)pucRecord[5] << 24;
+
+    // The firmware's time stamps wrap every 71 minutes
+    if (ulTime < (uint32_t)*pullTimeUs)
+    {
+        *pullTimeUs += 1ull << 32;
+    }
+    *pullTimeUs = (*pullTimeUs & ~0xFFFFFFFFull) | ulTime;
+
+    printf("[%5llu.%06llu] ", (unsigned long long)(*pullTimeUs / 1000000), (unsigned long long)(*pullTimeUs % 1000000));
+    if (usId >= pxFormats->len)
+    {
+        printf("? unknown format %u, was the capture made with this ELF file?\n", usId);
+        return;
+    }
+
+    xLogFormat(cLine, sizeof(cLine), &pxFormats->data[usId + 1], &pucRecord[LOG_HEADER_LEN - 1],
+               xLen - (LOG_HEADER_LEN - 1));
+    printf("%c %s", pxFormats->data[usId], cLine);
+
+    // Format strings without a trailing newline would run into the next record
+    if (cLine[0] == '\0' || cLine[strlen(cLine) - 1] != '\n')
+    {
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t ucFrame[LOG_DECODE_FRAME_LEN];
+    LOG_SECTION_T xFormats;
+    FILE *pxCapture = stdin;
+    uint64_t ullTimeUs = 0;
+    uint8_t *pucElf;
+    size_t xElfLen = 0;
+    size_t xFrameLen = 0;
+    int iInFrame = 0;
+    int iByte;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s <elf> [capture]\n", argv[0]);
+        return 1;
+    }
+
+    pucElf = prvReadFile(argv[1], &xElfLen);
+    if (pucElf == NULL)
+    {
+        fprintf(stderr, "<logdecode> cannot read %s\n", argv[1]);
+        return 1;
+    }
+    if (prvFindSection(pucElf, xElfLen, &xFormats) != 0)
+    {
+        fprintf(stderr, "<logdecode> %s has no log_fmt section\n", argv[1]);
+        free(pucElf);
+        return 1;
+    }
+    free(pucElf);
+
+    if (argc == 3 && (pxCapture = fopen(argv[2], "rb")) == NULL)
+    {
+        fprintf(stderr, "<logdecode> cannot open %s\n", argv[2]);
+        return 1;
+    }
+
+    // Line buffered, so a live capture shows up as it arrives
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    while ((iByte = getc(pxCapture)) != EOF)
+    {
+        if (!iInFrame)
+        {
+            if (iByte == 0)
+            {
+                iInFrame = 1;
+                xFrameLen = 0;
+            }
+            else
+            {
+                putchar(iByte);
+            }
+            continue;
+        }
+
+        if (iByte != 0)
+        {
+            // An overlong frame is not a record; it is discarded up to its closing NUL
+            if (xFrameLen < sizeof(ucFrame))
+            {
+                ucFrame[xFrameLen] = (uint8_t)iByte;
+            }
+            xFrameLen++;
+            continue;
+        }
+
+        // Back to back frames share no delimiter, so an empty frame is the next one's opening NUL
+        if (xFrameLen == 0)
+        {
+            continue;
+        }
+        if (xFrameLen <= sizeof(ucFrame))
+        {
+            prvPrintRecord(&xFormats, ucFrame, prvCobsDecode(ucFrame, xFrameLen), &ullTimeUs);
+        }
+        iInFrame = 0;
+    }
+
+    if (pxCapture != stdin)
+    {
+        fclose(pxCapture);
+    }
+    free(xFormats.data);
+
+    return 0;
+}
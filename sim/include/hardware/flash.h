@@ -0,0 +1,53 @@
+/**
+ * @file flash.h
+ *
+ * @brief Host simulation stand-in for hardware/flash.h.
+ *
+ * The QSPI flash is an array in host memory with NOR semantics: an erase sets
+ * a whole sector to 0xFF and programming can only clear bits. It is read
+ * through XIP_BASE like the memory mapped flash of the RP2040. sim_flash.c
+ * backs it with the file named by SIM_FLASH, so its contents survive a
+ * restart of the simulation.
+ */
+
+#ifndef SIM_HARDWARE_FLASH_H_
+#define SIM_HARDWARE_FLASH_H_
+
+#include "pico.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+
+// From the board header on the device
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+
+// Simulated flash contents, mapped before main() runs
+extern uint8_t *pucSimFlash;
+
+// From hardware/regs/addressmap.h on the device
+#define XIP_BASE ((uintptr_t)pucSimFlash)
+
+/**
+ * @brief Erase whole sectors of the flash.
+ *
+ * @param flash_offs Offset into the flash, a multiple of FLASH_SECTOR_SIZE.
+ * @param count Number of bytes, a multiple of FLASH_SECTOR_SIZE.
+ *
+ * @return None.
+ */
+void flash_range_erase(uint32_t flash_offs, size_t count);
+
+/**
+ * @brief Program whole pages of the flash; bits can only be cleared.
+ *
+ * @param flash_offs Offset into the flash, a multiple of FLASH_PAGE_SIZE.
+ * @param data Bytes to program.
+ * @param count Number of bytes, a multiple of FLASH_PAGE_SIZE.
+ *
+ * @return None.
+ */
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif /* SIM_HARDWARE_FLASH_H_ */
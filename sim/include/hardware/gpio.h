@@ -0,0 +1,32 @@
+/**
+ * @file gpio.h
+ *
+ * @brief Host simulation stand-in for hardware/gpio.h.
+ */
+
+#ifndef SIM_HARDWARE_GPIO_H_
+#define SIM_HARDWARE_GPIO_H_
+
+#include "pico.h"
+#include "hardware/irq.h"
+
+enum gpio_function
+{
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_NULL = 0x1f,
+};
+
+/**
+ * @brief Select the function of a GPIO. Pin muxing has no effect on the host.
+ *
+ * @param gpio GPIO number.
+ * @param fn Function to select.
+ *
+ * @return None.
+ */
+void gpio_set_function(uint gpio, enum gpio_function fn);
+
+#endif /* SIM_HARDWARE_GPIO_H_ */
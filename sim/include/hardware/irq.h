@@ -0,0 +1,40 @@
+/**
+ * @file irq.h
+ *
+ * @brief Host simulation stand-in for hardware/irq.h.
+ *
+ * Registered handlers are invoked by the simulation from the FreeRTOS idle hook
+ * whenever the emulated peripheral has a pending interrupt.
+ */
+
+#ifndef SIM_HARDWARE_IRQ_H_
+#define SIM_HARDWARE_IRQ_H_
+
+#include "pico.h"
+
+#define UART0_IRQ 20
+#define UART1_IRQ 21
+
+typedef void (*irq_handler_t)(void);
+
+/**
+ * @brief Install the handler for an interrupt number.
+ *
+ * @param num Interrupt number.
+ * @param handler Handler to call when the interrupt is raised.
+ *
+ * @return None.
+ */
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+
+/**
+ * @brief Enable or disable delivery of an interrupt number.
+ *
+ * @param num Interrupt number.
+ * @param enabled True to enable the interrupt.
+ *
+ * @return None.
+ */
+void irq_set_enabled(uint num, bool enabled);
+
+#endif /* SIM_HARDWARE_IRQ_H_ */
@@ -0,0 +1,66 @@
+/**
+ * @file sync.h
+ *
+ * @brief Host simulation stand-in for hardware/sync.h.
+ *
+ * The firmware's lock free rings rely on the memory barrier to order a slot's
+ * contents before the index that publishes it. Masking the interrupts blocks
+ * the tick signal, the only interrupt that preempts code in the simulation;
+ * emulated peripherals are serviced from the idle hook.
+ */
+
+#ifndef SIM_HARDWARE_SYNC_H_
+#define SIM_HARDWARE_SYNC_H_
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "pico.h"
+
+/**
+ * @brief Data memory barrier.
+ *
+ * @return None.
+ */
+static inline void __dmb(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Mask the interrupts of the calling core.
+ *
+ * @return Non-zero if they were masked already, for restore_interrupts().
+ */
+static inline uint32_t save_and_disable_interrupts(void)
+{
+    sigset_t xTick;
+    sigset_t xPrevious;
+
+    sigemptyset(&xTick);
+    sigaddset(&xTick, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &xTick, &xPrevious);
+
+    return (uint32_t)sigismember(&xPrevious, SIGALRM);
+}
+
+/**
+ * @brief Restore the interrupt mask saved by save_and_disable_interrupts().
+ *
+ * @param status Value save_and_disable_interrupts() returned.
+ *
+ * @return None.
+ */
+static inline void restore_interrupts(uint32_t status)
+{
+    if (status == 0)
+    {
+        sigset_t xTick;
+
+        sigemptyset(&xTick);
+        sigaddset(&xTick, SIGALRM);
+        pthread_sigmask(SIG_UNBLOCK, &xTick, NULL);
+    }
+}
+
+#endif /* SIM_HARDWARE_SYNC_H_ */
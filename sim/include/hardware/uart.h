@@ -0,0 +1,110 @@
+/**
+ * @file uart.h
+ *
+ * @brief Host simulation stand-in for hardware/uart.h.
+ *
+ * uart0 is backed by a file or a pseudo terminal on the host (see sim_uart.c).
+ * Received bytes are fed through an emulated 32 entry RX FIFO and raise
+ * UART0_IRQ while it is non-empty and the RX interrupt is enabled.
+ */
+
+#ifndef SIM_HARDWARE_UART_H_
+#define SIM_HARDWARE_UART_H_
+
+#include "pico.h"
+#include "hardware/irq.h"
+
+#define PICO_DEFAULT_UART_BAUD_RATE 115200
+
+#define UART_UARTRSR_OE_BITS 0x00000008
+#define UART_UARTRSR_BE_BITS 0x00000004
+#define UART_UARTRSR_PE_BITS 0x00000002
+#define UART_UARTRSR_FE_BITS 0x00000001
+
+/**
+ * @brief Subset of the PL011 registers that the firmware touches directly.
+ *
+ * Only the receive status register is modelled: the simulation sets the overrun
+ * bit when a byte is lost to a full RX FIFO, and any write clears it.
+ */
+typedef struct
+{
+    volatile uint32_t rsr;
+} uart_hw_t;
+
+typedef struct uart_inst uart_inst_t;
+
+extern uart_inst_t *const uart0_inst;
+extern uart_inst_t *const uart1_inst;
+
+#define uart0 uart0_inst
+#define uart1 uart1_inst
+
+/**
+ * @brief Initialise a UART and attach it to its host backing file.
+ *
+ * @param uart UART instance.
+ * @param baudrate Baud rate used to pace replayed input.
+ *
+ * @return The baud rate that was set.
+ */
+uint uart_init(uart_inst_t *uart, uint baudrate);
+
+/**
+ * @brief Enable or disable the UART RX and TX interrupts.
+ *
+ * @param uart UART instance.
+ * @param rx_has_data Raise the interrupt while the RX FIFO is not empty.
+ * @param tx_needs_data Ignored by the simulation.
+ *
+ * @return None.
+ */
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data);
+
+/**
+ * @brief Check whether the RX FIFO holds at least one byte.
+ *
+ * @param uart UART instance.
+ *
+ * @return True if a byte can be read without waiting.
+ */
+bool uart_is_readable(uart_inst_t *uart);
+
+/**
+ * @brief Read one byte from the RX FIFO, waiting for it if needed.
+ *
+ * @param uart UART instance.
+ *
+ * @return The received character.
+ */
+char uart_getc(uart_inst_t *uart);
+
+/**
+ * @brief Write a string to the UART.
+ *
+ * @param uart UART instance.
+ * @param s NUL terminated string.
+ *
+ * @return None.
+ */
+void uart_puts(uart_inst_t *uart, const char *s);
+
+/**
+ * @brief Return the register block of a UART instance.
+ *
+ * @param uart UART instance.
+ *
+ * @return Pointer to the emulated registers.
+ */
+uart_hw_t *uart_get_hw(uart_inst_t *uart);
+
+/**
+ * @brief Return the hardware index of a UART instance.
+ *
+ * @param uart UART instance.
+ *
+ * @return 0 for uart0, 1 for uart1.
+ */
+uint uart_get_index(uart_inst_t *uart);
+
+#endif /* SIM_HARDWARE_UART_H_ */
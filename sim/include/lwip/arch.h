@@ -0,0 +1,24 @@
+/**
+ * @file arch.h
+ *
+ * @brief Host simulation stand-in for the lwIP architecture types.
+ */
+
+#ifndef SIM_LWIP_ARCH_H_
+#define SIM_LWIP_ARCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint8_t u8_t;
+typedef int8_t s8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+
+/* Pull in the project lwIP options for buffer and segment sizes */
+#include "lwipopts.h"
+
+#endif /* SIM_LWIP_ARCH_H_ */
@@ -0,0 +1,35 @@
+/**
+ * @file err.h
+ *
+ * @brief Host simulation stand-in for lwIP error codes.
+ */
+
+#ifndef SIM_LWIP_ERR_H_
+#define SIM_LWIP_ERR_H_
+
+#include "lwip/arch.h"
+
+typedef s8_t err_t;
+
+typedef enum
+{
+    ERR_OK = 0,
+    ERR_MEM = -1,
+    ERR_BUF = -2,
+    ERR_TIMEOUT = -3,
+    ERR_RTE = -4,
+    ERR_INPROGRESS = -5,
+    ERR_VAL = -6,
+    ERR_WOULDBLOCK = -7,
+    ERR_USE = -8,
+    ERR_ALREADY = -9,
+    ERR_ISCONN = -10,
+    ERR_CONN = -11,
+    ERR_IF = -12,
+    ERR_ABRT = -13,
+    ERR_RST = -14,
+    ERR_CLSD = -15,
+    ERR_ARG = -16
+} err_enum_t;
+
+#endif /* SIM_LWIP_ERR_H_ */
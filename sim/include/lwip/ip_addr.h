@@ -0,0 +1,31 @@
+/**
+ * @file ip_addr.h
+ *
+ * @brief Host simulation stand-in for lwIP IPv4 addresses.
+ */
+
+#ifndef SIM_LWIP_IP_ADDR_H_
+#define SIM_LWIP_IP_ADDR_H_
+
+#include "lwip/arch.h"
+
+enum lwip_ip_addr_type
+{
+    IPADDR_TYPE_V4 = 0U,
+    IPADDR_TYPE_V6 = 6U,
+    IPADDR_TYPE_ANY = 46U
+};
+
+typedef struct ip4_addr
+{
+    u32_t addr;
+} ip4_addr_t;
+
+typedef ip4_addr_t ip_addr_t;
+
+#define IP_GET_TYPE(ipaddr) IPADDR_TYPE_V4
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr);
+char *ip4addr_ntoa(const ip4_addr_t *addr);
+
+#endif /* SIM_LWIP_IP_ADDR_H_ */
@@ -0,0 +1,29 @@
+/**
+ * @file pbuf.h
+ *
+ * @brief Host simulation stand-in for lwIP packet buffers.
+ *
+ * The simulation only creates single pbufs, but the chain fields are kept so
+ * that code walking p->next behaves as it would against lwIP.
+ */
+
+#ifndef SIM_LWIP_PBUF_H_
+#define SIM_LWIP_PBUF_H_
+
+#include "lwip/arch.h"
+#include "lwip/err.h"
+
+struct pbuf
+{
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+    u8_t type_internal;
+    u8_t flags;
+    u16_t ref;
+};
+
+u8_t pbuf_free(struct pbuf *p);
+
+#endif /* SIM_LWIP_PBUF_H_ */
@@ -0,0 +1,27 @@
+/**
+ * @file pico.h
+ *
+ * @brief Host simulation stand-in for the Pico SDK base header.
+ *
+ * Provides the compiler helpers the firmware relies on from pico/platform.h so
+ * that the sources in src/ compile unchanged against the FreeRTOS Posix port.
+ */
+
+#ifndef SIM_PICO_H_
+#define SIM_PICO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#ifndef __isr
+#define __isr
+#endif
+
+#endif /* SIM_PICO_H_ */
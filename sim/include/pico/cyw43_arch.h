@@ -0,0 +1,53 @@
+/**
+ * @file cyw43_arch.h
+ *
+ * @brief Host simulation stand-in for pico/cyw43_arch.h (poll architecture).
+ *
+ * The Wi-Fi association always succeeds immediately and cyw43_arch_poll()
+ * services the socket backed lwIP stand-in in sim_lwip.c.
+ */
+
+#ifndef SIM_PICO_CYW43_ARCH_H_
+#define SIM_PICO_CYW43_ARCH_H_
+
+#include "pico.h"
+
+#define CYW43_COUNTRY(A, B, REV) ((unsigned char)(A) | ((unsigned char)(B) << 8) | ((REV) << 16))
+#define CYW43_COUNTRY_USA CYW43_COUNTRY('U', 'S', 0)
+
+#define CYW43_AUTH_OPEN (0)
+#define CYW43_AUTH_WPA_TKIP_PSK (0x00200002)
+#define CYW43_AUTH_WPA2_AES_PSK (0x00400004)
+#define CYW43_AUTH_WPA2_MIXED_PSK (0x00400006)
+
+#define CYW43_WL_GPIO_LED_PIN 0
+
+typedef struct _cyw43_t
+{
+    bool wifi_up;
+    uint32_t pm;
+    bool led;
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+int cyw43_arch_init_with_country(uint32_t country);
+void cyw43_arch_deinit(void);
+void cyw43_arch_enable_sta_mode(void);
+int cyw43_arch_wifi_connect_timeout_ms(const char *ssid, const char *pw, uint32_t auth, uint32_t timeout);
+int cyw43_wifi_pm(cyw43_t *self, uint32_t pm);
+void cyw43_arch_gpio_put(uint wl_gpio, bool value);
+
+/**
+ * @brief Perform pending network work and invoke any due lwIP callbacks.
+ *
+ * @return None.
+ */
+void cyw43_arch_poll(void);
+
+/* Locking is a no-op for the poll architecture */
+#define cyw43_arch_lwip_begin() ((void)0)
+#define cyw43_arch_lwip_end() ((void)0)
+#define cyw43_arch_lwip_check() ((void)0)
+
+#endif /* SIM_PICO_CYW43_ARCH_H_ */
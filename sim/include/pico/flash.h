@@ -0,0 +1,44 @@
+/**
+ * @file flash.h
+ *
+ * @brief Host simulation stand-in for pico/flash.h.
+ *
+ * Nothing executes from the simulated flash, so a flash operation needs no
+ * other code paused and runs straight away.
+ */
+
+#ifndef SIM_PICO_FLASH_H_
+#define SIM_PICO_FLASH_H_
+
+#include "pico.h"
+
+#ifndef PICO_OK
+#define PICO_OK 0
+#endif
+
+/**
+ * @brief Run a function that erases or programs the flash.
+ *
+ * @param func Function to run.
+ * @param param Parameter passed to it.
+ * @param enter_exit_timeout_ms Unused, nothing has to be paused.
+ *
+ * @return PICO_OK.
+ */
+static inline int flash_safe_execute(void (*func)(void *), void *param, __unused uint32_t enter_exit_timeout_ms)
+{
+    func(param);
+    return PICO_OK;
+}
+
+/**
+ * @brief Prepare the calling core to be paused by flash_safe_execute() on the other core.
+ *
+ * @return true.
+ */
+static inline bool flash_safe_execute_core_init(void)
+{
+    return true;
+}
+
+#endif /* SIM_PICO_FLASH_H_ */
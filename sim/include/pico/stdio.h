@@ -0,0 +1,34 @@
+/**
+ * @file stdio.h
+ *
+ * @brief Host simulation stand-in for pico/stdio.h.
+ *
+ * USB CDC stdio is mapped onto the host process' stdout.
+ */
+
+#ifndef SIM_PICO_STDIO_H_
+#define SIM_PICO_STDIO_H_
+
+#include <stdio.h>
+
+#include "pico.h"
+
+/**
+ * @brief Initialise USB stdio, which on the host just sets up stdout buffering.
+ *
+ * @return Always true.
+ */
+bool stdio_usb_init(void);
+
+/**
+ * @brief Write a character without the CR the SDK adds before each LF.
+ *
+ * stdout is not translated on the host, so this is putchar().
+ *
+ * @param c Character to write.
+ *
+ * @return The character written.
+ */
+int putchar_raw(int c);
+
+#endif /* SIM_PICO_STDIO_H_ */
@@ -0,0 +1,18 @@
+/**
+ * @file stdlib.h
+ *
+ * @brief Host simulation stand-in for pico/stdlib.h.
+ */
+
+#ifndef SIM_PICO_STDLIB_H_
+#define SIM_PICO_STDLIB_H_
+
+#include <stdlib.h>
+
+#include "pico.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#endif /* SIM_PICO_STDLIB_H_ */
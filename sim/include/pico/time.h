@@ -0,0 +1,35 @@
+/**
+ * @file time.h
+ *
+ * @brief Host simulation stand-in for pico/time.h.
+ */
+
+#ifndef SIM_PICO_TIME_H_
+#define SIM_PICO_TIME_H_
+
+#include "pico.h"
+
+/**
+ * @brief Busy wait for the given number of milliseconds.
+ *
+ * @param ms Time to wait in milliseconds.
+ *
+ * @return None.
+ */
+void sleep_ms(uint32_t ms);
+
+/**
+ * @brief Return the time since boot in microseconds, like the RP2040 timer.
+ *
+ * @return Microseconds since the simulation started.
+ */
+uint64_t time_us_64(void);
+
+/**
+ * @brief Return the low 32 bits of the time since boot in microseconds.
+ *
+ * @return Microseconds since the simulation started, wrapping after about 71 minutes.
+ */
+uint32_t time_us_32(void);
+
+#endif /* SIM_PICO_TIME_H_ */
@@ -0,0 +1,116 @@
+/**
+ * @file sim.h
+ *
+ * @brief Internal interfaces shared by the host simulation stand-ins.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+
+// Standard includes
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pico includes
+#include "pico.h"
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Most bytes the in-process controller replies to one segment with: an ACK and a command for every setting
+#define SIM_CONTROLLER_REPLY_LEN (WIRE_MAX_ACK_LEN + (WIRE_CMD_COUNT - 1) * WIRE_MAX_COMMAND_LEN)
+
+// Connection from the uplink to the in-process controller of the virtual-time simulation
+typedef struct SIM_PEER_T_ SIM_PEER_T;
+
+/**
+ * @brief Raise an interrupt if it is enabled and has a handler installed.
+ *
+ * The handler runs inside a critical section, like an interrupt that the tick
+ * cannot pre-empt, and may yield to a task it has woken.
+ *
+ * @param num Interrupt number.
+ *
+ * @return None.
+ */
+void vSimRaiseIRQ(uint num);
+
+/**
+ * @brief Move bytes from the host backing files into the UART RX FIFOs.
+ *
+ * Called from the idle hook. Raises the UART interrupt for every UART with
+ * data in its RX FIFO and the RX interrupt enabled.
+ *
+ * @return pdTRUE if any UART had work to do.
+ */
+BaseType_t xSimUARTService(void);
+
+/**
+ * @brief Return when the next byte arrives on any UART.
+ *
+ * Only bytes already read from the backing files are known, which is every byte
+ * up to the end of the file once it has been read in.
+ *
+ * @return Arrival time in nanoseconds on the simulation clock, UINT64_MAX if none is pending.
+ */
+uint64_t ullSimUARTNextEventNs(void);
+
+/**
+ * @brief Check whether uart0 has delivered the whole of its backing file.
+ *
+ * @return pdTRUE once the file has been read to the end and its last byte taken from the RX FIFO.
+ */
+BaseType_t xSimUARTExhausted(void);
+
+/**
+ * @brief Drive the socket backed lwIP stand-in and invoke due callbacks.
+ *
+ * Called from cyw43_arch_poll(), i.e. from the task that owns the network.
+ *
+ * @return None.
+ */
+void vSimLwIPPoll(void);
+
+/**
+ * @brief Open a connection to the in-process controller.
+ *
+ * @return The connection, or NULL if it could not be allocated.
+ */
+SIM_PEER_T *pxSimControllerAccept(void);
+
+/**
+ * @brief Hand bytes sent on a connection to the in-process controller.
+ *
+ * @param pxPeer Connection the bytes were sent on.
+ * @param pucData Bytes in wire format.
+ * @param xLen Number of bytes.
+ * @param ullArrivalNs Time on the simulation clock at which they reach the controller.
+ * @param pucReply Destination for the frames the controller sends back once it has taken them, an ACK
+ *                 and the commands of a session that started, of SIM_CONTROLLER_REPLY_LEN bytes.
+ * @param pxReplyLen Destination for the number of reply bytes, 0 if there are none.
+ *
+ * @return false if the controller would close the connection because of them.
+ */
+bool xSimControllerReceive(SIM_PEER_T *pxPeer, const uint8_t *pucData, size_t xLen, uint64_t ullArrivalNs,
+                           uint8_t *pucReply, size_t *pxReplyLen);
+
+/**
+ * @brief Close a connection to the in-process controller.
+ *
+ * @param pxPeer Connection to close.
+ *
+ * @return None.
+ */
+void vSimControllerClose(SIM_PEER_T *pxPeer);
+
+/**
+ * @brief Return the simulation clock in nanoseconds.
+ *
+ * @return Nanoseconds on CLOCK_MONOTONIC, or on the virtual clock when built with SIM_VIRTUAL_TIME.
+ */
+uint64_t ullSimTimeNs(void);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,327 @@
+/**
+ * @file sim_controller.c
+ *
+ * @brief In-process controller for the virtual-time simulation.
+ *
+ * With a virtual clock the uplink cannot talk to a controller over host
+ * sockets, whose timing would leak back into the run. The lwIP stand-in hands
+ * every segment to this model instead, which decodes it with the firmware's own
+ * wire format code and writes one CSV line per record:
+ *
+ *     rx_ms,device_id,seq,time_ms,volume,mean,min,max,stddev,duration_ms,count
+ *
+ * Like the daemon it remembers the last sequence number of every device,
+ * drops records it has taken before and acknowledges the last one, which the
+ * lwIP stand-in delivers back to the device with the TCP acknowledgement.
+ * SIM_CONTROLLER_COMMANDS may list commands as "name=value,...", for example
+ * "flush_ms=500,batch_records=4", which are sent along with the first ACK of
+ * every session, as the daemon sends its settings.
+ * rx_ms is the virtual time since boot at which the segment reached the
+ * controller; the other fields are those printed by the controller daemon. The
+ * lines go to the file named by SIM_CONTROLLER_LOG, or to stderr with a
+ * "<sim> controller" prefix. Telemetry frames are printed to stderr as one
+ * "<sim> controller telemetry" line each, with every task's CPU share in
+ * permille of virtual time and its free stack bytes. Totals are printed to
+ * stderr when the simulation exits.
+ */
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// lwIP includes
+#include "lwip/tcp.h"
+
+// Pico includes
+#include "pico/time.h"
+
+// Simulation includes
+#include "sim.h"
+
+typedef struct SIM_DEVICE_T_
+{
+    struct SIM_DEVICE_T_ *next;
+    uint32_t last_seq;
+    char device_id[WIRE_MAX_DEVICE_ID_LEN + 1];
+} SIM_DEVICE_T;
+
+struct SIM_PEER_T_
+{
+    WIRE_CODEC_T codec;
+    char device_id[WIRE_MAX_DEVICE_ID_LEN + 1];
+    SIM_DEVICE_T *device;
+    size_t len;
+    uint8_t buffer[TCP_SND_BUF + WIRE_MAX_HELLO_LEN];
+};
+
+static FILE *pxLog;
+static WIRE_COMMAND_T xCommands[WIRE_CMD_COUNT];
+static size_t xCommandCount;
+static SIM_DEVICE_T *pxDevices;
+static uint64_t ullBootNs;
+static uint64_t ullSessions;
+static uint64_t ullRecords;
+static uint64_t ullDuplicates;
+static uint64_t ullTelemetry;
+static uint64_t ullCommands;
+static uint64_t ullCRCErrors;
+static uint64_t ullProtocolErrors;
+
+/**
+ * @brief Print the controller counters when the simulation exits.
+ *
+ * @return None.
+ */
+static void prvSimControllerReport(void)
+{
+    if (pxLog != NULL && pxLog != stderr)
+    {
+        fclose(pxLog);
+    }
+    fprintf(stderr, "<sim> controller %llu sessions, %llu records, %llu duplicates, %llu telemetry, %llu commands, %llu crc errors, %llu protocol errors\n",
+            (unsigned long long)ullSessions, (unsigned long long)ullRecords, (unsigned long long)ullDuplicates,
+            (unsigned long long)ullTelemetry, (unsigned long long)ullCommands,
+            (unsigned long long)ullCRCErrors, (unsigned long long)ullProtocolErrors);
+}
+
+/**
+ * @brief Print a telemetry frame as one line on stderr.
+ *
+ * @param ulRxMs Virtual time since boot at which the frame arrived.
+ * @param pcDeviceId Device that sent it.
+ * @param pxTelemetry Decoded telemetry.
+ *
+ * @return None.
+ */
+static void prvSimControllerTelemetry(unsigned long ulRxMs, const char *pcDeviceId, const WIRE_TELEMETRY_T *pxTelemetry)
+{
+    char cLine[64 * (1 + WIRE_MAX_TELEMETRY_TASKS)];
+    int iLen;
+
+    iLen = snprintf(cLine, sizeof(cLine), "%lu,%s,%lu,%lu,heap %lu/%lu,queues %lu/%lu/%lu/%lu", ulRxMs, pcDeviceId,
+                    (unsigned long)pxTelemetry->time_ms, (unsigned long)pxTelemetry->interval_ms,
+                    (unsigned long)pxTelemetry->heap_free, (unsigned long)pxTelemetry->heap_min,
+                    (unsigned long)pxTelemetry->uart_bytes, (unsigned long)pxTelemetry->queued_records,
+                    (unsigned long)pxTelemetry->batch_records, (unsigned long)pxTelemetry->outbox_records);
+    for (uint32_t i = 0; i < pxTelemetry->task_count && iLen > 0 && (size_t)iLen < sizeof(cLine); i++)
+    {
+        iLen += snprintf(&cLine[iLen], sizeof(cLine) - (size_t)iLen, ",%s %lu/%lu", pxTelemetry->tasks[i].name,
+                         (unsigned long)pxTelemetry->tasks[i].cpu_permille,
+                         (unsigned long)pxTelemetry->tasks[i].stack_free);
+    }
+    fprintf(stderr, "<sim> controller telemetry %s\n", cLine);
+}
+
+/**
+ * @brief Find the entry of a device, adding it on its first session.
+ *
+ * @param pcDeviceId Device identifier.
+ *
+ * @return The entry, or NULL if it could not be allocated.
+ */
+static SIM_DEVICE_T *prvSimControllerDevice(const char *pcDeviceId)
+{
+    SIM_DEVICE_T *pxDevice;
+
+    for (pxDevice = pxDevices; pxDevice != NULL; pxDevice = pxDevice->next)
+    {
+        if (strcmp(pxDevice->device_id, pcDeviceId) == 0)
+        {
+            return pxDevice;
+        }
+    }
+
+    pxDevice = calloc(1, sizeof(SIM_DEVICE_T));
+    if (pxDevice != NULL)
+    {
+        strncpy(pxDevice->device_id, pcDeviceId, WIRE_MAX_DEVICE_ID_LEN);
+        pxDevice->next = pxDevices;
+        pxDevices = pxDevice;
+    }
+
+    return pxDevice;
+}
+
+/**
+ * @brief Parse the commands sent at the start of every session from SIM_CONTROLLER_COMMANDS.
+ *
+ * @return None.
+ */
+static void prvSimControllerCommands(void)
+{
+    const char *pcList = getenv("SIM_CONTROLLER_COMMANDS");
+    char cList[256];
+    char *pcSave;
+
+    if (pcList == NULL)
+    {
+        return;
+    }
+    strncpy(cList, pcList, sizeof(cList) - 1);
+    cList[sizeof(cList) - 1] = '\0';
+
+    for (char *pcItem = strtok_r(cList, ",", &pcSave); pcItem != NULL; pcItem = strtok_r(NULL, ",", &pcSave))
+    {
+        char *pcValue = strchr(pcItem, '=');
+
+        if (pcValue != NULL)
+        {
+            *pcValue++ = '\0';
+        }
+
+        uint8_t ucId = ucWireCommandId(pcItem);
+
+        if (ucId == 0 || xCommandCount == WIRE_CMD_COUNT - 1)
+        {
+            fprintf(stderr, "<sim> controller: command %s ignored\n", pcItem);
+            continue;
+        }
+        xCommands[xCommandCount++] = (WIRE_COMMAND_T){
+            .id = ucId,
+            .value = pcValue != NULL ? (uint32_t)strtoul(pcValue, NULL, 0) : 0,
+        };
+    }
+}
+
+SIM_PEER_T *pxSimControllerAccept(void)
+{
+    if (pxLog == NULL)
+    {
+        const char *pcPath = getenv("SIM_CONTROLLER_LOG");
+
+        pxLog = pcPath != NULL ? fopen(pcPath, "w") : NULL;
+        if (pxLog == NULL)
+        {
+            pxLog = stderr;
+        }
+        ullBootNs = ullSimTimeNs() - time_us_64() * 1000;
+        prvSimControllerCommands();
+        atexit(prvSimControllerReport);
+    }
+
+    return calloc(1, sizeof(SIM_PEER_T));
+}
+
+bool xSimControllerReceive(SIM_PEER_T *pxPeer, const uint8_t *pucData, size_t xLen, uint64_t ullArrivalNs,
+                           uint8_t *pucReply, size_t *pxReplyLen)
+{
+    unsigned long ulRxMs = (unsigned long)((ullArrivalNs - ullBootNs) / 1000000);
+    bool xSession = false;
+
+    *pxReplyLen = 0;
+
+    while (xLen > 0)
+    {
+        size_t xChunk = sizeof(pxPeer->buffer) - pxPeer->len;
+        size_t xOffset = 0;
+
+        if (xChunk > xLen)
+        {
+            xChunk = xLen;
+        }
+        memcpy(&pxPeer->buffer[pxPeer->len], pucData, xChunk);
+        pxPeer->len += xChunk;
+        pucData += xChunk;
+        xLen -= xChunk;
+
+        while (xOffset < pxPeer->len)
+        {
+            WIRE_FRAME_T xFrame;
+            size_t xConsumed;
+            WIRE_RESULT_T eResult = eWireDecodeFrame(&pxPeer->codec, &pxPeer->buffer[xOffset], pxPeer->len - xOffset,
+                                                     &xConsumed, &xFrame);
+
+            if (eResult == WIRE_INCOMPLETE)
+            {
+                break;
+            }
+
+            if (eResult == WIRE_OK && xFrame.type == WIRE_FRAME_RECORD)
+            {
+                const WIRE_RECORD_T *pxRecord = &xFrame.record;
+
+                if (pxPeer->device != NULL && pxRecord->seq <= pxPeer->device->last_seq)
+                {
+                    ullDuplicates++;
+                }
+                else
+                {
+                    if (pxPeer->device != NULL)
+                    {
+                        pxPeer->device->last_seq = pxRecord->seq;
+                    }
+                    ullRecords++;
+                    fprintf(pxLog, "%s%lu,%s,%lu,%lu,%ld,%ld,%ld,%ld,%ld,%lu,%lu\n",
+                            pxLog == stderr ? "<sim> controller " : "", ulRxMs, pxPeer->device_id,
+                            (unsigned long)pxRecord->seq, (unsigned long)pxRecord->time_ms,
+                            (long)pxRecord->volume_milli, (long)pxRecord->mean_flow_milli,
+                            (long)pxRecord->min_flow_milli, (long)pxRecord->max_flow_milli,
+                            (long)pxRecord->stddev_flow_milli, (unsigned long)pxRecord->duration_ms,
+                            (unsigned long)pxRecord->count);
+                }
+            }
+            else if (eResult == WIRE_OK && xFrame.type == WIRE_FRAME_TELEMETRY)
+            {
+                WIRE_TELEMETRY_T xTelemetry;
+
+                if (eWireDecodeTelemetry(&xFrame, &xTelemetry) != WIRE_OK)
+                {
+                    ullProtocolErrors++;
+                }
+                else
+                {
+                    ullTelemetry++;
+                    prvSimControllerTelemetry(ulRxMs, pxPeer->device_id, &xTelemetry);
+                }
+            }
+            else if (eResult == WIRE_OK && xFrame.type == WIRE_FRAME_HELLO)
+            {
+                memcpy(pxPeer->device_id, xFrame.device_id, sizeof(pxPeer->device_id));
+                pxPeer->device = prvSimControllerDevice(pxPeer->device_id);
+                ullSessions++;
+                xSession = true;
+            }
+            else if (eResult == WIRE_BAD_CRC)
+            {
+                ullCRCErrors++;
+            }
+            else
+            {
+                ullProtocolErrors++;
+            }
+
+            // Like the controller, a frame that cannot be delimited or decoded ends the connection
+            if (xConsumed == 0 || eResult == WIRE_BAD_VERSION || eResult == WIRE_MALFORMED)
+            {
+                return false;
+            }
+            xOffset += xConsumed;
+        }
+
+        memmove(pxPeer->buffer, &pxPeer->buffer[xOffset], pxPeer->len - xOffset);
+        pxPeer->len -= xOffset;
+    }
+
+    // Also after a hello, so the device learns where the controller is
+    if (pxPeer->device != NULL && pxPeer->device->last_seq != 0)
+    {
+        *pxReplyLen += xWireEncodeAck(pucReply, WIRE_MAX_ACK_LEN, pxPeer->device->last_seq);
+    }
+
+    for (size_t i = 0; xSession && i < xCommandCount; i++)
+    {
+        *pxReplyLen += xWireEncodeCommand(&pucReply[*pxReplyLen], WIRE_MAX_COMMAND_LEN, &xCommands[i]);
+        ullCommands++;
+    }
+
+    return true;
+}
+
+void vSimControllerClose(SIM_PEER_T *pxPeer)
+{
+    free(pxPeer);
+}
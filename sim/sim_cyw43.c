@@ -0,0 +1,56 @@
+/**
+ * @file sim_cyw43.c
+ *
+ * @brief Host simulation of the CYW43 Wi-Fi chip architecture layer.
+ *
+ * The host network is always available, so association succeeds at once. The
+ * on-board LED is tracked in cyw43_state but not shown.
+ */
+
+// Standard includes
+#include <stdio.h>
+
+// Pico includes
+#include "pico/cyw43_arch.h"
+
+// Simulation includes
+#include "sim.h"
+
+cyw43_t cyw43_state;
+
+int cyw43_arch_init_with_country(__unused uint32_t country)
+{
+    return 0;
+}
+
+void cyw43_arch_deinit(void)
+{
+    cyw43_state.wifi_up = false;
+}
+
+void cyw43_arch_enable_sta_mode(void)
+{
+}
+
+int cyw43_arch_wifi_connect_timeout_ms(__unused const char *ssid, __unused const char *pw, __unused uint32_t auth,
+                                       __unused uint32_t timeout)
+{
+    cyw43_state.wifi_up = true;
+    return 0;
+}
+
+int cyw43_wifi_pm(cyw43_t *self, uint32_t pm)
+{
+    self->pm = pm;
+    return 0;
+}
+
+void cyw43_arch_gpio_put(__unused uint wl_gpio, bool value)
+{
+    cyw43_state.led = value;
+}
+
+void cyw43_arch_poll(void)
+{
+    vSimLwIPPoll();
+}
@@ -0,0 +1,131 @@
+/**
+ * @file sim_flash.c
+ *
+ * @brief Host simulation of the Pico W's 2 MB QSPI flash.
+ *
+ * The flash is mapped before main() runs. With SIM_FLASH=<path> it is a shared
+ * mapping of that file, created erased if it does not exist, so whatever the
+ * firmware stored survives a restart; otherwise it starts erased every run.
+ * Misaligned erases and programs abort the simulation, as the device would
+ * corrupt neighbouring data instead.
+ */
+
+// Standard includes
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pico includes
+#include "hardware/flash.h"
+
+// Simulation includes
+#include "sim_flash.h"
+
+#define SIM_FLASH_SECTORS (PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE)
+
+uint8_t *pucSimFlash;
+
+static SIM_FLASH_STATS_T xSimFlashStats;
+static uint32_t ulSectorErases[SIM_FLASH_SECTORS];
+
+/**
+ * @brief Map the flash, erased or from the SIM_FLASH file.
+ *
+ * @return None.
+ */
+__attribute__((constructor)) static void prvSimFlashInit(void)
+{
+    const char *pcPath = getenv("SIM_FLASH");
+    void *pvFlash = MAP_FAILED;
+
+    if (pcPath != NULL)
+    {
+        int iFd = open(pcPath, O_RDWR | O_CREAT, 0644);
+        struct stat xStat;
+
+        if (iFd < 0 || fstat(iFd, &xStat) != 0)
+        {
+            perror("<sim> SIM_FLASH");
+            exit(1);
+        }
+
+        pvFlash = mmap(NULL, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0);
+        if (pvFlash != MAP_FAILED && xStat.st_size != PICO_FLASH_SIZE_BYTES)
+        {
+            // A new file starts erased
+            if (ftruncate(iFd, PICO_FLASH_SIZE_BYTES) != 0)
+            {
+                perror("<sim> SIM_FLASH");
+                exit(1);
+            }
+            memset(pvFlash, 0xFF, PICO_FLASH_SIZE_BYTES);
+        }
+        close(iFd);
+    }
+    else
+    {
+        pvFlash = mmap(NULL, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pvFlash != MAP_FAILED)
+        {
+            memset(pvFlash, 0xFF, PICO_FLASH_SIZE_BYTES);
+        }
+    }
+
+    if (pvFlash == MAP_FAILED)
+    {
+        perror("<sim> flash");
+        exit(1);
+    }
+    pucSimFlash = pvFlash;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (flash_offs % FLASH_SECTOR_SIZE != 0 || count % FLASH_SECTOR_SIZE != 0 ||
+        count > PICO_FLASH_SIZE_BYTES - flash_offs)
+    {
+        fprintf(stderr, "<sim> flash erase of %zu bytes at 0x%lx is not sector aligned\n", count,
+                (unsigned long)flash_offs);
+        abort();
+    }
+
+    memset(&pucSimFlash[flash_offs], 0xFF, count);
+
+    for (size_t i = 0; i < count / FLASH_SECTOR_SIZE; i++)
+    {
+        ulSectorErases[flash_offs / FLASH_SECTOR_SIZE + i]++;
+        xSimFlashStats.sector_erases++;
+    }
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if (flash_offs % FLASH_PAGE_SIZE != 0 || count % FLASH_PAGE_SIZE != 0 ||
+        count > PICO_FLASH_SIZE_BYTES - flash_offs)
+    {
+        fprintf(stderr, "<sim> flash program of %zu bytes at 0x%lx is not page aligned\n", count,
+                (unsigned long)flash_offs);
+        abort();
+    }
+
+    // NOR flash only clears bits, an erase is the only way back to 1
+    for (size_t i = 0; i < count; i++)
+    {
+        pucSimFlash[flash_offs + i] &= data[i];
+    }
+    xSimFlashStats.page_programs += count / FLASH_PAGE_SIZE;
+}
+
+void vSimFlashStats(SIM_FLASH_STATS_T *pxStats)
+{
+    *pxStats = xSimFlashStats;
+}
+
+uint32_t ulSimFlashSectorErases(uint32_t ulSector)
+{
+    return ulSector < SIM_FLASH_SECTORS ? ulSectorErases[ulSector] : 0;
+}
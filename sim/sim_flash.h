@@ -0,0 +1,41 @@
+/**
+ * @file sim_flash.h
+ *
+ * @brief Counters of the simulated QSPI flash, for the host benchmarks.
+ */
+
+#ifndef SIM_FLASH_H_
+#define SIM_FLASH_H_
+
+// Standard includes
+#include <stdint.h>
+
+// Pico includes
+#include "hardware/flash.h"
+
+// Type definitions
+typedef struct SIM_FLASH_STATS_T_
+{
+    uint64_t page_programs;
+    uint64_t sector_erases;
+} SIM_FLASH_STATS_T;
+
+/**
+ * @brief Read the operation counters since the simulation started.
+ *
+ * @param pxStats Destination for the counters.
+ *
+ * @return None.
+ */
+void vSimFlashStats(SIM_FLASH_STATS_T *pxStats);
+
+/**
+ * @brief Return how often a sector has been erased.
+ *
+ * @param ulSector Sector number, counted from the start of the flash.
+ *
+ * @return Erase count of the sector.
+ */
+uint32_t ulSimFlashSectorErases(uint32_t ulSector);
+
+#endif /* SIM_FLASH_H_ */
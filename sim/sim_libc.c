@@ -0,0 +1,199 @@
+/**
+ * @file sim_libc.c
+ *
+ * @brief Scheduler-safe wrappers for the C library calls made by the firmware.
+ *
+ * On the Posix port a task can be switched out by the tick signal while it
+ * holds a C library lock (the stdout lock inside printf, the malloc arena lock),
+ * and the next task to take that lock would then deadlock the simulation. The
+ * firmware is linked with -Wl,--wrap for these symbols so every call runs with
+ * the scheduler suspended, which is what heap_3.c already does for
+ * pvPortMalloc(). Interrupts (the tick) still run; they just cannot switch task.
+ *
+ * The allocation wrappers also count the bytes in use, which stand in for the
+ * heap counters the telemetry reads when the kernel is built with heap_3. They
+ * are reported against SIM_HEAP_LEN, which is larger than the RP2040's heap
+ * because every task stack is host sized. heap_4 and heap_6 count their own.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Heap size the free bytes are reported against
+#define SIM_HEAP_LEN (1024 * 1024)
+
+// Bytes allocated, updated atomically as not every caller holds the scheduler
+static size_t xSimHeapUsed;
+static size_t xSimHeapPeak;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+int __real_puts(const char *s);
+int __real_putchar(int c);
+
+/**
+ * @brief Count an allocation or a release.
+ *
+ * @param pv Block allocated or about to be released, may be NULL.
+ * @param xAdd true for an allocation.
+ *
+ * @return None.
+ */
+static void prvSimHeapCount(void *pv, bool xAdd)
+{
+    if (pv == NULL)
+    {
+        return;
+    }
+
+    if (xAdd)
+    {
+        size_t xUsed = __atomic_add_fetch(&xSimHeapUsed, malloc_usable_size(pv), __ATOMIC_RELAXED);
+        size_t xPeak = __atomic_load_n(&xSimHeapPeak, __ATOMIC_RELAXED);
+
+        while (xUsed > xPeak && !__atomic_compare_exchange_n(&xSimHeapPeak, &xPeak, xUsed, true, __ATOMIC_RELAXED,
+                                                             __ATOMIC_RELAXED))
+        {
+        }
+    }
+    else
+    {
+        __atomic_sub_fetch(&xSimHeapUsed, malloc_usable_size(pv), __ATOMIC_RELAXED);
+    }
+}
+
+#if FREERTOS_HEAP == 3
+/**
+ * @brief Return the free bytes of the simulated heap.
+ *
+ * @return SIM_HEAP_LEN less the bytes allocated, or 0 once that is exceeded.
+ */
+size_t xPortGetFreeHeapSize(void)
+{
+    size_t xUsed = __atomic_load_n(&xSimHeapUsed, __ATOMIC_RELAXED);
+
+    return xUsed < SIM_HEAP_LEN ? SIM_HEAP_LEN - xUsed : 0;
+}
+
+/**
+ * @brief Return the lowest free bytes of the simulated heap.
+ *
+ * @return SIM_HEAP_LEN less the most bytes ever allocated, or 0 once that is exceeded.
+ */
+size_t xPortGetMinimumEverFreeHeapSize(void)
+{
+    size_t xPeak = __atomic_load_n(&xSimHeapPeak, __ATOMIC_RELAXED);
+
+    return xPeak < SIM_HEAP_LEN ? SIM_HEAP_LEN - xPeak : 0;
+}
+#endif
+
+/**
+ * @brief Suspend the scheduler if it is running.
+ *
+ * @return pdTRUE if the scheduler was suspended and must be resumed.
+ */
+static inline BaseType_t prvSimLock(void)
+{
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+    {
+        return pdFALSE;
+    }
+    vTaskSuspendAll();
+    return pdTRUE;
+}
+
+static inline void prvSimUnlock(BaseType_t xLocked)
+{
+    if (xLocked == pdTRUE)
+    {
+        (void)xTaskResumeAll();
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    BaseType_t xLocked = prvSimLock();
+    void *pv = __real_malloc(size);
+
+    prvSimHeapCount(pv, true);
+    prvSimUnlock(xLocked);
+    return pv;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    BaseType_t xLocked = prvSimLock();
+    void *pv = __real_calloc(nmemb, size);
+
+    prvSimHeapCount(pv, true);
+    prvSimUnlock(xLocked);
+    return pv;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    BaseType_t xLocked = prvSimLock();
+    size_t xOld = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    void *pv = __real_realloc(ptr, size);
+
+    // A failed realloc leaves the old block in place
+    if (pv != NULL || size == 0)
+    {
+        __atomic_sub_fetch(&xSimHeapUsed, xOld, __ATOMIC_RELAXED);
+        prvSimHeapCount(pv, true);
+    }
+    prvSimUnlock(xLocked);
+    return pv;
+}
+
+void __wrap_free(void *ptr)
+{
+    BaseType_t xLocked = prvSimLock();
+
+    prvSimHeapCount(ptr, false);
+    __real_free(ptr);
+    prvSimUnlock(xLocked);
+}
+
+int __wrap_printf(const char *format, ...)
+{
+    BaseType_t xLocked = prvSimLock();
+    va_list args;
+    int ret;
+
+    va_start(args, format);
+    ret = vprintf(format, args);
+    va_end(args);
+
+    prvSimUnlock(xLocked);
+    return ret;
+}
+
+int __wrap_puts(const char *s)
+{
+    BaseType_t xLocked = prvSimLock();
+    int ret = __real_puts(s);
+
+    prvSimUnlock(xLocked);
+    return ret;
+}
+
+int __wrap_putchar(int c)
+{
+    BaseType_t xLocked = prvSimLock();
+    int ret = __real_putchar(c);
+
+    prvSimUnlock(xLocked);
+    return ret;
+}
@@ -0,0 +1,617 @@
+/**
+ * @file sim_lwip.c
+ *
+ * @brief Host simulation of the lwIP raw TCP API on top of host sockets.
+ *
+ * Only the calls made by the firmware are provided. A pcb owns a non-blocking
+ * socket; tcp_write() queues into a TCP_SND_BUF sized send buffer and
+ * tcp_output() pushes as much as the socket accepts. vSimLwIPPoll() completes
+ * connects, delivers received data, reports acknowledged bytes through the sent
+ * callback (using SIOCOUTQ) and runs the coarse poll callback, all from the
+ * calling task like the poll architecture does on the device.
+ *
+ * As in lwIP the error callback is invoked after the connection is gone. The
+ * pcb memory is kept until tcp_close() or tcp_abort() is called on it so that a
+ * late close from the error callback is harmless on the host.
+ *
+ * Built with SIM_VIRTUAL_TIME no sockets are used, since host networking would
+ * tie the run back to host time. The connection is a link of SIM_NET_RTT_MS
+ * (default 20) round trip time to the in-process controller in sim_controller.c:
+ * a connect completes one round trip after it was started, tcp_output() hands
+ * the bytes to the controller half a round trip later, and they are reported
+ * acknowledged after a full one. The controller's reply to them, its ACK frame
+ * and any commands, arrives with the acknowledgement and is delivered to the
+ * recv callback.
+ */
+
+// Standard includes
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <unistd.h>
+
+// netinet/tcp.h has its own TCP_MSS, use the one from lwipopts.h
+#undef TCP_MSS
+
+// lwIP includes
+#include "lwip/tcp.h"
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Simulation includes
+#include "sim.h"
+
+#define SIM_TCP_SLOW_INTERVAL_NS 500000000ull
+#define SIM_NET_DEFAULT_RTT_MS 20
+
+// Segments in flight on the virtual link, more than tcp_output() calls per TCP_SND_BUF
+#define SIM_NET_MAX_SEGMENTS 32
+
+typedef enum
+{
+    SIM_PCB_NEW,
+    SIM_PCB_CONNECTING,
+    SIM_PCB_CONNECTED,
+    SIM_PCB_DEAD,
+} SimPcbState_t;
+
+struct tcp_pcb
+{
+    struct tcp_pcb *next;
+    SimPcbState_t state;
+    int iSocket;
+    void *arg;
+    tcp_connected_fn connected;
+    tcp_sent_fn sent;
+    tcp_recv_fn recv;
+    tcp_poll_fn poll;
+    tcp_err_fn errf;
+    u8_t pollinterval;
+    uint64_t ullNextPollNs;
+    uint32_t ulUnacked;
+    uint32_t ulQueued;
+    u8_t ucSendBuf[TCP_SND_BUF];
+#if configUSE_VIRTUAL_TICK
+    SIM_PEER_T *pxPeer;
+    uint64_t ullConnectedNs;
+    uint64_t ullAckNs[SIM_NET_MAX_SEGMENTS];
+    uint32_t ulSegmentLen[SIM_NET_MAX_SEGMENTS];
+    uint8_t ucSegmentReply[SIM_NET_MAX_SEGMENTS][SIM_CONTROLLER_REPLY_LEN];
+    size_t xSegmentReplyLen[SIM_NET_MAX_SEGMENTS];
+    uint ulSegmentHead;
+    uint ulSegmentCount;
+#endif
+};
+
+static struct tcp_pcb *pxActivePcbs;
+
+static void prvSimPcbUnlink(struct tcp_pcb *pcb)
+{
+    for (struct tcp_pcb **ppx = &pxActivePcbs; *ppx != NULL; ppx = &(*ppx)->next)
+    {
+        if (*ppx == pcb)
+        {
+            *ppx = pcb->next;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Tear down a connection after a fatal error and report it.
+ *
+ * @param pcb Connection that failed.
+ * @param err lwIP error to report.
+ *
+ * @return None.
+ */
+static void prvSimPcbFail(struct tcp_pcb *pcb, err_t err)
+{
+    if (pcb->iSocket >= 0)
+    {
+        close(pcb->iSocket);
+        pcb->iSocket = -1;
+    }
+#if configUSE_VIRTUAL_TICK
+    vSimControllerClose(pcb->pxPeer);
+    pcb->pxPeer = NULL;
+#endif
+    pcb->state = SIM_PCB_DEAD;
+    prvSimPcbUnlink(pcb);
+
+    if (pcb->errf != NULL)
+    {
+        pcb->errf(pcb->arg, err);
+    }
+
+    // Like lwIP, the pcb is gone once the error has been reported
+    free(pcb);
+}
+
+#if !configUSE_VIRTUAL_TICK
+static err_t prvSimErrFromErrno(int iErrno)
+{
+    switch (iErrno)
+    {
+    case ECONNREFUSED:
+    case ECONNRESET:
+    case EPIPE:
+        return ERR_RST;
+    case ETIMEDOUT:
+        return ERR_TIMEOUT;
+    case ENETUNREACH:
+    case EHOSTUNREACH:
+        return ERR_RTE;
+    default:
+        return ERR_ABRT;
+    }
+}
+#endif
+
+#if configUSE_VIRTUAL_TICK
+static uint64_t prvSimRttNs(void)
+{
+    static uint64_t ullRttNs;
+
+    if (ullRttNs == 0)
+    {
+        const char *pcRtt = getenv("SIM_NET_RTT_MS");
+        unsigned long ulRttMs = pcRtt != NULL ? strtoul(pcRtt, NULL, 0) : SIM_NET_DEFAULT_RTT_MS;
+
+        ullRttNs = (ulRttMs > 0 ? ulRttMs : 1) * 1000000ull;
+    }
+    return ullRttNs;
+}
+
+/**
+ * @brief Put the bytes queued on a connection on the virtual link.
+ *
+ * @param pcb Connection in the connected state.
+ *
+ * @return ERR_OK, also when the link is full and the bytes stay queued.
+ */
+static err_t prvSimVirtualOutput(struct tcp_pcb *pcb)
+{
+    uint64_t ullNow = ullSimTimeNs();
+    uint ulSlot = (pcb->ulSegmentHead + pcb->ulSegmentCount) % SIM_NET_MAX_SEGMENTS;
+
+    if (pcb->ulSegmentCount == SIM_NET_MAX_SEGMENTS)
+    {
+        return ERR_OK;
+    }
+
+    if (!xSimControllerReceive(pcb->pxPeer, pcb->ucSendBuf, pcb->ulQueued, ullNow + prvSimRttNs() / 2,
+                               pcb->ucSegmentReply[ulSlot], &pcb->xSegmentReplyLen[ulSlot]))
+    {
+        // The controller closes the connection, which the device sees as a reset on its next poll
+        pcb->ullConnectedNs = UINT64_MAX;
+    }
+
+    pcb->ullAckNs[ulSlot] = ullNow + prvSimRttNs();
+    pcb->ulSegmentLen[ulSlot] = pcb->ulQueued;
+    pcb->ulSegmentCount++;
+    pcb->ulUnacked += pcb->ulQueued;
+    pcb->ulQueued = 0;
+
+    return ERR_OK;
+}
+
+/**
+ * @brief Take the segments acknowledged by now off the virtual link.
+ *
+ * @param pcb Connection in the connected state.
+ * @param pucReply Destination for the controller's replies to them, in order, of
+ *                 SIM_NET_MAX_SEGMENTS * SIM_CONTROLLER_REPLY_LEN bytes.
+ * @param pxReplyLen Destination for the number of reply bytes, 0 if there are none.
+ *
+ * @return Number of bytes acknowledged.
+ */
+static uint32_t prvSimVirtualAcked(struct tcp_pcb *pcb, uint8_t *pucReply, size_t *pxReplyLen)
+{
+    uint64_t ullNow = ullSimTimeNs();
+    uint32_t ulAcked = 0;
+
+    *pxReplyLen = 0;
+    while (pcb->ulSegmentCount > 0 && pcb->ullAckNs[pcb->ulSegmentHead] <= ullNow)
+    {
+        ulAcked += pcb->ulSegmentLen[pcb->ulSegmentHead];
+        memcpy(&pucReply[*pxReplyLen], pcb->ucSegmentReply[pcb->ulSegmentHead],
+               pcb->xSegmentReplyLen[pcb->ulSegmentHead]);
+        *pxReplyLen += pcb->xSegmentReplyLen[pcb->ulSegmentHead];
+        pcb->ulSegmentHead = (pcb->ulSegmentHead + 1) % SIM_NET_MAX_SEGMENTS;
+        pcb->ulSegmentCount--;
+    }
+
+    return ulAcked;
+}
+#endif
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr)
+{
+    struct in_addr xAddr;
+
+    if (inet_aton(cp, &xAddr) == 0)
+    {
+        return 0;
+    }
+    if (addr != NULL)
+    {
+        addr->addr = xAddr.s_addr;
+    }
+    return 1;
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *addr)
+{
+    struct in_addr xAddr = {.s_addr = addr->addr};
+
+    return inet_ntoa(xAddr);
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+    u8_t count = 0;
+
+    while (p != NULL)
+    {
+        struct pbuf *next = p->next;
+
+        free(p);
+        p = next;
+        count++;
+    }
+    return count;
+}
+
+struct tcp_pcb *tcp_new_ip_type(__unused u8_t type)
+{
+    struct tcp_pcb *pcb = calloc(1, sizeof(struct tcp_pcb));
+
+    if (pcb != NULL)
+    {
+        pcb->iSocket = -1;
+    }
+    return pcb;
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg)
+{
+    pcb->arg = arg;
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv)
+{
+    pcb->recv = recv;
+}
+
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent)
+{
+    pcb->sent = sent;
+}
+
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
+{
+    pcb->poll = poll;
+    pcb->pollinterval = interval;
+    pcb->ullNextPollNs = ullSimTimeNs() + interval * SIM_TCP_SLOW_INTERVAL_NS;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err)
+{
+    pcb->errf = err;
+}
+
+err_t tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port, tcp_connected_fn connected)
+{
+    struct sockaddr_in xAddr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = ipaddr->addr};
+    int iOne = 1;
+
+    if (pcb->state != SIM_PCB_NEW)
+    {
+        return ERR_ISCONN;
+    }
+
+#if configUSE_VIRTUAL_TICK
+    (void)xAddr;
+    (void)iOne;
+
+    pcb->pxPeer = pxSimControllerAccept();
+    if (pcb->pxPeer == NULL)
+    {
+        return ERR_MEM;
+    }
+    pcb->ullConnectedNs = ullSimTimeNs() + prvSimRttNs();
+#else
+    pcb->iSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (pcb->iSocket < 0)
+    {
+        return ERR_MEM;
+    }
+
+    // lwIP sends small segments immediately unless told otherwise
+    setsockopt(pcb->iSocket, IPPROTO_TCP, TCP_NODELAY, &iOne, sizeof(iOne));
+
+    if (connect(pcb->iSocket, (struct sockaddr *)&xAddr, sizeof(xAddr)) != 0 && errno != EINPROGRESS)
+    {
+        close(pcb->iSocket);
+        pcb->iSocket = -1;
+        return ERR_RTE;
+    }
+#endif
+
+    pcb->connected = connected;
+    pcb->state = SIM_PCB_CONNECTING;
+    pcb->next = pxActivePcbs;
+    pxActivePcbs = pcb;
+
+    return ERR_OK;
+}
+
+u16_t tcp_sndbuf(const struct tcp_pcb *pcb)
+{
+    uint32_t ulUsed = pcb->ulQueued + pcb->ulUnacked;
+
+    return ulUsed >= TCP_SND_BUF ? 0 : (u16_t)(TCP_SND_BUF - ulUsed);
+}
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, __unused u8_t apiflags)
+{
+    // lwIP accepts writes while the SYN is still outstanding
+    if (pcb->state != SIM_PCB_CONNECTED && pcb->state != SIM_PCB_CONNECTING)
+    {
+        return ERR_CONN;
+    }
+    if (len > tcp_sndbuf(pcb))
+    {
+        return ERR_MEM;
+    }
+
+    // The data is always copied, which is also valid for callers that did not ask for it
+    memcpy(&pcb->ucSendBuf[pcb->ulQueued], dataptr, len);
+    pcb->ulQueued += len;
+
+    return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb)
+{
+    if (pcb->state != SIM_PCB_CONNECTED || pcb->ulQueued == 0)
+    {
+        return ERR_OK;
+    }
+
+#if configUSE_VIRTUAL_TICK
+    return prvSimVirtualOutput(pcb);
+#else
+    ssize_t xSent = send(pcb->iSocket, pcb->ucSendBuf, pcb->ulQueued, MSG_NOSIGNAL);
+    if (xSent < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? ERR_OK : ERR_CONN;
+    }
+
+    memmove(pcb->ucSendBuf, &pcb->ucSendBuf[xSent], pcb->ulQueued - (uint32_t)xSent);
+    pcb->ulQueued -= (uint32_t)xSent;
+    pcb->ulUnacked += (uint32_t)xSent;
+
+    return ERR_OK;
+#endif
+}
+
+void tcp_recved(__unused struct tcp_pcb *pcb, __unused u16_t len)
+{
+}
+
+err_t tcp_close(struct tcp_pcb *pcb)
+{
+    if (pcb->iSocket >= 0)
+    {
+        close(pcb->iSocket);
+    }
+#if configUSE_VIRTUAL_TICK
+    vSimControllerClose(pcb->pxPeer);
+#endif
+    prvSimPcbUnlink(pcb);
+    free(pcb);
+
+    return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb)
+{
+    struct linger xLinger = {.l_onoff = 1, .l_linger = 0};
+
+    // Send a RST like lwIP does
+    if (pcb->iSocket >= 0)
+    {
+        setsockopt(pcb->iSocket, SOL_SOCKET, SO_LINGER, &xLinger, sizeof(xLinger));
+    }
+    tcp_close(pcb);
+}
+
+/**
+ * @brief Complete a pending non-blocking connect.
+ *
+ * @param pcb Connection in the connecting state.
+ *
+ * @return None.
+ */
+static void prvSimPollConnecting(struct tcp_pcb *pcb)
+{
+#if configUSE_VIRTUAL_TICK
+    if (ullSimTimeNs() < pcb->ullConnectedNs)
+    {
+        return;
+    }
+#else
+    struct pollfd xPoll = {.fd = pcb->iSocket, .events = POLLOUT};
+    int iError = 0;
+    socklen_t xLen = sizeof(iError);
+
+    if (poll(&xPoll, 1, 0) <= 0)
+    {
+        return;
+    }
+
+    getsockopt(pcb->iSocket, SOL_SOCKET, SO_ERROR, &iError, &xLen);
+    if (iError != 0)
+    {
+        prvSimPcbFail(pcb, prvSimErrFromErrno(iError));
+        return;
+    }
+#endif
+
+    pcb->state = SIM_PCB_CONNECTED;
+    if (pcb->connected != NULL)
+    {
+        pcb->connected(pcb->arg, pcb, ERR_OK);
+    }
+}
+
+/**
+ * @brief Deliver received data, acknowledgements and poll callbacks.
+ *
+ * @param pcb Connection in the connected state.
+ *
+ * @return None.
+ */
+static void prvSimPollConnected(struct tcp_pcb *pcb)
+{
+#if configUSE_VIRTUAL_TICK
+    static uint8_t ucReply[SIM_NET_MAX_SEGMENTS * SIM_CONTROLLER_REPLY_LEN];
+    size_t xReplyLen;
+    uint32_t ulAcked = prvSimVirtualAcked(pcb, ucReply, &xReplyLen);
+
+    if (pcb->ullConnectedNs == UINT64_MAX)
+    {
+        prvSimPcbFail(pcb, ERR_RST);
+        return;
+    }
+
+    pcb->ulUnacked -= ulAcked;
+    if (ulAcked > 0 && pcb->sent != NULL && pcb->sent(pcb->arg, pcb, (u16_t)ulAcked) == ERR_ABRT)
+    {
+        return;
+    }
+
+    // The replies to the segments acknowledged together arrive as one
+    if (xReplyLen > 0 && pcb->recv != NULL)
+    {
+        struct pbuf *p = calloc(1, sizeof(struct pbuf) + xReplyLen + 1);
+
+        if (p != NULL)
+        {
+            p->payload = p + 1;
+            memcpy(p->payload, ucReply, xReplyLen);
+            p->len = p->tot_len = (u16_t)xReplyLen;
+            p->ref = 1;
+            if (pcb->recv(pcb->arg, pcb, p, ERR_OK) == ERR_ABRT)
+            {
+                return;
+            }
+        }
+    }
+
+    tcp_output(pcb);
+#else
+    int iOutQ = 0;
+
+    // Report bytes the peer has acknowledged since the last poll
+    if (pcb->ulUnacked > 0 && ioctl(pcb->iSocket, SIOCOUTQ, &iOutQ) == 0 && (uint32_t)iOutQ < pcb->ulUnacked)
+    {
+        u16_t acked = (u16_t)(pcb->ulUnacked - (uint32_t)iOutQ);
+
+        pcb->ulUnacked = (uint32_t)iOutQ;
+        if (pcb->sent != NULL && pcb->sent(pcb->arg, pcb, acked) == ERR_ABRT)
+        {
+            return;
+        }
+    }
+
+    // Push anything that did not fit into the socket earlier
+    tcp_output(pcb);
+
+    for (;;)
+    {
+        u8_t ucBuffer[TCP_MSS];
+        ssize_t xRead = recv(pcb->iSocket, ucBuffer, sizeof(ucBuffer), 0);
+
+        if (xRead < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                prvSimPcbFail(pcb, prvSimErrFromErrno(errno));
+                return;
+            }
+            break;
+        }
+
+        if (xRead == 0)
+        {
+            // Orderly close from the peer is reported as a NULL pbuf
+            if (pcb->recv != NULL)
+            {
+                pcb->recv(pcb->arg, pcb, NULL, ERR_OK);
+            }
+            return;
+        }
+
+        // Allocate one spare byte past the payload, like the slack lwIP pool pbufs have
+        struct pbuf *p = calloc(1, sizeof(struct pbuf) + (size_t)xRead + 1);
+
+        if (p == NULL)
+        {
+            break;
+        }
+        p->payload = p + 1;
+        p->len = p->tot_len = (u16_t)xRead;
+        p->ref = 1;
+        memcpy(p->payload, ucBuffer, (size_t)xRead);
+
+        if (pcb->recv == NULL)
+        {
+            pbuf_free(p);
+        }
+        else if (pcb->recv(pcb->arg, pcb, p, ERR_OK) == ERR_ABRT)
+        {
+            return;
+        }
+    }
+#endif
+
+    if (pcb->poll != NULL && pcb->pollinterval > 0 && ullSimTimeNs() >= pcb->ullNextPollNs)
+    {
+        pcb->ullNextPollNs = ullSimTimeNs() + pcb->pollinterval * SIM_TCP_SLOW_INTERVAL_NS;
+        pcb->poll(pcb->arg, pcb);
+    }
+}
+
+void vSimLwIPPoll(void)
+{
+    struct tcp_pcb *pcb = pxActivePcbs;
+
+    while (pcb != NULL)
+    {
+        // Callbacks may close the pcb, so step past it first
+        struct tcp_pcb *next = pcb->next;
+
+        if (pcb->state == SIM_PCB_CONNECTING)
+        {
+            prvSimPollConnecting(pcb);
+        }
+        else if (pcb->state == SIM_PCB_CONNECTED)
+        {
+            prvSimPollConnected(pcb);
+        }
+
+        pcb = next;
+    }
+}
@@ -0,0 +1,341 @@
+/**
+ * @file sim_pico.c
+ *
+ * @brief Host simulation of the Pico SDK platform services used by the firmware.
+ *
+ * Provides stdio, timing, GPIO and interrupt stand-ins, and the FreeRTOS idle
+ * hook that plays the role of the interrupt controller: emulated peripherals are
+ * serviced whenever no task is ready, which is when an RP2040 would be sleeping
+ * in WFI waiting for the same interrupts.
+ *
+ * Built with SIM_VIRTUAL_TIME the simulation runs on a virtual clock instead of
+ * host time. There is no tick timer: once every task is blocked and no emulated
+ * peripheral has work, the idle task moves the clock straight to the next task
+ * wake up or peripheral event and steps the tick count to match. Nothing then
+ * depends on host scheduling, so days of meter input replay in seconds and two
+ * runs over the same input produce identical output. The run stops SIM_STOP_S
+ * virtual seconds after boot, or SIM_DRAIN_S (default 60) virtual seconds after
+ * the UART input is exhausted.
+ *
+ * Built with TRACE the kernel event ring is written to the file named by
+ * SIM_TRACE when the simulation exits, in the layout tracejson reads from a
+ * debugger dump of the device.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Pico includes
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+
+// Simulation includes
+#include "sim.h"
+
+#if TRACE_ENABLED
+#include "trace/trace.h"
+#endif
+
+#define SIM_IRQ_COUNT 32
+#define SIM_IDLE_SLEEP_NS 50000
+#define SIM_TICK_NS (1000000000ull / configTICK_RATE_HZ)
+#define SIM_DEFAULT_DRAIN_S 60
+
+static irq_handler_t pxIRQHandlers[SIM_IRQ_COUNT];
+static bool xIRQEnabled[SIM_IRQ_COUNT];
+
+static uint64_t ullBootTimeNs;
+
+#if configUSE_VIRTUAL_TICK
+// Virtual clock, starting one second in so it never reads as zero
+static uint64_t ullVirtualNs = 1000000000ull;
+
+// Virtual time of the next tick, 0 until the scheduler has started
+static uint64_t ullNextTickNs;
+
+// Set by the idle hook when no peripheral had work, cleared once time has moved on
+static bool xSimIdleQuiet;
+
+static uint64_t ullStopNs;
+static uint64_t ullDrainNs;
+static uint64_t ullExhaustedNs;
+#endif
+
+#if TRACE_ENABLED
+static const char *pcTracePath;
+
+/**
+ * @brief Write the trace ring to SIM_TRACE.
+ *
+ * @return None.
+ */
+static void prvSimTraceWrite(void)
+{
+    FILE *pxFile = fopen(pcTracePath, "wb");
+
+    if (pxFile == NULL || fwrite(&xTraceBuffer, sizeof(xTraceBuffer), 1, pxFile) != 1)
+    {
+        fprintf(stderr, "<sim> cannot write trace to %s\n", pcTracePath);
+    }
+    else
+    {
+        fprintf(stderr, "<sim> trace of %u events written to %s\n", (unsigned)xTraceBuffer.header.head, pcTracePath);
+    }
+    if (pxFile != NULL)
+    {
+        fclose(pxFile);
+    }
+}
+#endif
+
+uint64_t ullSimTimeNs(void)
+{
+#if configUSE_VIRTUAL_TICK
+    return ullVirtualNs;
+#else
+    struct timespec xNow;
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (uint64_t)xNow.tv_sec * 1000000000ull + (uint64_t)xNow.tv_nsec;
+#endif
+}
+
+bool stdio_usb_init(void)
+{
+    ullBootTimeNs = ullSimTimeNs();
+
+#if configUSE_VIRTUAL_TICK
+    const char *pcStop = getenv("SIM_STOP_S");
+    const char *pcDrain = getenv("SIM_DRAIN_S");
+
+    ullStopNs = pcStop != NULL ? strtoull(pcStop, NULL, 0) * 1000000000ull : 0;
+    ullDrainNs = (pcDrain != NULL ? strtoull(pcDrain, NULL, 0) : SIM_DEFAULT_DRAIN_S) * 1000000000ull;
+#endif
+
+#if TRACE_ENABLED
+    pcTracePath = getenv("SIM_TRACE");
+    if (pcTracePath != NULL)
+    {
+        atexit(prvSimTraceWrite);
+    }
+#endif
+
+    // Flush every line so the output interleaves sensibly with other tools
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    return true;
+}
+
+int putchar_raw(int c)
+{
+    return putchar(c);
+}
+
+void sleep_ms(uint32_t ms)
+{
+#if configUSE_VIRTUAL_TICK
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+    {
+        ullVirtualNs += ms * 1000000ull;
+    }
+    else
+    {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+    }
+#else
+    struct timespec xDelay = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L};
+
+    while (nanosleep(&xDelay, &xDelay) != 0)
+    {
+    }
+#endif
+}
+
+uint64_t time_us_64(void)
+{
+    return (ullSimTimeNs() - ullBootTimeNs) / 1000;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+void gpio_set_function(__unused uint gpio, __unused enum gpio_function fn)
+{
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    if (num < SIM_IRQ_COUNT)
+    {
+        pxIRQHandlers[num] = handler;
+    }
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    if (num < SIM_IRQ_COUNT)
+    {
+        xIRQEnabled[num] = enabled;
+    }
+}
+
+void vSimRaiseIRQ(uint num)
+{
+    if (num >= SIM_IRQ_COUNT || !xIRQEnabled[num] || pxIRQHandlers[num] == NULL)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    pxIRQHandlers[num]();
+    taskEXIT_CRITICAL();
+}
+
+#if configUSE_VIRTUAL_TICK
+/**
+ * @brief Move the virtual clock forward, at most to the end of a number of ticks.
+ *
+ * The clock stops early at the next emulated peripheral event, so input is
+ * never delivered late however far the tick could jump.
+ *
+ * @param xMaxTicks Most tick boundaries the clock may cross.
+ *
+ * @return Number of tick boundaries crossed.
+ */
+static TickType_t prvSimAdvance(TickType_t xMaxTicks)
+{
+    uint64_t ullTarget = ullNextTickNs + (uint64_t)(xMaxTicks - 1) * SIM_TICK_NS;
+    uint64_t ullEvent = ullSimUARTNextEventNs();
+    TickType_t xTicks = 0;
+
+    // An event that is already due waits for the firmware, not for the clock
+    if (ullEvent > ullVirtualNs && ullEvent < ullTarget)
+    {
+        ullTarget = ullEvent;
+    }
+    if (ullTarget > ullVirtualNs)
+    {
+        ullVirtualNs = ullTarget;
+    }
+
+    while (ullNextTickNs <= ullVirtualNs)
+    {
+        ullNextTickNs += SIM_TICK_NS;
+        xTicks++;
+    }
+
+    return xTicks;
+}
+
+/**
+ * @brief Stop the simulation once the configured amount of virtual time has run.
+ *
+ * @return None.
+ */
+static void prvSimCheckStop(void)
+{
+    if (ullExhaustedNs == 0 && xSimUARTExhausted())
+    {
+        ullExhaustedNs = ullVirtualNs;
+    }
+
+    if ((ullStopNs > 0 && ullVirtualNs - ullBootTimeNs >= ullStopNs) ||
+        (ullStopNs == 0 && ullExhaustedNs > 0 && ullVirtualNs - ullExhaustedNs >= ullDrainNs))
+    {
+        fflush(stdout);
+        fprintf(stderr, "<sim> stopping at %llu ms virtual time\n",
+                (unsigned long long)((ullVirtualNs - ullBootTimeNs) / 1000000));
+        exit(0);
+    }
+}
+
+void vSimVirtualSleep(unsigned long xExpectedIdleTime)
+{
+    TickType_t xTicks;
+
+    // A peripheral had work in this pass of the idle loop, let the firmware handle it first
+    if (!xSimIdleQuiet)
+    {
+        return;
+    }
+    xSimIdleQuiet = false;
+
+    xTicks = prvSimAdvance(xExpectedIdleTime);
+    if (xTicks > 0)
+    {
+        vTaskStepTick(xTicks);
+    }
+}
+
+/**
+ * @brief FreeRTOS idle hook acting as the simulated interrupt controller.
+ *
+ * Services the emulated peripherals. When none had work the clock is left to
+ * vSimVirtualSleep(), which the kernel only calls when the next wake up is at
+ * least two ticks away, so a quiet pass without it steps a single tick here.
+ *
+ * @return None.
+ */
+void vApplicationIdleHook(void)
+{
+    if (ullNextTickNs == 0)
+    {
+        ullNextTickNs = ullVirtualNs + SIM_TICK_NS;
+    }
+
+    if (xSimUARTService() == pdTRUE)
+    {
+        xSimIdleQuiet = false;
+        return;
+    }
+
+    prvSimCheckStop();
+
+    if (!xSimIdleQuiet)
+    {
+        xSimIdleQuiet = true;
+        return;
+    }
+
+    if (prvSimAdvance(1) > 0)
+    {
+        BaseType_t xSwitch;
+
+        taskENTER_CRITICAL();
+        xSwitch = xTaskIncrementTick();
+        taskEXIT_CRITICAL();
+
+        if (xSwitch != pdFALSE)
+        {
+            taskYIELD();
+        }
+    }
+}
+#else
+/**
+ * @brief FreeRTOS idle hook acting as the simulated interrupt controller.
+ *
+ * Services the emulated peripherals and, when none of them had any work, sleeps
+ * briefly so an idle simulation does not spin a host core at 100%.
+ *
+ * @return None.
+ */
+void vApplicationIdleHook(void)
+{
+    if (xSimUARTService() == pdFALSE)
+    {
+        struct timespec xDelay = {.tv_sec = 0, .tv_nsec = SIM_IDLE_SLEEP_NS};
+
+        nanosleep(&xDelay, NULL);
+    }
+}
+#endif
@@ -0,0 +1,393 @@
+/**
+ * @file sim_uart.c
+ *
+ * @brief Host simulation of the RP2040 UARTs.
+ *
+ * uart0 reads from the path in the SIM_UART environment variable, which may be a
+ * regular file (replayed meter output), a FIFO or a terminal. When SIM_UART is
+ * not set a pseudo terminal is created and its name printed, so a meter emulator
+ * or a person can attach to it. Bytes written with uart_puts() go back out on the
+ * same descriptor when it is writable.
+ *
+ * Input is paced at the configured baud rate (10 bits per byte) unless
+ * SIM_UART_BAUD overrides it; SIM_UART_BAUD=0 disables pacing and replays input
+ * as fast as the firmware drains the RX FIFO. When paced, bytes that arrive
+ * while the 32 entry RX FIFO is full are dropped and counted as overruns, just
+ * as the PL011 does. SIM_UART_LINE_MS inserts a gap after every '\r', so a
+ * capture file replays at the meter's reporting cadence.
+ *
+ * With a virtual clock input has to come from a regular file: the arrival of
+ * the next byte is then known in advance and the clock can jump to it.
+ */
+
+#define _GNU_SOURCE
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Pico includes
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+
+// Simulation includes
+#include "sim.h"
+
+#define SIM_UART_FIFO_DEPTH 32
+#define SIM_UART_BITS_PER_BYTE 10
+
+struct uart_inst
+{
+    uart_hw_t xHw;
+    uint ulIndex;
+    int iFd;
+    int iPtySlaveFd;
+    bool xWritable;
+    bool xEOF;
+    bool xRxIrqEnabled;
+    uint ulBaudRate;
+    uint64_t ullByteNs;
+    uint64_t ullLineGapNs;
+    uint64_t ullLastByteNs;
+    uint64_t ullSeenNs;
+    uint64_t ullHoldUntilNs;
+    uint8_t ucPending[256];
+    uint ulPendingHead;
+    uint ulPendingCount;
+    uint8_t ucFIFO[SIM_UART_FIFO_DEPTH];
+    uint ulFIFOHead;
+    uint ulFIFOCount;
+    uint64_t ullRxBytes;
+    uint64_t ullTxBytes;
+    uint64_t ullOverruns;
+};
+
+static uart_inst_t xSimUARTs[2] = {
+    {.ulIndex = 0, .iFd = -1, .iPtySlaveFd = -1},
+    {.ulIndex = 1, .iFd = -1, .iPtySlaveFd = -1},
+};
+
+uart_inst_t *const uart0_inst = &xSimUARTs[0];
+uart_inst_t *const uart1_inst = &xSimUARTs[1];
+
+static BaseType_t prvSimUARTReceive(uart_inst_t *uart);
+
+/**
+ * @brief Print the UART counters when the simulation exits.
+ *
+ * @return None.
+ */
+static void prvSimUARTReport(void)
+{
+    for (uint i = 0; i < 2; i++)
+    {
+        uart_inst_t *uart = &xSimUARTs[i];
+
+        if (uart->iFd >= 0)
+        {
+            fprintf(stderr, "<sim> uart%u rx %llu bytes, tx %llu bytes, %llu overruns\n", i,
+                    (unsigned long long)uart->ullRxBytes, (unsigned long long)uart->ullTxBytes,
+                    (unsigned long long)uart->ullOverruns);
+        }
+    }
+}
+
+/**
+ * @brief Create a raw pseudo terminal to stand in for the meter connection.
+ *
+ * @param uart UART instance to attach the master side to.
+ *
+ * @return The master file descriptor, or -1 on failure.
+ */
+static int prvSimUARTOpenPty(uart_inst_t *uart)
+{
+    struct termios xTermios;
+    int iMaster = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (iMaster < 0 || grantpt(iMaster) != 0 || unlockpt(iMaster) != 0)
+    {
+        return -1;
+    }
+
+    // Keep the slave open so the master does not report EIO while nobody is attached,
+    // and put it in raw mode so '\r' terminators are not translated.
+    uart->iPtySlaveFd = open(ptsname(iMaster), O_RDWR | O_NOCTTY);
+    if (uart->iPtySlaveFd >= 0 && tcgetattr(uart->iPtySlaveFd, &xTermios) == 0)
+    {
+        cfmakeraw(&xTermios);
+        tcsetattr(uart->iPtySlaveFd, TCSANOW, &xTermios);
+    }
+
+    fprintf(stderr, "<sim> uart%u attached to %s\n", uart->ulIndex, ptsname(iMaster));
+
+    return iMaster;
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate)
+{
+    const char *pcPath = getenv(uart->ulIndex == 0 ? "SIM_UART" : "SIM_UART1");
+    const char *pcBaud = getenv("SIM_UART_BAUD");
+    const char *pcLineGap = getenv("SIM_UART_LINE_MS");
+    struct stat xStat;
+
+    uart->ulBaudRate = pcBaud != NULL ? (uint)strtoul(pcBaud, NULL, 0) : baudrate;
+    uart->ullByteNs = uart->ulBaudRate > 0 ? SIM_UART_BITS_PER_BYTE * 1000000000ull / uart->ulBaudRate : 0;
+    uart->ullLineGapNs = pcLineGap != NULL ? strtoull(pcLineGap, NULL, 0) * 1000000ull : 0;
+
+    if (uart->iFd >= 0)
+    {
+        return baudrate;
+    }
+
+    if (pcPath == NULL || *pcPath == '\0')
+    {
+        uart->iFd = prvSimUARTOpenPty(uart);
+        uart->xWritable = uart->iFd >= 0;
+    }
+    else if (stat(pcPath, &xStat) == 0 && S_ISREG(xStat.st_mode))
+    {
+        uart->iFd = open(pcPath, O_RDONLY | O_NONBLOCK);
+        uart->xWritable = false;
+    }
+    else
+    {
+        uart->iFd = open(pcPath, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        uart->xWritable = true;
+    }
+
+    if (uart->iFd < 0)
+    {
+        fprintf(stderr, "<sim> uart%u: cannot open %s: %s\n", uart->ulIndex, pcPath ? pcPath : "pty", strerror(errno));
+        exit(1);
+    }
+
+#if configUSE_VIRTUAL_TICK
+    if (uart->xWritable)
+    {
+        fprintf(stderr, "<sim> uart%u: virtual time needs SIM_UART%s to name a regular file\n", uart->ulIndex,
+                uart->ulIndex == 0 ? "" : "1");
+        exit(1);
+    }
+#endif
+
+    fcntl(uart->iFd, F_SETFL, fcntl(uart->iFd, F_GETFL) | O_NONBLOCK);
+
+    if (uart->ulIndex == 0)
+    {
+        atexit(prvSimUARTReport);
+    }
+
+    return baudrate;
+}
+
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, __unused bool tx_needs_data)
+{
+    uart->xRxIrqEnabled = rx_has_data;
+}
+
+bool uart_is_readable(uart_inst_t *uart)
+{
+    return uart->ulFIFOCount > 0;
+}
+
+char uart_getc(uart_inst_t *uart)
+{
+    while (uart->ulFIFOCount == 0)
+    {
+        prvSimUARTReceive(uart);
+    }
+
+    char c = (char)uart->ucFIFO[uart->ulFIFOHead];
+
+    uart->ulFIFOHead = (uart->ulFIFOHead + 1) % SIM_UART_FIFO_DEPTH;
+    uart->ulFIFOCount--;
+
+    return c;
+}
+
+void uart_puts(uart_inst_t *uart, const char *s)
+{
+    size_t xLen = strlen(s);
+
+    uart->ullTxBytes += xLen;
+
+    if (uart->xWritable && uart->iFd >= 0)
+    {
+        // Best effort, the meter side is expected to keep up with a few bytes
+        ssize_t xWritten = write(uart->iFd, s, xLen);
+        (void)xWritten;
+    }
+}
+
+uart_hw_t *uart_get_hw(uart_inst_t *uart)
+{
+    return &uart->xHw;
+}
+
+uint uart_get_index(uart_inst_t *uart)
+{
+    return uart->ulIndex;
+}
+
+/**
+ * @brief Return when the next pending byte arrives on the line.
+ *
+ * A byte arrives one character time after the previous one, but never before it
+ * was read from the host or before the gap following a line has elapsed.
+ *
+ * @param uart UART instance with at least one pending byte.
+ *
+ * @return Arrival time in nanoseconds on the simulation clock.
+ */
+static uint64_t prvSimUARTArrivalNs(const uart_inst_t *uart)
+{
+    uint64_t ullArrival = uart->ullLastByteNs + uart->ullByteNs;
+
+    if (ullArrival < uart->ullSeenNs)
+    {
+        ullArrival = uart->ullSeenNs;
+    }
+    if (ullArrival < uart->ullHoldUntilNs)
+    {
+        ullArrival = uart->ullHoldUntilNs;
+    }
+
+    return ullArrival;
+}
+
+/**
+ * @brief Pull newly arrived bytes from the backing descriptor into the RX FIFO.
+ *
+ * Bytes that arrive while the FIFO is full are overruns when paced; unpaced
+ * input is simply held back until the FIFO has room.
+ *
+ * @param uart UART instance.
+ *
+ * @return pdTRUE if any bytes arrived.
+ */
+static BaseType_t prvSimUARTReceive(uart_inst_t *uart)
+{
+    BaseType_t xArrived = pdFALSE;
+    uint64_t ullNow = ullSimTimeNs();
+
+    if (uart->iFd < 0)
+    {
+        return pdFALSE;
+    }
+
+    if (uart->ulPendingCount == 0 && !uart->xEOF)
+    {
+        ssize_t xRead = read(uart->iFd, uart->ucPending, sizeof(uart->ucPending));
+
+        if (xRead > 0)
+        {
+            uart->ulPendingHead = 0;
+            uart->ulPendingCount = (uint)xRead;
+            uart->ullSeenNs = ullNow;
+        }
+        else if (xRead == 0 && uart->iPtySlaveFd < 0)
+        {
+            struct stat xStat;
+
+            if (fstat(uart->iFd, &xStat) == 0 && S_ISREG(xStat.st_mode))
+            {
+                fprintf(stderr, "<sim> uart%u input exhausted\n", uart->ulIndex);
+                uart->xEOF = true;
+            }
+        }
+    }
+
+    while (uart->ulPendingCount > 0)
+    {
+        uint64_t ullArrival = prvSimUARTArrivalNs(uart);
+        uint8_t ucByte = uart->ucPending[uart->ulPendingHead];
+
+        if (ullArrival > ullNow)
+        {
+            break;
+        }
+
+        if (uart->ulFIFOCount == SIM_UART_FIFO_DEPTH)
+        {
+            if (uart->ullByteNs == 0)
+            {
+                break;
+            }
+            uart->ullOverruns++;
+            uart->xHw.rsr |= UART_UARTRSR_OE_BITS;
+        }
+        else
+        {
+            uart->ucFIFO[(uart->ulFIFOHead + uart->ulFIFOCount) % SIM_UART_FIFO_DEPTH] = ucByte;
+            uart->ulFIFOCount++;
+            uart->ullRxBytes++;
+        }
+
+        uart->ullLastByteNs = ullArrival;
+        uart->ulPendingHead++;
+        uart->ulPendingCount--;
+        xArrived = pdTRUE;
+
+        if (ucByte == '\r' && uart->ullLineGapNs > 0)
+        {
+            uart->ullHoldUntilNs = ullArrival + uart->ullLineGapNs;
+        }
+    }
+
+    return xArrived;
+}
+
+BaseType_t xSimUARTService(void)
+{
+    BaseType_t xWork = pdFALSE;
+
+    for (uint i = 0; i < 2; i++)
+    {
+        uart_inst_t *uart = &xSimUARTs[i];
+
+        if (prvSimUARTReceive(uart) == pdTRUE)
+        {
+            xWork = pdTRUE;
+        }
+
+        if (uart->ulFIFOCount > 0 && uart->xRxIrqEnabled)
+        {
+            xWork = pdTRUE;
+            vSimRaiseIRQ(i == 0 ? UART0_IRQ : UART1_IRQ);
+        }
+    }
+
+    return xWork;
+}
+
+uint64_t ullSimUARTNextEventNs(void)
+{
+    uint64_t ullNext = UINT64_MAX;
+
+    for (uint i = 0; i < 2; i++)
+    {
+        uart_inst_t *uart = &xSimUARTs[i];
+
+        if (uart->ulPendingCount > 0 && prvSimUARTArrivalNs(uart) < ullNext)
+        {
+            ullNext = prvSimUARTArrivalNs(uart);
+        }
+    }
+
+    return ullNext;
+}
+
+BaseType_t xSimUARTExhausted(void)
+{
+    return uart0_inst->xEOF && uart0_inst->ulPendingCount == 0 && uart0_inst->ulFIFOCount == 0 ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file core_link.c
+ *
+ * @brief Source file for the record channel between the two RP2040 cores.
+ *
+ * The ring is an SPSC_RING_T carrying whole WIRE_RECORD_T records, written on
+ * core 1 and read on core 0.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stream_buffer.h>
+
+// Pico includes
+#include "pico/sem.h"
+
+// Driver includes
+#include "core_link.h"
+#include "drivers/tcp/tcp_driver.h"
+
+// Project includes
+#include "log/log.h"
+#include "ring/spsc_ring.h"
+#include "trace/trace.h"
+
+// Stream buffer handles
+extern StreamBufferHandle_t xStreamBufferTCP;
+
+// Tasks
+extern TaskHandle_t xTaskTCP;
+
+static uint8_t ucRingStorage[CORE_LINK_RING_BYTES];
+static SPSC_RING_T xRing;
+
+// Written by core 1 only
+static volatile CORE_LINK_STATS_T xCoreLinkStats;
+
+// Binary doorbell, released by core 1 and acquired by vTaskCoreLink
+static semaphore_t xDoorbell;
+
+void vCoreLinkInit(void)
+{
+    vSPSCRingInit(&xRing, ucRingStorage, sizeof(ucRingStorage));
+    sem_init(&xDoorbell, 0, 1);
+}
+
+bool xCoreLinkSend(const WIRE_RECORD_T *pxRecord)
+{
+    if (!xSPSCRingWriteRecord(&xRing, pxRecord, sizeof(*pxRecord)))
+    {
+        xCoreLinkStats.dropped++;
+        return false;
+    }
+    xCoreLinkStats.sent++;
+
+    sem_release(&xDoorbell);
+
+    return true;
+}
+
+bool xCoreLinkReceive(WIRE_RECORD_T *pxRecord)
+{
+    return xSPSCRingReadRecord(&xRing, pxRecord, sizeof(*pxRecord));
+}
+
+void vGetCoreLinkStats(CORE_LINK_STATS_T *pxStats)
+{
+    pxStats->sent = xCoreLinkStats.sent;
+    pxStats->dropped = xCoreLinkStats.dropped;
+    pxStats->pending = ulSPSCRingAvailable(&xRing) / sizeof(WIRE_RECORD_T);
+}
+
+void vTaskCoreLink(__unused void *pvParameters)
+{
+    WIRE_RECORD_T xRecord;
+
+    for (;;)
+    {
+        // The RP2040 port blocks this task in FreeRTOS until core 1 releases the doorbell
+        sem_acquire_blocking(&xDoorbell);
+
+        while (xCoreLinkReceive(&xRecord))
+        {
+            // Only queue whole records, the uplink task reads them back as structures
+            if (xStreamBufferSpacesAvailable(xStreamBufferTCP) < sizeof(xRecord))
+            {
+                LOG_WARN("<vTaskCoreLink> TCP queue full, record dropped\n");
+                continue;
+            }
+            xStreamBufferSend(xStreamBufferTCP, (void *)&xRecord, sizeof(xRecord), 0);
+            TRACE_MARK(TRACE_MARK_RECORD, xRecord.time_ms);
+        }
+
+        xTaskNotifyIndexed(xTaskTCP, TCP_NOTIFY_INDEX, TCP_EVENT_RECORD, eSetBits);
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file core_link.h
+ *
+ * @brief Header file for the record channel between the two RP2040 cores.
+ *
+ * In the DUAL_CORE build FreeRTOS, the CYW43 driver and lwIP run on core 0,
+ * while the meter ingest runs on core 1 outside of FreeRTOS. Core 1 hands every
+ * finished usage record to core 0 through a single producer, single consumer
+ * ring in shared SRAM, the SPSC_RING_T of ring/spsc_ring.h. Neither side ever
+ * takes a lock or waits for the other; a full ring drops the record instead.
+ *
+ * After a record is pushed core 1 rings a doorbell, a pico_sync semaphore. The
+ * RP2040 port's SDK interop turns its release on core 1 into a FreeRTOS wake up
+ * of vTaskCoreLink on core 0, which moves the records into the TCP stream buffer
+ * for the uplink task.
+ */
+
+#ifndef CORE_LINK_H_
+#define CORE_LINK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Bytes of the ring, a power of two; records wrap around its end, so it holds 56 of them
+#define CORE_LINK_RING_BYTES 2048
+
+// Type definitions
+typedef struct CORE_LINK_STATS_T_
+{
+    uint32_t sent;
+    uint32_t dropped;
+
+    // Records in the ring, read on core 0
+    uint32_t pending;
+} CORE_LINK_STATS_T;
+
+/**
+ * @brief Initialise the ring and its doorbell.
+ *
+ * Must be called on core 0 before core 1 is launched.
+ *
+ * @return None.
+ */
+void vCoreLinkInit(void);
+
+/**
+ * @brief Push a record from core 1 and ring the doorbell.
+ *
+ * Never blocks; core 1 keeps servicing the UART whatever core 0 is doing.
+ *
+ * @param pxRecord Record to hand over.
+ *
+ * @return true if the record was queued, false if the ring was full and it was dropped.
+ */
+bool xCoreLinkSend(const WIRE_RECORD_T *pxRecord);
+
+/**
+ * @brief Pop the oldest record on core 0.
+ *
+ * @param pxRecord Destination for the record.
+ *
+ * @return true if a record was returned.
+ */
+bool xCoreLinkReceive(WIRE_RECORD_T *pxRecord);
+
+/**
+ * @brief Read the counters of the producing side and the depth of the ring.
+ *
+ * @param pxStats Destination for the counters.
+ *
+ * @return None.
+ */
+void vGetCoreLinkStats(CORE_LINK_STATS_T *pxStats);
+
+/**
+ * @brief Task on core 0 that forwards records from core 1 to the uplink task.
+ *
+ * Blocks on the doorbell, then moves every record in the ring into the TCP
+ * stream buffer and notifies vTaskTCP, as vTaskUART does in the single core build.
+ *
+ * @param pvParameters Unused parameter (required by FreeRTOS API).
+ *
+ * @return None.
+ */
+void vTaskCoreLink(void *pvParameters);
+
+#endif /* CORE_LINK_H_ */
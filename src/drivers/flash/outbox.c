@@ -0,0 +1,575 @@
+/**
+ * @file outbox.c
+ *
+ * @brief Source file for the store-and-forward outbox in flash.
+ *
+ * Every slot is laid out as
+ *
+ *     type (1 byte) | length (1 byte) | CRC-16 (2 bytes) | sequence (4 bytes) | payload
+ *
+ * with multi-byte fields little endian. The CRC covers the whole slot up to
+ * the end of the payload, taken with the CRC field zero. An erased slot is all
+ * 0xFF. Slots are written by programming their page with every other byte left
+ * at 0xFF, which leaves the slots already programmed in it unchanged.
+ */
+
+// Standard includes
+#include <string.h>
+
+// Pico includes
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+// Driver includes
+#include "outbox.h"
+
+// Slot types
+#define OUTBOX_SLOT_HEADER 0x48
+#define OUTBOX_SLOT_RECORD 0x52
+#define OUTBOX_SLOT_ACK 0x41
+#define OUTBOX_SLOT_RESERVE 0x53
+
+#define OUTBOX_SLOT_HEADER_LEN 8
+#define OUTBOX_SLOT_MAX_PAYLOAD (OUTBOX_SLOT_LEN - OUTBOX_SLOT_HEADER_LEN)
+
+// Header slot payload: magic, acknowledged sequence number, erase count of the sector and reserved sequence number
+#define OUTBOX_MAGIC 0x3258424FUL
+#define OUTBOX_HEADER_PAYLOAD_LEN 16
+
+#if OUTBOX_SECTORS < 2
+#error "OUTBOX_SECTORS must leave a sector to write while the oldest is erased"
+#endif
+
+#if FLASH_PAGE_SIZE % OUTBOX_SLOT_LEN != 0
+#error "OUTBOX_SLOT_LEN must divide FLASH_PAGE_SIZE"
+#endif
+
+#if WIRE_MAX_RECORD_LEN > OUTBOX_SLOT_MAX_PAYLOAD
+#error "A record frame must fit into one slot"
+#endif
+
+// Type definitions
+typedef enum
+{
+    OUTBOX_SLOT_FREE = 0,
+    OUTBOX_SLOT_VALID,
+    OUTBOX_SLOT_TORN,
+} OUTBOX_SLOT_STATE_T;
+
+typedef struct OUTBOX_FLASH_OP_T_
+{
+    uint32_t offset;
+    const uint8_t *data;
+} OUTBOX_FLASH_OP_T;
+
+// Page image a slot is programmed from, flash_range_program() cannot read from flash itself
+static uint8_t ucPage[FLASH_PAGE_SIZE];
+
+static uint32_t prvGet32(const uint8_t *pucData)
+{
+    return (uint32_t)pucData[0] | ((uint32_t)pucData[1] << 8) | ((uint32_t)pucData[2] << 16) |
+           ((uint32_t)pucData[3] << 24);
+}
+
+static void prvPut32(uint8_t *pucData, uint32_t ulValue)
+{
+    pucData[0] = (uint8_t)ulValue;
+    pucData[1] = (uint8_t)(ulValue >> 8);
+    pucData[2] = (uint8_t)(ulValue >> 16);
+    pucData[3] = (uint8_t)(ulValue >> 24);
+}
+
+static uint32_t prvOffset(uint32_t ulSector, uint32_t ulSlot)
+{
+    return OUTBOX_OFFSET + ulSector * FLASH_SECTOR_SIZE + ulSlot * OUTBOX_SLOT_LEN;
+}
+
+/**
+ * @brief Compute the CRC of a slot image.
+ *
+ * @param pucSlot Slot image, its length byte already checked.
+ *
+ * @return The CRC, taken with the CRC field zero.
+ */
+static uint16_t prvSlotCrc(const uint8_t *pucSlot)
+{
+    uint8_t ucSlot[OUTBOX_SLOT_LEN];
+    size_t xLen = OUTBOX_SLOT_HEADER_LEN + pucSlot[1];
+
+    memcpy(ucSlot, pucSlot, xLen);
+    ucSlot[2] = 0;
+    ucSlot[3] = 0;
+
+    return usWireCrc16(ucSlot, xLen);
+}
+
+/**
+ * @brief Copy a slot out of the memory mapped flash and check it.
+ *
+ * @param ulSector Sector of the slot.
+ * @param ulSlot Slot within the sector.
+ * @param pucSlot Destination for the OUTBOX_SLOT_LEN bytes of the slot.
+ *
+ * @return Whether the slot is erased, holds a valid entry or was torn.
+ */
+static OUTBOX_SLOT_STATE_T prvSlotRead(uint32_t ulSector, uint32_t ulSlot, uint8_t *pucSlot)
+{
+    bool xErased = true;
+
+    memcpy(pucSlot, (const void *)(XIP_BASE + prvOffset(ulSector, ulSlot)), OUTBOX_SLOT_LEN);
+
+    for (size_t i = 0; i < OUTBOX_SLOT_LEN && xErased; i++)
+    {
+        xErased = pucSlot[i] == 0xFF;
+    }
+    if (xErased)
+    {
+        return OUTBOX_SLOT_FREE;
+    }
+
+    if (pucSlot[1] > OUTBOX_SLOT_MAX_PAYLOAD ||
+        prvSlotCrc(pucSlot) != (uint16_t)(pucSlot[2] | (pucSlot[3] << 8)))
+    {
+        return OUTBOX_SLOT_TORN;
+    }
+
+    return OUTBOX_SLOT_VALID;
+}
+
+static void prvFlashErase(void *pvOp)
+{
+    flash_range_erase(((OUTBOX_FLASH_OP_T *)pvOp)->offset, FLASH_SECTOR_SIZE);
+}
+
+static void prvFlashProgram(void *pvOp)
+{
+    OUTBOX_FLASH_OP_T *pxOp = (OUTBOX_FLASH_OP_T *)pvOp;
+
+    flash_range_program(pxOp->offset, pxOp->data, FLASH_PAGE_SIZE);
+}
+
+/**
+ * @brief Program one slot and check that it reads back.
+ *
+ * @param pxOutbox Outbox the slot belongs to.
+ * @param ulSector Sector of the slot.
+ * @param ulSlot Slot within the sector, erased.
+ * @param ucType Slot type.
+ * @param ulSeq Sequence number stored in the slot.
+ * @param pucPayload Payload bytes.
+ * @param xLen Payload length, at most OUTBOX_SLOT_MAX_PAYLOAD.
+ *
+ * @return true if the slot was written.
+ */
+static bool prvSlotWrite(OUTBOX_T *pxOutbox, uint32_t ulSector, uint32_t ulSlot, uint8_t ucType, uint32_t ulSeq,
+                         const uint8_t *pucPayload, size_t xLen)
+{
+    uint32_t ulOffset = prvOffset(ulSector, ulSlot);
+    uint8_t *pucSlot = &ucPage[ulOffset % FLASH_PAGE_SIZE];
+    OUTBOX_FLASH_OP_T xOp = {.offset = ulOffset - ulOffset % FLASH_PAGE_SIZE, .data = ucPage};
+    uint16_t usCrc;
+
+    memset(ucPage, 0xFF, sizeof(ucPage));
+    pucSlot[0] = ucType;
+    pucSlot[1] = (uint8_t)xLen;
+    pucSlot[2] = 0;
+    pucSlot[3] = 0;
+    prvPut32(&pucSlot[4], ulSeq);
+    if (xLen > 0)
+    {
+        memcpy(&pucSlot[OUTBOX_SLOT_HEADER_LEN], pucPayload, xLen);
+    }
+
+    usCrc = prvSlotCrc(pucSlot);
+    pucSlot[2] = (uint8_t)usCrc;
+    pucSlot[3] = (uint8_t)(usCrc >> 8);
+
+    if (flash_safe_execute(prvFlashProgram, &xOp, OUTBOX_FLASH_TIMEOUT_MS) != PICO_OK ||
+        memcmp((const void *)(XIP_BASE + ulOffset), pucSlot, OUTBOX_SLOT_HEADER_LEN + xLen) != 0)
+    {
+        pxOutbox->stats.flash_errors++;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check whether a sector holds records that are not yet acknowledged.
+ *
+ * @param pxOutbox Outbox the sector belongs to.
+ * @param ulSector Sector to check.
+ *
+ * @return true if the sector holds a pending record.
+ */
+static bool prvSectorPending(const OUTBOX_T *pxOutbox, uint32_t ulSector)
+{
+    uint8_t ucSlot[OUTBOX_SLOT_LEN];
+
+    for (uint32_t ulSlot = 1; ulSlot < OUTBOX_SLOTS_PER_SECTOR; ulSlot++)
+    {
+        if (prvSlotRead(ulSector, ulSlot, ucSlot) == OUTBOX_SLOT_VALID && ucSlot[0] == OUTBOX_SLOT_RECORD &&
+            prvGet32(&ucSlot[4]) > pxOutbox->acked_seq)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Check whether a slot can be appended without costing pending records.
+ *
+ * @param pxOutbox Outbox to append to.
+ *
+ * @return false if the head is full and the sector the log would move on to still holds pending records.
+ */
+static bool prvRoomWithoutLoss(const OUTBOX_T *pxOutbox)
+{
+    return pxOutbox->head_slot < OUTBOX_SLOTS_PER_SECTOR ||
+           !prvSectorPending(pxOutbox, (pxOutbox->head_sector + 1) % OUTBOX_SECTORS);
+}
+
+/**
+ * @brief Move the head of the log to the next sector of the ring.
+ *
+ * The sector is the oldest of the ring. Its unacknowledged records are counted
+ * as lost and acknowledged along with it, then it is erased unless it is blank
+ * and given a new header.
+ *
+ * @param pxOutbox Outbox to advance.
+ *
+ * @return true if the new sector is ready to be written.
+ */
+static bool prvOpenSector(OUTBOX_T *pxOutbox)
+{
+    uint32_t ulSector = (pxOutbox->head_sector + 1) % OUTBOX_SECTORS;
+    uint32_t ulEraseCount = 0;
+    uint32_t ulLostSeq = 0;
+    bool xBlank = true;
+    uint8_t ucSlot[OUTBOX_SLOT_LEN];
+    uint8_t ucHeader[OUTBOX_HEADER_PAYLOAD_LEN];
+
+    for (uint32_t ulSlot = 0; ulSlot < OUTBOX_SLOTS_PER_SECTOR; ulSlot++)
+    {
+        OUTBOX_SLOT_STATE_T eState = prvSlotRead(ulSector, ulSlot, ucSlot);
+        uint32_t ulSeq = prvGet32(&ucSlot[4]);
+
+        xBlank = xBlank && eState == OUTBOX_SLOT_FREE;
+        if (eState != OUTBOX_SLOT_VALID)
+        {
+            continue;
+        }
+
+        if (ulSlot == 0 && ucSlot[0] == OUTBOX_SLOT_HEADER && ucSlot[1] == OUTBOX_HEADER_PAYLOAD_LEN &&
+            prvGet32(&ucSlot[OUTBOX_SLOT_HEADER_LEN]) == OUTBOX_MAGIC)
+        {
+            ulEraseCount = prvGet32(&ucSlot[OUTBOX_SLOT_HEADER_LEN + 8]);
+        }
+        else if (ulSlot > 0 && ucSlot[0] == OUTBOX_SLOT_RECORD && ulSeq > pxOutbox->acked_seq)
+        {
+            // The ring is full, the oldest records make room for the newest
+            pxOutbox->stats.lost++;
+            if (ulSeq > ulLostSeq)
+            {
+                ulLostSeq = ulSeq;
+            }
+        }
+    }
+
+    if (ulLostSeq > pxOutbox->acked_seq)
+    {
+        pxOutbox->acked_seq = ulLostSeq;
+    }
+
+    if (!xBlank)
+    {
+        OUTBOX_FLASH_OP_T xOp = {.offset = prvOffset(ulSector, 0)};
+
+        if (flash_safe_execute(prvFlashErase, &xOp, OUTBOX_FLASH_TIMEOUT_MS) != PICO_OK)
+        {
+            pxOutbox->stats.flash_errors++;
+            return false;
+        }
+        pxOutbox->stats.erases++;
+        ulEraseCount++;
+    }
+
+    prvPut32(&ucHeader[0], OUTBOX_MAGIC);
+    prvPut32(&ucHeader[4], pxOutbox->acked_seq);
+    prvPut32(&ucHeader[8], ulEraseCount);
+    prvPut32(&ucHeader[12], pxOutbox->reserved_seq);
+    if (!prvSlotWrite(pxOutbox, ulSector, 0, OUTBOX_SLOT_HEADER, pxOutbox->ring_seq + 1, ucHeader, sizeof(ucHeader)))
+    {
+        return false;
+    }
+
+    pxOutbox->head_sector = ulSector;
+    pxOutbox->head_slot = 1;
+    pxOutbox->ring_seq++;
+
+    // A cursor on the erased sector continues with the oldest records left
+    if (pxOutbox->read_sector == ulSector)
+    {
+        pxOutbox->read_sector = (ulSector + 1) % OUTBOX_SECTORS;
+        pxOutbox->read_slot = 1;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write a slot at the head of the log.
+ *
+ * @param pxOutbox Outbox to append to.
+ * @param ucType Slot type.
+ * @param ulSeq Sequence number stored in the slot.
+ * @param pucPayload Payload bytes.
+ * @param xLen Payload length.
+ *
+ * @return true if the slot was written.
+ */
+static bool prvAppendSlot(OUTBOX_T *pxOutbox, uint8_t ucType, uint32_t ulSeq, const uint8_t *pucPayload, size_t xLen)
+{
+    if (pxOutbox->head_slot >= OUTBOX_SLOTS_PER_SECTOR && !prvOpenSector(pxOutbox))
+    {
+        return false;
+    }
+
+    // A slot that failed to program is left behind, its CRC marks it as torn
+    return prvSlotWrite(pxOutbox, pxOutbox->head_sector, pxOutbox->head_slot++, ucType, ulSeq, pucPayload, xLen);
+}
+
+void vOutboxInit(OUTBOX_T *pxOutbox)
+{
+    uint8_t ucSlot[OUTBOX_SLOT_LEN];
+    bool xFound = false;
+
+    // Until a sector is found, the next append opens sector 0
+    *pxOutbox = (OUTBOX_T){
+        .head_sector = OUTBOX_SECTORS - 1,
+        .head_slot = OUTBOX_SLOTS_PER_SECTOR,
+        .next_seq = 1,
+    };
+
+    for (uint32_t ulSector = 0; ulSector < OUTBOX_SECTORS; ulSector++)
+    {
+        if (prvSlotRead(ulSector, 0, ucSlot) != OUTBOX_SLOT_VALID || ucSlot[0] != OUTBOX_SLOT_HEADER ||
+            ucSlot[1] != OUTBOX_HEADER_PAYLOAD_LEN || prvGet32(&ucSlot[OUTBOX_SLOT_HEADER_LEN]) != OUTBOX_MAGIC)
+        {
+            continue;
+        }
+
+        uint32_t ulRingSeq = prvGet32(&ucSlot[4]);
+        uint32_t ulAcked = prvGet32(&ucSlot[OUTBOX_SLOT_HEADER_LEN + 4]);
+        uint32_t ulReserved = prvGet32(&ucSlot[OUTBOX_SLOT_HEADER_LEN + 12]);
+        uint32_t ulLastUsed = 0;
+
+        if (ulAcked > pxOutbox->acked_seq)
+        {
+            pxOutbox->acked_seq = ulAcked;
+        }
+        if (ulReserved > pxOutbox->reserved_seq)
+        {
+            pxOutbox->reserved_seq = ulReserved;
+        }
+
+        for (uint32_t ulSlot = 1; ulSlot < OUTBOX_SLOTS_PER_SECTOR; ulSlot++)
+        {
+            OUTBOX_SLOT_STATE_T eState = prvSlotRead(ulSector, ulSlot, ucSlot);
+            uint32_t ulSeq = prvGet32(&ucSlot[4]);
+
+            if (eState == OUTBOX_SLOT_FREE)
+            {
+                continue;
+            }
+            ulLastUsed = ulSlot;
+
+            if (eState == OUTBOX_SLOT_TORN)
+            {
+                pxOutbox->stats.torn++;
+            }
+            else if (ucSlot[0] == OUTBOX_SLOT_RECORD && ulSeq > pxOutbox->last_seq)
+            {
+                pxOutbox->last_seq = ulSeq;
+            }
+            else if (ucSlot[0] == OUTBOX_SLOT_ACK && ulSeq > pxOutbox->acked_seq)
+            {
+                pxOutbox->acked_seq = ulSeq;
+            }
+            else if (ucSlot[0] == OUTBOX_SLOT_RESERVE && ulSeq > pxOutbox->reserved_seq)
+            {
+                pxOutbox->reserved_seq = ulSeq;
+            }
+        }
+
+        // The newest sector is the head, writing resumes after its last used slot
+        if (!xFound || ulRingSeq > pxOutbox->ring_seq)
+        {
+            xFound = true;
+            pxOutbox->ring_seq = ulRingSeq;
+            pxOutbox->head_sector = ulSector;
+            pxOutbox->head_slot = ulLastUsed + 1;
+        }
+    }
+
+    // Numbers may have been used up to the last reservation, and records lost to a full ring are
+    // acknowledged without being in the log any more
+    pxOutbox->next_seq = pxOutbox->last_seq + 1;
+    if (pxOutbox->next_seq <= pxOutbox->acked_seq)
+    {
+        pxOutbox->next_seq = pxOutbox->acked_seq + 1;
+    }
+    if (pxOutbox->next_seq < pxOutbox->reserved_seq)
+    {
+        pxOutbox->next_seq = pxOutbox->reserved_seq;
+    }
+
+    // With nothing left to replay, the numbers skipped were delivered or never sent
+    if (pxOutbox->last_seq <= pxOutbox->acked_seq)
+    {
+        pxOutbox->acked_seq = pxOutbox->next_seq - 1;
+    }
+
+    vOutboxRewind(pxOutbox);
+}
+
+bool xOutboxAppend(OUTBOX_T *pxOutbox, const WIRE_RECORD_T *pxRecord)
+{
+    // Every record is encoded on its own, against a fresh session
+    WIRE_CODEC_T xCodec = {.session = true};
+    WIRE_RECORD_T xRecord = *pxRecord;
+    uint8_t ucFrame[WIRE_MAX_RECORD_LEN];
+    size_t xLen;
+
+    if (xRecord.seq == 0)
+    {
+        xRecord.seq = pxOutbox->next_seq;
+    }
+    else if (xRecord.seq <= pxOutbox->last_seq)
+    {
+        return true;
+    }
+
+    xLen = xWireEncodeRecord(&xCodec, ucFrame, sizeof(ucFrame), &xRecord);
+    if (!prvAppendSlot(pxOutbox, OUTBOX_SLOT_RECORD, xRecord.seq, ucFrame, xLen))
+    {
+        return false;
+    }
+
+    pxOutbox->last_seq = xRecord.seq;
+    if (pxOutbox->next_seq <= xRecord.seq)
+    {
+        pxOutbox->next_seq = xRecord.seq + 1;
+    }
+    pxOutbox->stats.appended++;
+
+    return true;
+}
+
+uint32_t ulOutboxNextSeq(OUTBOX_T *pxOutbox)
+{
+    if (pxOutbox->next_seq >= pxOutbox->reserved_seq)
+    {
+        uint32_t ulReserved = pxOutbox->next_seq + OUTBOX_SEQ_BLOCK;
+
+        // Never at the cost of pending records; the uplink only sends unstored records once the log is
+        // delivered, so this does not happen in practice
+        if (prvRoomWithoutLoss(pxOutbox) && prvAppendSlot(pxOutbox, OUTBOX_SLOT_RESERVE, ulReserved, NULL, 0))
+        {
+            pxOutbox->reserved_seq = ulReserved;
+        }
+    }
+
+    return pxOutbox->next_seq++;
+}
+
+size_t xOutboxRead(OUTBOX_T *pxOutbox, WIRE_RECORD_T *pxRecords, size_t xMax)
+{
+    uint8_t ucSlot[OUTBOX_SLOT_LEN];
+    size_t xCount = 0;
+
+    while (xCount < xMax)
+    {
+        if (pxOutbox->read_sector == pxOutbox->head_sector && pxOutbox->read_slot >= pxOutbox->head_slot)
+        {
+            break;
+        }
+        if (pxOutbox->read_slot >= OUTBOX_SLOTS_PER_SECTOR)
+        {
+            pxOutbox->read_sector = (pxOutbox->read_sector + 1) % OUTBOX_SECTORS;
+            pxOutbox->read_slot = 1;
+            continue;
+        }
+
+        if (prvSlotRead(pxOutbox->read_sector, pxOutbox->read_slot++, ucSlot) != OUTBOX_SLOT_VALID ||
+            ucSlot[0] != OUTBOX_SLOT_RECORD || prvGet32(&ucSlot[4]) <= pxOutbox->acked_seq)
+        {
+            continue;
+        }
+
+        WIRE_CODEC_T xCodec = {.session = true};
+        WIRE_FRAME_T xFrame;
+        size_t xConsumed;
+
+        if (eWireDecodeFrame(&xCodec, &ucSlot[OUTBOX_SLOT_HEADER_LEN], ucSlot[1], &xConsumed, &xFrame) != WIRE_OK ||
+            xFrame.type != WIRE_FRAME_RECORD)
+        {
+            pxOutbox->stats.torn++;
+            continue;
+        }
+
+        pxRecords[xCount] = xFrame.record;
+        pxRecords[xCount++].seq = prvGet32(&ucSlot[4]);
+    }
+
+    pxOutbox->stats.replayed += (uint32_t)xCount;
+
+    return xCount;
+}
+
+void vOutboxRewind(OUTBOX_T *pxOutbox)
+{
+    // The sector after the head is the oldest of the ring; acknowledged records are skipped when read
+    pxOutbox->read_sector = (pxOutbox->head_sector + 1) % OUTBOX_SECTORS;
+    pxOutbox->read_slot = 1;
+}
+
+bool xOutboxAck(OUTBOX_T *pxOutbox, uint32_t ulSeq)
+{
+    bool xStored = pxOutbox->last_seq > pxOutbox->acked_seq;
+
+    if (ulSeq <= pxOutbox->acked_seq)
+    {
+        return true;
+    }
+
+    pxOutbox->acked_seq = ulSeq;
+
+    // A controller ahead of the device, e.g. after the log was erased, moves its numbering past its own
+    if (pxOutbox->next_seq <= ulSeq)
+    {
+        pxOutbox->next_seq = ulSeq + 1;
+    }
+
+    // Records that were never stored need no acknowledgement in the log, their numbers are reserved
+    if (!xStored)
+    {
+        return true;
+    }
+
+    // Making room for the acknowledgement must not cost records that are still pending. It is
+    // kept in RAM until the next slot is written, at worst a reset replays those records twice.
+    if (!prvRoomWithoutLoss(pxOutbox))
+    {
+        return true;
+    }
+
+    return prvAppendSlot(pxOutbox, OUTBOX_SLOT_ACK, ulSeq, NULL, 0);
+}
+
+uint32_t ulOutboxPending(const OUTBOX_T *pxOutbox)
+{
+    return pxOutbox->last_seq > pxOutbox->acked_seq ? pxOutbox->last_seq - pxOutbox->acked_seq : 0;
+}
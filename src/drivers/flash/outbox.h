@@ -0,0 +1,184 @@
+/**
+ * @file outbox.h
+ *
+ * @brief Header file for the store-and-forward outbox in flash.
+ *
+ * While the uplink cannot take records, vTaskTCP appends them to a log in the
+ * last OUTBOX_SECTORS sectors of the QSPI flash instead of letting the TCP
+ * stream buffer overflow, and replays them in order once a connection is up.
+ *
+ * The log is a ring of sectors that is written front to back, so every sector
+ * is erased once per pass and wear is spread evenly over the region. A sector
+ * starts with a header slot holding its position in the ring and the sequence
+ * number acknowledged when it was opened, followed by fixed size slots. A slot
+ * holds either a record, as a stand-alone wire format record frame with its
+ * sequence number, or the acknowledgement of every record up to a sequence
+ * number. Slots are programmed one at a time and carry a CRC, so one torn by a
+ * reset is skipped when the log is scanned at boot. Once the ring is full the
+ * oldest sector is erased for the newest records, and its unacknowledged
+ * records are counted as lost.
+ *
+ * The outbox also owns the uplink sequence numbers, which must never be reused
+ * across a reset even for records that were sent without being stored. Those
+ * are handed out from blocks of OUTBOX_SEQ_BLOCK that are reserved in the log
+ * before the first of them is used, and the scan at boot continues after the
+ * last reservation.
+ *
+ * Erasing and programming stall execution from flash, so interrupts and the
+ * other core are paused for up to a sector erase (about 50 ms) by
+ * flash_safe_execute(). With 63 records per sector this happens rarely.
+ */
+
+#ifndef OUTBOX_H_
+#define OUTBOX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pico includes
+#include "hardware/flash.h"
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Sectors at the end of the flash that hold the outbox, clear of the firmware image
+#ifndef OUTBOX_SECTORS
+#define OUTBOX_SECTORS 64
+#endif
+
+// Offset of the outbox from the start of the flash
+#define OUTBOX_OFFSET (PICO_FLASH_SIZE_BYTES - OUTBOX_SECTORS * FLASH_SECTOR_SIZE)
+
+// Size of a slot, a divisor of FLASH_PAGE_SIZE
+#define OUTBOX_SLOT_LEN 64
+#define OUTBOX_SLOTS_PER_SECTOR (FLASH_SECTOR_SIZE / OUTBOX_SLOT_LEN)
+
+// Records a full outbox holds; the first slot of every sector is its header
+#define OUTBOX_CAPACITY (OUTBOX_SECTORS * (OUTBOX_SLOTS_PER_SECTOR - 1))
+
+// Sequence numbers reserved at a time for records sent without being stored
+#define OUTBOX_SEQ_BLOCK 256
+
+// Longest the other core may take to pause for a flash operation
+#define OUTBOX_FLASH_TIMEOUT_MS 100
+
+// Type definitions
+typedef struct OUTBOX_STATS_T_
+{
+    uint32_t appended;
+    uint32_t replayed;
+    uint32_t lost;
+    uint32_t erases;
+    uint32_t torn;
+    uint32_t flash_errors;
+} OUTBOX_STATS_T;
+
+typedef struct OUTBOX_T_
+{
+    uint32_t head_sector;
+    uint32_t head_slot;
+    uint32_t ring_seq;
+    uint32_t next_seq;
+    uint32_t last_seq;
+    uint32_t acked_seq;
+    uint32_t reserved_seq;
+    uint32_t read_sector;
+    uint32_t read_slot;
+    OUTBOX_STATS_T stats;
+} OUTBOX_T;
+
+/**
+ * @brief Recover the outbox from the flash.
+ *
+ * Scans every sector for the newest one, the next free slot and the highest
+ * record, acknowledged and reserved sequence numbers. Nothing is erased; a
+ * blank or foreign sector is only erased when the log reaches it. The replay
+ * cursor is placed on the oldest unacknowledged record. Without one, the
+ * numbers skipped up to the last reservation count as acknowledged.
+ *
+ * @param pxOutbox Outbox to initialise.
+ *
+ * @return None.
+ */
+void vOutboxInit(OUTBOX_T *pxOutbox);
+
+/**
+ * @brief Append a record to the log.
+ *
+ * A record without a sequence number is given the next one. A record that has
+ * one, because it was sent but not acknowledged, keeps it; it is already stored
+ * if that number is not above the last record in the log. Opens the next sector
+ * of the ring when the current one is full, which erases it first.
+ *
+ * @param pxOutbox Outbox to append to.
+ * @param pxRecord Record to store.
+ *
+ * @return true if the record was stored, false if the flash could not be written.
+ */
+bool xOutboxAppend(OUTBOX_T *pxOutbox, const WIRE_RECORD_T *pxRecord);
+
+/**
+ * @brief Hand out the sequence number of a record that is sent without being stored.
+ *
+ * Reserves the next OUTBOX_SEQ_BLOCK numbers in the log when the current block
+ * is used up.
+ *
+ * @param pxOutbox Outbox that owns the sequence numbers.
+ *
+ * @return The sequence number.
+ */
+uint32_t ulOutboxNextSeq(OUTBOX_T *pxOutbox);
+
+/**
+ * @brief Read the next records to replay, oldest first.
+ *
+ * Advances the replay cursor; the records stay in the log until they are
+ * acknowledged with xOutboxAck().
+ *
+ * @param pxOutbox Outbox to read from.
+ * @param pxRecords Destination for the records, with their sequence numbers.
+ * @param xMax Most records to read.
+ *
+ * @return Number of records read, 0 once the cursor has caught up with the log.
+ */
+size_t xOutboxRead(OUTBOX_T *pxOutbox, WIRE_RECORD_T *pxRecords, size_t xMax);
+
+/**
+ * @brief Move the replay cursor back to the oldest unacknowledged record.
+ *
+ * Called when a connection is lost with replayed records unacknowledged, so
+ * they are sent again on the next one.
+ *
+ * @param pxOutbox Outbox to rewind.
+ *
+ * @return None.
+ */
+void vOutboxRewind(OUTBOX_T *pxOutbox);
+
+/**
+ * @brief Mark every record up to a sequence number as delivered.
+ *
+ * Appends an acknowledgement slot if it covers stored records, so they are
+ * not replayed again after a reset.
+ *
+ * @param pxOutbox Outbox to acknowledge records of.
+ * @param ulSeq Sequence number of the last delivered record.
+ *
+ * @return true if the acknowledgement was stored or nothing new was acknowledged.
+ */
+bool xOutboxAck(OUTBOX_T *pxOutbox, uint32_t ulSeq);
+
+/**
+ * @brief Return the number of records stored but not yet acknowledged.
+ *
+ * Counted from the sequence numbers, so numbers skipped by a reset during an
+ * outage are counted as well.
+ *
+ * @param pxOutbox Outbox to check.
+ *
+ * @return Number of pending records, 0 once the last stored record is acknowledged.
+ */
+uint32_t ulOutboxPending(const OUTBOX_T *pxOutbox);
+
+#endif /* OUTBOX_H_ */
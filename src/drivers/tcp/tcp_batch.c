@@ -0,0 +1,461 @@
+/**
+ * @file tcp_batch.c
+ *
+ * @brief Source file for the uplink batching stage.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stream_buffer.h>
+
+// Pico includes
+#include "pico/cyw43_arch.h"
+#include "lwip/tcp.h"
+
+// Driver includes
+#include "tcp_batch.h"
+#include "tcp_downlink.h"
+
+// Project includes
+#include "log/log.h"
+#include "trace/trace.h"
+
+#if TCP_BATCH_MAX_BYTES > TCP_MSS
+#error "TCP_BATCH_MAX_BYTES must fit into one segment of TCP_MSS"
+#endif
+
+#if WIRE_MAX_HELLO_LEN + WIRE_MAX_TELEMETRY_LEN > TCP_BATCH_MAX_BYTES
+#error "A telemetry frame must fit into the segment buffer of the batch"
+#endif
+
+/**
+ * @brief Empty the batch and the window, clear the counters and restore the default limits.
+ *
+ * @param pxBatch Batch to reset.
+ *
+ * @return None.
+ */
+void vTCPBatchReset(TCP_BATCH_T *pxBatch)
+{
+    pxBatch->count = 0;
+    pxBatch->first_tick = 0;
+    pxBatch->max_records = TCP_BATCH_MAX_RECORDS;
+    pxBatch->flush_ms = TCP_BATCH_FLUSH_MS;
+    pxBatch->codec = (WIRE_CODEC_T){0};
+    pxBatch->window_head = 0;
+    pxBatch->window_count = 0;
+    pxBatch->window_tick = 0;
+    pxBatch->stats = (TCP_BATCH_STATS_T){0};
+}
+
+/**
+ * @brief Start a new wire format session with the next segment.
+ *
+ * Called for every new connection; records still in the batch are kept.
+ *
+ * @param pxBatch Batch to start the session on.
+ *
+ * @return None.
+ */
+void vTCPBatchNewSession(TCP_BATCH_T *pxBatch)
+{
+    pxBatch->codec.session = false;
+}
+
+/**
+ * @brief Set the number of records that fill the batch.
+ *
+ * A batch that already holds as many records is due at once.
+ *
+ * @param pxBatch Batch to configure.
+ * @param ulRecords Records per segment, clamped to 1..TCP_BATCH_MAX_RECORDS.
+ *
+ * @return The number of records applied.
+ */
+uint32_t ulTCPBatchSetMaxRecords(TCP_BATCH_T *pxBatch, uint32_t ulRecords)
+{
+    if (ulRecords < 1)
+    {
+        ulRecords = 1;
+    }
+    else if (ulRecords > TCP_BATCH_MAX_RECORDS)
+    {
+        ulRecords = TCP_BATCH_MAX_RECORDS;
+    }
+
+    pxBatch->max_records = ulRecords;
+
+    return ulRecords;
+}
+
+/**
+ * @brief Set the longest time a record waits in the batch before it is sent.
+ *
+ * @param pxBatch Batch to configure.
+ * @param ulFlushMs Flush interval, clamped to TCP_DOWNLINK_MIN_FLUSH_MS..TCP_DOWNLINK_MAX_FLUSH_MS.
+ *
+ * @return The interval applied in milliseconds.
+ */
+uint32_t ulTCPBatchSetFlushMs(TCP_BATCH_T *pxBatch, uint32_t ulFlushMs)
+{
+    if (ulFlushMs < TCP_DOWNLINK_MIN_FLUSH_MS)
+    {
+        ulFlushMs = TCP_DOWNLINK_MIN_FLUSH_MS;
+    }
+    else if (ulFlushMs > TCP_DOWNLINK_MAX_FLUSH_MS)
+    {
+        ulFlushMs = TCP_DOWNLINK_MAX_FLUSH_MS;
+    }
+
+    pxBatch->flush_ms = ulFlushMs;
+
+    return ulFlushMs;
+}
+
+/**
+ * @brief Move queued records from the stream buffer into the batch.
+ *
+ * Each record is given the next sequence number of the outbox.
+ *
+ * @param pxBatch Batch to fill.
+ * @param xStreamBuffer Stream buffer holding WIRE_RECORD_T structures.
+ * @param pxOutbox Outbox that hands out the sequence numbers.
+ * @param xNow Current tick count, starts the flush deadline of the first record.
+ *
+ * @return Number of records taken from the stream buffer.
+ */
+size_t xTCPBatchFill(TCP_BATCH_T *pxBatch, StreamBufferHandle_t xStreamBuffer, OUTBOX_T *pxOutbox, TickType_t xNow)
+{
+    size_t xReceived;
+
+    // A lowered limit leaves the records already in the batch where they are
+    if (pxBatch->count >= pxBatch->max_records)
+    {
+        return 0;
+    }
+
+    // Records are only ever queued whole, so whole records come back out
+    xReceived = xStreamBufferReceive(xStreamBuffer, &pxBatch->records[pxBatch->count],
+                                     (pxBatch->max_records - pxBatch->count) * sizeof(WIRE_RECORD_T), 0) /
+                sizeof(WIRE_RECORD_T);
+
+    // The flush deadline runs from the oldest record
+    if (pxBatch->count == 0 && xReceived > 0)
+    {
+        pxBatch->first_tick = xNow;
+    }
+
+    for (size_t i = 0; i < xReceived; i++)
+    {
+        pxBatch->records[pxBatch->count++].seq = ulOutboxNextSeq(pxOutbox);
+    }
+
+    return xReceived;
+}
+
+/**
+ * @brief Fill the batch with the next records to replay from the outbox.
+ *
+ * Nothing is read while the batch holds live records. Replayed records are
+ * due at once, they have already waited.
+ *
+ * @param pxBatch Batch to fill.
+ * @param pxOutbox Outbox to replay.
+ * @param xNow Current tick count.
+ *
+ * @return Number of records read from the outbox.
+ */
+size_t xTCPBatchFillFromOutbox(TCP_BATCH_T *pxBatch, OUTBOX_T *pxOutbox, TickType_t xNow)
+{
+    size_t xRead;
+
+    if ((pxBatch->count > 0 && pxBatch->records[0].seq > pxOutbox->last_seq) || pxBatch->count >= pxBatch->max_records)
+    {
+        return 0;
+    }
+
+    xRead = xOutboxRead(pxOutbox, &pxBatch->records[pxBatch->count], pxBatch->max_records - pxBatch->count);
+
+    if (pxBatch->count == 0 && xRead > 0)
+    {
+        pxBatch->first_tick = xNow - pdMS_TO_TICKS(pxBatch->flush_ms);
+    }
+    pxBatch->count += (uint32_t)xRead;
+
+    return xRead;
+}
+
+/**
+ * @brief Keep the unacknowledged records once the connection is lost.
+ *
+ * Live records of the window and the batch are appended to the outbox with
+ * their sequence numbers. Replayed ones are still in it, so they are dropped
+ * and the outbox is rewound to send them again.
+ *
+ * @param pxBatch Batch to spill.
+ * @param pxOutbox Outbox to spill into.
+ *
+ * @return None.
+ */
+void vTCPBatchSpill(TCP_BATCH_T *pxBatch, OUTBOX_T *pxOutbox)
+{
+    // The window is older than the batch, so the outbox stays in sequence order
+    for (uint32_t i = 0; i < pxBatch->window_count + pxBatch->count; i++)
+    {
+        const WIRE_RECORD_T *pxRecord = i < pxBatch->window_count
+                                            ? &pxBatch->window[(pxBatch->window_head + i) % TCP_WINDOW_RECORDS]
+                                            : &pxBatch->records[i - pxBatch->window_count];
+
+        // Replayed records are skipped by the outbox, they are stored already
+        if (!xOutboxAppend(pxOutbox, pxRecord))
+        {
+            LOG_WARN("<vTCPBatchSpill> Outbox write failed, record dropped\n");
+        }
+    }
+
+    pxBatch->count = 0;
+    pxBatch->window_head = 0;
+    pxBatch->window_count = 0;
+
+    vOutboxRewind(pxOutbox);
+}
+
+/**
+ * @brief Drop the records the controller has acknowledged from the window.
+ *
+ * @param pxBatch Batch that wrote the records.
+ * @param ulSeq Highest sequence number the controller acknowledged.
+ * @param xNow Current tick count, restarts the acknowledgement timeout.
+ *
+ * @return Number of records acknowledged.
+ */
+uint32_t ulTCPBatchAcked(TCP_BATCH_T *pxBatch, uint32_t ulSeq, TickType_t xNow)
+{
+    uint32_t ulAcked = 0;
+
+    while (pxBatch->window_count > 0 && pxBatch->window[pxBatch->window_head].seq <= ulSeq)
+    {
+        pxBatch->window_head = (pxBatch->window_head + 1) % TCP_WINDOW_RECORDS;
+        pxBatch->window_count--;
+        ulAcked++;
+    }
+
+    // The controller is making progress, the remaining records get a full timeout
+    if (ulAcked > 0)
+    {
+        pxBatch->window_tick = xNow;
+        pxBatch->stats.acked += ulAcked;
+        TRACE_MARK(TRACE_MARK_ACKED, ulSeq);
+    }
+
+    return ulAcked;
+}
+
+/**
+ * @brief Time until the oldest record of the window has waited TCP_ACK_TIMEOUT_MS.
+ *
+ * @param pxBatch Batch to check.
+ * @param xNow Current tick count.
+ *
+ * @return 0 if the acknowledgement is overdue, the ticks left otherwise, or portMAX_DELAY
+ *         if nothing is waiting for one.
+ */
+TickType_t xTCPBatchAckTicksLeft(const TCP_BATCH_T *pxBatch, TickType_t xNow)
+{
+    TickType_t xWaited = xNow - pxBatch->window_tick;
+
+    if (pxBatch->window_count == 0)
+    {
+        return portMAX_DELAY;
+    }
+
+    return xWaited >= pdMS_TO_TICKS(TCP_ACK_TIMEOUT_MS) ? 0 : pdMS_TO_TICKS(TCP_ACK_TIMEOUT_MS) - xWaited;
+}
+
+/**
+ * @brief Time until the batch should be sent.
+ *
+ * @param pxBatch Batch to check.
+ * @param xNow Current tick count.
+ *
+ * @return 0 if the batch holds a record and is full or past its flush deadline, the ticks
+ *         left until the deadline otherwise, or portMAX_DELAY if the batch is empty.
+ */
+TickType_t xTCPBatchTicksToDue(const TCP_BATCH_T *pxBatch, TickType_t xNow)
+{
+    TickType_t xWaited = xNow - pxBatch->first_tick;
+
+    if (pxBatch->count == 0)
+    {
+        return portMAX_DELAY;
+    }
+
+    if (pxBatch->count >= pxBatch->max_records || xWaited >= pdMS_TO_TICKS(pxBatch->flush_ms))
+    {
+        return 0;
+    }
+
+    return pdMS_TO_TICKS(pxBatch->flush_ms) - xWaited;
+}
+
+/**
+ * @brief Encode the records of the batch and write them to the connection as one segment.
+ *
+ * Nothing is written while the window cannot take the records or the pcb's
+ * send buffer cannot take the segment. The records written move to the
+ * window, and the bytes written are added to tcp_client->sent_len, which the
+ * sent callback brings back down as TCP acknowledges them.
+ *
+ * @param pxBatch Batch to send.
+ * @param tcp_client Connected TCP client.
+ *
+ * @return pdPASS if a segment was written, pdFAIL otherwise.
+ */
+BaseType_t xTCPBatchFlush(TCP_BATCH_T *pxBatch, TCP_CLIENT_T *tcp_client)
+{
+    WIRE_CODEC_T xCodec = pxBatch->codec;
+    size_t xLen = 0;
+
+    if (pxBatch->count == 0 || tcp_client->tcp_pcb == NULL || !tcp_client->connected)
+    {
+        return pdFAIL;
+    }
+
+    // Keep a bounded number of records in flight; they are not waited for one segment at a time
+    if (pxBatch->window_count + pxBatch->count > TCP_WINDOW_RECORDS)
+    {
+        return pdFAIL;
+    }
+
+    // Encode on a copy of the codec, it only advances once the segment is written
+    if (!xCodec.session)
+    {
+        xLen = xWireEncodeHello(&xCodec, pxBatch->segment, sizeof(pxBatch->segment), DEVICE_ID);
+    }
+    for (uint32_t i = 0; i < pxBatch->count; i++)
+    {
+        xLen += xWireEncodeRecord(&xCodec, &pxBatch->segment[xLen], sizeof(pxBatch->segment) - xLen, &pxBatch->records[i]);
+    }
+
+    // The error callback may drop the pcb from the lwIP task, so check it again under the lock
+    cyw43_arch_lwip_begin();
+    if (tcp_client->tcp_pcb == NULL || !tcp_client->connected || tcp_sndbuf(tcp_client->tcp_pcb) < xLen)
+    {
+        cyw43_arch_lwip_end();
+        return pdFAIL;
+    }
+
+    err_t err = tcp_write(tcp_client->tcp_pcb, pxBatch->segment, (u16_t)xLen, TCP_WRITE_FLAG_COPY);
+    if (err == ERR_OK)
+    {
+        err = tcp_output(tcp_client->tcp_pcb);
+    }
+    if (err == ERR_OK)
+    {
+        // Counted under the lock, the sent callback may run in the lwIP task as soon as it is released
+        tcp_client->sent_len += (int)xLen;
+    }
+    cyw43_arch_lwip_end();
+
+    if (err != ERR_OK)
+    {
+        LOG_WARN("<xTCPBatchFlush> Write failed %d\n", err);
+        pxBatch->stats.write_errors++;
+        return pdFAIL;
+    }
+
+    pxBatch->codec = xCodec;
+
+    // The records wait in the window until the controller acknowledges them
+    if (pxBatch->window_count == 0)
+    {
+        pxBatch->window_tick = xTaskGetTickCount();
+    }
+    for (uint32_t i = 0; i < pxBatch->count; i++)
+    {
+        pxBatch->window[(pxBatch->window_head + pxBatch->window_count++) % TCP_WINDOW_RECORDS] = pxBatch->records[i];
+    }
+
+    TRACE_MARK(TRACE_MARK_SEGMENT, pxBatch->records[pxBatch->count - 1].time_ms);
+
+    pxBatch->stats.records += pxBatch->count;
+    pxBatch->stats.segments++;
+    pxBatch->stats.payload_bytes += (uint32_t)xLen;
+    pxBatch->stats.bytes_on_air += (uint32_t)xLen + TCP_BATCH_HEADER_BYTES;
+
+    pxBatch->count = 0;
+
+    return pdPASS;
+}
+
+/**
+ * @brief Write a telemetry frame to the connection as a segment of its own.
+ *
+ * Opens the session with a hello frame if no segment has yet. Nothing is
+ * written while the pcb's send buffer cannot take the segment; a telemetry
+ * frame that is not sent is not kept.
+ *
+ * @param pxBatch Batch whose session and segment buffer are used.
+ * @param tcp_client Connected TCP client.
+ * @param pxTelemetry Telemetry to send.
+ *
+ * @return pdPASS if the frame was written, pdFAIL otherwise.
+ */
+BaseType_t xTCPBatchSendTelemetry(TCP_BATCH_T *pxBatch, TCP_CLIENT_T *tcp_client, const WIRE_TELEMETRY_T *pxTelemetry)
+{
+    WIRE_CODEC_T xCodec = pxBatch->codec;
+    size_t xLen = 0;
+    size_t xFrameLen;
+
+    if (tcp_client->tcp_pcb == NULL || !tcp_client->connected)
+    {
+        return pdFAIL;
+    }
+
+    // Encode on a copy of the codec, as for records
+    if (!xCodec.session)
+    {
+        xLen = xWireEncodeHello(&xCodec, pxBatch->segment, sizeof(pxBatch->segment), DEVICE_ID);
+    }
+    xFrameLen = xWireEncodeTelemetry(&xCodec, &pxBatch->segment[xLen], sizeof(pxBatch->segment) - xLen, pxTelemetry);
+    if (xFrameLen == 0)
+    {
+        return pdFAIL;
+    }
+    xLen += xFrameLen;
+
+    // As in xTCPBatchFlush, the connection may have gone since the first check
+    cyw43_arch_lwip_begin();
+    if (tcp_client->tcp_pcb == NULL || !tcp_client->connected || tcp_sndbuf(tcp_client->tcp_pcb) < xLen)
+    {
+        cyw43_arch_lwip_end();
+        return pdFAIL;
+    }
+
+    err_t err = tcp_write(tcp_client->tcp_pcb, pxBatch->segment, (u16_t)xLen, TCP_WRITE_FLAG_COPY);
+    if (err == ERR_OK)
+    {
+        err = tcp_output(tcp_client->tcp_pcb);
+    }
+    if (err == ERR_OK)
+    {
+        tcp_client->sent_len += (int)xLen;
+    }
+    cyw43_arch_lwip_end();
+
+    if (err != ERR_OK)
+    {
+        LOG_WARN("<xTCPBatchSendTelemetry> Write failed %d\n", err);
+        pxBatch->stats.write_errors++;
+        return pdFAIL;
+    }
+
+    pxBatch->codec = xCodec;
+
+    pxBatch->stats.telemetry++;
+    pxBatch->stats.payload_bytes += (uint32_t)xLen;
+    pxBatch->stats.bytes_on_air += (uint32_t)xLen + TCP_BATCH_HEADER_BYTES;
+
+    return pdPASS;
+}
@@ -0,0 +1,246 @@
+/**
+ * @file tcp_batch.h
+ *
+ * @brief Header file for the uplink batching stage.
+ *
+ * Records are queued on the TCP stream buffer as WIRE_RECORD_T structures.
+ * Instead of writing and waiting for every record on its own, the uplink task
+ * collects them into a batch that is encoded in the binary wire format and
+ * written to the pcb as one segment once it is full or its oldest record has
+ * waited the flush interval. Both limits start at TCP_BATCH_MAX_RECORDS and
+ * TCP_BATCH_FLUSH_MS and may be lowered or raised by the controller at run
+ * time. The first segment of every connection starts with the hello frame of a
+ * new session.
+ *
+ * Every record is given a sequence number from the outbox as it enters the
+ * batch. Once written it moves to a window of records the controller has not
+ * acknowledged yet, which holds up to TCP_BATCH_MAX_IN_FLIGHT batches, so
+ * several segments are outstanding at once rather than one at a time. The
+ * controller's cumulative acknowledgements drop records from the window.
+ *
+ * While there is no connection the window and the batch are spilled into the
+ * flash outbox, and once one is up the batch is filled from the outbox instead
+ * until its backlog has been delivered. A batch holds either live or replayed
+ * records; replayed ones are those at or below the last sequence number in the
+ * outbox.
+ *
+ * Telemetry frames share the session and the segment buffer but not the
+ * window; they are never acknowledged or replayed.
+ */
+
+#ifndef TCP_BATCH_H_
+#define TCP_BATCH_H_
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <stream_buffer.h>
+
+// Driver includes
+#include "tcp_driver.h"
+#include "drivers/flash/outbox.h"
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Most records sent in one segment
+#define TCP_BATCH_MAX_RECORDS 16
+
+// Largest segment the batch is written as; stays below TCP_MSS
+#define TCP_BATCH_MAX_BYTES (WIRE_MAX_HELLO_LEN + TCP_BATCH_MAX_RECORDS * WIRE_MAX_RECORD_LEN)
+
+// Longest time a record waits in the batch before it is sent
+#define TCP_BATCH_FLUSH_MS 2000
+
+// Number of full batches that may be unacknowledged at once
+#define TCP_BATCH_MAX_IN_FLIGHT 4
+
+// Records written but not yet acknowledged by the controller
+#define TCP_WINDOW_RECORDS (TCP_BATCH_MAX_IN_FLIGHT * TCP_BATCH_MAX_RECORDS)
+
+// Longest time the oldest record of the window waits for an acknowledgement before the connection is dropped
+#define TCP_ACK_TIMEOUT_MS 30000
+
+// IPv4 and TCP header bytes added to every segment, counted in bytes on air
+#define TCP_BATCH_HEADER_BYTES 40
+
+// Size of the stream buffer between the UART task and the uplink task
+#define TCP_TX_BUFFER_LEN (2 * TCP_BATCH_MAX_RECORDS * sizeof(WIRE_RECORD_T))
+
+// Type definitions
+typedef struct TCP_BATCH_STATS_T_
+{
+    uint32_t records;
+    uint32_t segments;
+    uint32_t payload_bytes;
+    uint32_t bytes_on_air;
+    uint32_t write_errors;
+    uint32_t acked;
+    uint32_t telemetry;
+} TCP_BATCH_STATS_T;
+
+typedef struct TCP_BATCH_T_
+{
+    WIRE_RECORD_T records[TCP_BATCH_MAX_RECORDS];
+    uint32_t count;
+    TickType_t first_tick;
+    // Records that fill the batch and how long the oldest may wait, set at run time
+    uint32_t max_records;
+    uint32_t flush_ms;
+    WIRE_CODEC_T codec;
+    uint8_t segment[TCP_BATCH_MAX_BYTES];
+    // Records written but not acknowledged, oldest first, and when the oldest started waiting
+    WIRE_RECORD_T window[TCP_WINDOW_RECORDS];
+    uint32_t window_head;
+    uint32_t window_count;
+    TickType_t window_tick;
+    TCP_BATCH_STATS_T stats;
+} TCP_BATCH_T;
+
+/**
+ * @brief Empty the batch and the window, clear the counters and restore the default limits.
+ *
+ * @param pxBatch Batch to reset.
+ *
+ * @return None.
+ */
+void vTCPBatchReset(TCP_BATCH_T *pxBatch);
+
+/**
+ * @brief Start a new wire format session with the next segment.
+ *
+ * Called for every new connection; records still in the batch are kept.
+ *
+ * @param pxBatch Batch to start the session on.
+ *
+ * @return None.
+ */
+void vTCPBatchNewSession(TCP_BATCH_T *pxBatch);
+
+/**
+ * @brief Set the number of records that fill the batch.
+ *
+ * A batch that already holds as many records is due at once.
+ *
+ * @param pxBatch Batch to configure.
+ * @param ulRecords Records per segment, clamped to 1..TCP_BATCH_MAX_RECORDS.
+ *
+ * @return The number of records applied.
+ */
+uint32_t ulTCPBatchSetMaxRecords(TCP_BATCH_T *pxBatch, uint32_t ulRecords);
+
+/**
+ * @brief Set the longest time a record waits in the batch before it is sent.
+ *
+ * @param pxBatch Batch to configure.
+ * @param ulFlushMs Flush interval, clamped to TCP_DOWNLINK_MIN_FLUSH_MS..TCP_DOWNLINK_MAX_FLUSH_MS.
+ *
+ * @return The interval applied in milliseconds.
+ */
+uint32_t ulTCPBatchSetFlushMs(TCP_BATCH_T *pxBatch, uint32_t ulFlushMs);
+
+/**
+ * @brief Move queued records from the stream buffer into the batch.
+ *
+ * Each record is given the next sequence number of the outbox.
+ *
+ * @param pxBatch Batch to fill.
+ * @param xStreamBuffer Stream buffer holding WIRE_RECORD_T structures.
+ * @param pxOutbox Outbox that hands out the sequence numbers.
+ * @param xNow Current tick count, starts the flush deadline of the first record.
+ *
+ * @return Number of records taken from the stream buffer.
+ */
+size_t xTCPBatchFill(TCP_BATCH_T *pxBatch, StreamBufferHandle_t xStreamBuffer, OUTBOX_T *pxOutbox, TickType_t xNow);
+
+/**
+ * @brief Fill the batch with the next records to replay from the outbox.
+ *
+ * Nothing is read while the batch holds live records. Replayed records are
+ * due at once, they have already waited.
+ *
+ * @param pxBatch Batch to fill.
+ * @param pxOutbox Outbox to replay.
+ * @param xNow Current tick count.
+ *
+ * @return Number of records read from the outbox.
+ */
+size_t xTCPBatchFillFromOutbox(TCP_BATCH_T *pxBatch, OUTBOX_T *pxOutbox, TickType_t xNow);
+
+/**
+ * @brief Keep the unacknowledged records once the connection is lost.
+ *
+ * Live records of the window and the batch are appended to the outbox with
+ * their sequence numbers. Replayed ones are still in it, so they are dropped
+ * and the outbox is rewound to send them again.
+ *
+ * @param pxBatch Batch to spill.
+ * @param pxOutbox Outbox to spill into.
+ *
+ * @return None.
+ */
+void vTCPBatchSpill(TCP_BATCH_T *pxBatch, OUTBOX_T *pxOutbox);
+
+/**
+ * @brief Drop the records the controller has acknowledged from the window.
+ *
+ * @param pxBatch Batch that wrote the records.
+ * @param ulSeq Highest sequence number the controller acknowledged.
+ * @param xNow Current tick count, restarts the acknowledgement timeout.
+ *
+ * @return Number of records acknowledged.
+ */
+uint32_t ulTCPBatchAcked(TCP_BATCH_T *pxBatch, uint32_t ulSeq, TickType_t xNow);
+
+/**
+ * @brief Time until the oldest record of the window has waited TCP_ACK_TIMEOUT_MS.
+ *
+ * @param pxBatch Batch to check.
+ * @param xNow Current tick count.
+ *
+ * @return 0 if the acknowledgement is overdue, the ticks left otherwise, or portMAX_DELAY
+ *         if nothing is waiting for one.
+ */
+TickType_t xTCPBatchAckTicksLeft(const TCP_BATCH_T *pxBatch, TickType_t xNow);
+
+/**
+ * @brief Time until the batch should be sent.
+ *
+ * @param pxBatch Batch to check.
+ * @param xNow Current tick count.
+ *
+ * @return 0 if the batch holds a record and is full or past its flush deadline, the ticks
+ *         left until the deadline otherwise, or portMAX_DELAY if the batch is empty.
+ */
+TickType_t xTCPBatchTicksToDue(const TCP_BATCH_T *pxBatch, TickType_t xNow);
+
+/**
+ * @brief Encode the records of the batch and write them to the connection as one segment.
+ *
+ * Nothing is written while the window cannot take the records or the pcb's
+ * send buffer cannot take the segment. The records written move to the
+ * window, and the bytes written are added to tcp_client->sent_len, which the
+ * sent callback brings back down as TCP acknowledges them.
+ *
+ * @param pxBatch Batch to send.
+ * @param tcp_client Connected TCP client.
+ *
+ * @return pdPASS if a segment was written, pdFAIL otherwise.
+ */
+BaseType_t xTCPBatchFlush(TCP_BATCH_T *pxBatch, TCP_CLIENT_T *tcp_client);
+
+/**
+ * @brief Write a telemetry frame to the connection as a segment of its own.
+ *
+ * Opens the session with a hello frame if no segment has yet. Nothing is
+ * written while the pcb's send buffer cannot take the segment; a telemetry
+ * frame that is not sent is not kept.
+ *
+ * @param pxBatch Batch whose session and segment buffer are used.
+ * @param tcp_client Connected TCP client.
+ * @param pxTelemetry Telemetry to send.
+ *
+ * @return pdPASS if the frame was written, pdFAIL otherwise.
+ */
+BaseType_t xTCPBatchSendTelemetry(TCP_BATCH_T *pxBatch, TCP_CLIENT_T *tcp_client, const WIRE_TELEMETRY_T *pxTelemetry);
+
+#endif /* TCP_BATCH_H_ */
@@ -0,0 +1,88 @@
+/**
+ * @file tcp_downlink.c
+ *
+ * @brief Source file for the dispatcher of commands sent by the controller.
+ *
+ * Each owner's ring is an SPSC_RING_T carrying whole WIRE_COMMAND_T records,
+ * written by the recv callback and read by the owner.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Pico includes
+#include "pico.h"
+
+// Driver includes
+#include "tcp_downlink.h"
+#include "tcp_driver.h"
+
+// Project includes
+#include "ring/spsc_ring.h"
+
+// Tasks
+extern TaskHandle_t xTaskTCP;
+
+// Bytes of each owner's ring, a power of two as long as TCP_DOWNLINK_COMMANDS is
+#define TCP_DOWNLINK_RING_BYTES (TCP_DOWNLINK_COMMANDS * sizeof(WIRE_COMMAND_T))
+
+static uint8_t ucRingStorage[TCP_DOWNLINK_OWNERS][TCP_DOWNLINK_RING_BYTES];
+
+// Set up statically, commands may arrive before an owner first looks
+static SPSC_RING_T xRings[TCP_DOWNLINK_OWNERS] = {
+    [TCP_DOWNLINK_UART] = {.storage = ucRingStorage[TCP_DOWNLINK_UART], .size = TCP_DOWNLINK_RING_BYTES},
+    [TCP_DOWNLINK_TCP] = {.storage = ucRingStorage[TCP_DOWNLINK_TCP], .size = TCP_DOWNLINK_RING_BYTES},
+    [TCP_DOWNLINK_HEARTBEAT] = {.storage = ucRingStorage[TCP_DOWNLINK_HEARTBEAT], .size = TCP_DOWNLINK_RING_BYTES},
+};
+
+// Written by the producer only
+static volatile TCP_DOWNLINK_STATS_T xTCPDownlinkStats;
+
+// Owner of every command's setting
+static const uint8_t ucOwners[WIRE_CMD_COUNT] = {
+    [WIRE_CMD_CLEAR] = TCP_DOWNLINK_UART,
+    [WIRE_CMD_FLUSH_MS] = TCP_DOWNLINK_TCP,
+    [WIRE_CMD_BATCH_RECORDS] = TCP_DOWNLINK_TCP,
+    [WIRE_CMD_HEARTBEAT_MS] = TCP_DOWNLINK_HEARTBEAT,
+    [WIRE_CMD_FLOW_START] = TCP_DOWNLINK_UART,
+    [WIRE_CMD_FLOW_STOP] = TCP_DOWNLINK_UART,
+    [WIRE_CMD_TELEMETRY_MS] = TCP_DOWNLINK_TCP,
+};
+
+bool xTCPDownlinkDispatch(const WIRE_COMMAND_T *pxCommand)
+{
+    if (pcWireCommandName(pxCommand->id) == NULL)
+    {
+        xTCPDownlinkStats.unknown++;
+        return false;
+    }
+
+    TCP_DOWNLINK_OWNER_T eOwner = (TCP_DOWNLINK_OWNER_T)ucOwners[pxCommand->id];
+
+    if (!xSPSCRingWriteRecord(&xRings[eOwner], pxCommand, sizeof(*pxCommand)))
+    {
+        xTCPDownlinkStats.dropped++;
+        return false;
+    }
+    xTCPDownlinkStats.dispatched++;
+
+    if (eOwner == TCP_DOWNLINK_TCP)
+    {
+        xTaskNotifyIndexed(xTaskTCP, TCP_NOTIFY_INDEX, TCP_EVENT_COMMAND, eSetBits);
+    }
+
+    return true;
+}
+
+bool xTCPDownlinkReceive(TCP_DOWNLINK_OWNER_T eOwner, WIRE_COMMAND_T *pxCommand)
+{
+    return xSPSCRingReadRecord(&xRings[eOwner], pxCommand, sizeof(*pxCommand));
+}
+
+void vGetTCPDownlinkStats(TCP_DOWNLINK_STATS_T *pxStats)
+{
+    pxStats->dispatched = xTCPDownlinkStats.dispatched;
+    pxStats->dropped = xTCPDownlinkStats.dropped;
+    pxStats->unknown = xTCPDownlinkStats.unknown;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file tcp_downlink.h
+ *
+ * @brief Header file for the dispatcher of commands sent by the controller.
+ *
+ * The TCP client decodes WIRE_FRAME_COMMAND frames in its recv callback and
+ * hands each command to the task that owns the setting it changes: vTaskUART
+ * clears the meter and keeps the flow thresholds, vTaskTCP the batch size, the
+ * reporting interval and the telemetry interval, and vTaskHeartbeat the LED
+ * period. Every owner has a
+ * single producer, single consumer ring of TCP_DOWNLINK_COMMANDS commands that
+ * it drains at its own pace, so the callback never blocks and the ring also
+ * reaches vTaskUART on core 1 in the DUAL_CORE build. A full ring drops the
+ * command.
+ *
+ * vTaskTCP is notified with TCP_EVENT_COMMAND. The other owners pick their
+ * commands up when they next wake, vTaskUART with the next meter line and
+ * vTaskHeartbeat with the next toggle of the LED.
+ */
+
+#ifndef TCP_DOWNLINK_H_
+#define TCP_DOWNLINK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Commands each owner's ring holds, a power of two
+#define TCP_DOWNLINK_COMMANDS 8
+
+// Limits a command's argument is clamped to
+#define TCP_DOWNLINK_MIN_FLUSH_MS 100
+#define TCP_DOWNLINK_MAX_FLUSH_MS 3600000
+#define TCP_DOWNLINK_MIN_HEARTBEAT_MS 50
+#define TCP_DOWNLINK_MAX_HEARTBEAT_MS 60000
+#define TCP_DOWNLINK_MIN_TELEMETRY_MS 1000
+#define TCP_DOWNLINK_MAX_TELEMETRY_MS 3600000
+
+// Type definitions
+typedef enum
+{
+    TCP_DOWNLINK_UART = 0,
+    TCP_DOWNLINK_TCP,
+    TCP_DOWNLINK_HEARTBEAT,
+    TCP_DOWNLINK_OWNERS,
+} TCP_DOWNLINK_OWNER_T;
+
+typedef struct TCP_DOWNLINK_STATS_T_
+{
+    uint32_t dispatched;
+    uint32_t dropped;
+    uint32_t unknown;
+} TCP_DOWNLINK_STATS_T;
+
+/**
+ * @brief Queue a command for the task that owns its setting.
+ *
+ * Called from the TCP client's recv callback, the only producer.
+ *
+ * @param pxCommand Command decoded from the controller.
+ *
+ * @return true if the command was queued, false if it is unknown or its owner's ring is full.
+ */
+bool xTCPDownlinkDispatch(const WIRE_COMMAND_T *pxCommand);
+
+/**
+ * @brief Take the oldest command queued for an owner.
+ *
+ * Only called by the owning task.
+ *
+ * @param eOwner Owner whose ring to read.
+ * @param pxCommand Destination for the command.
+ *
+ * @return true if a command was returned.
+ */
+bool xTCPDownlinkReceive(TCP_DOWNLINK_OWNER_T eOwner, WIRE_COMMAND_T *pxCommand);
+
+/**
+ * @brief Read the dispatch counters.
+ *
+ * @param pxStats Destination for the counters.
+ *
+ * @return None.
+ */
+void vGetTCPDownlinkStats(TCP_DOWNLINK_STATS_T *pxStats);
+
+#endif /* TCP_DOWNLINK_H_ */
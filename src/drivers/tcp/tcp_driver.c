@@ -5,7 +5,8 @@
 #include <queue.h>
 
 // Standard includes
-#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 
 // Pico includes
 #include "pico/stdlib.h"
@@ -18,6 +19,10 @@
 
 // Driver includes
 #include "tcp_driver.h"
+#include "tcp_downlink.h"
+
+// Project includes
+#include "log/log.h"
 
 /**
  * @brief Initializes the CYW43 Wi-Fi module in STA (station) mode and connects to a Wi-Fi network.
@@ -28,8 +33,8 @@
  * This function initializes the CYW43 Wi-Fi module in STA mode and attempts to connect to a Wi-Fi network
  * using the SSID and password defined by the WIFI_SSID and WIFI_PASSWORD compile time variables, respectively.
  * 
- * If the connection is successful, this function prints a message to stdout indicating that the connection
- * was successful and returns pdPASS. If the connection fails, this function prints an error message to stdout
+ * If the connection is successful, this function logs a message indicating that the connection
+ * was successful and returns pdPASS. If the connection fails, this function logs an error message
  * and returns pdFAIL.
  * 
  * Note that this function assumes that the Wi-Fi module has already been initialized with the correct country code
@@ -40,7 +45,7 @@ BaseType_t xInitSTA(__unused void *pvParameters)
 {
     if (cyw43_arch_init_with_country(CYW43_COUNTRY_USA))
     {
-        printf("<xInitSTA> CYW43 ARCH: failed to initialise\n");
+        LOG_ERROR("<xInitSTA> CYW43 ARCH: failed to initialise\n");
         return pdFAIL;
     }
 
@@ -48,16 +53,16 @@ BaseType_t xInitSTA(__unused void *pvParameters)
 
     cyw43_wifi_pm(&cyw43_state, 0xa11140);
 
-    printf("<xInitSTA> Connecting to WiFi...\n");
-    printf("<xInitSTA> SSID: %s\n", WIFI_SSID);
+    LOG_INFO("<xInitSTA> Connecting to WiFi...\n");
+    LOG_INFO("<xInitSTA> SSID: %s\n", WIFI_SSID);
     if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK, 30000))
     {
-        printf("<xInitSTA> Wireless connection failed.\n");
+        LOG_ERROR("<xInitSTA> Wireless connection failed.\n");
         return pdFAIL;
     }
     else
     {
-        printf("<xInitSTA> Wireless connected.\n");
+        LOG_INFO("<xInitSTA> Wireless connected.\n");
         return pdPASS;
     }
 }
@@ -81,21 +86,52 @@ TCP_CLIENT_T *xInitTCPClient(__unused void *pvParameters)
     if (!tcp_client)
     {
         // Memory allocation failed
-        printf("<xInitTCPClient> Failed to allocate tcp_client\n");
+        LOG_ERROR("<xInitTCPClient> Failed to allocate tcp_client\n");
         return NULL;
     }
 
     // Initialize the TCP client remote address
     ip4addr_aton(CONTROLLER_IP, &tcp_client->remote_addr);
+
+    // Uplink events go to the task that owns the client
+    tcp_client->task = xTaskGetCurrentTaskHandle();
+    tcp_client->backoff_ms = TCP_BACKOFF_MIN_MS;
     
     // return the TCP client struct
     return tcp_client;
 }
 
+/**
+ * @brief Signals uplink events to the task that owns the TCP client.
+ *
+ * With the poll arch the lwIP callbacks run from cyw43_arch_poll() in that task,
+ * so the events are picked up by its next ulTCPClientWaitEvents() call. Otherwise
+ * they run in the lwIP task and wake the owner straight away.
+ *
+ * @param tcp_client TCP client the events belong to.
+ * @param ulEvents TCP_EVENT_ bits to signal.
+ *
+ * @return None.
+ */
+static void prvTCPClientNotify(TCP_CLIENT_T *tcp_client, uint32_t ulEvents)
+{
+    xTaskNotifyIndexed(tcp_client->task, TCP_NOTIFY_INDEX, ulEvents, eSetBits);
+}
+
+/**
+ * @brief Closes the connection of the TCP client, if it has one.
+ *
+ * @param pvParameters Pointer to the TCP client.
+ *
+ * @return ERR_OK, or ERR_ABRT if the connection had to be aborted.
+ */
 err_t xTCPClientClose(void *pvParameters)
 {
     TCP_CLIENT_T *tcp_client = (TCP_CLIENT_T *)pvParameters;
     err_t err = ERR_OK;
+
+    // Also called from the recv callback, which already holds the lock; it is recursive
+    cyw43_arch_lwip_begin();
     if (tcp_client->tcp_pcb != NULL)
     {
         tcp_arg(tcp_client->tcp_pcb, NULL);
@@ -106,32 +142,79 @@ err_t xTCPClientClose(void *pvParameters)
         err = tcp_close(tcp_client->tcp_pcb);
         if (err != ERR_OK)
         {
-            printf("<xTCPClientClose> Close failed %d, calling abort\n", err);
+            LOG_WARN("<xTCPClientClose> Close failed %d, calling abort\n", err);
             tcp_abort(tcp_client->tcp_pcb);
             err = ERR_ABRT;
         }
         tcp_client->tcp_pcb = NULL;
     }
+    tcp_client->connected = false;
+    cyw43_arch_lwip_end();
     return err;
 }
 
+/**
+ * @brief Closes the connection and schedules the next attempt.
+ *
+ * The client enters TCP_STATE_BACKOFF for its current reconnect delay, which is then
+ * doubled up to TCP_BACKOFF_MAX_MS. The delay returns to TCP_BACKOFF_MIN_MS once a
+ * connection is established.
+ *
+ * @param tcp_client TCP client to back off.
+ *
+ * @return None.
+ */
+void vTCPClientBackoff(TCP_CLIENT_T *tcp_client)
+{
+    xTCPClientClose(tcp_client);
+
+    tcp_client->state = TCP_STATE_BACKOFF;
+    tcp_client->state_tick = xTaskGetTickCount();
+    tcp_client->retry_ms = tcp_client->backoff_ms;
+    tcp_client->backoff_ms = tcp_client->backoff_ms >= TCP_BACKOFF_MAX_MS / 2 ? TCP_BACKOFF_MAX_MS : tcp_client->backoff_ms * 2;
+
+    LOG_INFO("<vTCPClientBackoff> Reconnecting in %lu ms\n", (unsigned long)tcp_client->retry_ms);
+}
+
+/**
+ * @brief Waits for uplink events signalled to the calling task.
+ *
+ * @param xTicksToWait Maximum time to wait for an event.
+ *
+ * @return The TCP_EVENT_ bits signalled since the last call, 0 on timeout.
+ */
+uint32_t ulTCPClientWaitEvents(TickType_t xTicksToWait)
+{
+    uint32_t ulEvents = 0;
+
+    xTaskNotifyWaitIndexed(TCP_NOTIFY_INDEX, 0, UINT32_MAX, &ulEvents, xTicksToWait);
+
+    return ulEvents;
+}
+
 err_t xTCPClientConnectedCallback(void *arg, struct tcp_pcb *tpcb, err_t err)
 {
     TCP_CLIENT_T *tcp_client = (TCP_CLIENT_T *)arg;
     if (err != ERR_OK)
     {
-        printf("<xTCPClientConnectedCallback> Connection failed %d\n", err);
+        LOG_WARN("<xTCPClientConnectedCallback> Connection failed %d\n", err);
         return ERR_TIMEOUT;
     }
-    printf("<xTCPClientConnectedCallback> Connected to IP: %s\n", ip4addr_ntoa(&tcp_client->remote_addr));
+    LOG_INFO("<xTCPClientConnectedCallback> Connected to IP: %s\n", ip4addr_ntoa(&tcp_client->remote_addr));
     tcp_client->connected = true;
+    prvTCPClientNotify(tcp_client, TCP_EVENT_CONNECTED);
     return ERR_OK;
 }
 
 void vTCPClientErrCallback(void *arg, err_t err)
 {
-    printf("<xTCPClientErrCallback> %d\n", err);
-    xTCPClientClose(arg);
+    TCP_CLIENT_T *tcp_client = (TCP_CLIENT_T *)arg;
+    LOG_WARN("<xTCPClientErrCallback> %d\n", err);
+
+    // lwIP has already freed the pcb, it must not be closed again
+    tcp_client->tcp_pcb = NULL;
+    tcp_client->connected = false;
+    prvTCPClientNotify(tcp_client, TCP_EVENT_CLOSED);
 }
 
 err_t xTCPClientPollCallback(void *arg, struct tcp_pcb *tpcb)
@@ -142,50 +225,210 @@ err_t xTCPClientPollCallback(void *arg, struct tcp_pcb *tpcb)
 err_t xTCPClientSentCallback(void *arg, struct tcp_pcb *tpcb, u16_t len)
 {
     TCP_CLIENT_T *tcp_client = (TCP_CLIENT_T *)arg;
-    printf("<xTCPClientSentCallback> %u\n", len);
+    LOG_DEBUG("<xTCPClientSentCallback> %u\n", len);
     tcp_client->sent_len -= len;
+    prvTCPClientNotify(tcp_client, TCP_EVENT_SENT);
     return ERR_OK;
 }
 
+/**
+ * @brief Act on a frame received from the controller.
+ *
+ * An acknowledgement raises the highest acknowledged sequence number and
+ * signals TCP_EVENT_ACKED, a command goes to the task that owns its setting.
+ * Frames that fail their CRC or are not meant for the device are counted.
+ *
+ * @param tcp_client TCP client that received the frame.
+ * @param eResult Result of decoding the frame.
+ * @param pxFrame Decoded frame.
+ *
+ * @return None.
+ */
+static void prvTCPClientHandle(TCP_CLIENT_T *tcp_client, WIRE_RESULT_T eResult, const WIRE_FRAME_T *pxFrame)
+{
+    if (eResult == WIRE_OK && pxFrame->type == WIRE_FRAME_ACK)
+    {
+        if (pxFrame->ack_seq > tcp_client->ack_seq)
+        {
+            tcp_client->ack_seq = pxFrame->ack_seq;
+            prvTCPClientNotify(tcp_client, TCP_EVENT_ACKED);
+        }
+    }
+    else if (eResult == WIRE_OK && pxFrame->type == WIRE_FRAME_COMMAND)
+    {
+        const char *pcName = pcWireCommandName(pxFrame->command.id);
+
+        LOG_INFO("<xTCPClientRecvCallback> Command %s %lu\n", pcName != NULL ? pcName : "unknown",
+                 (unsigned long)pxFrame->command.value);
+        if (!xTCPDownlinkDispatch(&pxFrame->command))
+        {
+            tcp_client->rx_errors++;
+        }
+    }
+    else
+    {
+        tcp_client->rx_errors++;
+    }
+}
+
+/**
+ * @brief Decode the whole frames at the start of a buffer.
+ *
+ * @param tcp_client TCP client that received the bytes.
+ * @param pucData Received bytes.
+ * @param xLen Number of received bytes.
+ * @param xMaxFrames Most frames to decode.
+ * @param pxOk Set to false if a frame cannot be delimited and the stream is lost.
+ *
+ * @return Number of bytes consumed; the rest is the start of an incomplete frame.
+ */
+static size_t prvTCPClientDecode(TCP_CLIENT_T *tcp_client, const uint8_t *pucData, size_t xLen, size_t xMaxFrames,
+                                 bool *pxOk)
+{
+    size_t xOffset = 0;
+
+    for (size_t i = 0; i < xMaxFrames && xOffset < xLen; i++)
+    {
+        WIRE_FRAME_T xFrame;
+        size_t xConsumed;
+        WIRE_RESULT_T eResult = eWireDecodeFrame(&tcp_client->rx_codec, &pucData[xOffset], xLen - xOffset,
+                                                 &xConsumed, &xFrame);
+
+        if (eResult == WIRE_INCOMPLETE)
+        {
+            // A frame longer than the client buffer could never be completed in it
+            *pxOk = xLen - xOffset < sizeof(tcp_client->rx);
+            break;
+        }
+        if (xConsumed == 0)
+        {
+            *pxOk = false;
+            break;
+        }
+
+        prvTCPClientHandle(tcp_client, eResult, &xFrame);
+        xOffset += xConsumed;
+    }
+
+    return xOffset;
+}
+
 err_t xTCPClientRecvCallback(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
-    
+    TCP_CLIENT_T *tcp_client = (TCP_CLIENT_T *)arg;
+    bool xOk = true;
+
     if (!p) {
-        printf("<xTCPClientRecvCallback> Connection closed\n");
-        xTCPClientClose(arg);
+        LOG_INFO("<xTCPClientRecvCallback> Connection closed\n");
+        // ERR_ABRT tells lwIP the pcb was aborted instead of closed
+        err = xTCPClientClose(arg);
+        prvTCPClientNotify(tcp_client, TCP_EVENT_CLOSED);
         return err;
     } 
 
     cyw43_arch_lwip_check();
 
-    uint8_t *buf = p->payload;
+    // Frames are decoded in place from the pbuf chain. Only a frame split across pbufs or
+    // segments is copied, into the client buffer, until its last byte arrives.
+    for (struct pbuf *q = p; q != NULL && xOk; q = q->next)
+    {
+        const uint8_t *pucData = q->payload;
+        size_t xLeft = q->len;
 
-    buf[p->tot_len]='\0';
+        while (xLeft > 0 && xOk)
+        {
+            size_t xUsed;
+
+            if (tcp_client->rx_len > 0)
+            {
+                size_t xHeld = tcp_client->rx_len;
+                size_t xChunk = sizeof(tcp_client->rx) - xHeld;
+
+                if (xChunk > xLeft)
+                {
+                    xChunk = xLeft;
+                }
+                memcpy(&tcp_client->rx[xHeld], pucData, xChunk);
+                tcp_client->rx_len += xChunk;
+
+                // Once the split frame is complete, whatever follows it is decoded in place again
+                xUsed = prvTCPClientDecode(tcp_client, tcp_client->rx, tcp_client->rx_len, 1, &xOk);
+                if (xUsed == 0)
+                {
+                    xUsed = xChunk;
+                }
+                else
+                {
+                    xUsed -= xHeld;
+                    tcp_client->rx_len = 0;
+                }
+            }
+            else
+            {
+                xUsed = prvTCPClientDecode(tcp_client, pucData, xLeft, SIZE_MAX, &xOk);
+                if (xOk && xUsed < xLeft)
+                {
+                    memcpy(tcp_client->rx, &pucData[xUsed], xLeft - xUsed);
+                    tcp_client->rx_len = xLeft - xUsed;
+                    xUsed = xLeft;
+                }
+            }
+
+            pucData += xUsed;
+            xLeft -= xUsed;
+        }
+    }
 
-    printf("<xTCPClientRecvCallback> Received data: %s\n", buf);
-    
     tcp_recved(tpcb, p->tot_len);
 
     pbuf_free(p);
 
+    if (!xOk)
+    {
+        LOG_WARN("<xTCPClientRecvCallback> Undecodable data from the controller\n");
+        err = xTCPClientClose(arg);
+        prvTCPClientNotify(tcp_client, TCP_EVENT_CLOSED);
+    }
+
     return err;
 }
 
-
+/**
+ * @brief Starts connecting the TCP client to the controller.
+ *
+ * The client enters TCP_STATE_CONNECTING; TCP_EVENT_CONNECTED is signalled once the
+ * connection is up and TCP_EVENT_CLOSED if it fails.
+ *
+ * @param pvParameters Pointer to the TCP client.
+ *
+ * @return pdTRUE if the connection attempt was started, pdFALSE otherwise.
+ */
 BaseType_t xTCPClientOpen(void *pvParameters)
 {
     // Cast the void pointer to a TCP_CLIENT_T pointer
     TCP_CLIENT_T *tcp_client = (TCP_CLIENT_T *)pvParameters;
 
-    printf("<xTCPClientOpen> Connecting to %s port %u\n", ip4addr_ntoa(&tcp_client->remote_addr), TCP_PORT);
+    LOG_INFO("<xTCPClientOpen> Connecting to %s port %u\n", ip4addr_ntoa(&tcp_client->remote_addr), TCP_PORT);
+
+    // cyw43_arch_lwip_begin/end should be used around calls into lwIP to ensure correct locking.
+    // You can omit them if you are in a callback from lwIP. With pico_cyw43_arch_poll these calls
+    // are a no-op, but in the background arches lwIP runs in its own task and must not see the
+    // pcb half set up.
+    cyw43_arch_lwip_begin();
     tcp_client->tcp_pcb = tcp_new_ip_type(IP_GET_TYPE(&tcp_client->remote_addr));
     if (!tcp_client->tcp_pcb)
     {
-        printf("<xTCPClientOpen> Failed to create pcb\n");
+        cyw43_arch_lwip_end();
+        LOG_ERROR("<xTCPClientOpen> Failed to create pcb\n");
         return pdFALSE;
     }
 
     tcp_client->connected=false;
     tcp_client->sent_len=0;
+    tcp_client->rx_len = 0;
+    tcp_client->rx_codec = (WIRE_CODEC_T){0};
+    tcp_client->ack_seq = 0;
+    tcp_client->state = TCP_STATE_CONNECTING;
+    tcp_client->state_tick = xTaskGetTickCount();
 
     // Set the TCP client tcp_client as the argument to the TCP callbacks
     tcp_arg(tcp_client->tcp_pcb, tcp_client);
@@ -202,13 +445,15 @@ BaseType_t xTCPClientOpen(void *pvParameters)
     // Set the TCP error callback
     tcp_err(tcp_client->tcp_pcb, vTCPClientErrCallback);
 
-    // cyw43_arch_lwip_begin/end should be used around calls into lwIP to ensure correct locking.
-    // You can omit them if you are in a callback from lwIP. Note that when using pico_cyw_arch_poll
-    // these calls are a no-op and can be omitted, but it is a good practice to use them in
-    // case you switch the cyw43_arch type later.
-    cyw43_arch_lwip_begin();
     err_t err = tcp_connect(tcp_client->tcp_pcb, &tcp_client->remote_addr, TCP_PORT, xTCPClientConnectedCallback);
     cyw43_arch_lwip_end();
 
-    return err == ERR_OK;
+    if (err != ERR_OK)
+    {
+        LOG_WARN("<xTCPClientOpen> Connect failed %d\n", err);
+        xTCPClientClose(tcp_client);
+        return pdFALSE;
+    }
+
+    return pdTRUE;
 }
\ No newline at end of file
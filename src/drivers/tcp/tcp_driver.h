@@ -2,6 +2,9 @@
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
 
+// Protocol includes
+#include "protocol/wire_format.h"
+
 #ifndef TCP_DRIVER_H_
 #define TCP_DRIVER_H_
 
@@ -10,13 +13,71 @@
 #define TCP_PORT 65400
 #define POLL_TIME_S 5
 
+// Period at which the uplink task polls the network while connecting or waiting for acknowledgements
+#define TCP_POLL_MS 10
+
+// Longest time the uplink task sleeps while the connection is idle; the poll arch still needs servicing
+#define TCP_IDLE_POLL_MS 250
+
+// Longest waits of the uplink task between network events. With the poll arch lwIP only runs when the
+// task calls cyw43_arch_poll(). Otherwise lwIP runs in its own task and signals every event, so the
+// uplink task sleeps until an event or one of its own deadlines.
+#if PICO_CYW43_ARCH_POLL
+#define TCP_POLL_TICKS pdMS_TO_TICKS(TCP_POLL_MS)
+#define TCP_IDLE_POLL_TICKS pdMS_TO_TICKS(TCP_IDLE_POLL_MS)
+#else
+#define TCP_POLL_TICKS portMAX_DELAY
+#define TCP_IDLE_POLL_TICKS portMAX_DELAY
+#endif
+
+// Time allowed for a connection attempt before it is abandoned
+#define TCP_CONNECT_TIMEOUT_MS 10000
+
+// Reconnect delays, doubled after every failed attempt
+#define TCP_BACKOFF_MIN_MS 1000
+#define TCP_BACKOFF_MAX_MS 60000
+
+// Task notification index the uplink events are signalled on; index 0 belongs to stream buffers
+#define TCP_NOTIFY_INDEX 1
+
+// Uplink events, set as bits in the uplink task's notification value
+#define TCP_EVENT_CONNECTED (1UL << 0)
+#define TCP_EVENT_SENT (1UL << 1)
+#define TCP_EVENT_CLOSED (1UL << 2)
+#define TCP_EVENT_RECORD (1UL << 3)
+#define TCP_EVENT_ACKED (1UL << 4)
+#define TCP_EVENT_COMMAND (1UL << 5)
+
+// Bytes of a frame from the controller that is split across pbufs, enough for the longest frame
+#define TCP_RX_BUFFER_LEN (2 * WIRE_MAX_RECORD_LEN)
+
 // Type definitions
+typedef enum
+{
+    TCP_STATE_CONNECTING = 0,
+    TCP_STATE_ESTABLISHED,
+    TCP_STATE_DRAINING,
+    TCP_STATE_BACKOFF,
+} TCP_STATE_T;
+
 typedef struct TCP_CLIENT_T_
 {
     struct tcp_pcb *tcp_pcb;
     ip_addr_t remote_addr;
     int sent_len;
     bool connected;
+    TaskHandle_t task;
+    TCP_STATE_T state;
+    TickType_t state_tick;
+    uint32_t retry_ms;
+    uint32_t backoff_ms;
+    uint32_t disconnects;
+    // Start of a frame from the controller still arriving, and the highest sequence number it acknowledged
+    uint8_t rx[TCP_RX_BUFFER_LEN];
+    size_t rx_len;
+    WIRE_CODEC_T rx_codec;
+    uint32_t ack_seq;
+    uint32_t rx_errors;
 } TCP_CLIENT_T;
 
 /**
@@ -43,6 +104,7 @@ BaseType_t xInitSTA(__unused void *pvParameters);
  *
  * This function allocates memory for the TCP client state and initializes its remote address.
  * It returns a pointer to the allocated state. If the memory allocation fails, the function returns NULL.
+ * The calling task receives the uplink events of the client.
  *
  * @param pvParameters Unused parameter (required by FreeRTOS API).
  *
@@ -50,8 +112,47 @@ BaseType_t xInitSTA(__unused void *pvParameters);
  */
 TCP_CLIENT_T *xInitTCPClient(__unused void *pvParameters);
 
+/**
+ * @brief Starts connecting the TCP client to the controller.
+ *
+ * The client enters TCP_STATE_CONNECTING; TCP_EVENT_CONNECTED is signalled once the
+ * connection is up and TCP_EVENT_CLOSED if it fails.
+ *
+ * @param pvParameters Pointer to the TCP client.
+ *
+ * @return pdTRUE if the connection attempt was started, pdFALSE otherwise.
+ */
 BaseType_t xTCPClientOpen(void *pvParameters);
 
+/**
+ * @brief Closes the connection of the TCP client, if it has one.
+ *
+ * @param pvParameters Pointer to the TCP client.
+ *
+ * @return ERR_OK, or ERR_ABRT if the connection had to be aborted.
+ */
 err_t xTCPClientClose(void *pvParameters);
 
+/**
+ * @brief Closes the connection and schedules the next attempt.
+ *
+ * The client enters TCP_STATE_BACKOFF for its current reconnect delay, which is then
+ * doubled up to TCP_BACKOFF_MAX_MS. The delay returns to TCP_BACKOFF_MIN_MS once a
+ * connection is established.
+ *
+ * @param tcp_client TCP client to back off.
+ *
+ * @return None.
+ */
+void vTCPClientBackoff(TCP_CLIENT_T *tcp_client);
+
+/**
+ * @brief Waits for uplink events signalled to the calling task.
+ *
+ * @param xTicksToWait Maximum time to wait for an event.
+ *
+ * @return The TCP_EVENT_ bits signalled since the last call, 0 on timeout.
+ */
+uint32_t ulTCPClientWaitEvents(TickType_t xTicksToWait);
+
 #endif /* TCP_DRIVER_H_ */
\ No newline at end of file
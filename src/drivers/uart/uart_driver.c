@@ -7,22 +7,74 @@
  * initialization and interrupt handling. It includes the required FreeRTOS and
  * Pico headers, as well as a project-specific header for defining the UART ID,
  * baud rate, and pin assignments.
+ *
+ * Received bytes reach the UART task through a single producer, single
+ * consumer ring. The ISR reads the RX FIFO straight into the ring's free space
+ * and the task assembles lines from the stored bytes in place, so each byte is
+ * copied once into the ring and once into its line, and neither side enters a
+ * critical section. The ISR notifies the task, the ring's doorbell, only once a
+ * complete line has arrived or the ring is full.
+ *
+ * In the DUAL_CORE build the driver runs on core 1, where FreeRTOS does not.
+ * The ring then has no doorbell, and the reader sleeps in WFI until the ISR has
+ * added to it.
  */
 
 // FreeRTOS includes
 #include <FreeRTOS.h>
 #include <task.h>
-#include <queue.h>
+
+// Standard includes
+#include <string.h>
 
 // Pico includes
 #include "hardware/gpio.h"
 #include "hardware/uart.h"
+#if DUAL_CORE
+#include "hardware/sync.h"
+#endif
 
 // Driver includes
 #include "uart_driver.h"
 
-// Queue handles
-extern QueueHandle_t xQueueUART;
+// Project includes
+#include "ring/spsc_ring.h"
+#include "trace/trace.h"
+
+// Receive counters, written by ISR_UART_RX only
+static volatile UART_STATS_T xUARTStats;
+
+// Bytes from ISR_UART_RX to the reader
+static uint8_t ucRxStorage[UART_RX_BUFFER_LEN];
+static SPSC_RING_T xRxRing;
+
+/**
+ * @brief Wait until the receive ring holds data.
+ *
+ * @param xTicksToWait 0 to return at once, any other value to wait for at least one byte.
+ *
+ * @return pdTRUE if the ring holds data, pdFALSE otherwise.
+ */
+static BaseType_t prvRxWait(TickType_t xTicksToWait)
+{
+#if DUAL_CORE
+    // Check and sleep with interrupts masked, so an interrupt in between still ends the WFI
+    while (xTicksToWait != 0 && ulSPSCRingAvailable(&xRxRing) == 0)
+    {
+        uint32_t ulSave = save_and_disable_interrupts();
+
+        if (ulSPSCRingAvailable(&xRxRing) == 0)
+        {
+            __wfi();
+        }
+        restore_interrupts(ulSave);
+    }
+
+    return ulSPSCRingAvailable(&xRxRing) != 0 ? pdTRUE : pdFALSE;
+#else
+    return xSPSCRingWait(&xRxRing, xTicksToWait);
+#endif
+}
 
 /**
  * @brief Initialize UART and set up RX interrupt.
@@ -41,6 +93,8 @@ void vInitUART(__unused void *pvParameters)
     // Set up our UART with the required speed.
     uart_init(UART_ID, BAUD_RATE);
 
+    vSPSCRingInit(&xRxRing, ucRxStorage, sizeof(ucRxStorage));
+
     // Set the TX and RX pins by using the function select on the GPIO
     // See datasheet for more information on function select
     gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
@@ -56,32 +110,206 @@ void vInitUART(__unused void *pvParameters)
     irq_set_enabled(UART_IRQ, pdTRUE);
 }
 
+/**
+ * @brief Make the calling task the reader of the UART and enable the RX interrupt.
+ *
+ * In the DUAL_CORE build the caller runs outside of FreeRTOS and sleeps in WFI
+ * instead of being notified.
+ *
+ * @return None.
+ */
+void vUARTEnableRx(void)
+{
+#if !DUAL_CORE
+    vSPSCRingSetDoorbell(&xRxRing, xTaskGetCurrentTaskHandle(), UART_NOTIFY_INDEX);
+#endif
+
+    // RX only
+    uart_set_irq_enables(UART_ID, true, false);
+}
+
 /**
  * @brief Interrupt service routine for UART receive.
  *
- * This ISR is triggered when the UART receives a byte of data. It reads the data
- * from the UART buffer and sends it to a queue for processing in a task.
+ * This ISR drains the whole RX FIFO straight into the free space of the
+ * receive ring and commits it, once per contiguous span. Carriage returns are
+ * replaced with NUL terminators, and the reader is only woken once a complete
+ * line has been written or the ring is full. Hardware FIFO overruns and bytes
+ * that did not fit into the ring are counted.
  *
  * @return None.
  */
-void __attribute__((interrupt)) ISR_UART_RX(void)
+void __isr ISR_UART_RX(void)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    BaseType_t xLineComplete = pdFALSE;
+    uint32_t ulReceived = 0;
+    uint32_t ulDropped = 0;
+
+    TRACE_ISR_ENTER(TRACE_ISR_UART_RX);
+
+    // The overrun flag means the FIFO filled up and bytes were lost before we ran
+    if (uart_get_hw(UART_ID)->rsr & UART_UARTRSR_OE_BITS)
+    {
+        xUARTStats.fifo_overruns++;
+        uart_get_hw(UART_ID)->rsr = 0;
+    }
 
-    // Read data from UART buffer and send to queue
     while (uart_is_readable(UART_ID))
     {
-        uint8_t ch = uart_getc(UART_ID);
+        uint8_t *pucSpan;
+        size_t xSpace = xSPSCRingReserve(&xRxRing, &pucSpan);
+        size_t xLength = 0;
+
+        // Fill the free span; with none left the FIFO is still drained, and its bytes dropped
+        while ((xLength < xSpace || xSpace == 0) && uart_is_readable(UART_ID))
+        {
+            char ch = uart_getc(UART_ID);
+
+            // Replace '\r' with '\0'
+            if (ch == '\r')
+            {
+                ch = '\0';
+                xLineComplete = pdTRUE;
+                xUARTStats.rx_lines++;
+            }
 
-        // Replace '\r' with '\0'
-        char toSend = (ch == '\r') ? '\0' : ch;
+            if (xSpace == 0)
+            {
+                ulDropped++;
+            }
+            else
+            {
+                pucSpan[xLength++] = (uint8_t)ch;
+            }
+            ulReceived++;
+        }
 
-        xQueueSendFromISR(xQueueUART, (void *)&toSend, &xHigherPriorityTaskWoken);
+        vSPSCRingCommit(&xRxRing, xLength);
+    }
+
+    xUARTStats.rx_bytes += ulReceived;
+    xUARTStats.dropped_bytes += ulDropped;
+
+#if DUAL_CORE
+    // Returning from the interrupt ends the reader's WFI
+    (void)xLineComplete;
+    (void)xHigherPriorityTaskWoken;
+#else
+    if (xLineComplete || ulSPSCRingAvailable(&xRxRing) == UART_RX_BUFFER_LEN)
+    {
+        vSPSCRingNotifyFromISR(&xRxRing, &xHigherPriorityTaskWoken);
     }
 
     // Yield to a higher priority task if one was unblocked
-    if (xHigherPriorityTaskWoken)
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+#endif
+
+    TRACE_ISR_EXIT(TRACE_ISR_UART_RX);
+}
+
+/**
+ * @brief Read the next complete line received on the UART.
+ *
+ * Bytes are read in place from the receive ring and reassembled into pxLine,
+ * which keeps a partially received line between calls. Lines longer than
+ * MAX_RX_STR_LEN - 1 characters are truncated and flagged as overflowed.
+ *
+ * @param pxLine Line assembly state owned by the caller.
+ * @param xTicksToWait Maximum time to wait for more data if no complete line is buffered.
+ *
+ * @return pdPASS if pxLine holds a complete NUL terminated line, pdFAIL otherwise.
+ */
+BaseType_t xUARTReadLine(UART_LINE_T *pxLine, TickType_t xTicksToWait)
+{
+    // Start a new line if the previous call returned a complete one
+    if (pxLine->complete)
     {
-        taskYIELD();
+        pxLine->len = 0;
+        pxLine->complete = false;
+        pxLine->overflow = false;
     }
-}
\ No newline at end of file
+
+    for (;;)
+    {
+        const uint8_t *pucSpan;
+        size_t xAvailable = xSPSCRingPeek(&xRxRing, &pucSpan);
+
+        // Waits only if nothing is buffered
+        if (xAvailable == 0)
+        {
+            if (prvRxWait(xTicksToWait) == pdFALSE)
+            {
+                return pdFAIL;
+            }
+            continue;
+        }
+
+        // Copy up to the terminator, or the whole span if the line continues
+        const char *pcStart = (const char *)pucSpan;
+        const char *pcEnd = memchr(pcStart, '\0', xAvailable);
+        size_t xCopy = pcEnd != NULL ? (size_t)(pcEnd - pcStart) : xAvailable;
+        size_t xTake = pcEnd != NULL ? xCopy + 1 : xCopy;
+        size_t xRoom = sizeof(pxLine->line) - 1 - pxLine->len;
+
+        if (xCopy > xRoom)
+        {
+            xCopy = xRoom;
+            pxLine->overflow = true;
+        }
+
+        memcpy(&pxLine->line[pxLine->len], pcStart, xCopy);
+        pxLine->len += xCopy;
+        vSPSCRingConsume(&xRxRing, xTake);
+
+        if (pcEnd != NULL)
+        {
+            pxLine->line[pxLine->len] = '\0';
+            pxLine->complete = true;
+            return pdPASS;
+        }
+    }
+}
+
+/**
+ * @brief Discard everything received so far, including any partial line.
+ *
+ * @param pxLine Line assembly state owned by the caller.
+ *
+ * @return None.
+ */
+void vUARTFlush(UART_LINE_T *pxLine)
+{
+    vSPSCRingFlush(&xRxRing);
+    pxLine->len = 0;
+    pxLine->complete = false;
+    pxLine->overflow = false;
+}
+
+/**
+ * @brief Take a snapshot of the UART receive counters.
+ *
+ * With a single core the counters are read together in a critical section.
+ * With DUAL_CORE, ISR_UART_RX runs on core 1 and masking core 0 does not hold
+ * it off, so each counter is read once on its own and they may come from
+ * different passes of the ISR.
+ *
+ * @param pxStats Destination for the counters.
+ *
+ * @return None.
+ */
+void vGetUARTStats(UART_STATS_T *pxStats)
+{
+#if !DUAL_CORE
+    taskENTER_CRITICAL();
+#endif
+    // Word sized volatile loads, each value is whole even while core 1 updates the others
+    pxStats->rx_bytes = xUARTStats.rx_bytes;
+    pxStats->rx_lines = xUARTStats.rx_lines;
+    pxStats->fifo_overruns = xUARTStats.fifo_overruns;
+    pxStats->dropped_bytes = xUARTStats.dropped_bytes;
+    pxStats->pending = ulSPSCRingAvailable(&xRxRing);
+#if !DUAL_CORE
+    taskEXIT_CRITICAL();
+#endif
+}
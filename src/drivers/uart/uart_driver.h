@@ -4,7 +4,8 @@
  * @brief Header file for UART driver functions.
  *
  * This header file contains function prototypes and macros for UART driver
- * functions, including initialization and interrupt handling.
+ * functions, including initialization, interrupt handling and line reassembly
+ * from the ISR-fed receive ring.
  */
 
 #ifndef UART_DRIVER_H_
@@ -16,6 +17,32 @@
 #define UART_RX_PIN 1
 #define MAX_RX_STR_LEN 32
 
+// Size of the ring between ISR_UART_RX and the UART task, a power of two
+#define UART_RX_BUFFER_LEN 256
+
+// Task notification index ISR_UART_RX wakes the reader with
+#define UART_NOTIFY_INDEX 0
+
+// Type definitions
+typedef struct UART_LINE_T_
+{
+    char line[MAX_RX_STR_LEN];
+    size_t len;
+    bool complete;
+    bool overflow;
+} UART_LINE_T;
+
+typedef struct UART_STATS_T_
+{
+    uint32_t rx_bytes;
+    uint32_t rx_lines;
+    uint32_t fifo_overruns;
+    uint32_t dropped_bytes;
+
+    // Bytes received by the ISR but not yet read, at the time of the snapshot
+    uint32_t pending;
+} UART_STATS_T;
+
 /**
  * @brief Initialize UART and set up RX interrupt.
  *
@@ -30,14 +57,64 @@
  */
 void vInitUART(__unused void *pvParameters);
 
+/**
+ * @brief Make the calling task the reader of the UART and enable the RX interrupt.
+ *
+ * In the DUAL_CORE build the caller runs outside of FreeRTOS and sleeps in WFI
+ * instead of being notified.
+ *
+ * @return None.
+ */
+void vUARTEnableRx(void);
+
 /**
  * @brief Interrupt service routine for UART receive.
  *
- * This ISR is triggered when the UART receives a byte of data. It reads the data
- * from the UART buffer and sends it to a queue for processing in a task.
+ * This ISR drains the whole RX FIFO straight into the free space of the
+ * receive ring and commits it, once per contiguous span. Carriage returns are
+ * replaced with NUL terminators, and the reader is only woken once a complete
+ * line has been written or the ring is full. Hardware FIFO overruns and bytes
+ * that did not fit into the ring are counted.
+ *
+ * @return None.
+ */
+void __isr ISR_UART_RX(void);
+
+/**
+ * @brief Read the next complete line received on the UART.
+ *
+ * Bytes are read in place from the receive ring and reassembled into pxLine,
+ * which keeps a partially received line between calls. Lines longer than
+ * MAX_RX_STR_LEN - 1 characters are truncated and flagged as overflowed.
+ *
+ * @param pxLine Line assembly state owned by the caller.
+ * @param xTicksToWait Maximum time to wait for more data if no complete line is buffered.
+ *
+ * @return pdPASS if pxLine holds a complete NUL terminated line, pdFAIL otherwise.
+ */
+BaseType_t xUARTReadLine(UART_LINE_T *pxLine, TickType_t xTicksToWait);
+
+/**
+ * @brief Discard everything received so far, including any partial line.
+ *
+ * @param pxLine Line assembly state owned by the caller.
+ *
+ * @return None.
+ */
+void vUARTFlush(UART_LINE_T *pxLine);
+
+/**
+ * @brief Take a snapshot of the UART receive counters.
+ *
+ * With a single core the counters are read together in a critical section.
+ * With DUAL_CORE, ISR_UART_RX runs on core 1 and masking core 0 does not hold
+ * it off, so each counter is read once on its own and they may come from
+ * different passes of the ISR.
+ *
+ * @param pxStats Destination for the counters.
  *
  * @return None.
  */
-void __attribute__((interrupt)) ISR_UART_RX(void);
+void vGetUARTStats(UART_STATS_T *pxStats);
 
-#endif /* UART_DRIVER_H_ */
\ No newline at end of file
+#endif /* UART_DRIVER_H_ */
@@ -0,0 +1,325 @@
+/**
+ * @file log.c
+ *
+ * @brief Source file for the deferred logger.
+ *
+ * Each core's ring is an SPSC_RING_T of ring/spsc_ring.h. Any task may log,
+ * so the writers of core 0's ring are serialised by a critical section once
+ * the scheduler runs and core 1's by masking its interrupts, which makes them a
+ * single producer to the ring; vTaskLog is its consumer. Records vary in
+ * length and are written piece by piece, header first, so the reader only
+ * takes a record once all the bytes its length byte announces are there.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <stdio.h>
+#include <string.h>
+
+// Pico includes
+#include "hardware/sync.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+
+// Project includes
+#include "log.h"
+#include "log_format.h"
+#include "ring/spsc_ring.h"
+
+#if DUAL_CORE
+#define LOG_CORES 2
+#else
+#define LOG_CORES 1
+#endif
+
+typedef struct LOG_RING_T_
+{
+    SPSC_RING_T ring;
+    LOG_STATS_T stats;
+} LOG_RING_T;
+
+static uint8_t ucRingStorage[LOG_CORES][LOG_BUFFER_LEN];
+
+// Set up statically, main() logs before any task runs
+static LOG_RING_T xRings[LOG_CORES] = {
+    {.ring = {.storage = ucRingStorage[0], .size = LOG_BUFFER_LEN}},
+#if DUAL_CORE
+    {.ring = {.storage = ucRingStorage[1], .size = LOG_BUFFER_LEN}},
+#endif
+};
+
+// Set by vTaskLog once it runs, so writers only notify a task that exists
+static TaskHandle_t volatile xTaskLogHandle;
+
+// Start of the format strings, provided by the linker
+extern const char __start_log_fmt[];
+
+/**
+ * @brief Store a record in the ring of the calling core.
+ *
+ * Called by the LOG_ macros.
+ *
+ * @param pcFormat Format string in the log_fmt section, starting with its level letter.
+ * @param pxArgs Arguments of the format string, in order.
+ * @param xCount Number of arguments.
+ *
+ * @return None.
+ */
+void vLogWrite(const char *pcFormat, const LOG_ARG_T *pxArgs, size_t xCount)
+{
+    uint8_t ucStringLen[LOG_MAX_ARGS];
+    uint8_t ucHeader[LOG_HEADER_LEN];
+    uint32_t ulTime = time_us_32();
+    uint16_t usId = (uint16_t)(pcFormat - __start_log_fmt);
+    size_t xLen = LOG_HEADER_LEN;
+    bool xWasEmpty;
+    bool xStored = false;
+
+    // Sized before the interrupts are masked
+    for (size_t i = 0; i < xCount; i++)
+    {
+        if (pxArgs[i].string != NULL)
+        {
+            size_t xStringLen = strnlen(pxArgs[i].string, LOG_MAX_STRING_LEN);
+
+            ucStringLen[i] = (uint8_t)xStringLen;
+            xLen += 1 + xStringLen;
+        }
+        else
+        {
+            xLen += 4;
+        }
+    }
+
+    ucHeader[0] = (uint8_t)xLen;
+    ucHeader[1] = (uint8_t)usId;
+    ucHeader[2] = (uint8_t)(usId >> 8);
+    ucHeader[3] = (uint8_t)ulTime;
+    ucHeader[4] = (uint8_t)(ulTime >> 8);
+    ucHeader[5] = (uint8_t)(ulTime >> 16);
+    ucHeader[6] = (uint8_t)(ulTime >> 24);
+
+#if DUAL_CORE
+    bool xCore1 = get_core_num() != 0;
+    LOG_RING_T *pxRing = &xRings[xCore1];
+    uint32_t ulSave = 0;
+
+    if (xCore1)
+    {
+        ulSave = save_and_disable_interrupts();
+    }
+#else
+    bool xCore1 = false;
+    LOG_RING_T *pxRing = &xRings[0];
+#endif
+    // Before the scheduler starts main() is the only writer, and must not mask the interrupts WiFi needs
+    bool xScheduler = !xCore1 && xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+
+    if (xScheduler)
+    {
+        taskENTER_CRITICAL();
+    }
+
+    uint32_t ulHeld = ulSPSCRingAvailable(&pxRing->ring);
+
+    xWasEmpty = ulHeld == 0;
+
+    // The whole record is checked for room, no writer can take it before the pieces follow
+    if (LOG_BUFFER_LEN - ulHeld >= xLen)
+    {
+        (void)xSPSCRingWrite(&pxRing->ring, ucHeader, LOG_HEADER_LEN);
+        for (size_t i = 0; i < xCount; i++)
+        {
+            if (pxArgs[i].string != NULL)
+            {
+                (void)xSPSCRingWrite(&pxRing->ring, &ucStringLen[i], 1);
+                (void)xSPSCRingWrite(&pxRing->ring, pxArgs[i].string, ucStringLen[i]);
+            }
+            else
+            {
+                uint8_t ucValue[4] = {(uint8_t)pxArgs[i].value, (uint8_t)(pxArgs[i].value >> 8),
+                                      (uint8_t)(pxArgs[i].value >> 16), (uint8_t)(pxArgs[i].value >> 24)};
+
+                (void)xSPSCRingWrite(&pxRing->ring, ucValue, 4);
+            }
+        }
+        pxRing->stats.written++;
+        xStored = true;
+    }
+    else
+    {
+        pxRing->stats.dropped++;
+    }
+
+#if DUAL_CORE
+    if (xCore1)
+    {
+        // Core 1 cannot notify a task, vTaskLog finds its records when it next wakes
+        restore_interrupts(ulSave);
+        return;
+    }
+#endif
+    if (xScheduler)
+    {
+        taskEXIT_CRITICAL();
+    }
+
+    // Only the first record of a burst wakes the task; it runs once the writers block
+    if (xStored && xWasEmpty && xTaskLogHandle != NULL)
+    {
+        xTaskNotifyGive(xTaskLogHandle);
+    }
+}
+
+#if LOG_BINARY
+/**
+ * @brief Write a record as a COBS encoded frame between NUL bytes.
+ *
+ * The frame holds the record without its length byte; the NUL bytes delimit it.
+ *
+ * @param pucRecord Record to write.
+ * @param xLen Length of the record.
+ *
+ * @return None.
+ */
+static void prvLogWriteFrame(const uint8_t *pucRecord, size_t xLen)
+{
+    static uint8_t ucFrame[LOG_MAX_RECORD_LEN + LOG_MAX_RECORD_LEN / 254 + 3];
+    size_t xCode = 1;
+    size_t xOut = 2;
+
+    ucFrame[0] = 0;
+    for (size_t i = 1; i < xLen; i++)
+    {
+        if (pucRecord[i] != 0)
+        {
+            ucFrame[xOut++] = pucRecord[i];
+        }
+        if (pucRecord[i] == 0 || xOut - xCode == 0xFF)
+        {
+            ucFrame[xCode] = (uint8_t)(xOut - xCode);
+            xCode = xOut++;
+        }
+    }
+    ucFrame[xCode] = (uint8_t)(xOut - xCode);
+    ucFrame[xOut++] = 0;
+
+    // Raw, without the CR the stdio driver would add before every LF byte
+    for (size_t i = 0; i < xOut; i++)
+    {
+        putchar_raw(ucFrame[i]);
+    }
+}
+#endif
+
+/**
+ * @brief Write out the records of a ring.
+ *
+ * @param pxRing Ring to drain.
+ *
+ * @return None.
+ */
+static void prvLogDrain(LOG_RING_T *pxRing)
+{
+    static uint8_t ucRecord[LOG_MAX_RECORD_LEN];
+#if !LOG_BINARY
+    static char cLine[LOG_LINE_LEN];
+#endif
+    const uint8_t *pucLen;
+
+    while (xSPSCRingPeek(&pxRing->ring, &pucLen) > 0)
+    {
+        // Core 1 may be part way through a record, whose rest is taken on the next drain
+        if (ulSPSCRingAvailable(&pxRing->ring) < *pucLen)
+        {
+            break;
+        }
+        (void)xSPSCRingRead(&pxRing->ring, ucRecord, *pucLen);
+
+#if LOG_BINARY
+        prvLogWriteFrame(ucRecord, ucRecord[0]);
+#else
+        // Skip the level letter, the console shows what printf would have
+        const char *pcFormat = __start_log_fmt + (ucRecord[1] | ucRecord[2] << 8) + 1;
+
+        xLogFormat(cLine, sizeof(cLine), pcFormat, &ucRecord[LOG_HEADER_LEN], ucRecord[0] - LOG_HEADER_LEN);
+        printf("%s", cLine);
+#endif
+    }
+}
+
+/**
+ * @brief Write out every record in the rings from the calling task.
+ *
+ * Used before the firmware halts, when vTaskLog would not get to run again.
+ *
+ * @return None.
+ */
+void vLogFlush(void)
+{
+    for (unsigned i = 0; i < LOG_CORES; i++)
+    {
+        prvLogDrain(&xRings[i]);
+    }
+}
+
+/**
+ * @brief Read the counters of all rings.
+ *
+ * @param pxStats Destination for the counters.
+ *
+ * @return None.
+ */
+void vGetLogStats(LOG_STATS_T *pxStats)
+{
+    *pxStats = (LOG_STATS_T){0};
+
+    for (unsigned i = 0; i < LOG_CORES; i++)
+    {
+        pxStats->written += xRings[i].stats.written;
+        pxStats->dropped += xRings[i].stats.dropped;
+    }
+}
+
+/**
+ * @brief Task that writes out the records of the rings.
+ *
+ * Woken by the first record written into an empty ring on core 0. Core 1
+ * cannot notify a task, so in the DUAL_CORE build it also wakes every
+ * LOG_DRAIN_MS.
+ *
+ * @param pvParameters Unused parameter (required by FreeRTOS API).
+ *
+ * @return None.
+ */
+void vTaskLog(__unused void *pvParameters)
+{
+    uint32_t ulDropped = 0;
+
+    xTaskLogHandle = xTaskGetCurrentTaskHandle();
+
+    for (;;)
+    {
+        LOG_STATS_T xStats;
+
+        // Records written before the scheduler started are waiting already
+        vLogFlush();
+
+        vGetLogStats(&xStats);
+        if (xStats.dropped != ulDropped)
+        {
+            LOG_WARN("<vTaskLog> %lu records dropped\n", (unsigned long)(xStats.dropped - ulDropped));
+            ulDropped = xStats.dropped;
+            continue;
+        }
+
+#if DUAL_CORE
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_DRAIN_MS));
+#else
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#endif
+    }
+}
@@ -0,0 +1,197 @@
+/**
+ * @file log.h
+ *
+ * @brief Header file for the deferred logger.
+ *
+ * Formatting a line with printf and writing it over USB CDC costs thousands of
+ * cycles and blocks while the host is not reading. The LOG_ macros instead
+ * store a reference to their format string and the raw arguments in a RAM
+ * ring, which takes a few dozen cycles, and vTaskLog formats and writes the
+ * records later at low priority.
+ *
+ * Every format string is placed in the log_fmt section, and a record refers to
+ * it by its offset in that section. Integer arguments are stored as 32 bits and
+ * string arguments are copied, truncated to LOG_MAX_STRING_LEN characters, so
+ * they may come from a buffer that is reused. Levels below LOG_LEVEL are
+ * removed at compile time, along with their format strings.
+ *
+ * vTaskLog writes each record as the text printf would have produced, or with
+ * LOG_BINARY set as a COBS encoded frame between NUL bytes, which is much
+ * shorter; logdecode turns such a capture back into text using the format
+ * strings in the firmware's ELF file. Text written with printf before the
+ * scheduler starts passes through the decoder unchanged.
+ *
+ * Records are written in a critical section, so the macros may be used from
+ * tasks, from main() before the scheduler starts and, in the DUAL_CORE build,
+ * from core 1, which has a ring of its own; not from interrupt handlers. A
+ * record that does not fit into the ring is dropped and counted.
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Levels, in increasing severity
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+// Lowest level that is compiled in
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Set to 1 to write binary frames for logdecode instead of text
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+
+// Bytes of each ring, a power of two
+#define LOG_BUFFER_LEN 2048
+
+// Longest string argument stored, longer ones are truncated
+#define LOG_MAX_STRING_LEN 31
+
+// Most arguments a LOG_ macro takes
+#define LOG_MAX_ARGS 8
+
+// Longest line vTaskLog formats, longer ones are truncated
+#define LOG_LINE_LEN 192
+
+// Longest vTaskLog waits with records in core 1's ring, which cannot wake it
+#define LOG_DRAIN_MS 100
+
+// Record header: a length byte, the format string's offset and a time stamp in microseconds
+#define LOG_HEADER_LEN (1 + 2 + 4)
+
+// Largest record
+#define LOG_MAX_RECORD_LEN (LOG_HEADER_LEN + LOG_MAX_ARGS * (1 + LOG_MAX_STRING_LEN))
+
+// Type definitions
+typedef struct LOG_ARG_T_
+{
+    const char *string;
+    uint32_t value;
+} LOG_ARG_T;
+
+typedef struct LOG_STATS_T_
+{
+    uint32_t written;
+    uint32_t dropped;
+} LOG_STATS_T;
+
+/**
+ * @brief Store a record in the ring of the calling core.
+ *
+ * Called by the LOG_ macros.
+ *
+ * @param pcFormat Format string in the log_fmt section, starting with its level letter.
+ * @param pxArgs Arguments of the format string, in order.
+ * @param xCount Number of arguments.
+ *
+ * @return None.
+ */
+void vLogWrite(const char *pcFormat, const LOG_ARG_T *pxArgs, size_t xCount);
+
+/**
+ * @brief Write out every record in the rings from the calling task.
+ *
+ * Used before the firmware halts, when vTaskLog would not get to run again.
+ *
+ * @return None.
+ */
+void vLogFlush(void);
+
+/**
+ * @brief Read the counters of all rings.
+ *
+ * @param pxStats Destination for the counters.
+ *
+ * @return None.
+ */
+void vGetLogStats(LOG_STATS_T *pxStats);
+
+/**
+ * @brief Task that writes out the records of the rings.
+ *
+ * Woken by the first record written into an empty ring on core 0. Core 1
+ * cannot notify a task, so in the DUAL_CORE build it also wakes every
+ * LOG_DRAIN_MS.
+ *
+ * @param pvParameters Unused parameter (required by FreeRTOS API).
+ *
+ * @return None.
+ */
+void vTaskLog(void *pvParameters);
+
+static inline LOG_ARG_T xLogArgString(const char *pcString)
+{
+    return (LOG_ARG_T){.string = pcString};
+}
+
+static inline LOG_ARG_T xLogArgValue(uint32_t ulValue)
+{
+    return (LOG_ARG_T){.value = ulValue};
+}
+
+// Strings are copied, anything else is stored as a 32 bit integer
+#define LOG_ARG(x) _Generic((x), char *: xLogArgString, const char *: xLogArgString, default: xLogArgValue)(x)
+
+#define LOG_ARGS_0() NULL, 0
+#define LOG_ARGS_1(a) (const LOG_ARG_T[]){LOG_ARG(a)}, 1
+#define LOG_ARGS_2(a, b) (const LOG_ARG_T[]){LOG_ARG(a), LOG_ARG(b)}, 2
+#define LOG_ARGS_3(a, b, c) (const LOG_ARG_T[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c)}, 3
+#define LOG_ARGS_4(a, b, c, d) (const LOG_ARG_T[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d)}, 4
+#define LOG_ARGS_5(a, b, c, d, e) \
+    (const LOG_ARG_T[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), LOG_ARG(e)}, 5
+#define LOG_ARGS_6(a, b, c, d, e, f) \
+    (const LOG_ARG_T[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), LOG_ARG(e), LOG_ARG(f)}, 6
+#define LOG_ARGS_7(a, b, c, d, e, f, g) \
+    (const LOG_ARG_T[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), LOG_ARG(e), LOG_ARG(f), LOG_ARG(g)}, 7
+#define LOG_ARGS_8(a, b, c, d, e, f, g, h)                                                                  \
+    (const LOG_ARG_T[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), LOG_ARG(e), LOG_ARG(f), LOG_ARG(g), \
+                        LOG_ARG(h)},                                                                        \
+        8
+
+// Picks LOG_ARGS_<n> for the n arguments that follow the format string
+#define LOG_SELECT(_0, _1, _2, _3, _4, _5, _6, _7, _8, NAME, ...) NAME
+#define LOG_ARGS(pcFormat, ...)                                                                                \
+    LOG_SELECT(pcFormat, ##__VA_ARGS__, LOG_ARGS_8, LOG_ARGS_7, LOG_ARGS_6, LOG_ARGS_5, LOG_ARGS_4, LOG_ARGS_3, \
+               LOG_ARGS_2, LOG_ARGS_1, LOG_ARGS_0)(__VA_ARGS__)
+
+#define LOG_AT(cLevel, pcFormat, ...)                                                                     \
+    do                                                                                                    \
+    {                                                                                                     \
+        static const char pcLogFormat[] __attribute__((section("log_fmt"))) = cLevel pcFormat; \
+        vLogWrite(pcLogFormat, LOG_ARGS(pcFormat, ##__VA_ARGS__));                                        \
+    } while (0)
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(pcFormat, ...) LOG_AT("D", pcFormat, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(pcFormat, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(pcFormat, ...) LOG_AT("I", pcFormat, ##__VA_ARGS__)
+#else
+#define LOG_INFO(pcFormat, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(pcFormat, ...) LOG_AT("W", pcFormat, ##__VA_ARGS__)
+#else
+#define LOG_WARN(pcFormat, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(pcFormat, ...) LOG_AT("E", pcFormat, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(pcFormat, ...) do { } while (0)
+#endif
+
+#endif /* LOG_H_ */
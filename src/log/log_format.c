@@ -0,0 +1,133 @@
+/**
+ * @file log_format.c
+ *
+ * @brief Source file for rendering deferred log records as text.
+ */
+
+// Standard includes
+#include <stdio.h>
+#include <string.h>
+
+// Project includes
+#include "log_format.h"
+
+// Longest conversion specification, "%-+ #0" with width and precision
+#define LOG_SPEC_LEN 24
+
+/**
+ * @brief Render a format string with the arguments of a log record.
+ *
+ * Missing or truncated arguments are rendered as '?'.
+ *
+ * @param pcOut Destination buffer, always NUL terminated.
+ * @param xOutLen Size of the destination buffer.
+ * @param pcFormat printf-style format string.
+ * @param pucArgs Encoded arguments.
+ * @param xArgsLen Number of bytes of encoded arguments.
+ *
+ * @return Number of characters written, excluding the NUL.
+ */
+size_t xLogFormat(char *pcOut, size_t xOutLen, const char *pcFormat, const uint8_t *pucArgs, size_t xArgsLen)
+{
+    const uint8_t *pucEnd = pucArgs + xArgsLen;
+    size_t xLen = 0;
+
+    if (xOutLen == 0)
+    {
+        return 0;
+    }
+
+    while (*pcFormat != '\0' && xLen < xOutLen - 1)
+    {
+        char cSpec[LOG_SPEC_LEN];
+        size_t xSpecLen = 0;
+        int iWritten;
+
+        if (*pcFormat != '%' || pcFormat[1] == '%')
+        {
+            pcOut[xLen++] = *pcFormat;
+            pcFormat += *pcFormat == '%' ? 2 : 1;
+            continue;
+        }
+
+        // Copy the flags, width and precision; the length modifiers are dropped
+        cSpec[xSpecLen++] = *pcFormat++;
+        while (*pcFormat != '\0' && strchr("-+ #0123456789.", *pcFormat) != NULL && xSpecLen < LOG_SPEC_LEN - 2)
+        {
+            cSpec[xSpecLen++] = *pcFormat++;
+        }
+        while (*pcFormat != '\0' && strchr("hlLqjzt", *pcFormat) != NULL)
+        {
+            pcFormat++;
+        }
+        if (*pcFormat == '\0')
+        {
+            break;
+        }
+
+        char cConversion = *pcFormat++;
+
+        if (cConversion == 's')
+        {
+            char cString[256];
+            size_t xStringLen;
+
+            if (pucArgs >= pucEnd || (size_t)(pucEnd - pucArgs) < 1u + pucArgs[0])
+            {
+                pucArgs = pucEnd;
+                pcOut[xLen++] = '?';
+                continue;
+            }
+            xStringLen = *pucArgs++;
+            memcpy(cString, pucArgs, xStringLen);
+            cString[xStringLen] = '\0';
+            pucArgs += xStringLen;
+
+            cSpec[xSpecLen++] = 's';
+            cSpec[xSpecLen] = '\0';
+            iWritten = snprintf(&pcOut[xLen], xOutLen - xLen, cSpec, cString);
+        }
+        else if (strchr("diuxXocp", cConversion) != NULL)
+        {
+            uint32_t ulValue;
+
+            if (pucEnd - pucArgs < 4)
+            {
+                pucArgs = pucEnd;
+                pcOut[xLen++] = '?';
+                continue;
+            }
+            ulValue = (uint32_t)pucArgs[0] | (uint32_t)pucArgs[1] << 8 | (uint32_t)pucArgs[2] << 16 |
+                      (uint32_t)pucArgs[3] << 24;
+            pucArgs += 4;
+
+            // Pointers were stored as 32 bits like everything else
+            cSpec[xSpecLen++] = cConversion == 'p' ? 'x' : cConversion;
+            cSpec[xSpecLen] = '\0';
+            if (cConversion == 'd' || cConversion == 'i' || cConversion == 'c')
+            {
+                iWritten = snprintf(&pcOut[xLen], xOutLen - xLen, cSpec, (int)(int32_t)ulValue);
+            }
+            else
+            {
+                iWritten = snprintf(&pcOut[xLen], xOutLen - xLen, cSpec, (unsigned int)ulValue);
+            }
+        }
+        else
+        {
+            // Not a conversion this renderer knows, shown as written
+            cSpec[xSpecLen++] = cConversion;
+            cSpec[xSpecLen] = '\0';
+            iWritten = snprintf(&pcOut[xLen], xOutLen - xLen, "%s", cSpec);
+        }
+
+        if (iWritten > 0)
+        {
+            xLen += (size_t)iWritten < xOutLen - xLen ? (size_t)iWritten : xOutLen - xLen - 1;
+        }
+    }
+
+    pcOut[xLen] = '\0';
+
+    return xLen;
+}
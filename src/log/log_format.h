@@ -0,0 +1,37 @@
+/**
+ * @file log_format.h
+ *
+ * @brief Header file for rendering deferred log records as text.
+ *
+ * A log record holds the arguments of its format string in the order they
+ * appear, each integer as 4 bytes little-endian and each string as a length
+ * byte followed by that many characters. The conversions d, i, u, x, X, o, c,
+ * s and p are understood with their flags, width and precision; length
+ * modifiers are accepted and ignored, every integer was stored as 32 bits.
+ *
+ * The renderer is shared by the firmware's log task and the host decoder, so
+ * it depends on the C library only.
+ */
+
+#ifndef LOG_FORMAT_H_
+#define LOG_FORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Render a format string with the arguments of a log record.
+ *
+ * Missing or truncated arguments are rendered as '?'.
+ *
+ * @param pcOut Destination buffer, always NUL terminated.
+ * @param xOutLen Size of the destination buffer.
+ * @param pcFormat printf-style format string.
+ * @param pucArgs Encoded arguments.
+ * @param xArgsLen Number of bytes of encoded arguments.
+ *
+ * @return Number of characters written, excluding the NUL.
+ */
+size_t xLogFormat(char *pcOut, size_t xOutLen, const char *pcFormat, const uint8_t *pucArgs, size_t xArgsLen);
+
+#endif /* LOG_FORMAT_H_ */
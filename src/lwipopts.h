@@ -5,7 +5,12 @@
 // (see https://www.nongnu.org/lwip/2_1_x/group__lwip__opts.html for details)
 
 #ifndef NO_SYS
+#if PICO_CYW43_ARCH_POLL
 #define NO_SYS 1
+#else
+// pico_cyw43_arch_lwip_sys_freertos runs lwIP in the tcpip thread
+#define NO_SYS 0
+#endif
 #endif
 #ifndef LWIP_SOCKET
 #define LWIP_SOCKET 0
@@ -56,6 +61,9 @@
 #endif
 
 #if !NO_SYS
+// Above the UART and uplink tasks so acknowledgements are handled as they arrive, below the
+// CYW43 driver task that feeds it (CYW43_TASK_PRIORITY, 4)
+#define TCPIP_THREAD_PRIO 3
 #define TCPIP_THREAD_STACKSIZE 1024
 #define DEFAULT_THREAD_STACKSIZE 1024
 #define DEFAULT_RAW_RECVMBOX_SIZE 8
@@ -11,48 +11,83 @@
 // Pico includes
 #include "pico/stdlib.h"
 #include "pico/stdio.h"
+#if DUAL_CORE
+#include "pico/multicore.h"
+#endif
 
 // Driver includes
 #include "drivers/uart/uart_driver.h"
 #include "drivers/tcp/tcp_driver.h"
+#include "drivers/tcp/tcp_batch.h"
+#if DUAL_CORE
+#include "drivers/core/core_link.h"
+#endif
 
 // Project includes
+#include "log/log.h"
+#include "trace/trace.h"
 #include "pico_tasks.h"
 
-#define HEARTBEAT_MS 500
-
-QueueHandle_t xQueueUART = NULL;
 StreamBufferHandle_t xStreamBufferTCP = NULL;
 
+TaskHandle_t xTaskTCP = NULL;
+
 int main()
 {
+    // Ready the trace before the UART interrupt and the first task
+    TRACE_INIT();
+
     // Setup the USB as as a serial port
     stdio_usb_init();
 
-    // Initialize the UART settings
+#if !DUAL_CORE
+    // Initialize the UART settings; with two cores this is done on core 1
     vInitUART(NULL);
+#endif
 
     // Delay to allow for the USB serial to be ready
     sleep_ms(5000);
 
+#if PICO_CYW43_ARCH_POLL
+    // The background arches bring up WiFi in vTaskTCP, once the scheduler runs
     printf("<main> Initialising WiFi...\n");
-    if(xInitSTA(NULL) != pdPASS)
+    BaseType_t xWiFi = xInitSTA(NULL);
+
+    // Its messages are logged; write them out before ours, vTaskLog does not run yet
+    vLogFlush();
+    if(xWiFi != pdPASS)
     {
         printf("<main> WiFi failed to initialise!\n");
         exit(1);
     }
+#endif
 
     printf("<main> Starting FreeRTOS...\n");
 
+#if PICO_CYW43_ARCH_POLL
     xTaskCreate(vTaskHeartbeat, "Heartbeat Task", configMINIMAL_STACK_SIZE, (void *)HEARTBEAT_MS, 1, NULL);
-    xTaskCreate(vTaskUART, "UART Task", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-    xTaskCreate(vTaskTCP, "TCP Task", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-
-    // Set up a queue for transferring command from the
-    // UART interrupt handler to the UART task.
-    xQueueUART = xQueueCreate(80, sizeof(char));
-
-    xStreamBufferTCP = xStreamBufferCreate(MAX_RX_STR_LEN, 4);
+#endif
+#if DUAL_CORE
+    // Core 1 runs the meter ingest outside of FreeRTOS; its records arrive through the core link
+    vCoreLinkInit();
+    xTaskCreate(vTaskCoreLink, "Core Link Task", configMINIMAL_STACK_SIZE, NULL, 2, NULL);
+#else
+    // The UART task runs above the others so a completed line is handled as soon as the ISR wakes it
+    xTaskCreate(vTaskUART, "UART Task", configMINIMAL_STACK_SIZE, NULL, 2, NULL);
+#endif
+    xTaskCreate(vTaskTCP, "TCP Task", configMINIMAL_STACK_SIZE, NULL, 1, &xTaskTCP);
+
+    // Log records are formatted and written out below the meter ingest, snprintf() needs the larger stack
+    xTaskCreate(vTaskLog, "Log Task", configMINIMAL_STACK_SIZE * 2, NULL, 1, NULL);
+
+    // Records are queued whole for the uplink task, which batches them into segments
+    xStreamBufferTCP = xStreamBufferCreate(TCP_TX_BUFFER_LEN, 1);
+    TRACE_OBJECT_NAME(xStreamBufferTCP, "TCP stream");
+
+#if DUAL_CORE
+    // Start core 1 once everything it hands records to exists
+    multicore_launch_core1(vCore1Ingest);
+#endif
 
     vTaskStartScheduler();
 
@@ -0,0 +1,184 @@
+/**
+ * @file flow_stats.c
+ *
+ * @brief Source file for the per usage event flow statistics.
+ *
+ * The running mean is kept in milli-units with FLOW_STATS_MEAN_FRAC_BITS
+ * fractional bits. The sum of weighted squared deviations (m2) is kept in
+ * milli-units squared times milliseconds and saturates instead of wrapping;
+ * at 100 units of flow it lasts for weeks of continuous use.
+ */
+
+// Project includes
+#include "flow_stats.h"
+
+/**
+ * @brief Integer square root, rounded down.
+ *
+ * @param ullValue Value to take the root of.
+ *
+ * @return floor(sqrt(ullValue)).
+ */
+static uint32_t prvSqrt64(uint64_t ullValue)
+{
+    uint64_t ullRoot = 0;
+    uint64_t ullBit = 1ULL << 62;
+
+    while (ullBit > ullValue)
+    {
+        ullBit >>= 2;
+    }
+
+    while (ullBit != 0)
+    {
+        if (ullValue >= ullRoot + ullBit)
+        {
+            ullValue -= ullRoot + ullBit;
+            ullRoot = (ullRoot >> 1) + ullBit;
+        }
+        else
+        {
+            ullRoot >>= 1;
+        }
+        ullBit >>= 2;
+    }
+
+    return (uint32_t)ullRoot;
+}
+
+/**
+ * @brief Fold the last sample into the mean and variance.
+ *
+ * @param pxStats Statistics to update.
+ * @param ulTimeMs Time the last sample stopped holding.
+ *
+ * @return None.
+ */
+static void prvFoldLast(FLOW_STATS_T *pxStats, uint32_t ulTimeMs)
+{
+    uint32_t ulHold = ulTimeMs - pxStats->last_ms;
+
+    if (pxStats->count == 0 || ulHold == 0)
+    {
+        return;
+    }
+
+    if (ulHold > FLOW_STATS_MAX_HOLD_MS)
+    {
+        ulHold = FLOW_STATS_MAX_HOLD_MS;
+    }
+
+    // West (1979): mean += w * delta / W; m2 += w * delta * (x - new mean)
+    int64_t llSample = (int64_t)pxStats->last_flow_milli << FLOW_STATS_MEAN_FRAC_BITS;
+    int64_t llDelta = llSample - pxStats->mean_q;
+
+    pxStats->weight_ms += ulHold;
+    pxStats->mean_q += llDelta * (int64_t)ulHold / (int64_t)pxStats->weight_ms;
+
+    // Deviations are back in whole milli-units before they are multiplied
+    int64_t llDeviation = (llDelta >> FLOW_STATS_MEAN_FRAC_BITS) *
+                          ((llSample - pxStats->mean_q) >> FLOW_STATS_MEAN_FRAC_BITS);
+    uint64_t ullTerm = (uint64_t)(llDeviation < 0 ? 0 : llDeviation) * ulHold;
+
+    pxStats->m2 = (UINT64_MAX - pxStats->m2 < ullTerm) ? UINT64_MAX : pxStats->m2 + ullTerm;
+}
+
+/**
+ * @brief Reset the statistics for a new usage event.
+ *
+ * @param pxStats Statistics to reset.
+ *
+ * @return None.
+ */
+void vFlowStatsReset(FLOW_STATS_T *pxStats)
+{
+    *pxStats = (FLOW_STATS_T){0};
+}
+
+/**
+ * @brief Add a flow sample to the statistics.
+ *
+ * The previous sample is folded into the mean and variance, weighted by the
+ * time it held; this sample is held until the next call or vFlowStatsFinish().
+ *
+ * @param pxStats Statistics to update.
+ * @param ulTimeMs Time of the sample in milliseconds, from any free running clock.
+ * @param lFlowMilli Flow in milli-units.
+ *
+ * @return None.
+ */
+void vFlowStatsAdd(FLOW_STATS_T *pxStats, uint32_t ulTimeMs, int32_t lFlowMilli)
+{
+    if (pxStats->count == 0)
+    {
+        pxStats->start_ms = ulTimeMs;
+        pxStats->min_flow_milli = lFlowMilli;
+        pxStats->max_flow_milli = lFlowMilli;
+        pxStats->mean_q = (int64_t)lFlowMilli << FLOW_STATS_MEAN_FRAC_BITS;
+    }
+    else
+    {
+        prvFoldLast(pxStats, ulTimeMs);
+
+        if (lFlowMilli < pxStats->min_flow_milli)
+        {
+            pxStats->min_flow_milli = lFlowMilli;
+        }
+        if (lFlowMilli > pxStats->max_flow_milli)
+        {
+            pxStats->max_flow_milli = lFlowMilli;
+        }
+    }
+
+    pxStats->last_ms = ulTimeMs;
+    pxStats->last_flow_milli = lFlowMilli;
+    pxStats->count++;
+}
+
+/**
+ * @brief End the usage event, closing the hold time of the last sample.
+ *
+ * @param pxStats Statistics to update.
+ * @param ulTimeMs Time the event ended, on the same clock as vFlowStatsAdd().
+ *
+ * @return None.
+ */
+void vFlowStatsFinish(FLOW_STATS_T *pxStats, uint32_t ulTimeMs)
+{
+    prvFoldLast(pxStats, ulTimeMs);
+    pxStats->last_ms = ulTimeMs;
+}
+
+/**
+ * @brief Summarise the statistics of the usage event.
+ *
+ * If no time has been accumulated yet (a single sample, or all samples at the
+ * same time), the mean falls back to the last sample and the variance is 0.
+ *
+ * @param pxStats Statistics to summarise.
+ * @param pxSummary Destination for the summary.
+ *
+ * @return None.
+ */
+void vFlowStatsSummary(const FLOW_STATS_T *pxStats, FLOW_SUMMARY_T *pxSummary)
+{
+    pxSummary->count = pxStats->count;
+    pxSummary->min_flow_milli = pxStats->min_flow_milli;
+    pxSummary->max_flow_milli = pxStats->max_flow_milli;
+    pxSummary->duration_ms = pxStats->count == 0 ? 0 : pxStats->last_ms - pxStats->start_ms;
+
+    if (pxStats->weight_ms == 0)
+    {
+        pxSummary->mean_flow_milli = pxStats->last_flow_milli;
+        pxSummary->variance_milli2 = 0;
+    }
+    else
+    {
+        // Round the mean to the nearest milli-unit
+        int64_t llHalf = (int64_t)1 << (FLOW_STATS_MEAN_FRAC_BITS - 1);
+        pxSummary->mean_flow_milli = (int32_t)((pxStats->mean_q + llHalf) >> FLOW_STATS_MEAN_FRAC_BITS);
+        pxSummary->variance_milli2 = pxStats->m2 / pxStats->weight_ms;
+    }
+
+    pxSummary->stddev_flow_milli = (int32_t)prvSqrt64(pxSummary->variance_milli2);
+}
@@ -0,0 +1,94 @@
+/**
+ * @file flow_stats.h
+ *
+ * @brief Header file for the per usage event flow statistics.
+ *
+ * Flow samples are treated as a step function: each sample holds from its own
+ * timestamp until the next one arrives. Mean and variance are weighted by that
+ * hold time using West's weighted form of Welford's algorithm, in fixed point,
+ * so every sample costs O(1) with no allocation and no floating point.
+ */
+
+#ifndef FLOW_STATS_H_
+#define FLOW_STATS_H_
+
+#include <stdint.h>
+
+// Longest time a sample is assumed to hold; longer gaps (a stalled meter) are capped
+#define FLOW_STATS_MAX_HOLD_MS 10000
+
+// Fractional bits kept in the running mean
+#define FLOW_STATS_MEAN_FRAC_BITS 16
+
+// Type definitions
+typedef struct FLOW_STATS_T_
+{
+    uint32_t start_ms;
+    uint32_t last_ms;
+    int32_t last_flow_milli;
+    int32_t min_flow_milli;
+    int32_t max_flow_milli;
+    uint32_t count;
+    uint64_t weight_ms;
+    int64_t mean_q;
+    uint64_t m2;
+} FLOW_STATS_T;
+
+typedef struct FLOW_SUMMARY_T_
+{
+    int32_t mean_flow_milli;
+    int32_t min_flow_milli;
+    int32_t max_flow_milli;
+    int32_t stddev_flow_milli;
+    uint64_t variance_milli2;
+    uint32_t duration_ms;
+    uint32_t count;
+} FLOW_SUMMARY_T;
+
+/**
+ * @brief Reset the statistics for a new usage event.
+ *
+ * @param pxStats Statistics to reset.
+ *
+ * @return None.
+ */
+void vFlowStatsReset(FLOW_STATS_T *pxStats);
+
+/**
+ * @brief Add a flow sample to the statistics.
+ *
+ * The previous sample is folded into the mean and variance, weighted by the
+ * time it held; this sample is held until the next call or vFlowStatsFinish().
+ *
+ * @param pxStats Statistics to update.
+ * @param ulTimeMs Time of the sample in milliseconds, from any free running clock.
+ * @param lFlowMilli Flow in milli-units.
+ *
+ * @return None.
+ */
+void vFlowStatsAdd(FLOW_STATS_T *pxStats, uint32_t ulTimeMs, int32_t lFlowMilli);
+
+/**
+ * @brief End the usage event, closing the hold time of the last sample.
+ *
+ * @param pxStats Statistics to update.
+ * @param ulTimeMs Time the event ended, on the same clock as vFlowStatsAdd().
+ *
+ * @return None.
+ */
+void vFlowStatsFinish(FLOW_STATS_T *pxStats, uint32_t ulTimeMs);
+
+/**
+ * @brief Summarise the statistics of the usage event.
+ *
+ * If no time has been accumulated yet (a single sample, or all samples at the
+ * same time), the mean falls back to the last sample and the variance is 0.
+ *
+ * @param pxStats Statistics to summarise.
+ * @param pxSummary Destination for the summary.
+ *
+ * @return None.
+ */
+void vFlowStatsSummary(const FLOW_STATS_T *pxStats, FLOW_SUMMARY_T *pxSummary);
+
+#endif /* FLOW_STATS_H_ */
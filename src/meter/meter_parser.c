@@ -0,0 +1,210 @@
+/**
+ * @file meter_parser.c
+ *
+ * @brief Source file for the flow meter line parser.
+ *
+ * Parsing works directly on the caller's line buffer with integer arithmetic
+ * only, which matters on the Cortex-M0+ where atof() and printf("%f") are
+ * implemented in soft-float and dominate the cost of handling a line.
+ */
+
+// Standard includes
+#include <stdbool.h>
+#include <stdint.h>
+
+// Project includes
+#include "meter_parser.h"
+
+// Maximum number of integer digits, enough for METER_MAX_VOLUME_MILLI; the value is scaled in 64 bits
+#define METER_MAX_INT_DIGITS 7
+
+/**
+ * @brief Check whether a character is whitespace the parser skips.
+ *
+ * @param c Character to check.
+ *
+ * @return true for space, tab and line feed.
+ */
+static inline bool prvIsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+/**
+ * @brief Parse one unsigned decimal field into milli-units.
+ *
+ * @param ppcCursor Current position, advanced past the field.
+ * @param pcEnd End of the line.
+ * @param plMilli Destination for the value.
+ *
+ * @return METER_PARSE_OK, or METER_PARSE_MALFORMED / METER_PARSE_OUT_OF_RANGE.
+ */
+static METER_PARSE_RESULT_T prvParseField(const char **ppcCursor, const char *pcEnd, int32_t *plMilli)
+{
+    const char *pc = *ppcCursor;
+    uint32_t ulInteger = 0;
+    uint32_t ulFraction = 0;
+    uint32_t ulScale = METER_SCALE;
+    uint64_t ullMilli;
+    int iIntDigits = 0;
+    int iFracDigits = 0;
+
+    while (pc < pcEnd && *pc >= '0' && *pc <= '9')
+    {
+        if (++iIntDigits > METER_MAX_INT_DIGITS)
+        {
+            return METER_PARSE_OUT_OF_RANGE;
+        }
+        ulInteger = ulInteger * 10 + (uint32_t)(*pc++ - '0');
+    }
+
+    if (pc < pcEnd && *pc == '.')
+    {
+        pc++;
+        while (pc < pcEnd && *pc >= '0' && *pc <= '9')
+        {
+            // Keep three decimal places, the rest only has to be digits
+            if (ulScale > 1)
+            {
+                ulScale /= 10;
+                ulFraction += (uint32_t)(*pc - '0') * ulScale;
+            }
+            pc++;
+            iFracDigits++;
+        }
+    }
+
+    // A field needs at least one digit on either side of the point
+    if (iIntDigits == 0 && iFracDigits == 0)
+    {
+        return METER_PARSE_MALFORMED;
+    }
+
+    // Seven digits times the scale overflow 32 bits, so range check before narrowing
+    ullMilli = (uint64_t)ulInteger * METER_SCALE + ulFraction;
+    if (ullMilli > INT32_MAX)
+    {
+        return METER_PARSE_OUT_OF_RANGE;
+    }
+
+    *plMilli = (int32_t)ullMilli;
+    *ppcCursor = pc;
+
+    return METER_PARSE_OK;
+}
+
+/**
+ * @brief Parse a "total volume,flow" line into fixed point values.
+ *
+ * Each field is an unsigned decimal number with an optional fractional part.
+ * Digits beyond the third decimal place are checked but truncated. Leading
+ * whitespace (such as the '\n' of a "\r\n" terminated meter) and trailing
+ * whitespace are ignored; anything else, including a missing or extra field,
+ * makes the line malformed. The line is only read, never modified.
+ *
+ * @param pcLine Line to parse, without its terminator.
+ * @param xLen Number of characters in pcLine.
+ * @param pxSample Destination for the parsed values, only written on success.
+ *
+ * @return METER_PARSE_OK on success, METER_PARSE_MALFORMED if the line does not
+ *         have the expected format, METER_PARSE_OUT_OF_RANGE if a value exceeds
+ *         METER_MAX_VOLUME_MILLI or METER_MAX_FLOW_MILLI.
+ */
+METER_PARSE_RESULT_T eMeterParseLine(const char *pcLine, size_t xLen, METER_SAMPLE_T *pxSample)
+{
+    const char *pc = pcLine;
+    const char *pcEnd = pcLine + xLen;
+    METER_PARSE_RESULT_T eResult;
+    int32_t lVolume;
+    int32_t lFlow;
+
+    while (pc < pcEnd && prvIsSpace(*pc))
+    {
+        pc++;
+    }
+
+    if ((eResult = prvParseField(&pc, pcEnd, &lVolume)) != METER_PARSE_OK)
+    {
+        return eResult;
+    }
+
+    if (pc >= pcEnd || *pc++ != ',')
+    {
+        return METER_PARSE_MALFORMED;
+    }
+
+    if ((eResult = prvParseField(&pc, pcEnd, &lFlow)) != METER_PARSE_OK)
+    {
+        return eResult;
+    }
+
+    while (pc < pcEnd && prvIsSpace(*pc))
+    {
+        pc++;
+    }
+
+    if (pc != pcEnd)
+    {
+        return METER_PARSE_MALFORMED;
+    }
+
+    if (lVolume > METER_MAX_VOLUME_MILLI || lFlow > METER_MAX_FLOW_MILLI)
+    {
+        return METER_PARSE_OUT_OF_RANGE;
+    }
+
+    pxSample->volume_milli = lVolume;
+    pxSample->flow_milli = lFlow;
+
+    return METER_PARSE_OK;
+}
+
+/**
+ * @brief Format a fixed point milli-unit value with two decimal places.
+ *
+ * The value is rounded half away from zero to hundredths, matching what
+ * printf("%.2f") produces for the equivalent float.
+ *
+ * @param pcBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param lMilli Value in milli-units.
+ *
+ * @return Number of characters written, excluding the terminator, or 0 if the
+ *         buffer is too small.
+ */
+size_t xMeterFormatMilli(char *pcBuffer, size_t xBufferLen, int32_t lMilli)
+{
+    char cDigits[12];
+    size_t xDigits = 0;
+    size_t xLen = 0;
+    bool xNegative = lMilli < 0;
+    uint32_t ulCenti = ((xNegative ? (uint32_t)0 - (uint32_t)lMilli : (uint32_t)lMilli) + 5) / 10;
+
+    // Produce the digits in reverse, always at least "0.00"
+    do
+    {
+        cDigits[xDigits++] = (char)('0' + ulCenti % 10);
+        ulCenti /= 10;
+    } while (ulCenti > 0 || xDigits < 3);
+
+    if (xDigits + (xNegative ? 2 : 1) + 1 > xBufferLen)
+    {
+        return 0;
+    }
+
+    if (xNegative)
+    {
+        pcBuffer[xLen++] = '-';
+    }
+    while (xDigits > 0)
+    {
+        pcBuffer[xLen++] = cDigits[--xDigits];
+        if (xDigits == 2)
+        {
+            pcBuffer[xLen++] = '.';
+        }
+    }
+    pcBuffer[xLen] = '\0';
+
+    return xLen;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file meter_parser.h
+ *
+ * @brief Header file for the flow meter line parser.
+ *
+ * The meter reports "total volume,flow" as two decimal numbers per line. This
+ * module parses such a line in place into fixed point integers in thousandths
+ * (milli-units) without allocating, copying or using floating point, and
+ * formats fixed point values back to text for outbound records.
+ */
+
+#ifndef METER_PARSER_H_
+#define METER_PARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed point scale of parsed values (milli-units)
+#define METER_SCALE 1000
+
+// Largest accepted values, in milli-units
+#define METER_MAX_VOLUME_MILLI 1000000000L
+#define METER_MAX_FLOW_MILLI 10000000L
+
+// Buffer size that holds any value formatted by xMeterFormatMilli
+#define METER_FIELD_STR_LEN 16
+
+// Type definitions
+typedef enum
+{
+    METER_PARSE_OK = 0,
+    METER_PARSE_MALFORMED,
+    METER_PARSE_OUT_OF_RANGE,
+} METER_PARSE_RESULT_T;
+
+typedef struct METER_SAMPLE_T_
+{
+    int32_t volume_milli;
+    int32_t flow_milli;
+} METER_SAMPLE_T;
+
+/**
+ * @brief Parse a "total volume,flow" line into fixed point values.
+ *
+ * Each field is an unsigned decimal number with an optional fractional part.
+ * Digits beyond the third decimal place are checked but truncated. Leading
+ * whitespace (such as the '\n' of a "\r\n" terminated meter) and trailing
+ * whitespace are ignored; anything else, including a missing or extra field,
+ * makes the line malformed. The line is only read, never modified.
+ *
+ * @param pcLine Line to parse, without its terminator.
+ * @param xLen Number of characters in pcLine.
+ * @param pxSample Destination for the parsed values, only written on success.
+ *
+ * @return METER_PARSE_OK on success, METER_PARSE_MALFORMED if the line does not
+ *         have the expected format, METER_PARSE_OUT_OF_RANGE if a value exceeds
+ *         METER_MAX_VOLUME_MILLI or METER_MAX_FLOW_MILLI.
+ */
+METER_PARSE_RESULT_T eMeterParseLine(const char *pcLine, size_t xLen, METER_SAMPLE_T *pxSample);
+
+/**
+ * @brief Format a fixed point milli-unit value with two decimal places.
+ *
+ * The value is rounded half away from zero to hundredths, matching what
+ * printf("%.2f") produces for the equivalent float.
+ *
+ * @param pcBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param lMilli Value in milli-units.
+ *
+ * @return Number of characters written, excluding the terminator, or 0 if the
+ *         buffer is too small.
+ */
+size_t xMeterFormatMilli(char *pcBuffer, size_t xBufferLen, int32_t lMilli);
+
+#endif /* METER_PARSER_H_ */
@@ -0,0 +1,94 @@
+/**
+ * @file volume_tracker.c
+ *
+ * @brief Source file for local accounting of the meter's cumulative volume.
+ */
+
+// Project includes
+#include "volume_tracker.h"
+
+/**
+ * @brief Reset the tracker, the next reading becomes the baseline.
+ *
+ * @param pxTracker Tracker to reset.
+ *
+ * @return None.
+ */
+void vVolumeTrackerReset(VOLUME_TRACKER_T *pxTracker)
+{
+    *pxTracker = (VOLUME_TRACKER_T){0};
+}
+
+/**
+ * @brief Account a cumulative volume reading from the meter.
+ *
+ * The volume since the previous reading is added to the pending volume. The
+ * first reading after a reset only sets the baseline, and so does a reading
+ * that would account more than METER_MAX_STEP_MILLI, which is counted as a
+ * resync.
+ *
+ * @param pxTracker Tracker to update.
+ * @param lVolumeMilli Cumulative volume reported by the meter, in milli-units.
+ *
+ * @return The volume since the previous reading, in milli-units.
+ */
+int32_t lVolumeTrackerUpdate(VOLUME_TRACKER_T *pxTracker, int32_t lVolumeMilli)
+{
+    int32_t lDelta = 0;
+
+    if (!pxTracker->synced)
+    {
+        pxTracker->synced = true;
+    }
+    else if (lVolumeMilli >= pxTracker->last_volume_milli)
+    {
+        if (lVolumeMilli - pxTracker->last_volume_milli <= METER_MAX_STEP_MILLI)
+        {
+            lDelta = lVolumeMilli - pxTracker->last_volume_milli;
+        }
+        else
+        {
+            // More than can pass between two readings, such as a corrupted line; only the baseline moves
+            pxTracker->resyncs++;
+        }
+    }
+    else if (pxTracker->last_volume_milli < METER_VOLUME_WRAP_MILLI &&
+             METER_VOLUME_WRAP_MILLI - pxTracker->last_volume_milli + lVolumeMilli <= METER_MAX_STEP_MILLI)
+    {
+        // The counter rolled over, count up to the wrap and on from 0
+        lDelta = METER_VOLUME_WRAP_MILLI - pxTracker->last_volume_milli + lVolumeMilli;
+        pxTracker->wraps++;
+    }
+    else if (lVolumeMilli <= METER_MAX_STEP_MILLI)
+    {
+        // The meter restarted, everything it reports now was counted from 0
+        lDelta = lVolumeMilli;
+        pxTracker->restarts++;
+    }
+    else
+    {
+        // Too far back for a wrap and too far from 0 for a restart, such as the reading after a corrupted one
+        pxTracker->resyncs++;
+    }
+
+    pxTracker->last_volume_milli = lVolumeMilli;
+    pxTracker->pending_milli += lDelta;
+
+    return lDelta;
+}
+
+/**
+ * @brief Take the volume accounted since the last call.
+ *
+ * @param pxTracker Tracker to take the pending volume from.
+ *
+ * @return The pending volume in milli-units, which is then reset to 0.
+ */
+int32_t lVolumeTrackerTake(VOLUME_TRACKER_T *pxTracker)
+{
+    int32_t lPending = pxTracker->pending_milli;
+
+    pxTracker->pending_milli = 0;
+
+    return lPending;
+}
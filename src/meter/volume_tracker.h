@@ -0,0 +1,73 @@
+/**
+ * @file volume_tracker.h
+ *
+ * @brief Header file for local accounting of the meter's cumulative volume.
+ *
+ * Instead of clearing the meter after every usage event, the cumulative volume
+ * it reports is turned into deltas locally. A reading below the previous one is
+ * either the counter rolling over at METER_VOLUME_WRAP_MILLI or the meter having
+ * restarted from zero; both are accounted without losing volume. A step in
+ * either direction larger than METER_MAX_STEP_MILLI is not accounted, so a
+ * single corrupted reading cannot add a bogus volume.
+ */
+
+#ifndef VOLUME_TRACKER_H_
+#define VOLUME_TRACKER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Set to 1 to clear the meter with "clear\r" after every usage event instead of tracking deltas
+#define METER_RESET_ON_EVENT 0
+
+// Value at which the meter's volume counter rolls over to 0, in milli-units
+#define METER_VOLUME_WRAP_MILLI 100000000L
+
+// Largest volume that can plausibly pass between two readings, in milli-units
+#define METER_MAX_STEP_MILLI 1000000L
+
+// Type definitions
+typedef struct VOLUME_TRACKER_T_
+{
+    int32_t last_volume_milli;
+    int32_t pending_milli;
+    bool synced;
+    uint32_t wraps;
+    uint32_t restarts;
+    uint32_t resyncs;
+} VOLUME_TRACKER_T;
+
+/**
+ * @brief Reset the tracker, the next reading becomes the baseline.
+ *
+ * @param pxTracker Tracker to reset.
+ *
+ * @return None.
+ */
+void vVolumeTrackerReset(VOLUME_TRACKER_T *pxTracker);
+
+/**
+ * @brief Account a cumulative volume reading from the meter.
+ *
+ * The volume since the previous reading is added to the pending volume. The
+ * first reading after a reset only sets the baseline, and so does a reading
+ * that would account more than METER_MAX_STEP_MILLI, which is counted as a
+ * resync.
+ *
+ * @param pxTracker Tracker to update.
+ * @param lVolumeMilli Cumulative volume reported by the meter, in milli-units.
+ *
+ * @return The volume since the previous reading, in milli-units.
+ */
+int32_t lVolumeTrackerUpdate(VOLUME_TRACKER_T *pxTracker, int32_t lVolumeMilli);
+
+/**
+ * @brief Take the volume accounted since the last call.
+ *
+ * @param pxTracker Tracker to take the pending volume from.
+ *
+ * @return The pending volume in milli-units, which is then reset to 0.
+ */
+int32_t lVolumeTrackerTake(VOLUME_TRACKER_T *pxTracker);
+
+#endif /* VOLUME_TRACKER_H_ */
@@ -10,7 +10,8 @@
 #include <stream_buffer.h>
 
 // Standard includes
-#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Pico includes
@@ -22,25 +23,45 @@
 // #include "lwip/pbuf.h"
 // #include "lwip/tcp.h"
 
+#if DUAL_CORE
+#include "pico/time.h"
+#include "pico/flash.h"
+#endif
+
 // Driver includes
 #include "drivers/uart/uart_driver.h"
+#if DUAL_CORE
+#include "drivers/core/core_link.h"
+#endif
 #include "drivers/tcp/tcp_driver.h"
+#include "drivers/tcp/tcp_batch.h"
+#include "drivers/tcp/tcp_downlink.h"
+#include "drivers/flash/outbox.h"
+
+// Meter includes
+#include "meter/meter_parser.h"
+#include "meter/flow_stats.h"
+#include "meter/volume_tracker.h"
 
 // Project includes
+#include "log/log.h"
+#include "telemetry/telemetry.h"
+#include "trace/trace.h"
 #include "pico_tasks.h"
 
-// Queue Handles
-extern QueueHandle_t xQueueUART; // Queue handle for UART messages (defined elsewhere)
-
 // Stream Buffers
 extern StreamBufferHandle_t xStreamBufferTCP; // Stream buffer handle for TCP messages (defined elsewhere)
 
+// Tasks
+extern TaskHandle_t xTaskTCP; // Uplink task handle, woken when a record is queued (defined elsewhere)
+
 /**
  * @brief Task that toggles an LED at a regular interval.
  *
  * This task toggles the onboard LED at a regular interval, specified by the
  * parameter passed to the task. The task uses xTaskDelayUntil to delay until
- * the next execution time.
+ * the next execution time. A heartbeat_ms command from the controller changes
+ * the interval from the next toggle.
  *
  * @param pvParameters A pointer to the delay time in milliseconds.
  *
@@ -48,8 +69,11 @@ extern StreamBufferHandle_t xStreamBufferTCP; // Stream buffer handle for TCP me
  */
 void vTaskHeartbeat(void *pvParameters)
 {
-    // Constant delay for parameter time
-    const TickType_t xDelay = pdMS_TO_TICKS((int)pvParameters);
+    // Delay for parameter time, until the controller sets another
+    TickType_t xDelay = pdMS_TO_TICKS((uintptr_t)pvParameters);
+
+    // Command from the controller
+    WIRE_COMMAND_T xCommand;
 
     // Get the current tick count
     TickType_t xLastWakeTime = xTaskGetTickCount();
@@ -62,19 +86,118 @@ void vTaskHeartbeat(void *pvParameters)
         // Toggle onboard LED
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, (xLEDState = !xLEDState));
 
+        // Apply a new interval, heartbeat_ms is the only command sent here
+        while (xTCPDownlinkReceive(TCP_DOWNLINK_HEARTBEAT, &xCommand))
+        {
+            uint32_t ulMs = xCommand.value;
+
+            if (ulMs < TCP_DOWNLINK_MIN_HEARTBEAT_MS)
+            {
+                ulMs = TCP_DOWNLINK_MIN_HEARTBEAT_MS;
+            }
+            else if (ulMs > TCP_DOWNLINK_MAX_HEARTBEAT_MS)
+            {
+                ulMs = TCP_DOWNLINK_MAX_HEARTBEAT_MS;
+            }
+
+            xDelay = pdMS_TO_TICKS(ulMs);
+            LOG_INFO("<vTaskHeartbeat> Interval %lu ms\n", (unsigned long)ulMs);
+        }
+
         // Delay for parameter time
         xTaskDelayUntil(&xLastWakeTime, xDelay);
     }
 }
 
 /**
- * @brief This function is a task that processes incoming data from a UART queue and calculates the average flow.
+ * @brief Close a usage event and queue its record for the uplink.
+ *
+ * @param pxFlowStats Flow statistics of the event, reset afterwards.
+ * @param lVolumeMilli Volume used during the event, in milli-units.
+ * @param ulNowMs Time the event ended.
+ *
+ * @return None.
+ */
+static void prvSendUsageEvent(FLOW_STATS_T *pxFlowStats, int32_t lVolumeMilli, uint32_t ulNowMs)
+{
+    FLOW_SUMMARY_T xSummary;
+
+    // Formatted fields for the console
+    static char cVolume[METER_FIELD_STR_LEN];
+    static char cMean[METER_FIELD_STR_LEN];
+    static char cMin[METER_FIELD_STR_LEN];
+    static char cMax[METER_FIELD_STR_LEN];
+    static char cStdDev[METER_FIELD_STR_LEN];
+
+    vFlowStatsFinish(pxFlowStats, ulNowMs);
+    vFlowStatsSummary(pxFlowStats, &xSummary);
+
+    if (xSummary.count > 0)
+    {
+        xMeterFormatMilli(cVolume, sizeof(cVolume), lVolumeMilli);
+        xMeterFormatMilli(cMean, sizeof(cMean), xSummary.mean_flow_milli);
+        xMeterFormatMilli(cMin, sizeof(cMin), xSummary.min_flow_milli);
+        xMeterFormatMilli(cMax, sizeof(cMax), xSummary.max_flow_milli);
+        xMeterFormatMilli(cStdDev, sizeof(cStdDev), xSummary.stddev_flow_milli);
+        LOG_INFO("<vTaskUART> Volume: %s, Mean Flow: %s (min %s, max %s, sd %s) over %lu ms, %lu samples\n",
+                 cVolume, cMean, cMin, cMax, cStdDev,
+                 (unsigned long)xSummary.duration_ms, (unsigned long)xSummary.count);
+
+        // The uplink task encodes the record in the wire format when it sends the batch
+        WIRE_RECORD_T xRecord = {
+            .time_ms = ulNowMs,
+            .volume_milli = lVolumeMilli,
+            .mean_flow_milli = xSummary.mean_flow_milli,
+            .min_flow_milli = xSummary.min_flow_milli,
+            .max_flow_milli = xSummary.max_flow_milli,
+            .stddev_flow_milli = xSummary.stddev_flow_milli,
+            .duration_ms = xSummary.duration_ms,
+            .count = xSummary.count,
+        };
+
+#if DUAL_CORE
+        // Core 1 cannot call FreeRTOS, vTaskCoreLink queues the record on core 0
+        if (!xCoreLinkSend(&xRecord))
+        {
+            LOG_WARN("<vTaskUART> Core link full, record dropped\n");
+        }
+#else
+        // Only queue whole records, the uplink task reads them back as structures
+        if (xStreamBufferSpacesAvailable(xStreamBufferTCP) < sizeof(xRecord))
+        {
+            LOG_WARN("<vTaskUART> TCP queue full, record dropped\n");
+        }
+        else
+        {
+            xStreamBufferSend(xStreamBufferTCP, (void *)&xRecord, sizeof(xRecord), 0);
+            TRACE_MARK(TRACE_MARK_RECORD, xRecord.time_ms);
+            xTaskNotifyIndexed(xTaskTCP, TCP_NOTIFY_INDEX, TCP_EVENT_RECORD, eSetBits);
+        }
+#endif
+    }
+
+    vFlowStatsReset(pxFlowStats);
+}
+
+/**
+ * @brief This function is a task that processes incoming data from the UART and calculates the flow statistics of each usage event.
+ *
+ * This task reads lines from the UART receive ring and processes them to calculate the flow statistics of each usage event. The
+ * incoming data is expected to be in the format "total volume,flow" and is parsed in place into fixed point milli-units. While
+ * water flows, each sample is added to time weighted statistics (mean, min, max, standard deviation, duration and sample count),
+ * which are sent to the TCP stream buffer when the flow stops. The volume of each event is accounted locally from the meter's
+ * cumulative total, so the meter is never reset and back-to-back events lose no samples. With METER_RESET_ON_EVENT set, the task
+ * instead sends a "clear" command to the device, which resets the total volume, then it discards received data until the meter
+ * reports zero volume.
+ * Receive overruns reported by the UART driver are printed as they occur.
  *
- * This task receives data from a queue and processes it to calculate the average flow. The incoming data is expected
- * to be in the format "total volume,flow" and is separated by a comma. The task then sends a
- * "clear" command to the device, which resets the total volume then it clears the queue and clears the average flow.
+ * The controller may clear the meter and set the flow thresholds of a usage event. An event starts once the flow
+ * exceeds the start threshold and lasts while it exceeds the stop threshold, which is at most the start threshold;
+ * both are 0 until set, so any flow counts. Commands are taken from the downlink with every line.
  *
- * If there is no data in the queue, the task waits for a fixed delay of 1 second before checking the queue again.
+ * The task is event driven: it blocks on the UART receive ring until the ISR signals that a line terminator
+ * has arrived, then handles every complete line before blocking again. In the DUAL_CORE build it runs on core 1
+ * outside of FreeRTOS, started by vCore1Ingest, sleeps in WFI instead and hands records to core 0 over the core link.
  *
  * @param pvParameters Unused parameter (required by FreeRTOS API).
  *
@@ -82,143 +205,530 @@ void vTaskHeartbeat(void *pvParameters)
  */
 void vTaskUART(__unused void *pvParameters)
 {
-    // Assert if the queue handle is NULL
-    configASSERT(xQueueUART == NULL);
+    // Now take the received lines and enable the UART to send interrupts
+    vUARTEnableRx();
 
-    // Constant delay for task
-    const TickType_t xDelay = pdMS_TO_TICKS(1000);
+    // Flow statistics of the current usage event
+    static FLOW_STATS_T xFlowStats;
 
-    // Get the current tick count
-    TickType_t xLastWakeTime = xTaskGetTickCount();
+    // Whether water is flowing, and the flow that starts and ends a usage event in milli-units
+    BaseType_t xInEvent = pdFALSE;
+    int32_t lFlowStartMilli = 0;
+    int32_t lFlowStopMilli = 0;
 
-    // Now enable the UART to send interrupts - RX only
-    uart_set_irq_enables(UART_ID, true, false);
+#if METER_RESET_ON_EVENT
+    // Used to clear the received data and total volume on device
+    BaseType_t xClearFlag = pdTRUE;
+#else
+    // Volume accounted from the meter's cumulative total
+    static VOLUME_TRACKER_T xVolumeTracker;
 
-    // Used to calculate average flow
-    float xAverageFlow = 0;
+    vVolumeTrackerReset(&xVolumeTracker);
+#endif
 
-    // Used to clear the queue and total volume on device
-    BaseType_t xClearFlag = pdTRUE;
+    // Command from the controller
+    WIRE_COMMAND_T xCommand;
+
+    // Line reassembled from the UART receive ring
+    static UART_LINE_T xLine;
+
+    // Receive counters, used to report overruns as they happen
+    UART_STATS_T xStats;
+    UART_STATS_T xLastStats = {0};
 
     for (;;)
     {
-        // Check if there is any data in the UART queue
-        if (uxQueueMessagesWaiting(xQueueUART) > 0)
+        // Block until the ISR signals a complete line. Lines that are already
+        // buffered are returned without blocking, so every complete line is
+        // drained before the task waits again. Overlong lines are dropped.
+        BaseType_t xReceived = xUARTReadLine(&xLine, portMAX_DELAY);
+
+        // Apply the controller's commands before the line they may affect
+        while (xTCPDownlinkReceive(TCP_DOWNLINK_UART, &xCommand))
         {
-            // Allocate memory for buffer to hold incoming data
-            char *xQueueBuffer = calloc(MAX_RX_STR_LEN, sizeof(char));
-            BaseType_t xQueueBufferIndex = 0;
-            char cIn;
+            int32_t lValue = xCommand.value > INT32_MAX ? INT32_MAX : (int32_t)xCommand.value;
 
-            // Loop until a null character is found
-            do
+            switch (xCommand.id)
             {
-                // Attempt to receive a character from the UART queue
-                if (xQueueReceive(xQueueUART, &cIn, (TickType_t)0) == pdPASS)
+            case WIRE_CMD_CLEAR:
+#if METER_RESET_ON_EVENT
+                // The event in progress is dropped, its volume is lost with the meter's total
+                vFlowStatsReset(&xFlowStats);
+                xInEvent = pdFALSE;
+                xClearFlag = pdTRUE;
+#else
+                // The tracker counts the drop to zero as a meter restart, so no volume is lost
+                uart_puts(UART_ID, "clear\r");
+#endif
+                break;
+            case WIRE_CMD_FLOW_START:
+                lFlowStartMilli = lValue;
+                if (lFlowStopMilli > lFlowStartMilli)
                 {
-                    // Add the received character to the buffer
-                    xQueueBuffer[xQueueBufferIndex++] = cIn;
+                    lFlowStopMilli = lFlowStartMilli;
                 }
-            } while (cIn != '\0');
+                break;
+            case WIRE_CMD_FLOW_STOP:
+                lFlowStopMilli = lValue > lFlowStartMilli ? lFlowStartMilli : lValue;
+                break;
+            default:
+                break;
+            }
+            LOG_INFO("<vTaskUART> Command %s, flow thresholds start %ld stop %ld\n", pcWireCommandName(xCommand.id),
+                     (long)lFlowStartMilli, (long)lFlowStopMilli);
+        }
 
-            // Extract the total volume and flow rate from the buffer
-            char *xTotalVolume = strtok_r(xQueueBuffer, ",", &xQueueBuffer);
-            char *xFlow = strtok_r(NULL, ",", &xQueueBuffer);
+        if (xReceived == pdPASS && !xLine.overflow)
+        {
+            METER_SAMPLE_T xSample;
+            BaseType_t xFlowing;
 
-            // Check if the total volume is greater than 0 and the flow rate is 0
-            if (atof(xFlow) == 0 && atof(xTotalVolume) > 0 && xClearFlag == pdFALSE)
+            // Extract the total volume and flow rate from the line, dropping malformed lines
+            if (eMeterParseLine(xLine.line, xLine.len, &xSample) != METER_PARSE_OK)
             {
-                if (xAverageFlow > 0)
-                {
-                    printf("<vTaskUART> Volume: %s, Average Flow: %.2f\n", xTotalVolume, xAverageFlow);
-                    char *xSendBuffer = calloc(MAX_RX_STR_LEN, sizeof(char));
-                    snprintf(xSendBuffer, sizeof(char) * MAX_RX_STR_LEN, "%s,%.2f,%s", xTotalVolume, xAverageFlow, DEVICE_ID);
-                    printf("<vTaskUART> Sending to TCP queue: %s\n", xSendBuffer);
-                    xStreamBufferSend(xStreamBufferTCP, (void *)xSendBuffer, strlen(xSendBuffer), 0);
-                    free(xSendBuffer);
-                }
-                // Clear the queue and reset the average flow
-                xQueueReset(xQueueUART);
-                xAverageFlow = 0;
+                continue;
+            }
+
+#if DUAL_CORE
+            // Sample time from the hardware timer, the tick count belongs to core 0
+            uint32_t ulNowMs = to_ms_since_boot(get_absolute_time());
+#else
+            // Sample time, wrapping along with the tick count
+            uint32_t ulNowMs = (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+#endif
+
+            // Hysteresis keeps an event from being split while the flow hovers around one threshold
+            xFlowing = xSample.flow_milli > (xInEvent == pdTRUE ? lFlowStopMilli : lFlowStartMilli);
+
+#if METER_RESET_ON_EVENT
+            // Check if the total volume is greater than 0 and the water stopped flowing
+            if (!xFlowing && xSample.volume_milli > 0 && xClearFlag == pdFALSE)
+            {
+                prvSendUsageEvent(&xFlowStats, xSample.volume_milli, ulNowMs);
+                xInEvent = pdFALSE;
+
+                // Clear the received data
+                vUARTFlush(&xLine);
 
                 // Set the clear flag
                 xClearFlag = pdTRUE;
             }
-            // Check if the flow rate is greater than 0 and the clear flag is false
-            else if (atof(xFlow) > 0 && xClearFlag == pdFALSE)
+            // Check if the water is flowing and the clear flag is false
+            else if (xFlowing && xClearFlag == pdFALSE)
             {
-                // Calculate the average flow
-                xAverageFlow = (xAverageFlow + atof(xFlow)) / 2;
+                // Accumulate the time weighted flow statistics
+                vFlowStatsAdd(&xFlowStats, ulNowMs, xSample.flow_milli);
+                xInEvent = pdTRUE;
             }
 
             // Check if the total volume is greater than 0 and the clear flag is true
-            if (atof(xTotalVolume) > 0 && xClearFlag == pdTRUE)
+            if (xSample.volume_milli > 0 && xClearFlag == pdTRUE)
             {
                 // Send a clear command to the device
                 uart_puts(UART_ID, "clear\r");
             }
             // Check if the total volume is 0 and the clear flag is true
-            else if (atof(xTotalVolume) == 0 && xClearFlag == pdTRUE)
+            else if (xSample.volume_milli == 0 && xClearFlag == pdTRUE)
             {
                 // Clear the clear flag
                 xClearFlag = pdFALSE;
             }
+#else
+            // Account the volume since the previous line, including counter wraps and meter restarts
+            lVolumeTrackerUpdate(&xVolumeTracker, xSample.volume_milli);
 
-            // Free all allocated memory
-            free(xQueueBuffer);
+            if (xFlowing)
+            {
+                // Accumulate the time weighted flow statistics
+                vFlowStatsAdd(&xFlowStats, ulNowMs, xSample.flow_milli);
+                xInEvent = pdTRUE;
+            }
+            else if (xInEvent == pdTRUE)
+            {
+                // The flow stopped, report everything counted since the previous event
+                prvSendUsageEvent(&xFlowStats, lVolumeTrackerTake(&xVolumeTracker), ulNowMs);
+                xInEvent = pdFALSE;
+            }
+#endif
+        }
+
+        // Report any bytes lost on the way in
+        vGetUARTStats(&xStats);
+        if (xStats.fifo_overruns != xLastStats.fifo_overruns || xStats.dropped_bytes != xLastStats.dropped_bytes)
+        {
+            LOG_WARN("<vTaskUART> RX overruns: FIFO %lu, buffer %lu bytes dropped\n",
+                     (unsigned long)xStats.fifo_overruns, (unsigned long)xStats.dropped_bytes);
+            xLastStats = xStats;
+        }
+    }
+}
+
+#if DUAL_CORE
+/**
+ * @brief Entry point of core 1, which runs the meter ingest outside of FreeRTOS.
+ *
+ * The UART is initialised here so that its interrupt is enabled on core 1, then
+ * vTaskUART runs for good. CYW43 and lwIP stay on core 0, so Wi-Fi work there
+ * never delays servicing the UART.
+ *
+ * @return None.
+ */
+void vCore1Ingest(void)
+{
+    // Core 1 executes from flash, so it is paused while core 0 writes the outbox
+    flash_safe_execute_core_init();
+
+    vInitUART(NULL);
+    vTaskUART(NULL);
+}
+#endif
+
+/**
+ * @brief Move the records queued for the uplink into the outbox.
+ *
+ * @param pxOutbox Outbox to append to.
+ *
+ * @return None.
+ */
+static void prvOutboxStore(OUTBOX_T *pxOutbox)
+{
+    WIRE_RECORD_T xRecord;
+
+    // Records are only ever queued whole
+    while (xStreamBufferReceive(xStreamBufferTCP, &xRecord, sizeof(xRecord), 0) == sizeof(xRecord))
+    {
+        if (!xOutboxAppend(pxOutbox, &xRecord))
+        {
+            LOG_WARN("<vTaskTCP> Outbox write failed, record dropped\n");
+        }
+    }
+}
+
+/**
+ * @brief Sample the device's health and send it as a telemetry frame.
+ *
+ * @param pxBatch Batch whose session the frame is sent on.
+ * @param pxOutbox Outbox whose backlog is reported.
+ * @param tcp_client Connected TCP client.
+ *
+ * @return pdPASS if the frame was written, pdFAIL otherwise.
+ */
+static BaseType_t prvTelemetrySend(TCP_BATCH_T *pxBatch, OUTBOX_T *pxOutbox, TCP_CLIENT_T *tcp_client)
+{
+    // Too large for the task's stack
+    static WIRE_TELEMETRY_T xTelemetry;
+    UART_STATS_T xUARTStats;
+
+    vTelemetrySample(&xTelemetry);
+
+    vGetUARTStats(&xUARTStats);
+    xTelemetry.uart_bytes = xUARTStats.pending;
+    xTelemetry.queued_records = (uint32_t)(xStreamBufferBytesAvailable(xStreamBufferTCP) / sizeof(WIRE_RECORD_T));
+#if DUAL_CORE
+    CORE_LINK_STATS_T xLinkStats;
+
+    vGetCoreLinkStats(&xLinkStats);
+    xTelemetry.queued_records += xLinkStats.pending;
+#endif
+    xTelemetry.batch_records = pxBatch->count + pxBatch->window_count;
+    xTelemetry.outbox_records = ulOutboxPending(pxOutbox);
+
+    return xTCPBatchSendTelemetry(pxBatch, tcp_client, &xTelemetry);
+}
+
+/**
+ * @brief Apply the controller's commands to the batching limits and the telemetry interval.
+ *
+ * @param pxBatch Batch whose limits the commands set.
+ * @param pulTelemetryMs Interval of the telemetry frames, 0 when they are stopped.
+ *
+ * @return None.
+ */
+static void prvTCPCommands(TCP_BATCH_T *pxBatch, uint32_t *pulTelemetryMs)
+{
+    WIRE_COMMAND_T xCommand;
+
+    while (xTCPDownlinkReceive(TCP_DOWNLINK_TCP, &xCommand))
+    {
+        switch (xCommand.id)
+        {
+        case WIRE_CMD_FLUSH_MS:
+            LOG_INFO("<vTaskTCP> Flush interval %lu ms\n", (unsigned long)ulTCPBatchSetFlushMs(pxBatch, xCommand.value));
+            break;
+        case WIRE_CMD_BATCH_RECORDS:
+            LOG_INFO("<vTaskTCP> Batch size %lu records\n", (unsigned long)ulTCPBatchSetMaxRecords(pxBatch, xCommand.value));
+            break;
+        case WIRE_CMD_TELEMETRY_MS:
+            *pulTelemetryMs = xCommand.value;
+            if (*pulTelemetryMs != 0 && *pulTelemetryMs < TCP_DOWNLINK_MIN_TELEMETRY_MS)
+            {
+                *pulTelemetryMs = TCP_DOWNLINK_MIN_TELEMETRY_MS;
+            }
+            else if (*pulTelemetryMs > TCP_DOWNLINK_MAX_TELEMETRY_MS)
+            {
+                *pulTelemetryMs = TCP_DOWNLINK_MAX_TELEMETRY_MS;
+            }
+            LOG_INFO("<vTaskTCP> Telemetry interval %lu ms\n", (unsigned long)*pulTelemetryMs);
+            break;
+        default:
+            break;
         }
-        // Delay for 500ms
-        xTaskDelayUntil(&xLastWakeTime, xDelay);
     }
 }
 
+/**
+ * @brief Task that sends the records queued by vTaskUART to the controller.
+ *
+ * The uplink is a connection state machine. In TCP_STATE_CONNECTING the task waits for the connected callback, and
+ * gives up after TCP_CONNECT_TIMEOUT_MS. In TCP_STATE_ESTABLISHED records are taken from the TCP stream buffer into a
+ * batch, which is encoded in the binary wire format and written as one segment once it is full or its oldest record
+ * has waited the flush interval. Both limits start at TCP_BATCH_MAX_RECORDS and TCP_BATCH_FLUSH_MS, and the
+ * controller may change them, which wakes the task with TCP_EVENT_COMMAND. Every connection starts a new wire format
+ * session. Records carry sequence numbers, and while the controller has not acknowledged some of them the client is
+ * in TCP_STATE_DRAINING, with up to TCP_WINDOW_RECORDS outstanding. A lost connection, a failed attempt or a
+ * controller that stops acknowledging for TCP_ACK_TIMEOUT_MS enters TCP_STATE_BACKOFF, and the next attempt is made
+ * after an exponentially growing delay.
+ *
+ * Without a connection the records go to the flash outbox instead, along with the unacknowledged ones. Once
+ * connected the outbox is replayed first, as many segments at a time as may be in flight, and new records queue
+ * behind it until it is empty. The controller's acknowledgements are recorded in the outbox, and it drops records
+ * that it sees again, so every record is taken exactly once.
+ *
+ * Transitions are signalled by the lwIP callbacks and vTaskUART through task notifications. Between them the task
+ * sleeps until the next deadline; with the poll arch, which still needs servicing, that is at most TCP_IDLE_POLL_MS,
+ * or TCP_POLL_MS while connecting or draining. The batching counters are printed after every segment.
+ *
+ * While connected a telemetry frame with the CPU share and stack of every task, the heap and the depth of every
+ * queue on the way to the controller is sent every TELEMETRY_INTERVAL_MS, or the interval the controller sets; a
+ * telemetry_ms command of 0 stops them. Telemetry is not kept while there is no connection.
+ *
+ * @param pvParameters Unused parameter (required by FreeRTOS API).
+ *
+ * @return None.
+ */
 void vTaskTCP(__unused void *pvParameters)
 {
-    const TickType_t xDelay = pdMS_TO_TICKS(500);
+    // Records waiting to be sent
+    static TCP_BATCH_T xBatch;
 
-    TickType_t xLastWakeTime = xTaskGetTickCount();
+    // Records kept in flash while they cannot be sent
+    static OUTBOX_T xOutbox;
 
-    TCP_CLIENT_T *tcp_client = xInitTCPClient(NULL);
+    TCP_CLIENT_T *tcp_client;
 
-    if (tcp_client == NULL)
+#if !PICO_CYW43_ARCH_POLL
+    // The background arches need the scheduler to associate, so Wi-Fi is brought up here
+    // rather than in main(). The heartbeat drives the LED through the CYW43 and starts after it.
+    LOG_INFO("<vTaskTCP> Initialising WiFi...\n");
+    if (xInitSTA(NULL) != pdPASS)
     {
-        printf("Failed to create TCP client.\nExiting...\n");
+        LOG_ERROR("<vTaskTCP> WiFi failed to initialise!\n");
+        vLogFlush();
         exit(1);
     }
+    xTaskCreate(vTaskHeartbeat, "Heartbeat Task", configMINIMAL_STACK_SIZE, (void *)HEARTBEAT_MS, 1, NULL);
+#endif
+
+    // Keep trying rather than halting the device, the heap may recover
+    while ((tcp_client = xInitTCPClient(NULL)) == NULL)
+    {
+        vTaskDelay(pdMS_TO_TICKS(TCP_BACKOFF_MAX_MS));
+    }
+
+    vTCPBatchReset(&xBatch);
+
+    vOutboxInit(&xOutbox);
+    LOG_INFO("<vTaskTCP> Outbox: %lu records pending, %lu torn slots\n", (unsigned long)ulOutboxPending(&xOutbox),
+             (unsigned long)xOutbox.stats.torn);
 
     if (!xTCPClientOpen(tcp_client))
     {
-        printf("Failed to open TCP client.\nExiting...\n");
-        exit(1);
+        vTCPClientBackoff(tcp_client);
     }
 
+    TickType_t xWait = 0;
+
+    // Telemetry interval, and when the last frame was sent or tried and the ticks from then to the next
+    uint32_t ulTelemetryMs = TELEMETRY_INTERVAL_MS;
+    TickType_t xTelemetryTick = xTaskGetTickCount();
+    TickType_t xTelemetryWait = pdMS_TO_TICKS(ulTelemetryMs);
+
     for (;;)
     {
+        uint32_t ulEvents = ulTCPClientWaitEvents(xWait);
+
+#if PICO_CYW43_ARCH_POLL
         // if you are using pico_cyw43_arch_poll, then you must poll periodically from your
         // main loop (not from a timer) to check for WiFi driver or lwIP work that needs to be done.
         cyw43_arch_poll();
-        vTaskDelay(pdMS_TO_TICKS(1));
 
-        char *xQueueBuffer = calloc(MAX_RX_STR_LEN, sizeof(char));
+        // Collect the events raised by the callbacks cyw43_arch_poll just ran
+        ulEvents |= ulTCPClientWaitEvents(0);
+#endif
 
-        if (xStreamBufferReceive(xStreamBufferTCP, (void *)xQueueBuffer, MAX_RX_STR_LEN, 0) > 0)
+        if (ulEvents & TCP_EVENT_COMMAND)
         {
-            printf("<vTaskTCP> Sending data to server: %s\n", xQueueBuffer);
+            prvTCPCommands(&xBatch, &ulTelemetryMs);
+            xTelemetryWait = pdMS_TO_TICKS(ulTelemetryMs);
+        }
 
-            tcp_write(tcp_client->tcp_pcb, xQueueBuffer, strlen(xQueueBuffer), TCP_WRITE_FLAG_COPY);
-            tcp_client->sent_len = strlen(xQueueBuffer);
-            tcp_output(tcp_client->tcp_pcb);
+        TickType_t xNow = xTaskGetTickCount();
+        TickType_t xInState = xNow - tcp_client->state_tick;
 
-            while (tcp_client->sent_len > 0)
+        if ((ulEvents & TCP_EVENT_CLOSED) && tcp_client->state != TCP_STATE_BACKOFF)
+        {
+            tcp_client->disconnects++;
+            LOG_INFO("<vTaskTCP> Connection closed (%lu times)\n", (unsigned long)tcp_client->disconnects);
+            vTCPClientBackoff(tcp_client);
+        }
+
+        if (tcp_client->state == TCP_STATE_BACKOFF || tcp_client->state == TCP_STATE_CONNECTING)
+        {
+            // Nothing can be sent, keep the records in flash rather than let the stream buffer overflow
+            vTCPBatchSpill(&xBatch, &xOutbox);
+            prvOutboxStore(&xOutbox);
+        }
+
+        switch (tcp_client->state)
+        {
+        case TCP_STATE_BACKOFF:
+            if (xInState < pdMS_TO_TICKS(tcp_client->retry_ms))
             {
-                vTaskDelay(pdMS_TO_TICKS(1));
+                xWait = pdMS_TO_TICKS(tcp_client->retry_ms) - xInState;
+                break;
             }
-        }
+            if (!xTCPClientOpen(tcp_client))
+            {
+                vTCPClientBackoff(tcp_client);
+                xWait = pdMS_TO_TICKS(tcp_client->retry_ms);
+                break;
+            }
+            xWait = pdMS_TO_TICKS(TCP_CONNECT_TIMEOUT_MS);
+            if (xWait > TCP_POLL_TICKS)
+            {
+                xWait = TCP_POLL_TICKS;
+            }
+            break;
 
-        free(xQueueBuffer);
+        case TCP_STATE_CONNECTING:
+            if (tcp_client->connected)
+            {
+                tcp_client->state = TCP_STATE_ESTABLISHED;
+                tcp_client->state_tick = xNow;
+                tcp_client->backoff_ms = TCP_BACKOFF_MIN_MS;
 
-        xTaskDelayUntil(&xLastWakeTime, xDelay);
-    }
+                // Every connection is a new wire format session
+                vTCPBatchNewSession(&xBatch);
+                xWait = 0;
+            }
+            else if (xInState >= pdMS_TO_TICKS(TCP_CONNECT_TIMEOUT_MS))
+            {
+                LOG_WARN("<vTaskTCP> Connection attempt timed out\n");
+                vTCPClientBackoff(tcp_client);
+                xWait = pdMS_TO_TICKS(tcp_client->retry_ms);
+            }
+            else
+            {
+                // Woken early by TCP_EVENT_CONNECTED or TCP_EVENT_CLOSED
+                xWait = pdMS_TO_TICKS(TCP_CONNECT_TIMEOUT_MS) - xInState;
+                if (xWait > TCP_POLL_TICKS)
+                {
+                    xWait = TCP_POLL_TICKS;
+                }
+            }
+            break;
+
+        case TCP_STATE_ESTABLISHED:
+        case TCP_STATE_DRAINING:
+        {
+            // The controller acknowledges what it has taken, also records it got before a reconnect
+            ulTCPBatchAcked(&xBatch, tcp_client->ack_seq, xNow);
+            if (!xOutboxAck(&xOutbox, tcp_client->ack_seq))
+            {
+                LOG_ERROR("<vTaskTCP> Outbox acknowledgement failed\n");
+            }
 
-    xTCPClientClose(tcp_client);
-}
\ No newline at end of file
+            if (xTCPBatchAckTicksLeft(&xBatch, xNow) == 0)
+            {
+                LOG_WARN("<vTaskTCP> No acknowledgement from the controller in %u ms\n", TCP_ACK_TIMEOUT_MS);
+                tcp_client->disconnects++;
+                vTCPClientBackoff(tcp_client);
+                vTCPBatchSpill(&xBatch, &xOutbox);
+                xWait = pdMS_TO_TICKS(tcp_client->retry_ms);
+                break;
+            }
+
+            // While a backlog is replayed, new records queue behind it so the controller sees them in order
+            BaseType_t xReplay = ulOutboxPending(&xOutbox) > 0;
+
+            if (xReplay)
+            {
+                prvOutboxStore(&xOutbox);
+            }
+            else
+            {
+                xTCPBatchFill(&xBatch, xStreamBufferTCP, &xOutbox, xNow);
+            }
+
+            // A replay writes as many segments as may be in flight
+            do
+            {
+                if (xReplay)
+                {
+                    xTCPBatchFillFromOutbox(&xBatch, &xOutbox, xNow);
+                }
+                if (xTCPBatchTicksToDue(&xBatch, xNow) != 0 || xTCPBatchFlush(&xBatch, tcp_client) != pdPASS)
+                {
+                    break;
+                }
+                LOG_INFO("<vTaskTCP> Segment sent: %lu records in %lu segments (%lu.%02lu per segment), %lu payload bytes, %lu bytes on air\n",
+                         (unsigned long)xBatch.stats.records, (unsigned long)xBatch.stats.segments,
+                         (unsigned long)(xBatch.stats.records / xBatch.stats.segments),
+                         (unsigned long)(xBatch.stats.records * 100 / xBatch.stats.segments % 100),
+                         (unsigned long)xBatch.stats.payload_bytes, (unsigned long)xBatch.stats.bytes_on_air);
+            } while (xReplay);
+
+            tcp_client->state = xBatch.window_count > 0 ? TCP_STATE_DRAINING : TCP_STATE_ESTABLISHED;
+
+            // A due batch that could not be written waits for TCP_EVENT_ACKED or TCP_EVENT_SENT to make room
+            xWait = xTCPBatchTicksToDue(&xBatch, xNow);
+            if (tcp_client->state == TCP_STATE_DRAINING)
+            {
+                if (xWait == 0 || xWait > TCP_POLL_TICKS)
+                {
+                    xWait = TCP_POLL_TICKS;
+                }
+                if (xWait > xTCPBatchAckTicksLeft(&xBatch, xNow))
+                {
+                    xWait = xTCPBatchAckTicksLeft(&xBatch, xNow);
+                }
+            }
+            else if (xWait == 0)
+            {
+                xWait = TCP_POLL_TICKS;
+            }
+            else if (xWait > TCP_IDLE_POLL_TICKS)
+            {
+                xWait = TCP_IDLE_POLL_TICKS;
+            }
+
+            // Telemetry keeps its own interval, whatever the records are doing
+            if (ulTelemetryMs != 0)
+            {
+                if (xNow - xTelemetryTick >= xTelemetryWait)
+                {
+                    BaseType_t xSent = prvTelemetrySend(&xBatch, &xOutbox, tcp_client);
+
+                    xTelemetryTick = xNow;
+                    xTelemetryWait = pdMS_TO_TICKS(xSent == pdPASS ? ulTelemetryMs : TELEMETRY_RETRY_MS);
+                }
+                if (xWait > xTelemetryWait - (xNow - xTelemetryTick))
+                {
+                    xWait = xTelemetryWait - (xNow - xTelemetryTick);
+                }
+            }
+            break;
+        }
+        }
+    }
+}
@@ -6,12 +6,16 @@
 #ifndef PICO_TASKS_H_
 #define PICO_TASKS_H_
 
+// Period of the heartbeat LED
+#define HEARTBEAT_MS 500
+
 /**
  * @brief Task that toggles an LED at a regular interval.
  *
  * This task toggles the onboard LED at a regular interval, specified by the
  * parameter passed to the task. The task uses xTaskDelayUntil to delay until
- * the next execution time.
+ * the next execution time. A heartbeat_ms command from the controller changes
+ * the interval from the next toggle.
  *
  * @param pvParameters A pointer to the delay time in milliseconds.
  *
@@ -20,20 +24,74 @@
 void vTaskHeartbeat(void *pvParameters);
 
 /**
- * @brief This function is a task that processes incoming data from a UART queue and calculates the average flow.
+ * @brief This function is a task that processes incoming data from the UART and calculates the flow statistics of each usage event.
+ *
+ * This task reads lines from the UART receive ring and processes them to calculate the flow statistics of each usage event. The
+ * incoming data is expected to be in the format "total volume,flow" and is parsed in place into fixed point milli-units. While
+ * water flows, each sample is added to time weighted statistics (mean, min, max, standard deviation, duration and sample count),
+ * which are sent to the TCP stream buffer when the flow stops. The volume of each event is accounted locally from the meter's
+ * cumulative total, so the meter is never reset and back-to-back events lose no samples. With METER_RESET_ON_EVENT set, the task
+ * instead sends a "clear" command to the device, which resets the total volume, then it discards received data until the meter
+ * reports zero volume.
+ * Receive overruns reported by the UART driver are printed as they occur.
+ *
+ * The controller may clear the meter and set the flow thresholds of a usage event. An event starts once the flow
+ * exceeds the start threshold and lasts while it exceeds the stop threshold, which is at most the start threshold;
+ * both are 0 until set, so any flow counts. Commands are taken from the downlink with every line.
  *
- * This task receives data from a queue and processes it to calculate the average flow. The incoming data is expected 
- * to be in the format "total volume,flow" and is separated by a comma. The task then sends a 
- * "clear" command to the device, which resets the total volume then it clears the queue and clears the average flow. 
+ * The task is event driven: it blocks on the UART receive ring until the ISR signals that a line terminator
+ * has arrived, then handles every complete line before blocking again. In the DUAL_CORE build it runs on core 1
+ * outside of FreeRTOS, started by vCore1Ingest, sleeps in WFI instead and hands records to core 0 over the core link.
  *
- * If there is no data in the queue, the task waits for a fixed delay of 1 second before checking the queue again. 
- * 
  * @param pvParameters Unused parameter (required by FreeRTOS API).
  *
  * @return None.
  */
 void vTaskUART(__unused void *pvParameters);
 
+#if DUAL_CORE
+/**
+ * @brief Entry point of core 1, which runs the meter ingest outside of FreeRTOS.
+ *
+ * The UART is initialised here so that its interrupt is enabled on core 1, then
+ * vTaskUART runs for good. CYW43 and lwIP stay on core 0, so Wi-Fi work there
+ * never delays servicing the UART.
+ *
+ * @return None.
+ */
+void vCore1Ingest(void);
+#endif
+
+/**
+ * @brief Task that sends the records queued by vTaskUART to the controller.
+ *
+ * The uplink is a connection state machine. In TCP_STATE_CONNECTING the task waits for the connected callback, and
+ * gives up after TCP_CONNECT_TIMEOUT_MS. In TCP_STATE_ESTABLISHED records are taken from the TCP stream buffer into a
+ * batch, which is encoded in the binary wire format and written as one segment once it is full or its oldest record
+ * has waited the flush interval. Both limits start at TCP_BATCH_MAX_RECORDS and TCP_BATCH_FLUSH_MS, and the
+ * controller may change them, which wakes the task with TCP_EVENT_COMMAND. Every connection starts a new wire format
+ * session. Records carry sequence numbers, and while the controller has not acknowledged some of them the client is
+ * in TCP_STATE_DRAINING, with up to TCP_WINDOW_RECORDS outstanding. A lost connection, a failed attempt or a
+ * controller that stops acknowledging for TCP_ACK_TIMEOUT_MS enters TCP_STATE_BACKOFF, and the next attempt is made
+ * after an exponentially growing delay.
+ *
+ * Without a connection the records go to the flash outbox instead, along with the unacknowledged ones. Once
+ * connected the outbox is replayed first, as many segments at a time as may be in flight, and new records queue
+ * behind it until it is empty. The controller's acknowledgements are recorded in the outbox, and it drops records
+ * that it sees again, so every record is taken exactly once.
+ *
+ * Transitions are signalled by the lwIP callbacks and vTaskUART through task notifications. Between them the task
+ * sleeps until the next deadline; with the poll arch, which still needs servicing, that is at most TCP_IDLE_POLL_MS,
+ * or TCP_POLL_MS while connecting or draining. The batching counters are printed after every segment.
+ *
+ * While connected a telemetry frame with the CPU share and stack of every task, the heap and the depth of every
+ * queue on the way to the controller is sent every TELEMETRY_INTERVAL_MS, or the interval the controller sets; a
+ * telemetry_ms command of 0 stops them. Telemetry is not kept while there is no connection.
+ *
+ * @param pvParameters Unused parameter (required by FreeRTOS API).
+ *
+ * @return None.
+ */
 void vTaskTCP(__unused void *pvParameters);
 
 #endif /* PICO_TASKS_H_ */
\ No newline at end of file
@@ -0,0 +1,582 @@
+/**
+ * @file wire_format.c
+ *
+ * @brief Source file for the binary uplink wire format.
+ */
+
+// Standard includes
+#include <string.h>
+
+// Project includes
+#include "wire_format.h"
+
+// Names of the WIRE_CMD_ identifiers
+static const char *const pcCommandNames[WIRE_CMD_COUNT] = {
+    [WIRE_CMD_CLEAR] = "clear",
+    [WIRE_CMD_FLUSH_MS] = "flush_ms",
+    [WIRE_CMD_BATCH_RECORDS] = "batch_records",
+    [WIRE_CMD_HEARTBEAT_MS] = "heartbeat_ms",
+    [WIRE_CMD_FLOW_START] = "flow_start",
+    [WIRE_CMD_FLOW_STOP] = "flow_stop",
+    [WIRE_CMD_TELEMETRY_MS] = "telemetry_ms",
+};
+
+// CRC-16/CCITT-FALSE, one nibble at a time
+static const uint16_t usCrcNibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+/**
+ * @brief Compute the CRC-16/CCITT-FALSE of a buffer.
+ *
+ * @param pucData Data to checksum.
+ * @param xLen Number of bytes.
+ *
+ * @return The CRC.
+ */
+uint16_t usWireCrc16(const uint8_t *pucData, size_t xLen)
+{
+    uint16_t usCrc = 0xffff;
+
+    for (size_t i = 0; i < xLen; i++)
+    {
+        usCrc = (uint16_t)((usCrc << 4) ^ usCrcNibble[(usCrc >> 12) ^ (pucData[i] >> 4)]);
+        usCrc = (uint16_t)((usCrc << 4) ^ usCrcNibble[(usCrc >> 12) ^ (pucData[i] & 0x0f)]);
+    }
+
+    return usCrc;
+}
+
+static inline uint32_t prvZigZag(int32_t lValue)
+{
+    return ((uint32_t)lValue << 1) ^ (uint32_t)(lValue >> 31);
+}
+
+static inline int32_t prvUnZigZag(uint32_t ulValue)
+{
+    return (int32_t)(ulValue >> 1) ^ -(int32_t)(ulValue & 1);
+}
+
+/**
+ * @brief Append an unsigned varint, 7 bits per byte, least significant first.
+ *
+ * @param pucOut Destination, with room for WIRE_MAX_VARINT_LEN bytes.
+ * @param ulValue Value to write.
+ *
+ * @return Number of bytes written.
+ */
+static size_t prvPutVarint(uint8_t *pucOut, uint32_t ulValue)
+{
+    size_t xLen = 0;
+
+    while (ulValue >= 0x80)
+    {
+        pucOut[xLen++] = (uint8_t)(ulValue | 0x80);
+        ulValue >>= 7;
+    }
+    pucOut[xLen++] = (uint8_t)ulValue;
+
+    return xLen;
+}
+
+/**
+ * @brief Read an unsigned varint.
+ *
+ * @param ppucCursor Read position, advanced past the varint.
+ * @param pucEnd End of the readable bytes.
+ * @param pulValue Destination for the value.
+ *
+ * @return true if a varint of at most WIRE_MAX_VARINT_LEN bytes was read.
+ */
+static bool prvGetVarint(const uint8_t **ppucCursor, const uint8_t *pucEnd, uint32_t *pulValue)
+{
+    const uint8_t *pucCursor = *ppucCursor;
+    uint32_t ulValue = 0;
+
+    for (unsigned uShift = 0; uShift < 7 * WIRE_MAX_VARINT_LEN && pucCursor < pucEnd; uShift += 7)
+    {
+        uint8_t ucByte = *pucCursor++;
+
+        ulValue |= (uint32_t)(ucByte & 0x7f) << uShift;
+        if ((ucByte & 0x80) == 0)
+        {
+            *ppucCursor = pucCursor;
+            *pulValue = ulValue;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Wrap a payload into a frame.
+ *
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param ucType Frame type.
+ * @param pucPayload Payload bytes.
+ * @param xPayloadLen Number of payload bytes.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+static size_t prvPutFrame(uint8_t *pucBuffer, size_t xBufferLen, uint8_t ucType,
+                          const uint8_t *pucPayload, size_t xPayloadLen)
+{
+    uint8_t ucHeader[1 + WIRE_MAX_VARINT_LEN];
+    size_t xHeaderLen;
+    uint16_t usCrc;
+
+    ucHeader[0] = ucType;
+    xHeaderLen = 1 + prvPutVarint(&ucHeader[1], (uint32_t)xPayloadLen);
+
+    if (xHeaderLen + xPayloadLen + 2 > xBufferLen)
+    {
+        return 0;
+    }
+
+    memcpy(pucBuffer, ucHeader, xHeaderLen);
+    memcpy(&pucBuffer[xHeaderLen], pucPayload, xPayloadLen);
+    usCrc = usWireCrc16(pucBuffer, xHeaderLen + xPayloadLen);
+    pucBuffer[xHeaderLen + xPayloadLen] = (uint8_t)usCrc;
+    pucBuffer[xHeaderLen + xPayloadLen + 1] = (uint8_t)(usCrc >> 8);
+
+    return xHeaderLen + xPayloadLen + 2;
+}
+
+/**
+ * @brief Encode the hello frame that starts a session.
+ *
+ * The codec is reset, so the next record is encoded against zero.
+ *
+ * @param pxCodec Encoder state of the session.
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pcDeviceId NUL terminated device ID, at most WIRE_MAX_DEVICE_ID_LEN characters.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small or the ID too long.
+ */
+size_t xWireEncodeHello(WIRE_CODEC_T *pxCodec, uint8_t *pucBuffer, size_t xBufferLen, const char *pcDeviceId)
+{
+    uint8_t ucPayload[2 + WIRE_MAX_DEVICE_ID_LEN];
+    size_t xIdLen = strlen(pcDeviceId);
+    size_t xLen;
+
+    if (xIdLen > WIRE_MAX_DEVICE_ID_LEN)
+    {
+        return 0;
+    }
+
+    ucPayload[0] = WIRE_VERSION;
+    ucPayload[1] = (uint8_t)xIdLen;
+    memcpy(&ucPayload[2], pcDeviceId, xIdLen);
+
+    xLen = prvPutFrame(pucBuffer, xBufferLen, WIRE_FRAME_HELLO, ucPayload, 2 + xIdLen);
+    if (xLen > 0)
+    {
+        *pxCodec = (WIRE_CODEC_T){.session = true};
+    }
+
+    return xLen;
+}
+
+/**
+ * @brief Encode a record frame.
+ *
+ * The codec only advances when the frame was written.
+ *
+ * @param pxCodec Encoder state of the session.
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pxRecord Record to encode.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t xWireEncodeRecord(WIRE_CODEC_T *pxCodec, uint8_t *pucBuffer, size_t xBufferLen, const WIRE_RECORD_T *pxRecord)
+{
+    uint8_t ucPayload[WIRE_RECORD_FIELDS * WIRE_MAX_VARINT_LEN];
+    size_t xPayloadLen = 0;
+    size_t xLen;
+
+    // Wrapping differences, the decoder adds them back with the same wrap
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], pxRecord->seq - pxCodec->last_seq);
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], pxRecord->time_ms - pxCodec->last_time_ms);
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen],
+                                prvZigZag((int32_t)((uint32_t)pxRecord->volume_milli - (uint32_t)pxCodec->last_volume_milli)));
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen],
+                                prvZigZag((int32_t)((uint32_t)pxRecord->mean_flow_milli - (uint32_t)pxCodec->last_mean_flow_milli)));
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen],
+                                prvZigZag((int32_t)((uint32_t)pxRecord->mean_flow_milli - (uint32_t)pxRecord->min_flow_milli)));
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen],
+                                prvZigZag((int32_t)((uint32_t)pxRecord->max_flow_milli - (uint32_t)pxRecord->mean_flow_milli)));
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], prvZigZag(pxRecord->stddev_flow_milli));
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], pxRecord->duration_ms);
+    xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], pxRecord->count);
+
+    xLen = prvPutFrame(pucBuffer, xBufferLen, WIRE_FRAME_RECORD, ucPayload, xPayloadLen);
+    if (xLen > 0)
+    {
+        pxCodec->last_seq = pxRecord->seq;
+        pxCodec->last_time_ms = pxRecord->time_ms;
+        pxCodec->last_volume_milli = pxRecord->volume_milli;
+        pxCodec->last_mean_flow_milli = pxRecord->mean_flow_milli;
+    }
+
+    return xLen;
+}
+
+/**
+ * @brief Encode an acknowledgement frame.
+ *
+ * Sent by the controller; it does not belong to a session.
+ *
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param ulSeq Highest sequence number taken from the device.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t xWireEncodeAck(uint8_t *pucBuffer, size_t xBufferLen, uint32_t ulSeq)
+{
+    uint8_t ucPayload[WIRE_MAX_VARINT_LEN];
+
+    return prvPutFrame(pucBuffer, xBufferLen, WIRE_FRAME_ACK, ucPayload, prvPutVarint(ucPayload, ulSeq));
+}
+
+/**
+ * @brief Encode a command frame.
+ *
+ * Sent by the controller; it does not belong to a session.
+ *
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pxCommand Command to encode.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t xWireEncodeCommand(uint8_t *pucBuffer, size_t xBufferLen, const WIRE_COMMAND_T *pxCommand)
+{
+    uint8_t ucPayload[1 + WIRE_MAX_VARINT_LEN];
+
+    ucPayload[0] = pxCommand->id;
+
+    return prvPutFrame(pucBuffer, xBufferLen, WIRE_FRAME_COMMAND, ucPayload,
+                       1 + prvPutVarint(&ucPayload[1], pxCommand->value));
+}
+
+/**
+ * @brief Encode a telemetry frame.
+ *
+ * Task names longer than WIRE_MAX_TASK_NAME_LEN are truncated.
+ *
+ * @param pxCodec Encoder state of the session, which must be open; it does not advance.
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pxTelemetry Telemetry to encode, with at most WIRE_MAX_TELEMETRY_TASKS tasks.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small or there is no session.
+ */
+size_t xWireEncodeTelemetry(const WIRE_CODEC_T *pxCodec, uint8_t *pucBuffer, size_t xBufferLen,
+                            const WIRE_TELEMETRY_T *pxTelemetry)
+{
+    uint8_t ucPayload[WIRE_MAX_TELEMETRY_PAYLOAD_LEN];
+    const uint32_t ulFields[WIRE_TELEMETRY_FIELDS] = {
+        pxTelemetry->time_ms,        pxTelemetry->interval_ms,    pxTelemetry->heap_free,
+        pxTelemetry->heap_min,       pxTelemetry->uart_bytes,     pxTelemetry->queued_records,
+        pxTelemetry->batch_records,  pxTelemetry->outbox_records,
+    };
+    size_t xPayloadLen = 0;
+
+    if (!pxCodec->session || pxTelemetry->task_count > WIRE_MAX_TELEMETRY_TASKS)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < WIRE_TELEMETRY_FIELDS; i++)
+    {
+        xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], ulFields[i]);
+    }
+
+    ucPayload[xPayloadLen++] = (uint8_t)pxTelemetry->task_count;
+    for (uint32_t i = 0; i < pxTelemetry->task_count; i++)
+    {
+        const WIRE_TASK_STATS_T *pxTask = &pxTelemetry->tasks[i];
+        size_t xNameLen = strnlen(pxTask->name, WIRE_MAX_TASK_NAME_LEN);
+
+        ucPayload[xPayloadLen++] = (uint8_t)xNameLen;
+        memcpy(&ucPayload[xPayloadLen], pxTask->name, xNameLen);
+        xPayloadLen += xNameLen;
+        xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], pxTask->cpu_permille);
+        xPayloadLen += prvPutVarint(&ucPayload[xPayloadLen], pxTask->stack_free);
+    }
+
+    return prvPutFrame(pucBuffer, xBufferLen, WIRE_FRAME_TELEMETRY, ucPayload, xPayloadLen);
+}
+
+/**
+ * @brief Decode the payload of a telemetry frame.
+ *
+ * eWireDecodeFrame() only checks the frame and points at its payload, so that
+ * devices, which never receive telemetry, need no room for it.
+ *
+ * @param pxFrame Frame of type WIRE_FRAME_TELEMETRY returned by eWireDecodeFrame().
+ * @param pxTelemetry Destination for the telemetry.
+ *
+ * @return WIRE_OK, or WIRE_MALFORMED if the payload does not hold exactly one telemetry record.
+ */
+WIRE_RESULT_T eWireDecodeTelemetry(const WIRE_FRAME_T *pxFrame, WIRE_TELEMETRY_T *pxTelemetry)
+{
+    const uint8_t *pucCursor = pxFrame->telemetry;
+    const uint8_t *pucEnd = pucCursor + pxFrame->telemetry_len;
+    uint32_t ulField[WIRE_TELEMETRY_FIELDS];
+
+    if (pxFrame->type != WIRE_FRAME_TELEMETRY || pucCursor == NULL)
+    {
+        return WIRE_MALFORMED;
+    }
+
+    for (size_t i = 0; i < WIRE_TELEMETRY_FIELDS; i++)
+    {
+        if (!prvGetVarint(&pucCursor, pucEnd, &ulField[i]))
+        {
+            return WIRE_MALFORMED;
+        }
+    }
+    if (pucCursor >= pucEnd || *pucCursor > WIRE_MAX_TELEMETRY_TASKS)
+    {
+        return WIRE_MALFORMED;
+    }
+
+    pxTelemetry->time_ms = ulField[0];
+    pxTelemetry->interval_ms = ulField[1];
+    pxTelemetry->heap_free = ulField[2];
+    pxTelemetry->heap_min = ulField[3];
+    pxTelemetry->uart_bytes = ulField[4];
+    pxTelemetry->queued_records = ulField[5];
+    pxTelemetry->batch_records = ulField[6];
+    pxTelemetry->outbox_records = ulField[7];
+    pxTelemetry->task_count = *pucCursor++;
+
+    for (uint32_t i = 0; i < pxTelemetry->task_count; i++)
+    {
+        WIRE_TASK_STATS_T *pxTask = &pxTelemetry->tasks[i];
+        size_t xNameLen;
+
+        if (pucCursor >= pucEnd || *pucCursor > WIRE_MAX_TASK_NAME_LEN || (size_t)(pucEnd - pucCursor) < 1u + *pucCursor)
+        {
+            return WIRE_MALFORMED;
+        }
+        xNameLen = *pucCursor++;
+        memcpy(pxTask->name, pucCursor, xNameLen);
+        pxTask->name[xNameLen] = '\0';
+        pucCursor += xNameLen;
+
+        if (!prvGetVarint(&pucCursor, pucEnd, &pxTask->cpu_permille) ||
+            !prvGetVarint(&pucCursor, pucEnd, &pxTask->stack_free))
+        {
+            return WIRE_MALFORMED;
+        }
+    }
+
+    return pucCursor == pucEnd ? WIRE_OK : WIRE_MALFORMED;
+}
+
+/**
+ * @brief Return the name of a command, for logs and the controller's command line.
+ *
+ * @param ucId WIRE_CMD_ identifier.
+ *
+ * @return The lower case name, or NULL for an unknown identifier.
+ */
+const char *pcWireCommandName(uint8_t ucId)
+{
+    return ucId < WIRE_CMD_COUNT ? pcCommandNames[ucId] : NULL;
+}
+
+/**
+ * @brief Look up a command by its name.
+ *
+ * @param pcName Lower case name as returned by pcWireCommandName().
+ *
+ * @return The WIRE_CMD_ identifier, or 0 for an unknown name.
+ */
+uint8_t ucWireCommandId(const char *pcName)
+{
+    for (uint8_t ucId = 0; ucId < WIRE_CMD_COUNT; ucId++)
+    {
+        if (pcCommandNames[ucId] != NULL && strcmp(pcCommandNames[ucId], pcName) == 0)
+        {
+            return ucId;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Decode the payload of a record frame.
+ *
+ * @param pxCodec Decoder state of the session.
+ * @param pucCursor Start of the payload.
+ * @param pucEnd End of the payload.
+ * @param pxRecord Destination for the record.
+ *
+ * @return WIRE_OK, or WIRE_MALFORMED if the payload does not hold exactly one record.
+ */
+static WIRE_RESULT_T prvDecodeRecord(WIRE_CODEC_T *pxCodec, const uint8_t *pucCursor, const uint8_t *pucEnd,
+                                     WIRE_RECORD_T *pxRecord)
+{
+    uint32_t ulField[WIRE_RECORD_FIELDS];
+
+    for (size_t i = 0; i < WIRE_RECORD_FIELDS; i++)
+    {
+        if (!prvGetVarint(&pucCursor, pucEnd, &ulField[i]))
+        {
+            return WIRE_MALFORMED;
+        }
+    }
+
+    if (pucCursor != pucEnd)
+    {
+        return WIRE_MALFORMED;
+    }
+
+    pxRecord->seq = pxCodec->last_seq + ulField[0];
+    pxRecord->time_ms = pxCodec->last_time_ms + ulField[1];
+    pxRecord->volume_milli = (int32_t)((uint32_t)pxCodec->last_volume_milli + (uint32_t)prvUnZigZag(ulField[2]));
+    pxRecord->mean_flow_milli = (int32_t)((uint32_t)pxCodec->last_mean_flow_milli + (uint32_t)prvUnZigZag(ulField[3]));
+    pxRecord->min_flow_milli = (int32_t)((uint32_t)pxRecord->mean_flow_milli - (uint32_t)prvUnZigZag(ulField[4]));
+    pxRecord->max_flow_milli = (int32_t)((uint32_t)pxRecord->mean_flow_milli + (uint32_t)prvUnZigZag(ulField[5]));
+    pxRecord->stddev_flow_milli = prvUnZigZag(ulField[6]);
+    pxRecord->duration_ms = ulField[7];
+    pxRecord->count = ulField[8];
+
+    pxCodec->last_seq = pxRecord->seq;
+    pxCodec->last_time_ms = pxRecord->time_ms;
+    pxCodec->last_volume_milli = pxRecord->volume_milli;
+    pxCodec->last_mean_flow_milli = pxRecord->mean_flow_milli;
+
+    return WIRE_OK;
+}
+
+/**
+ * @brief Decode the frame at the start of a buffer.
+ *
+ * A hello frame resets the codec; record and telemetry frames are only
+ * accepted after one. Acknowledgement and command frames are accepted at any
+ * time, commands with identifiers this side does not know included.
+ * Except for WIRE_INCOMPLETE, *pxConsumed is set to the length of the frame so
+ * the caller can skip a bad frame. Only a malformed length cannot be skipped.
+ *
+ * @param pxCodec Decoder state of the session.
+ * @param pucBuffer Received bytes.
+ * @param xLen Number of received bytes.
+ * @param pxConsumed Set to the number of bytes the frame occupies.
+ * @param pxFrame Destination for the decoded frame.
+ *
+ * @return WIRE_OK if a frame was decoded, or the reason it was not.
+ */
+WIRE_RESULT_T eWireDecodeFrame(WIRE_CODEC_T *pxCodec, const uint8_t *pucBuffer, size_t xLen,
+                               size_t *pxConsumed, WIRE_FRAME_T *pxFrame)
+{
+    const uint8_t *pucEnd = pucBuffer + xLen;
+    const uint8_t *pucCursor = pucBuffer + 1;
+    uint32_t ulPayloadLen;
+    size_t xHeaderLen;
+    size_t xFrameLen;
+    uint16_t usCrc;
+
+    *pxConsumed = 0;
+
+    if (xLen < 2)
+    {
+        return WIRE_INCOMPLETE;
+    }
+
+    if (!prvGetVarint(&pucCursor, pucEnd, &ulPayloadLen))
+    {
+        // Either the length is still arriving or it is longer than any varint
+        return (pucEnd - pucBuffer) > WIRE_MAX_VARINT_LEN ? WIRE_MALFORMED : WIRE_INCOMPLETE;
+    }
+
+    xHeaderLen = (size_t)(pucCursor - pucBuffer);
+    if (ulPayloadLen > WIRE_MAX_PAYLOAD_LEN)
+    {
+        return WIRE_MALFORMED;
+    }
+
+    xFrameLen = xHeaderLen + ulPayloadLen + 2;
+    if (xLen < xFrameLen)
+    {
+        return WIRE_INCOMPLETE;
+    }
+
+    *pxConsumed = xFrameLen;
+
+    usCrc = (uint16_t)(pucBuffer[xFrameLen - 2] | (pucBuffer[xFrameLen - 1] << 8));
+    if (usCrc != usWireCrc16(pucBuffer, xFrameLen - 2))
+    {
+        return WIRE_BAD_CRC;
+    }
+
+    pxFrame->type = pucBuffer[0];
+    pucEnd = pucCursor + ulPayloadLen;
+
+    switch (pxFrame->type)
+    {
+    case WIRE_FRAME_HELLO:
+        if (ulPayloadLen < 2 || pucCursor[1] > WIRE_MAX_DEVICE_ID_LEN || (size_t)pucCursor[1] != ulPayloadLen - 2)
+        {
+            return WIRE_MALFORMED;
+        }
+        pxFrame->version = pucCursor[0];
+        if (pxFrame->version != WIRE_VERSION)
+        {
+            pxCodec->session = false;
+            return WIRE_BAD_VERSION;
+        }
+        memcpy(pxFrame->device_id, &pucCursor[2], pucCursor[1]);
+        pxFrame->device_id[pucCursor[1]] = '\0';
+        *pxCodec = (WIRE_CODEC_T){.session = true};
+        return WIRE_OK;
+
+    case WIRE_FRAME_RECORD:
+        if (!pxCodec->session)
+        {
+            return WIRE_NO_SESSION;
+        }
+        return prvDecodeRecord(pxCodec, pucCursor, pucEnd, &pxFrame->record);
+
+    case WIRE_FRAME_ACK:
+        if (!prvGetVarint(&pucCursor, pucEnd, &pxFrame->ack_seq) || pucCursor != pucEnd)
+        {
+            return WIRE_MALFORMED;
+        }
+        return WIRE_OK;
+
+    case WIRE_FRAME_COMMAND:
+        if (ulPayloadLen < 2)
+        {
+            return WIRE_MALFORMED;
+        }
+        pxFrame->command.id = *pucCursor++;
+        if (!prvGetVarint(&pucCursor, pucEnd, &pxFrame->command.value) || pucCursor != pucEnd)
+        {
+            return WIRE_MALFORMED;
+        }
+        return WIRE_OK;
+
+    case WIRE_FRAME_TELEMETRY:
+        if (!pxCodec->session)
+        {
+            return WIRE_NO_SESSION;
+        }
+        pxFrame->telemetry = pucCursor;
+        pxFrame->telemetry_len = ulPayloadLen;
+        return WIRE_OK;
+
+    default:
+        return WIRE_MALFORMED;
+    }
+}
@@ -0,0 +1,300 @@
+/**
+ * @file wire_format.h
+ *
+ * @brief Header file for the binary uplink wire format.
+ *
+ * The uplink is a stream of frames:
+ *
+ *     type (1 byte) | payload length (varint) | payload | CRC-16 (2 bytes, little endian)
+ *
+ * The CRC is CRC-16/CCITT-FALSE over type, length and payload. A session starts
+ * with a WIRE_FRAME_HELLO carrying the format version and the device ID, which
+ * is not repeated afterwards. Each WIRE_FRAME_RECORD is encoded against the
+ * previous record of the session: the sequence number and the timestamp as
+ * unsigned varints of their increase, volume and mean flow as zigzag varint
+ * deltas, min and max flow as zigzag varints relative to the mean, and the
+ * remaining fields as plain varints. Encoder and decoder are plain C without
+ * dependencies so the same code runs on the device and on the host.
+ *
+ * Every record of a device carries a sequence number that grows from record to
+ * record, though not always by one, and is never reused. The controller answers
+ * with WIRE_FRAME_ACK frames on the same connection, each carrying the highest
+ * sequence number it has taken from the device. Acknowledgements are
+ * cumulative, so the device keeps every record above the last one until it is
+ * acknowledged and sends it again on the next connection, and the controller
+ * drops records it already has.
+ *
+ * The controller may also send WIRE_FRAME_COMMAND frames, each carrying one
+ * WIRE_CMD_ identifier and an unsigned varint argument, to change a setting of
+ * the device at run time. Like acknowledgements they need no session.
+ *
+ * Within a session the device periodically sends a WIRE_FRAME_TELEMETRY frame
+ * about its own health: WIRE_TELEMETRY_FIELDS unsigned varints (uptime, the
+ * span the CPU shares cover, heap free and lowest free, and the depths of the
+ * queues along the record path), then a count byte and for every task its
+ * name as a length byte and characters, followed by its CPU share in permille
+ * and its lowest free stack in bytes as unsigned varints. Telemetry has no
+ * sequence number and is not acknowledged or stored while offline.
+ */
+
+#ifndef WIRE_FORMAT_H_
+#define WIRE_FORMAT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Version carried in the hello frame
+#define WIRE_VERSION 3
+
+// Frame types
+#define WIRE_FRAME_HELLO 0x01
+#define WIRE_FRAME_RECORD 0x02
+#define WIRE_FRAME_ACK 0x03
+#define WIRE_FRAME_COMMAND 0x04
+#define WIRE_FRAME_TELEMETRY 0x05
+
+// Commands, and what their argument is
+#define WIRE_CMD_CLEAR 0x01         // Reset the meter's total volume; no argument, send 0
+#define WIRE_CMD_FLUSH_MS 0x02      // Longest a record waits for its batch, the reporting interval
+#define WIRE_CMD_BATCH_RECORDS 0x03 // Records per segment
+#define WIRE_CMD_HEARTBEAT_MS 0x04  // Period of the heartbeat LED
+#define WIRE_CMD_FLOW_START 0x05    // Flow above which a usage event starts, in milli-units
+#define WIRE_CMD_FLOW_STOP 0x06     // Flow at or below which a usage event ends, in milli-units
+#define WIRE_CMD_TELEMETRY_MS 0x07  // Interval of the telemetry frames, 0 stops them
+#define WIRE_CMD_COUNT 0x08
+
+// Longest device ID a hello frame can carry
+#define WIRE_MAX_DEVICE_ID_LEN 32
+
+// Varints in the payload of a record frame
+#define WIRE_RECORD_FIELDS 9
+
+// Varints ahead of the tasks in the payload of a telemetry frame
+#define WIRE_TELEMETRY_FIELDS 8
+
+// Most tasks a telemetry frame describes, and the longest task name it carries
+#define WIRE_MAX_TELEMETRY_TASKS 12
+#define WIRE_MAX_TASK_NAME_LEN 15
+
+// Longest encodings, in bytes: type, one byte length, payload and CRC
+#define WIRE_MAX_VARINT_LEN 5
+#define WIRE_MAX_HELLO_LEN (1 + 1 + 2 + WIRE_MAX_DEVICE_ID_LEN + 2)
+#define WIRE_MAX_RECORD_LEN (1 + 1 + WIRE_RECORD_FIELDS * WIRE_MAX_VARINT_LEN + 2)
+#define WIRE_MAX_ACK_LEN (1 + 1 + WIRE_MAX_VARINT_LEN + 2)
+#define WIRE_MAX_COMMAND_LEN (1 + 1 + 1 + WIRE_MAX_VARINT_LEN + 2)
+
+// The telemetry payload is the longest; its length takes two bytes
+#define WIRE_MAX_TELEMETRY_PAYLOAD_LEN                          \
+    (WIRE_TELEMETRY_FIELDS * WIRE_MAX_VARINT_LEN + 1 +          \
+     WIRE_MAX_TELEMETRY_TASKS * (1 + WIRE_MAX_TASK_NAME_LEN + 2 * WIRE_MAX_VARINT_LEN))
+#define WIRE_MAX_PAYLOAD_LEN WIRE_MAX_TELEMETRY_PAYLOAD_LEN
+#define WIRE_MAX_TELEMETRY_LEN (1 + 2 + WIRE_MAX_TELEMETRY_PAYLOAD_LEN + 2)
+
+// Type definitions
+typedef enum
+{
+    WIRE_OK = 0,
+    WIRE_INCOMPLETE,
+    WIRE_BAD_CRC,
+    WIRE_MALFORMED,
+    WIRE_BAD_VERSION,
+    WIRE_NO_SESSION,
+} WIRE_RESULT_T;
+
+typedef struct WIRE_RECORD_T_
+{
+    uint32_t seq;
+    uint32_t time_ms;
+    int32_t volume_milli;
+    int32_t mean_flow_milli;
+    int32_t min_flow_milli;
+    int32_t max_flow_milli;
+    int32_t stddev_flow_milli;
+    uint32_t duration_ms;
+    uint32_t count;
+} WIRE_RECORD_T;
+
+typedef struct WIRE_COMMAND_T_
+{
+    uint8_t id;
+    uint32_t value;
+} WIRE_COMMAND_T;
+
+typedef struct WIRE_TASK_STATS_T_
+{
+    char name[WIRE_MAX_TASK_NAME_LEN + 1];
+    uint32_t cpu_permille;
+    uint32_t stack_free;
+} WIRE_TASK_STATS_T;
+
+typedef struct WIRE_TELEMETRY_T_
+{
+    uint32_t time_ms;
+    // Span of the CPU shares, since the previous telemetry
+    uint32_t interval_ms;
+    uint32_t heap_free;
+    uint32_t heap_min;
+    // Bytes received from the meter and not yet parsed
+    uint32_t uart_bytes;
+    // Records queued for the uplink task, in the batch or its window, and in the outbox
+    uint32_t queued_records;
+    uint32_t batch_records;
+    uint32_t outbox_records;
+    uint32_t task_count;
+    WIRE_TASK_STATS_T tasks[WIRE_MAX_TELEMETRY_TASKS];
+} WIRE_TELEMETRY_T;
+
+typedef struct WIRE_CODEC_T_
+{
+    bool session;
+    uint32_t last_seq;
+    uint32_t last_time_ms;
+    int32_t last_volume_milli;
+    int32_t last_mean_flow_milli;
+} WIRE_CODEC_T;
+
+typedef struct WIRE_FRAME_T_
+{
+    uint8_t type;
+    uint8_t version;
+    char device_id[WIRE_MAX_DEVICE_ID_LEN + 1];
+    WIRE_RECORD_T record;
+    uint32_t ack_seq;
+    WIRE_COMMAND_T command;
+    // Payload of a telemetry frame, pointing into the decoded buffer; see eWireDecodeTelemetry()
+    const uint8_t *telemetry;
+    size_t telemetry_len;
+} WIRE_FRAME_T;
+
+/**
+ * @brief Encode the hello frame that starts a session.
+ *
+ * The codec is reset, so the next record is encoded against zero.
+ *
+ * @param pxCodec Encoder state of the session.
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pcDeviceId NUL terminated device ID, at most WIRE_MAX_DEVICE_ID_LEN characters.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small or the ID too long.
+ */
+size_t xWireEncodeHello(WIRE_CODEC_T *pxCodec, uint8_t *pucBuffer, size_t xBufferLen, const char *pcDeviceId);
+
+/**
+ * @brief Encode a record frame.
+ *
+ * The codec only advances when the frame was written.
+ *
+ * @param pxCodec Encoder state of the session.
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pxRecord Record to encode.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t xWireEncodeRecord(WIRE_CODEC_T *pxCodec, uint8_t *pucBuffer, size_t xBufferLen, const WIRE_RECORD_T *pxRecord);
+
+/**
+ * @brief Encode an acknowledgement frame.
+ *
+ * Sent by the controller; it does not belong to a session.
+ *
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param ulSeq Highest sequence number taken from the device.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t xWireEncodeAck(uint8_t *pucBuffer, size_t xBufferLen, uint32_t ulSeq);
+
+/**
+ * @brief Encode a command frame.
+ *
+ * Sent by the controller; it does not belong to a session.
+ *
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pxCommand Command to encode.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small.
+ */
+size_t xWireEncodeCommand(uint8_t *pucBuffer, size_t xBufferLen, const WIRE_COMMAND_T *pxCommand);
+
+/**
+ * @brief Encode a telemetry frame.
+ *
+ * Task names longer than WIRE_MAX_TASK_NAME_LEN are truncated.
+ *
+ * @param pxCodec Encoder state of the session, which must be open; it does not advance.
+ * @param pucBuffer Destination buffer.
+ * @param xBufferLen Size of the destination buffer.
+ * @param pxTelemetry Telemetry to encode, with at most WIRE_MAX_TELEMETRY_TASKS tasks.
+ *
+ * @return Number of bytes written, or 0 if the buffer is too small or there is no session.
+ */
+size_t xWireEncodeTelemetry(const WIRE_CODEC_T *pxCodec, uint8_t *pucBuffer, size_t xBufferLen,
+                            const WIRE_TELEMETRY_T *pxTelemetry);
+
+/**
+ * @brief Decode the payload of a telemetry frame.
+ *
+ * eWireDecodeFrame() only checks the frame and points at its payload, so that
+ * devices, which never receive telemetry, need no room for it.
+ *
+ * @param pxFrame Frame of type WIRE_FRAME_TELEMETRY returned by eWireDecodeFrame().
+ * @param pxTelemetry Destination for the telemetry.
+ *
+ * @return WIRE_OK, or WIRE_MALFORMED if the payload does not hold exactly one telemetry record.
+ */
+WIRE_RESULT_T eWireDecodeTelemetry(const WIRE_FRAME_T *pxFrame, WIRE_TELEMETRY_T *pxTelemetry);
+
+/**
+ * @brief Return the name of a command, for logs and the controller's command line.
+ *
+ * @param ucId WIRE_CMD_ identifier.
+ *
+ * @return The lower case name, or NULL for an unknown identifier.
+ */
+const char *pcWireCommandName(uint8_t ucId);
+
+/**
+ * @brief Look up a command by its name.
+ *
+ * @param pcName Lower case name as returned by pcWireCommandName().
+ *
+ * @return The WIRE_CMD_ identifier, or 0 for an unknown name.
+ */
+uint8_t ucWireCommandId(const char *pcName);
+
+/**
+ * @brief Decode the frame at the start of a buffer.
+ *
+ * A hello frame resets the codec; record and telemetry frames are only
+ * accepted after one. Acknowledgement and command frames are accepted at any
+ * time, commands with identifiers this side does not know included.
+ * Except for WIRE_INCOMPLETE, *pxConsumed is set to the length of the frame so
+ * the caller can skip a bad frame. Only a malformed length cannot be skipped.
+ *
+ * @param pxCodec Decoder state of the session.
+ * @param pucBuffer Received bytes.
+ * @param xLen Number of received bytes.
+ * @param pxConsumed Set to the number of bytes the frame occupies.
+ * @param pxFrame Destination for the decoded frame.
+ *
+ * @return WIRE_OK if a frame was decoded, or the reason it was not.
+ */
+WIRE_RESULT_T eWireDecodeFrame(WIRE_CODEC_T *pxCodec, const uint8_t *pucBuffer, size_t xLen,
+                               size_t *pxConsumed, WIRE_FRAME_T *pxFrame);
+
+/**
+ * @brief Compute the CRC-16/CCITT-FALSE of a buffer.
+ *
+ * @param pucData Data to checksum.
+ * @param xLen Number of bytes.
+ *
+ * @return The CRC.
+ */
+uint16_t usWireCrc16(const uint8_t *pucData, size_t xLen);
+
+#endif /* WIRE_FORMAT_H_ */
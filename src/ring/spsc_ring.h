@@ -0,0 +1,382 @@
+/**
+ * @file spsc_ring.h
+ *
+ * @brief Header file for the single producer, single consumer byte ring.
+ *
+ * For one interrupt handler feeding one task, such as ISR_UART_RX feeding the
+ * UART task, a ring needs no critical section: the head index is only written
+ * by the producer and the tail index only by the consumer. Both are free
+ * running 32 bit counts, stored and loaded as C11 atomics, which the RP2040
+ * does with a single word store or load and a data memory barrier. The
+ * release store of an index orders the bytes before it, so each side sees the
+ * data before it sees the index that hands it over.
+ *
+ * Either side may copy through the ring, or borrow its storage in place: the
+ * producer reserves contiguous free space, writes it and commits, and the
+ * consumer peeks at contiguous data, reads it and consumes it. A ring that only
+ * carries records of one size, written and read whole, serves as a queue of
+ * structures between an interrupt, a task or the other core.
+ *
+ * The consumer task may set itself as the doorbell, a task notification index
+ * the producer gives when it rings. The producer decides when to ring, for
+ * example once a whole line has arrived, and the consumer waits with
+ * xSPSCRingWait(). Without a doorbell the ring does not depend on the
+ * scheduler, so it also serves code that runs outside of FreeRTOS.
+ *
+ * Everything is inline, so the producer side costs a few loads and stores in
+ * the interrupt handler.
+ */
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Type definitions
+typedef struct SPSC_RING_T_
+{
+    uint8_t *storage;
+    // Bytes of storage, a power of two
+    uint32_t size;
+
+    // Bytes written and read, free running; head written by the producer only, tail by the consumer only
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+
+    // Task given a notification when the producer rings, NULL for none
+    TaskHandle_t doorbell;
+    UBaseType_t doorbell_index;
+} SPSC_RING_T;
+
+/**
+ * @brief Set up an empty ring without a doorbell.
+ *
+ * @param pxRing Ring to set up.
+ * @param pucStorage Storage of the ring.
+ * @param ulSize Bytes of storage, a power of two.
+ *
+ * @return None.
+ */
+static inline void vSPSCRingInit(SPSC_RING_T *pxRing, uint8_t *pucStorage, uint32_t ulSize)
+{
+    configASSERT(ulSize != 0 && (ulSize & (ulSize - 1)) == 0);
+
+    pxRing->storage = pucStorage;
+    pxRing->size = ulSize;
+    atomic_init(&pxRing->head, 0);
+    atomic_init(&pxRing->tail, 0);
+    pxRing->doorbell = NULL;
+    pxRing->doorbell_index = 0;
+}
+
+/**
+ * @brief Have the producer's rings notify a task.
+ *
+ * Must be set before the producer starts, normally by the consumer task for
+ * itself.
+ *
+ * @param pxRing Ring.
+ * @param xTask Task to notify, NULL for none.
+ * @param uxIndexToNotify Task notification index the doorbell uses.
+ *
+ * @return None.
+ */
+static inline void vSPSCRingSetDoorbell(SPSC_RING_T *pxRing, TaskHandle_t xTask, UBaseType_t uxIndexToNotify)
+{
+    pxRing->doorbell = xTask;
+    pxRing->doorbell_index = uxIndexToNotify;
+}
+
+/**
+ * @brief Bytes written but not consumed yet.
+ *
+ * Exact on the consumer side; on the producer side data may only have been
+ * consumed since.
+ *
+ * @param pxRing Ring.
+ *
+ * @return Number of bytes.
+ */
+static inline uint32_t ulSPSCRingAvailable(SPSC_RING_T *pxRing)
+{
+    return atomic_load_explicit(&pxRing->head, memory_order_acquire) -
+           atomic_load_explicit(&pxRing->tail, memory_order_acquire);
+}
+
+/**
+ * @brief Lend the producer the contiguous free space at the head of the ring.
+ *
+ * Free space that wraps around the end of the storage is lent by the next
+ * call, once this part has been committed.
+ *
+ * @param pxRing Ring.
+ * @param ppucSpan Set to the start of the free space.
+ *
+ * @return Number of bytes that may be written at *ppucSpan.
+ */
+static inline size_t xSPSCRingReserve(SPSC_RING_T *pxRing, uint8_t **ppucSpan)
+{
+    uint32_t ulHead = atomic_load_explicit(&pxRing->head, memory_order_relaxed);
+    uint32_t ulFree = pxRing->size - (ulHead - atomic_load_explicit(&pxRing->tail, memory_order_acquire));
+    uint32_t ulToEnd = pxRing->size - (ulHead & (pxRing->size - 1));
+
+    *ppucSpan = &pxRing->storage[ulHead & (pxRing->size - 1)];
+
+    return ulFree < ulToEnd ? ulFree : ulToEnd;
+}
+
+/**
+ * @brief Hand bytes written into the lent space to the consumer.
+ *
+ * @param pxRing Ring.
+ * @param xLength Number of bytes written, at most what was lent.
+ *
+ * @return None.
+ */
+static inline void vSPSCRingCommit(SPSC_RING_T *pxRing, size_t xLength)
+{
+    uint32_t ulHead = atomic_load_explicit(&pxRing->head, memory_order_relaxed);
+
+    atomic_store_explicit(&pxRing->head, ulHead + (uint32_t)xLength, memory_order_release);
+}
+
+/**
+ * @brief Copy bytes into the ring, as many as fit.
+ *
+ * @param pxRing Ring.
+ * @param pvData Bytes to write.
+ * @param xLength Number of bytes.
+ *
+ * @return Number of bytes written.
+ */
+static inline size_t xSPSCRingWrite(SPSC_RING_T *pxRing, const void *pvData, size_t xLength)
+{
+    const uint8_t *pucData = pvData;
+    size_t xWritten = 0;
+
+    // At most two spans, the second once the first has reached the end of the storage
+    while (xWritten < xLength)
+    {
+        uint8_t *pucSpan;
+        size_t xSpan = xSPSCRingReserve(pxRing, &pucSpan);
+
+        if (xSpan == 0)
+        {
+            break;
+        }
+        if (xSpan > xLength - xWritten)
+        {
+            xSpan = xLength - xWritten;
+        }
+
+        memcpy(pucSpan, &pucData[xWritten], xSpan);
+        vSPSCRingCommit(pxRing, xSpan);
+        xWritten += xSpan;
+    }
+
+    return xWritten;
+}
+
+/**
+ * @brief Copy a whole record into the ring, or nothing if it does not fit.
+ *
+ * A record that wraps around the end of the storage is committed in two parts,
+ * which xSPSCRingReadRecord() does not take until both are there.
+ *
+ * @param pxRing Ring.
+ * @param pvRecord Record to write.
+ * @param xSize Bytes of every record the ring carries.
+ *
+ * @return true if the record was written, false if the ring was too full.
+ */
+static inline bool xSPSCRingWriteRecord(SPSC_RING_T *pxRing, const void *pvRecord, size_t xSize)
+{
+    if (pxRing->size - ulSPSCRingAvailable(pxRing) < xSize)
+    {
+        return false;
+    }
+
+    (void)xSPSCRingWrite(pxRing, pvRecord, xSize);
+
+    return true;
+}
+
+/**
+ * @brief Lend the consumer the contiguous data at the tail of the ring.
+ *
+ * Data that wraps around the end of the storage is lent by the next call, once
+ * this part has been consumed.
+ *
+ * @param pxRing Ring.
+ * @param ppucSpan Set to the oldest byte not consumed yet.
+ *
+ * @return Number of bytes that may be read at *ppucSpan.
+ */
+static inline size_t xSPSCRingPeek(SPSC_RING_T *pxRing, const uint8_t **ppucSpan)
+{
+    uint32_t ulTail = atomic_load_explicit(&pxRing->tail, memory_order_relaxed);
+    uint32_t ulData = atomic_load_explicit(&pxRing->head, memory_order_acquire) - ulTail;
+    uint32_t ulToEnd = pxRing->size - (ulTail & (pxRing->size - 1));
+
+    *ppucSpan = &pxRing->storage[ulTail & (pxRing->size - 1)];
+
+    return ulData < ulToEnd ? ulData : ulToEnd;
+}
+
+/**
+ * @brief Release bytes the consumer has finished with back to the producer.
+ *
+ * @param pxRing Ring.
+ * @param xLength Number of bytes, at most what was lent.
+ *
+ * @return None.
+ */
+static inline void vSPSCRingConsume(SPSC_RING_T *pxRing, size_t xLength)
+{
+    uint32_t ulTail = atomic_load_explicit(&pxRing->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&pxRing->tail, ulTail + (uint32_t)xLength, memory_order_release);
+}
+
+/**
+ * @brief Copy bytes out of the ring, as many as are there.
+ *
+ * @param pxRing Ring.
+ * @param pvData Destination for the bytes.
+ * @param xLength Most bytes to read.
+ *
+ * @return Number of bytes read.
+ */
+static inline size_t xSPSCRingRead(SPSC_RING_T *pxRing, void *pvData, size_t xLength)
+{
+    uint8_t *pucData = pvData;
+    size_t xRead = 0;
+
+    while (xRead < xLength)
+    {
+        const uint8_t *pucSpan;
+        size_t xSpan = xSPSCRingPeek(pxRing, &pucSpan);
+
+        if (xSpan == 0)
+        {
+            break;
+        }
+        if (xSpan > xLength - xRead)
+        {
+            xSpan = xLength - xRead;
+        }
+
+        memcpy(&pucData[xRead], pucSpan, xSpan);
+        vSPSCRingConsume(pxRing, xSpan);
+        xRead += xSpan;
+    }
+
+    return xRead;
+}
+
+/**
+ * @brief Copy the oldest whole record out of the ring.
+ *
+ * @param pxRing Ring.
+ * @param pvRecord Destination for the record.
+ * @param xSize Bytes of every record the ring carries.
+ *
+ * @return true if a record was read, false if none has been written completely.
+ */
+static inline bool xSPSCRingReadRecord(SPSC_RING_T *pxRing, void *pvRecord, size_t xSize)
+{
+    if (ulSPSCRingAvailable(pxRing) < xSize)
+    {
+        return false;
+    }
+
+    (void)xSPSCRingRead(pxRing, pvRecord, xSize);
+
+    return true;
+}
+
+/**
+ * @brief Drop everything written so far, from the consumer side.
+ *
+ * @param pxRing Ring.
+ *
+ * @return None.
+ */
+static inline void vSPSCRingFlush(SPSC_RING_T *pxRing)
+{
+    atomic_store_explicit(&pxRing->tail, atomic_load_explicit(&pxRing->head, memory_order_acquire),
+                          memory_order_release);
+}
+
+/**
+ * @brief Notify the doorbell task from an interrupt handler, if there is one.
+ *
+ * @param pxRing Ring.
+ * @param pxHigherPriorityTaskWoken Set to pdTRUE if the doorbell task has a higher priority than the task interrupted.
+ *
+ * @return None.
+ */
+static inline void vSPSCRingNotifyFromISR(SPSC_RING_T *pxRing, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxRing->doorbell != NULL)
+    {
+        vTaskNotifyGiveIndexedFromISR(pxRing->doorbell, pxRing->doorbell_index, pxHigherPriorityTaskWoken);
+    }
+}
+
+/**
+ * @brief Notify the doorbell task from a task, if there is one.
+ *
+ * @param pxRing Ring.
+ *
+ * @return None.
+ */
+static inline void vSPSCRingNotify(SPSC_RING_T *pxRing)
+{
+    if (pxRing->doorbell != NULL)
+    {
+        xTaskNotifyGiveIndexed(pxRing->doorbell, pxRing->doorbell_index);
+    }
+}
+
+/**
+ * @brief Wait on the doorbell until the ring holds data.
+ *
+ * Must be called by the doorbell task. Returns at once if there is data. The
+ * notification count only tells the consumer to look again, so a ring that
+ * found the data already consumed just makes it wait once more.
+ *
+ * @param pxRing Ring.
+ * @param xTicksToWait Maximum time to wait.
+ *
+ * @return pdTRUE if the ring holds data, pdFALSE if the time ran out.
+ */
+static inline BaseType_t xSPSCRingWait(SPSC_RING_T *pxRing, TickType_t xTicksToWait)
+{
+    TimeOut_t xTimeOut;
+
+    vTaskSetTimeOutState(&xTimeOut);
+
+    while (ulSPSCRingAvailable(pxRing) == 0)
+    {
+        if (xTaskCheckForTimeOut(&xTimeOut, &xTicksToWait) != pdFALSE)
+        {
+            return pdFALSE;
+        }
+
+        (void)ulTaskNotifyTakeIndexed(pxRing->doorbell_index, pdTRUE, xTicksToWait);
+    }
+
+    return pdTRUE;
+}
+
+#endif /* SPSC_RING_H_ */
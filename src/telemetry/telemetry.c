@@ -0,0 +1,114 @@
+/**
+ * @file telemetry.c
+ *
+ * @brief Source file for the device health telemetry.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <string.h>
+
+// Pico includes
+#include "pico/time.h"
+
+// Project includes
+#include "telemetry.h"
+
+// Run time of a task at the previous sample; task numbers are never reused
+typedef struct TELEMETRY_TASK_T_
+{
+    UBaseType_t number;
+    configRUN_TIME_COUNTER_TYPE run_time;
+} TELEMETRY_TASK_T;
+
+static TELEMETRY_TASK_T xPrevious[TELEMETRY_MAX_TASKS];
+static UBaseType_t uxPreviousCount;
+static configRUN_TIME_COUNTER_TYPE xPreviousTotal;
+
+/**
+ * @brief Return the run time a task had at the previous sample.
+ *
+ * @param uxNumber Task number.
+ *
+ * @return The run time, or 0 for a task created since.
+ */
+static configRUN_TIME_COUNTER_TYPE prvPreviousRunTime(UBaseType_t uxNumber)
+{
+    for (UBaseType_t i = 0; i < uxPreviousCount; i++)
+    {
+        if (xPrevious[i].number == uxNumber)
+        {
+            return xPrevious[i].run_time;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Sample the CPU share and stack of every task and the heap.
+ *
+ * Fills everything of the telemetry but the queue depths, which belong to the
+ * caller. With more than WIRE_MAX_TELEMETRY_TASKS tasks the busiest are kept.
+ * Called by one task only; the CPU shares cover the time since its previous
+ * call, or since boot on the first one.
+ *
+ * @param pxTelemetry Destination for the sample.
+ *
+ * @return None.
+ */
+void vTelemetrySample(WIRE_TELEMETRY_T *pxTelemetry)
+{
+    static TaskStatus_t xStatus[TELEMETRY_MAX_TASKS];
+    static TELEMETRY_TASK_T xCurrent[TELEMETRY_MAX_TASKS];
+    configRUN_TIME_COUNTER_TYPE xTotal;
+    configRUN_TIME_COUNTER_TYPE xInterval;
+    UBaseType_t uxCount = uxTaskGetSystemState(xStatus, TELEMETRY_MAX_TASKS, &xTotal);
+
+    xInterval = xTotal - xPreviousTotal;
+
+    pxTelemetry->time_ms = (uint32_t)(time_us_64() / 1000);
+    pxTelemetry->interval_ms = (uint32_t)(xInterval / 1000);
+    pxTelemetry->heap_free = (uint32_t)xPortGetFreeHeapSize();
+    pxTelemetry->heap_min = (uint32_t)xPortGetMinimumEverFreeHeapSize();
+    pxTelemetry->task_count = 0;
+
+    for (UBaseType_t i = 0; i < uxCount; i++)
+    {
+        configRUN_TIME_COUNTER_TYPE xRan = xStatus[i].ulRunTimeCounter - prvPreviousRunTime(xStatus[i].xTaskNumber);
+        WIRE_TASK_STATS_T xTask = {
+            .cpu_permille = xInterval > 0 ? (uint32_t)((xRan * 1000 + xInterval / 2) / xInterval) : 0,
+            .stack_free = (uint32_t)(xStatus[i].usStackHighWaterMark * sizeof(StackType_t)),
+        };
+        uint32_t ulSlot = pxTelemetry->task_count;
+
+        strncpy(xTask.name, xStatus[i].pcTaskName, WIRE_MAX_TASK_NAME_LEN);
+
+        // Kept ordered by CPU share, busiest first; the least busy falls off the end
+        while (ulSlot > 0 && pxTelemetry->tasks[ulSlot - 1].cpu_permille < xTask.cpu_permille)
+        {
+            if (ulSlot < WIRE_MAX_TELEMETRY_TASKS)
+            {
+                pxTelemetry->tasks[ulSlot] = pxTelemetry->tasks[ulSlot - 1];
+            }
+            ulSlot--;
+        }
+        if (ulSlot < WIRE_MAX_TELEMETRY_TASKS)
+        {
+            pxTelemetry->tasks[ulSlot] = xTask;
+            if (pxTelemetry->task_count < WIRE_MAX_TELEMETRY_TASKS)
+            {
+                pxTelemetry->task_count++;
+            }
+        }
+
+        xCurrent[i] = (TELEMETRY_TASK_T){.number = xStatus[i].xTaskNumber, .run_time = xStatus[i].ulRunTimeCounter};
+    }
+
+    memcpy(xPrevious, xCurrent, uxCount * sizeof(xCurrent[0]));
+    uxPreviousCount = uxCount;
+    xPreviousTotal = xTotal;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file telemetry.h
+ *
+ * @brief Header file for the device health telemetry.
+ *
+ * The kernel counts the time every task has run in microseconds of the 64 bit
+ * RP2040 timer (configGENERATE_RUN_TIME_STATS). vTelemetrySample() turns the
+ * increase since the previous sample into a CPU share per task, in permille,
+ * together with each task's lowest free stack and the heap's free and lowest
+ * free bytes, and vTaskTCP sends the result as a WIRE_FRAME_TELEMETRY frame
+ * every TELEMETRY_INTERVAL_MS while it has a session.
+ *
+ * The idle task's share is the CPU left over. In the DUAL_CORE build only
+ * core 0 is accounted; core 1 runs the meter ingest outside of FreeRTOS.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+// Protocol includes
+#include "protocol/wire_format.h"
+
+// Default interval of the telemetry frames, the controller may change it
+#define TELEMETRY_INTERVAL_MS 60000
+
+// Delay before a telemetry frame that could not be written is tried again
+#define TELEMETRY_RETRY_MS 1000
+
+// Most tasks sampled; uxTaskGetSystemState() returns none if there are more
+#define TELEMETRY_MAX_TASKS 16
+
+/**
+ * @brief Sample the CPU share and stack of every task and the heap.
+ *
+ * Fills everything of the telemetry but the queue depths, which belong to the
+ * caller. With more than WIRE_MAX_TELEMETRY_TASKS tasks the busiest are kept.
+ * Called by one task only; the CPU shares cover the time since its previous
+ * call, or since boot on the first one.
+ *
+ * @param pxTelemetry Destination for the sample.
+ *
+ * @return None.
+ */
+void vTelemetrySample(WIRE_TELEMETRY_T *pxTelemetry);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,58 @@
+/**
+ * @file telemetry_heap.c
+ *
+ * @brief Heap counters for heap_3, which does not keep any.
+ *
+ * heap_3 hands every allocation to newlib's malloc, which lwIP and the CYW43
+ * driver also use directly, so the free bytes are those of the newlib heap
+ * between the end of .bss and the stack limit. newlib does not track a low
+ * water mark; the lowest free bytes are the lowest seen by any call.
+ */
+
+// FreeRTOS includes
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Standard includes
+#include <malloc.h>
+
+// Bounds of the heap, provided by the Pico SDK linker script
+extern char __bss_end__;
+extern char __StackLimit;
+
+static size_t xMinimumFree = SIZE_MAX;
+
+/**
+ * @brief Return the free bytes of the heap.
+ *
+ * @return Bytes that are neither allocated nor taken by the heap's overhead.
+ */
+size_t xPortGetFreeHeapSize(void)
+{
+    struct mallinfo xInfo;
+    size_t xFree;
+
+    // Same as heap_3 around malloc, so the arena is not changed while it is walked
+    vTaskSuspendAll();
+    xInfo = mallinfo();
+    xFree = (size_t)(&__StackLimit - &__bss_end__) - xInfo.uordblks;
+    if (xFree < xMinimumFree)
+    {
+        xMinimumFree = xFree;
+    }
+    (void)xTaskResumeAll();
+
+    return xFree;
+}
+
+/**
+ * @brief Return the lowest free bytes of the heap seen so far.
+ *
+ * @return Lowest value xPortGetFreeHeapSize() has returned, including now.
+ */
+size_t xPortGetMinimumEverFreeHeapSize(void)
+{
+    (void)xPortGetFreeHeapSize();
+
+    return xMinimumFree;
+}
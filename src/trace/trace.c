@@ -0,0 +1,149 @@
+/**
+ * @file trace.c
+ *
+ * @brief Source file for the kernel event trace recorder.
+ *
+ * A record is claimed and written with the interrupts masked, which on the
+ * single FreeRTOS core orders the records of tasks, interrupt handlers and the
+ * kernel without a lock. In the DUAL_CORE build core 1 runs outside of
+ * FreeRTOS and is not recorded; its events would race core 0's for the ring.
+ */
+
+// Standard includes
+#include <string.h>
+
+// Pico includes
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+// Project includes
+#include "trace.h"
+
+#if (TRACE_RECORDS & (TRACE_RECORDS - 1)) != 0
+#error "TRACE_RECORDS must be a power of two"
+#endif
+
+TRACE_BUFFER_T xTraceBuffer;
+
+// Number of the running task, stamped on every record
+static uint8_t ucTraceTask;
+
+/**
+ * @brief Fill in the header of the ring.
+ *
+ * Must be called before the first task is created.
+ *
+ * @return None.
+ */
+void vTraceInit(void)
+{
+    memcpy(xTraceBuffer.header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    xTraceBuffer.header.version = TRACE_VERSION;
+    xTraceBuffer.header.record_len = sizeof(TRACE_RECORD_T);
+    xTraceBuffer.header.records = TRACE_RECORDS;
+}
+
+/**
+ * @brief Append a record to the ring, overwriting the oldest once it is full.
+ *
+ * May be called from tasks, interrupt handlers and the kernel.
+ *
+ * @param ucEvent One of TRACE_EVENT_.
+ * @param ulObject Kernel object or mark the event concerns.
+ * @param ulValue Value of the event.
+ *
+ * @return None.
+ */
+void vTraceRecord(uint8_t ucEvent, uint32_t ulObject, uint32_t ulValue)
+{
+#if DUAL_CORE
+    if (get_core_num() != 0)
+    {
+        return;
+    }
+#endif
+
+    uint32_t ulSave = save_and_disable_interrupts();
+    TRACE_RECORD_T *pxRecord = &xTraceBuffer.records[xTraceBuffer.header.head % TRACE_RECORDS];
+
+    pxRecord->time_us = time_us_32();
+    pxRecord->event = ucEvent;
+    pxRecord->task = ucTraceTask;
+    pxRecord->reserved = 0;
+    pxRecord->object = ulObject;
+    pxRecord->value = ulValue;
+    xTraceBuffer.header.head++;
+
+    restore_interrupts(ulSave);
+}
+
+/**
+ * @brief Record that a task starts running, and stamp the records that follow with it.
+ *
+ * @param ucTask Number of the task.
+ *
+ * @return None.
+ */
+void vTraceSwitchedIn(uint8_t ucTask)
+{
+    // Called by the scheduler with the interrupts masked
+    ucTraceTask = ucTask;
+    vTraceRecord(TRACE_EVENT_TASK_SWITCHED_IN, 0, 0);
+}
+
+/**
+ * @brief Enter a name into a table of the header.
+ *
+ * A name already entered for the identifier is replaced. Once the table is
+ * full further names are dropped, and tracejson shows their identifiers.
+ *
+ * @param pxNames Table to enter the name into.
+ * @param xCount Entries of the table.
+ * @param ulId Identifier to name, not 0.
+ * @param pcName Name, truncated to TRACE_NAME_LEN characters.
+ *
+ * @return None.
+ */
+static void prvTraceName(TRACE_NAME_T *pxNames, size_t xCount, uint32_t ulId, const char *pcName)
+{
+    uint32_t ulSave = save_and_disable_interrupts();
+
+    for (size_t i = 0; i < xCount; i++)
+    {
+        if (pxNames[i].id == ulId || pxNames[i].id == 0)
+        {
+            pxNames[i].id = ulId;
+            strncpy(pxNames[i].name, pcName, TRACE_NAME_LEN);
+            pxNames[i].name[TRACE_NAME_LEN] = '\0';
+            break;
+        }
+    }
+
+    restore_interrupts(ulSave);
+}
+
+/**
+ * @brief Name a task in the header.
+ *
+ * @param ulNumber Number of the task.
+ * @param pcName Name, truncated to TRACE_NAME_LEN characters.
+ *
+ * @return None.
+ */
+void vTraceTaskName(uint32_t ulNumber, const char *pcName)
+{
+    prvTraceName(xTraceBuffer.header.tasks, TRACE_MAX_TASKS, ulNumber, pcName);
+}
+
+/**
+ * @brief Name a queue, semaphore or stream buffer in the header.
+ *
+ * @param pvObject Handle of the object.
+ * @param pcName Name, truncated to TRACE_NAME_LEN characters.
+ *
+ * @return None.
+ */
+void vTraceObjectName(const void *pvObject, const char *pcName)
+{
+    prvTraceName(xTraceBuffer.header.objects, TRACE_MAX_OBJECTS, TRACE_OBJECT(pvObject), pcName);
+}
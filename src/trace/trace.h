@@ -0,0 +1,152 @@
+/**
+ * @file trace.h
+ *
+ * @brief Header file for the kernel event trace recorder.
+ *
+ * Built with TRACE_ENABLED the FreeRTOS trace macros record task switches,
+ * tasks made ready, delays, queue, stream buffer and notification traffic into
+ * a RAM ring of TRACE_RECORDS fixed size records, each time stamped in
+ * microseconds. The firmware adds the entry and exit of its interrupt handlers
+ * and marks of its own, so the trace shows where the time goes between
+ * ISR_UART_RX receiving a meter line and vTaskTCP writing its record.
+ *
+ * The ring always holds the newest records. It is read out of the running
+ * device with a debugger, by dumping xTraceBuffer or the whole SRAM, or written
+ * to the file named by SIM_TRACE when the host simulation exits. tracejson
+ * turns the dump into Chrome trace JSON for Perfetto.
+ *
+ * This header is included by FreeRTOSConfig.h, so it may only depend on the C
+ * library. Without TRACE_ENABLED every macro compiles to nothing.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trace_format.h"
+
+// Set to 1 to record kernel events, the TRACE CMake option does
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+// Records the ring holds, a power of two
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 1024
+#endif
+
+// Type definitions
+typedef struct TRACE_BUFFER_T_
+{
+    TRACE_HEADER_T header;
+    TRACE_RECORD_T records[TRACE_RECORDS];
+} TRACE_BUFFER_T;
+
+#if TRACE_ENABLED
+// The ring, named so a debugger can dump it
+extern TRACE_BUFFER_T xTraceBuffer;
+
+/**
+ * @brief Fill in the header of the ring.
+ *
+ * Must be called before the first task is created.
+ *
+ * @return None.
+ */
+void vTraceInit(void);
+
+/**
+ * @brief Append a record to the ring, overwriting the oldest once it is full.
+ *
+ * May be called from tasks, interrupt handlers and the kernel.
+ *
+ * @param ucEvent One of TRACE_EVENT_.
+ * @param ulObject Kernel object or mark the event concerns.
+ * @param ulValue Value of the event.
+ *
+ * @return None.
+ */
+void vTraceRecord(uint8_t ucEvent, uint32_t ulObject, uint32_t ulValue);
+
+/**
+ * @brief Record that a task starts running, and stamp the records that follow with it.
+ *
+ * @param ucTask Number of the task.
+ *
+ * @return None.
+ */
+void vTraceSwitchedIn(uint8_t ucTask);
+
+/**
+ * @brief Name a task in the header.
+ *
+ * @param ulNumber Number of the task.
+ * @param pcName Name, truncated to TRACE_NAME_LEN characters.
+ *
+ * @return None.
+ */
+void vTraceTaskName(uint32_t ulNumber, const char *pcName);
+
+/**
+ * @brief Name a queue, semaphore or stream buffer in the header.
+ *
+ * @param pvObject Handle of the object.
+ * @param pcName Name, truncated to TRACE_NAME_LEN characters.
+ *
+ * @return None.
+ */
+void vTraceObjectName(const void *pvObject, const char *pcName);
+
+#define TRACE_OBJECT(x) ((uint32_t)(uintptr_t)(x))
+
+#define TRACE_INIT() vTraceInit()
+#define TRACE_OBJECT_NAME(xObject, pcName) vTraceObjectName((xObject), (pcName))
+#define TRACE_ISR_ENTER(ucIsr) vTraceRecord(TRACE_EVENT_ISR_ENTER, 0, (ucIsr))
+#define TRACE_ISR_EXIT(ucIsr) vTraceRecord(TRACE_EVENT_ISR_EXIT, 0, (ucIsr))
+#define TRACE_MARK(ucMark, ulValue) vTraceRecord(TRACE_EVENT_MARK, (ucMark), (ulValue))
+
+// Kernel hooks; they expand inside the kernel sources, where the TCB and queue fields are visible
+#define traceTASK_CREATE(pxNewTCB) vTraceTaskName((pxNewTCB)->uxTCBNumber, (pxNewTCB)->pcTaskName)
+#define traceTASK_SWITCHED_IN() vTraceSwitchedIn((uint8_t)pxCurrentTCB->uxTCBNumber)
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB) vTraceRecord(TRACE_EVENT_TASK_READY, 0, (pxTCB)->uxTCBNumber)
+#define traceTASK_DELAY() vTraceRecord(TRACE_EVENT_TASK_DELAY, 0, xTicksToDelay)
+#define traceTASK_DELAY_UNTIL(xTimeToWake) vTraceRecord(TRACE_EVENT_TASK_DELAY_UNTIL, 0, (xTimeToWake))
+
+#define traceQUEUE_SEND(pxQueue) \
+    vTraceRecord(TRACE_EVENT_QUEUE_SEND, TRACE_OBJECT(pxQueue), (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue) \
+    vTraceRecord(TRACE_EVENT_QUEUE_SEND_FROM_ISR, TRACE_OBJECT(pxQueue), (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE(pxQueue) \
+    vTraceRecord(TRACE_EVENT_QUEUE_RECEIVE, TRACE_OBJECT(pxQueue), (pxQueue)->uxMessagesWaiting)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue) vTraceRecord(TRACE_EVENT_QUEUE_BLOCK, TRACE_OBJECT(pxQueue), 0)
+
+#define traceSTREAM_BUFFER_SEND(xStreamBuffer, xBytesSent) \
+    vTraceRecord(TRACE_EVENT_STREAM_SEND, TRACE_OBJECT(xStreamBuffer), (xBytesSent))
+#define traceSTREAM_BUFFER_SEND_FROM_ISR(xStreamBuffer, xBytesSent) \
+    vTraceRecord(TRACE_EVENT_STREAM_SEND_FROM_ISR, TRACE_OBJECT(xStreamBuffer), (xBytesSent))
+#define traceSTREAM_BUFFER_RECEIVE(xStreamBuffer, xReceivedLength) \
+    vTraceRecord(TRACE_EVENT_STREAM_RECEIVE, TRACE_OBJECT(xStreamBuffer), (xReceivedLength))
+#define traceSTREAM_BUFFER_RECEIVE_FROM_ISR(xStreamBuffer, xReceivedLength) \
+    vTraceRecord(TRACE_EVENT_STREAM_RECEIVE_FROM_ISR, TRACE_OBJECT(xStreamBuffer), (xReceivedLength))
+#define traceBLOCKING_ON_STREAM_BUFFER_SEND(xStreamBuffer) \
+    vTraceRecord(TRACE_EVENT_STREAM_BLOCK, TRACE_OBJECT(xStreamBuffer), 1)
+#define traceBLOCKING_ON_STREAM_BUFFER_RECEIVE(xStreamBuffer) \
+    vTraceRecord(TRACE_EVENT_STREAM_BLOCK, TRACE_OBJECT(xStreamBuffer), 0)
+
+#define traceTASK_NOTIFY(uxIndexToNotify) vTraceRecord(TRACE_EVENT_NOTIFY, 0, pxTCB->uxTCBNumber)
+#define traceTASK_NOTIFY_FROM_ISR(uxIndexToNotify) vTraceRecord(TRACE_EVENT_NOTIFY_FROM_ISR, 0, pxTCB->uxTCBNumber)
+#define traceTASK_NOTIFY_GIVE_FROM_ISR(uxIndexToNotify) \
+    vTraceRecord(TRACE_EVENT_NOTIFY_FROM_ISR, 0, pxTCB->uxTCBNumber)
+#define traceTASK_NOTIFY_TAKE_BLOCK(uxIndexToWait) vTraceRecord(TRACE_EVENT_NOTIFY_BLOCK, 0, 0)
+#define traceTASK_NOTIFY_WAIT_BLOCK(uxIndexToWait) vTraceRecord(TRACE_EVENT_NOTIFY_BLOCK, 0, 0)
+#else
+#define TRACE_INIT() do { } while (0)
+#define TRACE_OBJECT_NAME(xObject, pcName) do { } while (0)
+#define TRACE_ISR_ENTER(ucIsr) do { } while (0)
+#define TRACE_ISR_EXIT(ucIsr) do { } while (0)
+#define TRACE_MARK(ucMark, ulValue) do { } while (0)
+#endif
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,98 @@
+/**
+ * @file trace_format.h
+ *
+ * @brief Header file for the layout of the kernel event trace buffer.
+ *
+ * The buffer is a header followed by a ring of fixed size records. The header
+ * starts with TRACE_MAGIC, so the buffer can be found in a dump of the whole
+ * SRAM as well as in one of the buffer alone, and names the tasks and kernel
+ * objects the records refer to by number. Every field is little-endian with
+ * its natural alignment, which is the same on the RP2040 and the host.
+ *
+ * The layout is shared by the firmware's recorder and the host converter, so
+ * it depends on the C library only.
+ */
+
+#ifndef TRACE_FORMAT_H_
+#define TRACE_FORMAT_H_
+
+#include <stdint.h>
+
+// First bytes of the buffer
+#define TRACE_MAGIC "FRTRACE"
+#define TRACE_MAGIC_LEN 8
+
+// Raised whenever the layout changes
+#define TRACE_VERSION 1
+
+// Longest task or object name kept
+#define TRACE_NAME_LEN 15
+
+// Tasks and objects that can be named
+#define TRACE_MAX_TASKS 16
+#define TRACE_MAX_OBJECTS 16
+
+// Events, in TRACE_RECORD_T.event
+#define TRACE_EVENT_TASK_SWITCHED_IN 0x01  // The task in TRACE_RECORD_T.task starts running
+#define TRACE_EVENT_TASK_READY 0x02        // Task value was made ready to run
+#define TRACE_EVENT_TASK_DELAY 0x03        // Blocks for value ticks
+#define TRACE_EVENT_TASK_DELAY_UNTIL 0x04  // Blocks until tick count value
+#define TRACE_EVENT_QUEUE_SEND 0x10        // Queue object held value items before the send
+#define TRACE_EVENT_QUEUE_SEND_FROM_ISR 0x11
+#define TRACE_EVENT_QUEUE_RECEIVE 0x12     // Queue object held value items before the receive
+#define TRACE_EVENT_QUEUE_BLOCK 0x13       // Blocks receiving from queue object
+#define TRACE_EVENT_STREAM_SEND 0x20       // value bytes written to stream buffer object
+#define TRACE_EVENT_STREAM_SEND_FROM_ISR 0x21
+#define TRACE_EVENT_STREAM_RECEIVE 0x22    // value bytes read from stream buffer object
+#define TRACE_EVENT_STREAM_RECEIVE_FROM_ISR 0x23
+#define TRACE_EVENT_STREAM_BLOCK 0x24      // Blocks on stream buffer object, value 1 sending, 0 receiving
+#define TRACE_EVENT_NOTIFY 0x30            // Task value was notified
+#define TRACE_EVENT_NOTIFY_FROM_ISR 0x31
+#define TRACE_EVENT_NOTIFY_BLOCK 0x32      // Blocks waiting for a notification
+#define TRACE_EVENT_ISR_ENTER 0x40         // Interrupt handler value starts
+#define TRACE_EVENT_ISR_EXIT 0x41          // Interrupt handler value ends
+#define TRACE_EVENT_MARK 0x50              // Mark object of the firmware, with its value
+
+// Interrupt handlers, the value of TRACE_EVENT_ISR_ENTER and TRACE_EVENT_ISR_EXIT
+#define TRACE_ISR_UART_RX 0
+
+// Marks, the object of TRACE_EVENT_MARK
+#define TRACE_MARK_RECORD 0   // A record was queued for the uplink on core 0, value its time_ms
+#define TRACE_MARK_SEGMENT 1  // vTaskTCP wrote a segment, value the time_ms of its newest record
+#define TRACE_MARK_ACKED 2    // The controller acknowledged records, value the sequence number
+
+// Type definitions
+typedef struct TRACE_NAME_T_
+{
+    // Task number, or the low 32 bits of the object's address; 0 if unused
+    uint32_t id;
+    char name[TRACE_NAME_LEN + 1];
+} TRACE_NAME_T;
+
+typedef struct TRACE_HEADER_T_
+{
+    char magic[TRACE_MAGIC_LEN];
+    uint16_t version;
+    uint16_t record_len;
+    // Records the ring holds
+    uint32_t records;
+    // Records written, free running; the newest is at (head - 1) % records
+    uint32_t head;
+    TRACE_NAME_T tasks[TRACE_MAX_TASKS];
+    TRACE_NAME_T objects[TRACE_MAX_OBJECTS];
+} TRACE_HEADER_T;
+
+typedef struct TRACE_RECORD_T_
+{
+    // Microseconds of the RP2040 timer, wraps every 71 minutes
+    uint32_t time_us;
+    uint8_t event;
+    // Number of the task running, or interrupted, when the event happened
+    uint8_t task;
+    uint16_t reserved;
+    // Low 32 bits of the kernel object's address, or the mark
+    uint32_t object;
+    uint32_t value;
+} TRACE_RECORD_T;
+
+#endif /* TRACE_FORMAT_H_ */
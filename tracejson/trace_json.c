@@ -0,0 +1,511 @@
+/**
+ * @file trace_json.c
+ *
+ * @brief Host converter from a kernel event trace dump to Chrome trace JSON.
+ *
+ * A firmware built with TRACE records kernel events into a RAM ring (see
+ * src/trace/trace.h). The converter finds the ring in a dump of it, or in a
+ * dump of the whole SRAM, and writes the records as Chrome trace JSON, which
+ * Perfetto (ui.perfetto.dev) and chrome://tracing open:
+ *
+ *  - one track per task, with a slice for every time it ran;
+ *  - one track per interrupt handler, with a slice for every time it ran;
+ *  - instant events for tasks made ready, delays, queue, stream buffer and
+ *    notification traffic, and the firmware's marks;
+ *  - an async slice per meter record, from the ISR_UART_RX run before it was
+ *    queued to the segment vTaskTCP wrote it in.
+ *
+ * A summary of the record latencies is printed to stderr.
+ *
+ * Usage: tracejson <dump> [json]
+ *
+ * The JSON is written to stdout if no file is given.
+ */
+
+// Standard includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Project includes
+#include "trace/trace_format.h"
+
+// Records between being queued and written to a segment that are followed
+#define TRACE_JSON_PENDING 256
+
+// Track of the interrupt handlers, after those of the tasks
+#define TRACE_JSON_ISR_TID 1000
+
+typedef struct TRACE_JSON_PENDING_T_
+{
+    uint32_t time_ms;
+    uint64_t start_us;
+} TRACE_JSON_PENDING_T;
+
+// Names of the interrupt handlers, by TRACE_ISR_
+static const char *const pcIsrNames[] = {"ISR_UART_RX"};
+
+// Names of the marks, by TRACE_MARK_
+static const char *const pcMarkNames[] = {"record queued", "segment written", "acked"};
+
+/**
+ * @brief Read a whole file into memory.
+ *
+ * @param pcPath Path of the file.
+ * @param pxLen Set to the length of the file.
+ *
+ * @return The contents, to be freed by the caller, or NULL on error.
+ */
+static uint8_t *prvReadFile(const char *pcPath, size_t *pxLen)
+{
+    FILE *pxFile = fopen(pcPath, "rb");
+    uint8_t *pucData = NULL;
+    long lLen;
+
+    if (pxFile == NULL)
+    {
+        return NULL;
+    }
+    if (fseek(pxFile, 0, SEEK_END) == 0 && (lLen = ftell(pxFile)) > 0 && fseek(pxFile, 0, SEEK_SET) == 0)
+    {
+        pucData = malloc((size_t)lLen);
+        if (pucData != NULL && fread(pucData, 1, (size_t)lLen, pxFile) != (size_t)lLen)
+        {
+            free(pucData);
+            pucData = NULL;
+        }
+        *pxLen = (size_t)lLen;
+    }
+    fclose(pxFile);
+
+    return pucData;
+}
+
+/**
+ * @brief Find the trace buffer in a dump.
+ *
+ * The buffer is word aligned, so only word offsets are searched for the magic.
+ * A header of another version or with a ring running past the end of the dump
+ * is skipped.
+ *
+ * @param pucDump Contents of the dump.
+ * @param xLen Length of the dump.
+ *
+ * @return The header of the buffer, or NULL if there is none.
+ */
+static const TRACE_HEADER_T *prvFindBuffer(const uint8_t *pucDump, size_t xLen)
+{
+    for (size_t xOffset = 0; xOffset + sizeof(TRACE_HEADER_T) <= xLen; xOffset += 4)
+    {
+        const TRACE_HEADER_T *pxHeader = (const TRACE_HEADER_T *)&pucDump[xOffset];
+
+        if (memcmp(pxHeader->magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0)
+        {
+            continue;
+        }
+        if (pxHeader->version != TRACE_VERSION || pxHeader->record_len != sizeof(TRACE_RECORD_T) ||
+            pxHeader->records == 0 ||
+            (uint64_t)pxHeader->records * sizeof(TRACE_RECORD_T) > xLen - xOffset - sizeof(TRACE_HEADER_T))
+        {
+            fprintf(stderr, "<tracejson> skipping unusable trace header at offset %zu\n", xOffset);
+            continue;
+        }
+
+        return pxHeader;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Write a name as a JSON string.
+ *
+ * @param pxOut Output file.
+ * @param pcName Name, NUL terminated.
+ *
+ * @return None.
+ */
+static void prvPrintString(FILE *pxOut, const char *pcName)
+{
+    fputc('"', pxOut);
+    for (; *pcName != '\0'; pcName++)
+    {
+        if (*pcName == '"' || *pcName == '\\')
+        {
+            fputc('\\', pxOut);
+        }
+        fputc((unsigned char)*pcName >= ' ' ? *pcName : '?', pxOut);
+    }
+    fputc('"', pxOut);
+}
+
+/**
+ * @brief Look up a name in a table of the header.
+ *
+ * @param pxNames Table of the header.
+ * @param xCount Entries of the table.
+ * @param ulId Task number or object address.
+ *
+ * @return The name, or NULL if the identifier was not named.
+ */
+static const char *prvLookup(const TRACE_NAME_T *pxNames, size_t xCount, uint32_t ulId)
+{
+    for (size_t i = 0; i < xCount && pxNames[i].id != 0; i++)
+    {
+        if (pxNames[i].id == ulId)
+        {
+            return pxNames[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Write the JSON string naming a task.
+ *
+ * @param pxOut Output file.
+ * @param pxHeader Header of the buffer.
+ * @param ulTask Number of the task.
+ *
+ * @return None.
+ */
+static void prvPrintTask(FILE *pxOut, const TRACE_HEADER_T *pxHeader, uint32_t ulTask)
+{
+    const char *pcName = prvLookup(pxHeader->tasks, TRACE_MAX_TASKS, ulTask);
+    char cName[24];
+
+    if (pcName == NULL)
+    {
+        snprintf(cName, sizeof(cName), ulTask == 0 ? "startup" : "task %u", (unsigned)ulTask);
+        pcName = cName;
+    }
+    prvPrintString(pxOut, pcName);
+}
+
+/**
+ * @brief Write the JSON string naming a kernel object.
+ *
+ * @param pxOut Output file.
+ * @param pxHeader Header of the buffer.
+ * @param ulObject Low 32 bits of the object's address.
+ *
+ * @return None.
+ */
+static void prvPrintObject(FILE *pxOut, const TRACE_HEADER_T *pxHeader, uint32_t ulObject)
+{
+    const char *pcName = prvLookup(pxHeader->objects, TRACE_MAX_OBJECTS, ulObject);
+
+    if (pcName != NULL)
+    {
+        prvPrintString(pxOut, pcName);
+    }
+    else
+    {
+        fprintf(pxOut, "\"0x%08x\"", (unsigned)ulObject);
+    }
+}
+
+/**
+ * @brief Write a complete event, a slice of a track.
+ *
+ * @param pxOut Output file.
+ * @param pcName Name of the slice, a JSON string.
+ * @param ulTid Track of the slice.
+ * @param ullStartUs Start of the slice.
+ * @param ullEndUs End of the slice.
+ *
+ * @return None.
+ */
+static void prvPrintSlice(FILE *pxOut, const char *pcName, uint32_t ulTid, uint64_t ullStartUs, uint64_t ullEndUs)
+{
+    fprintf(pxOut, ",\n{\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%llu,\"dur\":%llu,\"name\":%s}", (unsigned)ulTid,
+            (unsigned long long)ullStartUs, (unsigned long long)(ullEndUs - ullStartUs), pcName);
+}
+
+/**
+ * @brief Write an instant event on the track of the running task, leaving its arguments open.
+ *
+ * @param pxOut Output file.
+ * @param pxRecord Record of the event.
+ * @param ullTimeUs Time of the record, extended past the 32 bit wrap.
+ * @param pcName Name of the event.
+ *
+ * @return None.
+ */
+static void prvPrintInstant(FILE *pxOut, const TRACE_RECORD_T *pxRecord, uint64_t ullTimeUs, const char *pcName)
+{
+    fprintf(pxOut, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"ts\":%llu,\"name\":\"%s\",\"args\":{",
+            (unsigned)pxRecord->task, (unsigned long long)ullTimeUs, pcName);
+}
+
+/**
+ * @brief Write a queue or stream buffer event.
+ *
+ * @param pxOut Output file.
+ * @param pxHeader Header of the buffer.
+ * @param pxRecord Record of the event.
+ * @param ullTimeUs Time of the record.
+ * @param pcName Name of the event.
+ * @param pcValue Name of the record's value.
+ *
+ * @return None.
+ */
+static void prvPrintObjectEvent(FILE *pxOut, const TRACE_HEADER_T *pxHeader, const TRACE_RECORD_T *pxRecord,
+                                uint64_t ullTimeUs, const char *pcName, const char *pcValue)
+{
+    prvPrintInstant(pxOut, pxRecord, ullTimeUs, pcName);
+    fprintf(pxOut, "\"object\":");
+    prvPrintObject(pxOut, pxHeader, pxRecord->object);
+    fprintf(pxOut, ",\"%s\":%u}}", pcValue, (unsigned)pxRecord->value);
+}
+
+/**
+ * @brief Write an event concerning another task.
+ *
+ * @param pxOut Output file.
+ * @param pxHeader Header of the buffer.
+ * @param pxRecord Record of the event, its value the number of the other task.
+ * @param ullTimeUs Time of the record.
+ * @param pcName Name of the event.
+ *
+ * @return None.
+ */
+static void prvPrintTaskEvent(FILE *pxOut, const TRACE_HEADER_T *pxHeader, const TRACE_RECORD_T *pxRecord,
+                              uint64_t ullTimeUs, const char *pcName)
+{
+    prvPrintInstant(pxOut, pxRecord, ullTimeUs, pcName);
+    fprintf(pxOut, "\"task\":");
+    prvPrintTask(pxOut, pxHeader, pxRecord->value);
+    fprintf(pxOut, "}}");
+}
+
+int main(int argc, char **argv)
+{
+    static TRACE_JSON_PENDING_T xPending[TRACE_JSON_PENDING];
+    uint64_t ullIsrStartUs[sizeof(pcIsrNames) / sizeof(pcIsrNames[0])] = {0};
+    const TRACE_HEADER_T *pxHeader;
+    const TRACE_RECORD_T *pxRecords;
+    FILE *pxOut = stdout;
+    uint8_t *pucDump;
+    size_t xDumpLen = 0;
+    uint64_t ullTimeUs = 0;
+    uint64_t ullSliceUs = 0;
+    uint64_t ullLastIsrUs = 0;
+    uint64_t ullLatencySumUs = 0;
+    uint64_t ullLatencyMaxUs = 0;
+    uint32_t ulLatencies = 0;
+    uint32_t ulFirst;
+    uint32_t ulCount;
+    uint32_t ulPendingCount = 0;
+    uint32_t ulSpans = 0;
+    uint32_t ulTask = 0;
+    char cName[40];
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s <dump> [json]\n", argv[0]);
+        return 1;
+    }
+
+    pucDump = prvReadFile(argv[1], &xDumpLen);
+    if (pucDump == NULL)
+    {
+        fprintf(stderr, "<tracejson> cannot read %s\n", argv[1]);
+        return 1;
+    }
+    pxHeader = prvFindBuffer(pucDump, xDumpLen);
+    if (pxHeader == NULL)
+    {
+        fprintf(stderr, "<tracejson> %s holds no trace, was the firmware built with TRACE?\n", argv[1]);
+        free(pucDump);
+        return 1;
+    }
+    if (argc == 3 && (pxOut = fopen(argv[2], "w")) == NULL)
+    {
+        fprintf(stderr, "<tracejson> cannot open %s\n", argv[2]);
+        free(pucDump);
+        return 1;
+    }
+
+    // Once the ring has wrapped it holds the newest records, starting at head
+    pxRecords = (const TRACE_RECORD_T *)(pxHeader + 1);
+    ulCount = pxHeader->head < pxHeader->records ? pxHeader->head : pxHeader->records;
+    ulFirst = pxHeader->head - ulCount;
+    fprintf(stderr, "<tracejson> %u of %u events\n", (unsigned)ulCount, (unsigned)pxHeader->head);
+
+    // The metadata opens the array, every following event is written with its leading comma
+    fprintf(pxOut, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(pxOut, "{\"ph\":\"M\",\"pid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"FreeRTOS\"}}");
+    for (uint32_t i = 0; i < TRACE_MAX_TASKS && pxHeader->tasks[i].id != 0; i++)
+    {
+        fprintf(pxOut, ",\n{\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":",
+                (unsigned)pxHeader->tasks[i].id);
+        prvPrintTask(pxOut, pxHeader, pxHeader->tasks[i].id);
+        fprintf(pxOut, "}}");
+    }
+    for (uint32_t i = 0; i < sizeof(pcIsrNames) / sizeof(pcIsrNames[0]); i++)
+    {
+        fprintf(pxOut, ",\n{\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                (unsigned)(TRACE_JSON_ISR_TID + i), pcIsrNames[i]);
+    }
+
+    for (uint32_t i = 0; i < ulCount; i++)
+    {
+        const TRACE_RECORD_T *pxRecord = &pxRecords[(ulFirst + i) % pxHeader->records];
+
+        // The time stamps wrap every 71 minutes, they are extended from the first record on
+        if (i == 0)
+        {
+            ullTimeUs = pxRecord->time_us;
+            ullSliceUs = ullTimeUs;
+            ulTask = pxRecord->task;
+        }
+        if (pxRecord->time_us < (uint32_t)ullTimeUs)
+        {
+            ullTimeUs += 1ull << 32;
+        }
+        ullTimeUs = (ullTimeUs & ~0xFFFFFFFFull) | pxRecord->time_us;
+
+        switch (pxRecord->event)
+        {
+        case TRACE_EVENT_TASK_SWITCHED_IN:
+            prvPrintSlice(pxOut, "\"running\"", ulTask, ullSliceUs, ullTimeUs);
+            ulTask = pxRecord->task;
+            ullSliceUs = ullTimeUs;
+            break;
+        case TRACE_EVENT_TASK_READY:
+            prvPrintTaskEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "ready");
+            break;
+        case TRACE_EVENT_TASK_DELAY:
+        case TRACE_EVENT_TASK_DELAY_UNTIL:
+            prvPrintInstant(pxOut, pxRecord, ullTimeUs,
+                            pxRecord->event == TRACE_EVENT_TASK_DELAY ? "delay" : "delay until");
+            fprintf(pxOut, "\"ticks\":%u}}", (unsigned)pxRecord->value);
+            break;
+        case TRACE_EVENT_QUEUE_SEND:
+        case TRACE_EVENT_QUEUE_SEND_FROM_ISR:
+            prvPrintObjectEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "queue send", "waiting");
+            break;
+        case TRACE_EVENT_QUEUE_RECEIVE:
+            prvPrintObjectEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "queue receive", "waiting");
+            break;
+        case TRACE_EVENT_QUEUE_BLOCK:
+            prvPrintObjectEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "queue block", "sending");
+            break;
+        case TRACE_EVENT_STREAM_SEND:
+        case TRACE_EVENT_STREAM_SEND_FROM_ISR:
+            prvPrintObjectEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "stream send", "bytes");
+            break;
+        case TRACE_EVENT_STREAM_RECEIVE:
+        case TRACE_EVENT_STREAM_RECEIVE_FROM_ISR:
+            prvPrintObjectEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "stream receive", "bytes");
+            break;
+        case TRACE_EVENT_STREAM_BLOCK:
+            prvPrintObjectEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "stream block", "sending");
+            break;
+        case TRACE_EVENT_NOTIFY:
+        case TRACE_EVENT_NOTIFY_FROM_ISR:
+            prvPrintTaskEvent(pxOut, pxHeader, pxRecord, ullTimeUs, "notify");
+            break;
+        case TRACE_EVENT_NOTIFY_BLOCK:
+            prvPrintInstant(pxOut, pxRecord, ullTimeUs, "notify wait");
+            fprintf(pxOut, "}}");
+            break;
+        case TRACE_EVENT_ISR_ENTER:
+            if (pxRecord->value < sizeof(pcIsrNames) / sizeof(pcIsrNames[0]))
+            {
+                ullIsrStartUs[pxRecord->value] = ullTimeUs;
+                if (pxRecord->value == TRACE_ISR_UART_RX)
+                {
+                    ullLastIsrUs = ullTimeUs;
+                }
+            }
+            break;
+        case TRACE_EVENT_ISR_EXIT:
+            // An exit without its entry, cut off by the start of the ring, is dropped
+            if (pxRecord->value < sizeof(pcIsrNames) / sizeof(pcIsrNames[0]) && ullIsrStartUs[pxRecord->value] != 0)
+            {
+                snprintf(cName, sizeof(cName), "\"%s\"", pcIsrNames[pxRecord->value]);
+                prvPrintSlice(pxOut, cName, TRACE_JSON_ISR_TID + pxRecord->value, ullIsrStartUs[pxRecord->value],
+                              ullTimeUs);
+                ullIsrStartUs[pxRecord->value] = 0;
+            }
+            break;
+        case TRACE_EVENT_MARK:
+            prvPrintInstant(pxOut, pxRecord, ullTimeUs,
+                            pxRecord->object < sizeof(pcMarkNames) / sizeof(pcMarkNames[0]) ? pcMarkNames[pxRecord->object]
+                                                                                             : "mark");
+            fprintf(pxOut, "\"value\":%u}}", (unsigned)pxRecord->value);
+
+            // A record starts at the last UART interrupt before it was queued, or at the queueing if there was none
+            if (pxRecord->object == TRACE_MARK_RECORD && ulPendingCount < TRACE_JSON_PENDING)
+            {
+                xPending[ulPendingCount].time_ms = pxRecord->value;
+                xPending[ulPendingCount].start_us = ullLastIsrUs != 0 ? ullLastIsrUs : ullTimeUs;
+                ulPendingCount++;
+            }
+
+            // The segment carries every pending record up to its newest
+            if (pxRecord->object == TRACE_MARK_SEGMENT)
+            {
+                uint32_t ulKept = 0;
+
+                for (uint32_t j = 0; j < ulPendingCount; j++)
+                {
+                    if ((int32_t)(xPending[j].time_ms - pxRecord->value) > 0)
+                    {
+                        xPending[ulKept++] = xPending[j];
+                        continue;
+                    }
+
+                    uint64_t ullLatencyUs = ullTimeUs - xPending[j].start_us;
+
+                    fprintf(pxOut,
+                            ",\n{\"ph\":\"b\",\"cat\":\"record\",\"id\":%u,\"pid\":0,\"ts\":%llu,\"name\":\"record\","
+                            "\"args\":{\"time_ms\":%u}}",
+                            (unsigned)ulSpans, (unsigned long long)xPending[j].start_us, (unsigned)xPending[j].time_ms);
+                    fprintf(pxOut,
+                            ",\n{\"ph\":\"e\",\"cat\":\"record\",\"id\":%u,\"pid\":0,\"ts\":%llu,\"name\":\"record\"}",
+                            (unsigned)ulSpans, (unsigned long long)ullTimeUs);
+                    ulSpans++;
+
+                    ullLatencySumUs += ullLatencyUs;
+                    ulLatencies++;
+                    if (ullLatencyUs > ullLatencyMaxUs)
+                    {
+                        ullLatencyMaxUs = ullLatencyUs;
+                    }
+                }
+                ulPendingCount = ulKept;
+            }
+            break;
+        default:
+            fprintf(stderr, "<tracejson> unknown event 0x%02x\n", pxRecord->event);
+            break;
+        }
+    }
+
+    // The running task's slice lasts to the end of the ring
+    if (ulCount > 0)
+    {
+        prvPrintSlice(pxOut, "\"running\"", ulTask, ullSliceUs, ullTimeUs);
+    }
+    fprintf(pxOut, "\n]}\n");
+
+    if (ulLatencies > 0)
+    {
+        fprintf(stderr, "<tracejson> %u records from ISR_UART_RX to segment: mean %llu us, max %llu us\n",
+                (unsigned)ulLatencies, (unsigned long long)(ullLatencySumUs / ulLatencies),
+                (unsigned long long)ullLatencyMaxUs);
+    }
+
+    if (pxOut != stdout)
+    {
+        fclose(pxOut);
+    }
+    free(pucDump);
+
+    return 0;
+}